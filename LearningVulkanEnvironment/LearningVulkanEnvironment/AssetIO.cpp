@@ -0,0 +1,323 @@
+#include "AssetIO.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+namespace
+{
+  const char PACK_MAGIC[4] = { 'L', 'V', 'A', 'P' };
+  const uint32_t PACK_VERSION = 1;
+  // Cache line, more than any vertex format or SPIR-V needs
+  const uint64_t PACK_ALIGNMENT = 64;
+
+  struct PackHeader
+  {
+    char magic[4];
+    uint32_t version;
+    uint32_t entryCount;
+    uint32_t stringTableSize;
+    uint64_t tocOffset;
+  };
+
+  struct PackEntry
+  {
+    uint64_t offset;
+    uint64_t size;
+    uint32_t nameOffset;
+    uint32_t nameLength;
+  };
+
+  // A read only view of a whole file, unmapped when destroyed
+  class MappedFile
+  {
+  public:
+    MappedFile(const void* address, size_t size) : address(address), size(size) {}
+    ~MappedFile()
+    {
+#ifdef _WIN32
+      UnmapViewOfFile(address);
+#else
+      munmap(const_cast<void*>(address), size);
+#endif
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* data() const { return static_cast<const char*>(address); }
+
+  private:
+    const void* address;
+    size_t size;
+  };
+
+  // Null if the file can't be opened or is empty, empty files can't be mapped
+  std::shared_ptr<MappedFile> mapFile(const std::string& path, size_t& size)
+  {
+    size = 0;
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+      FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+      return nullptr;
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+    {
+      CloseHandle(file);
+      return nullptr;
+    }
+
+    // The view keeps the file open, both handles can go right away
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(file);
+    if (!mapping)
+      return nullptr;
+    const void* address = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    if (!address)
+      return nullptr;
+
+    size = static_cast<size_t>(fileSize.QuadPart);
+#else
+    int file = ::open(path.c_str(), O_RDONLY);
+    if (file < 0)
+      return nullptr;
+
+    struct stat info;
+    if (fstat(file, &info) != 0 || info.st_size == 0)
+    {
+      close(file);
+      return nullptr;
+    }
+
+    // The mapping keeps the file open, the descriptor can go right away
+    void* address = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+    close(file);
+    if (address == MAP_FAILED)
+      return nullptr;
+
+    size = static_cast<size_t>(info.st_size);
+#endif
+    return std::make_shared<MappedFile>(address, size);
+  }
+
+  uint64_t alignUp(uint64_t value, uint64_t alignment)
+  {
+    return (value + alignment - 1) / alignment * alignment;
+  }
+
+  // Pack names and lookups always use forward slashes
+  std::string normalizeName(const std::string& path)
+  {
+    std::string name(path);
+    std::replace(name.begin(), name.end(), '\\', '/');
+    while (name.compare(0, 2, "./") == 0)
+      name.erase(0, 2);
+    return name;
+  }
+}
+
+Asset Asset::map(const std::string& path)
+{
+  Asset asset;
+  std::shared_ptr<MappedFile> file = mapFile(path, asset.length);
+  if (!file)
+    return Asset();
+
+  asset.bytes = file->data();
+  asset.owner = file;
+  return asset;
+}
+
+Asset Asset::fromWords(std::vector<uint32_t> words)
+{
+  auto storage = std::make_shared<std::vector<uint32_t>>(std::move(words));
+  Asset asset;
+  asset.bytes = reinterpret_cast<const char*>(storage->data());
+  asset.length = storage->size() * sizeof(uint32_t);
+  asset.owner = storage;
+  return asset;
+}
+
+Asset Asset::fromBytes(std::vector<uint8_t> bytes)
+{
+  auto storage = std::make_shared<std::vector<uint8_t>>(std::move(bytes));
+  Asset asset;
+  asset.bytes = reinterpret_cast<const char*>(storage->data());
+  asset.length = storage->size();
+  asset.owner = storage;
+  return asset;
+}
+
+Asset Asset::slice(size_t offset, size_t size) const
+{
+  if (offset > length || size > length - offset)
+    throw std::runtime_error("asset slice out of range!");
+
+  Asset asset(*this);
+  asset.bytes = bytes + offset;
+  asset.length = size;
+  return asset;
+}
+
+const uint32_t* Asset::words() const
+{
+  if (length % sizeof(uint32_t) != 0 || reinterpret_cast<uintptr_t>(bytes) % alignof(uint32_t) != 0)
+    throw std::runtime_error("asset isn't made of aligned 32-bit words!");
+  return reinterpret_cast<const uint32_t*>(bytes);
+}
+
+void AssetPack::open(const std::string& path)
+{
+  file = Asset::map(path);
+  entries.clear();
+
+  PackHeader header;
+  if (file.size() < sizeof(header))
+    throw std::runtime_error("failed to open asset pack " + path + "!");
+  std::memcpy(&header, file.data(), sizeof(header));
+
+  // Every range is checked against the file before anything is read from it
+  uint64_t tocSize = static_cast<uint64_t>(header.entryCount) * sizeof(PackEntry);
+  if (std::memcmp(header.magic, PACK_MAGIC, sizeof(PACK_MAGIC)) != 0 || header.version != PACK_VERSION ||
+    header.tocOffset < sizeof(header) || header.tocOffset > file.size() ||
+    tocSize + header.stringTableSize > file.size() - header.tocOffset)
+    throw std::runtime_error(path + " isn't a valid asset pack!");
+
+  const char* strings = file.data() + header.tocOffset + tocSize;
+  for (uint32_t i = 0; i < header.entryCount; ++i)
+  {
+    // Copied out, a damaged pack could put the table at any offset
+    PackEntry entry;
+    std::memcpy(&entry, file.data() + header.tocOffset + i * sizeof(PackEntry), sizeof(entry));
+
+    if (entry.offset > header.tocOffset || entry.size > header.tocOffset - entry.offset ||
+      entry.nameOffset > header.stringTableSize || entry.nameLength > header.stringTableSize - entry.nameOffset)
+      throw std::runtime_error(path + " has a corrupt table of contents!");
+
+    std::string name(strings + entry.nameOffset, entry.nameLength);
+    entries[name] = file.slice(static_cast<size_t>(entry.offset), static_cast<size_t>(entry.size));
+  }
+}
+
+Asset AssetPack::find(const std::string& name) const
+{
+  auto entry = entries.find(normalizeName(name));
+  return entry == entries.end() ? Asset() : entry->second;
+}
+
+void AssetPack::write(const std::string& path, const std::vector<std::pair<std::string, Asset>>& packEntries)
+{
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  if (!out.is_open())
+    throw std::runtime_error("failed to create asset pack " + path + "!");
+
+  std::vector<PackEntry> toc;
+  std::string strings;
+  uint64_t position = sizeof(PackHeader);
+  const char padding[PACK_ALIGNMENT] = {};
+
+  // Header goes in last, once the table of contents has a place
+  out.write(padding, sizeof(PackHeader));
+  for (const auto& packEntry : packEntries)
+  {
+    uint64_t start = alignUp(position, PACK_ALIGNMENT);
+    out.write(padding, static_cast<std::streamsize>(start - position));
+    out.write(packEntry.second.data(), static_cast<std::streamsize>(packEntry.second.size()));
+    position = start + packEntry.second.size();
+
+    std::string name = normalizeName(packEntry.first);
+    PackEntry entry = {};
+    entry.offset = start;
+    entry.size = packEntry.second.size();
+    entry.nameOffset = static_cast<uint32_t>(strings.size());
+    entry.nameLength = static_cast<uint32_t>(name.size());
+    toc.push_back(entry);
+    strings += name;
+  }
+
+  PackHeader header = {};
+  std::memcpy(header.magic, PACK_MAGIC, sizeof(PACK_MAGIC));
+  header.version = PACK_VERSION;
+  header.entryCount = static_cast<uint32_t>(toc.size());
+  header.stringTableSize = static_cast<uint32_t>(strings.size());
+  header.tocOffset = alignUp(position, 8);
+
+  out.write(padding, static_cast<std::streamsize>(header.tocOffset - position));
+  out.write(reinterpret_cast<const char*>(toc.data()), static_cast<std::streamsize>(toc.size() * sizeof(PackEntry)));
+  out.write(strings.data(), static_cast<std::streamsize>(strings.size()));
+  out.seekp(0);
+  out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+  if (!out)
+    throw std::runtime_error("failed to write asset pack " + path + "!");
+}
+
+void AssetLoader::mount(const std::string& packPath)
+{
+  AssetPack pack;
+  pack.open(packPath);
+
+  std::lock_guard<std::mutex> lock(mutex);
+  packs.push_back(std::move(pack));
+}
+
+Asset AssetLoader::open(const std::string& path)
+{
+  Asset asset = tryOpen(path);
+  if (asset.empty())
+    throw std::runtime_error("failed to open asset " + path + "!");
+  return asset;
+}
+
+Asset AssetLoader::tryOpen(const std::string& path)
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto pack = packs.rbegin(); pack != packs.rend(); ++pack)
+    {
+      Asset asset = pack->find(path);
+      if (!asset.empty())
+      {
+        ++packHits;
+        bytesMapped += asset.size();
+        return asset;
+      }
+    }
+  }
+
+  // Mapping happens outside the lock, it is a system call
+  Asset asset = Asset::map(path);
+  if (!asset.empty())
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    ++looseFiles;
+    bytesMapped += asset.size();
+  }
+  return asset;
+}
+
+void AssetLoader::writeReport(std::ostream& out) const
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  out << "asset_io,value\n"
+    << "packs_mounted," << packs.size() << '\n'
+    << "pack_entries_opened," << packHits << '\n'
+    << "loose_files_mapped," << looseFiles << '\n'
+    << "bytes_mapped," << bytesMapped << std::endl;
+}
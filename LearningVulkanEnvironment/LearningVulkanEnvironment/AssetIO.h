@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/*
+  Read only bytes of a file or of an entry in an asset pack. Files are
+  memory mapped instead of read, so the data is never copied: pages are
+  faulted in from the OS file cache as they are touched, and being clean
+  and file backed they don't count against the process the way a heap
+  copy does.
+
+  Copies share the mapping, it is unmapped once the last copy goes away.
+  Mappings start on a page boundary and pack entries are 64 byte aligned,
+  so the data can be used as uint32_t SPIR-V words or vertex arrays as is.
+*/
+class Asset
+{
+public:
+  Asset() = default;
+
+  // Maps the whole file, an empty asset if it can't be opened
+  static Asset map(const std::string& path);
+  // Takes ownership of data that was produced in memory
+  static Asset fromWords(std::vector<uint32_t> words);
+  static Asset fromBytes(std::vector<uint8_t> bytes);
+
+  // A range of this asset sharing its mapping
+  Asset slice(size_t offset, size_t size) const;
+
+  const char* data() const { return bytes; }
+  size_t size() const { return length; }
+  bool empty() const { return length == 0; }
+
+  // The data as 32-bit words, throws if it isn't a whole number of
+  // aligned words
+  const uint32_t* words() const;
+
+private:
+  std::shared_ptr<const void> owner;
+  const char* bytes = nullptr;
+  size_t length = 0;
+};
+
+/*
+  Many assets packed into one file, so loading them costs one open and one
+  mapping instead of one per file. Layout, every field little endian:
+
+    header   | "LVAP" | version | entry count | string table size | toc offset |
+    data     | entry data, each entry starts 64 byte aligned                     |
+    toc      | per entry: offset | size | name offset | name length             |
+    strings  | every entry name back to back, no terminators                     |
+
+  The table of contents is at the end so packs can be written in one pass.
+*/
+class AssetPack
+{
+public:
+  // Throws if the file is missing or isn't a valid pack
+  void open(const std::string& path);
+
+  // Empty if the pack has no entry of that name
+  Asset find(const std::string& name) const;
+  size_t entryCount() const { return entries.size(); }
+
+  // Names use forward slashes, e.g. shaders/vert.spv
+  static void write(const std::string& path, const std::vector<std::pair<std::string, Asset>>& entries);
+
+private:
+  Asset file;
+  std::unordered_map<std::string, Asset> entries;
+};
+
+/*
+  Where every asset is opened through. Mounted packs are searched first,
+  the most recently mounted one wins, then the path is mapped as a loose
+  file. Safe to call from several threads, pipelines are built on workers.
+*/
+class AssetLoader
+{
+public:
+  void mount(const std::string& packPath);
+
+  // Throws if the asset can't be found
+  Asset open(const std::string& path);
+  // Empty if the asset can't be found
+  Asset tryOpen(const std::string& path);
+
+  // Files and packs opened and the bytes handed out, for startup I/O
+  void writeReport(std::ostream& out) const;
+
+private:
+  std::vector<AssetPack> packs;
+  mutable std::mutex mutex;
+  uint32_t packHits = 0;
+  uint32_t looseFiles = 0;
+  uint64_t bytesMapped = 0;
+};
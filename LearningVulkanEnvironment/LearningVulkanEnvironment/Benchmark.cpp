@@ -0,0 +1,123 @@
+#include "Benchmark.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+namespace
+{
+  struct Phase
+  {
+    const char* name;
+    double FrameTiming::*member;
+  };
+
+  const Phase phases[] =
+  {
+    { "frame", &FrameTiming::total },
+    { "wait", &FrameTiming::wait },
+    { "acquire", &FrameTiming::acquire },
+    { "update", &FrameTiming::update },
+    { "record", &FrameTiming::record },
+    { "submit", &FrameTiming::submit },
+    { "present", &FrameTiming::present }
+  };
+
+  // Nearest rank percentile, samples must already be sorted
+  double percentile(const std::vector<double>& sorted, double p)
+  {
+    size_t rank = static_cast<size_t>(std::ceil(p / 100.0 * sorted.size()));
+    return sorted[std::max<size_t>(rank, 1) - 1];
+  }
+}
+
+TimingSummary summarizeTimings(std::vector<double> samples)
+{
+  TimingSummary summary;
+  if (samples.empty())
+    return summary;
+
+  std::sort(samples.begin(), samples.end());
+
+  summary.min = samples.front();
+  summary.mean = std::accumulate(samples.begin(), samples.end(), 0.0) / samples.size();
+  summary.p50 = percentile(samples, 50.0);
+  summary.p95 = percentile(samples, 95.0);
+  summary.p99 = percentile(samples, 99.0);
+  return summary;
+}
+
+FrameBenchmark::FrameBenchmark(size_t expectedFrames)
+{
+  frames.reserve(expectedFrames);
+}
+
+void FrameBenchmark::record(const FrameTiming& timing)
+{
+  frames.push_back(timing);
+}
+
+void FrameBenchmark::recordEvent(const std::string& name, double milliseconds)
+{
+  events.emplace_back(name, milliseconds);
+}
+
+std::vector<double> FrameBenchmark::collect(double FrameTiming::*phase) const
+{
+  std::vector<double> samples;
+  samples.reserve(frames.size());
+  for (const auto& frame : frames)
+    samples.push_back(frame.*phase);
+  return samples;
+}
+
+void FrameBenchmark::writeCsv(std::ostream& out, double elapsedSeconds) const
+{
+  // fps only makes sense for whole frames, phases leave the column empty
+  out << "phase,frames,min_ms,mean_ms,p50_ms,p95_ms,p99_ms,fps\n";
+  for (const auto& phase : phases)
+  {
+    TimingSummary summary = summarizeTimings(collect(phase.member));
+    out << phase.name << ',' << frames.size() << ','
+      << summary.min << ',' << summary.mean << ',' << summary.p50 << ','
+      << summary.p95 << ',' << summary.p99 << ',';
+    if (phase.member == &FrameTiming::total && elapsedSeconds > 0.0)
+      out << frames.size() / elapsedSeconds;
+    out << '\n';
+  }
+
+  // A single sample, so every statistic is the same value
+  for (const auto& event : events)
+  {
+    out << event.first << ",1";
+    for (int i = 0; i < 5; ++i)
+      out << ',' << event.second;
+    out << ",\n";
+  }
+}
+
+void FrameBenchmark::writeJson(std::ostream& out, double elapsedSeconds) const
+{
+  out << "{\n";
+  out << "  \"frames\": " << frames.size() << ",\n";
+  out << "  \"elapsed_s\": " << elapsedSeconds << ",\n";
+  out << "  \"fps\": " << (elapsedSeconds > 0.0 ? frames.size() / elapsedSeconds : 0.0) << ",\n";
+  out << "  \"phases_ms\": {\n";
+  for (size_t i = 0; i < sizeof(phases) / sizeof(phases[0]); ++i)
+  {
+    TimingSummary summary = summarizeTimings(collect(phases[i].member));
+    out << "    \"" << phases[i].name << "\": { "
+      << "\"min\": " << summary.min << ", "
+      << "\"mean\": " << summary.mean << ", "
+      << "\"p50\": " << summary.p50 << ", "
+      << "\"p95\": " << summary.p95 << ", "
+      << "\"p99\": " << summary.p99 << " }"
+      << (i + 1 < sizeof(phases) / sizeof(phases[0]) ? ",\n" : "\n");
+  }
+  out << "  },\n";
+  out << "  \"events_ms\": {";
+  for (size_t i = 0; i < events.size(); ++i)
+    out << (i == 0 ? "\n" : ",\n") << "    \"" << events[i].first << "\": " << events[i].second;
+  out << (events.empty() ? "}\n" : "\n  }\n");
+  out << "}\n";
+}
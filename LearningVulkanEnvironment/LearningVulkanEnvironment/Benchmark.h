@@ -0,0 +1,67 @@
+#pragma once
+
+#include <chrono>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+/*
+  CPU time spent in each part of a single frame, in milliseconds. The phases
+  follow drawFrame: wait on the frame's fence, acquire a swap chain image,
+  update the frame's per instance data, record its command buffer (zero
+  with --static-commands), submit it and present it. total is measured from the start
+  of a frame, before event polling, to the end of its drawFrame.
+*/
+struct FrameTiming
+{
+  double wait = 0.0;
+  double acquire = 0.0;
+  double update = 0.0;
+  double record = 0.0;
+  double submit = 0.0;
+  double present = 0.0;
+  double total = 0.0;
+};
+
+// Milliseconds since a point in time, for the frame phase and load timings
+inline double millisecondsSince(std::chrono::steady_clock::time_point start)
+{
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Distribution of one phase over every recorded frame
+struct TimingSummary
+{
+  double min = 0.0;
+  double mean = 0.0;
+  double p50 = 0.0;
+  double p95 = 0.0;
+  double p99 = 0.0;
+};
+
+// Takes the samples by value since they have to be sorted for percentiles
+TimingSummary summarizeTimings(std::vector<double> samples);
+
+class FrameBenchmark
+{
+public:
+  // Reserving up front keeps the recording itself out of the measurements
+  explicit FrameBenchmark(size_t expectedFrames = 0);
+
+  void record(const FrameTiming& timing);
+  size_t frameCount() const { return frames.size(); }
+
+  // One-off timings such as startup, reported next to the frame phases
+  void recordEvent(const std::string& name, double milliseconds);
+
+  // elapsedSeconds is the wall time of the whole run, used for the average FPS
+  void writeCsv(std::ostream& out, double elapsedSeconds) const;
+  void writeJson(std::ostream& out, double elapsedSeconds) const;
+
+private:
+  std::vector<double> collect(double FrameTiming::*phase) const;
+
+  std::vector<FrameTiming> frames;
+  std::vector<std::pair<std::string, double>> events;
+};
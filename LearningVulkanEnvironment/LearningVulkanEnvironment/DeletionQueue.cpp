@@ -0,0 +1,74 @@
+#include "DeletionQueue.h"
+
+void DeletionQueue::create(VkDevice logicalDevice, GpuAllocator& gpuAllocator, DeviceQueues& deviceQueues)
+{
+  device = logicalDevice;
+  allocator = &gpuAllocator;
+  queues = &deviceQueues;
+}
+
+void DeletionQueue::destroy()
+{
+  for (auto& entry : entries)
+    destroyEntry(entry);
+  entries.clear();
+}
+
+void DeletionQueue::destroyBuffer(VkBuffer buffer, GpuAllocation& allocation)
+{
+  Entry entry;
+  entry.buffer = buffer;
+  entry.allocation = allocation;
+  allocation = GpuAllocation();
+  push(entry);
+}
+
+void DeletionQueue::destroyImage(VkImage image, GpuAllocation& allocation)
+{
+  Entry entry;
+  entry.image = image;
+  entry.allocation = allocation;
+  allocation = GpuAllocation();
+  push(entry);
+}
+
+void DeletionQueue::destroyImageView(VkImageView view)
+{
+  Entry entry;
+  entry.view = view;
+  push(entry);
+}
+
+void DeletionQueue::destroyPipeline(VkPipeline pipeline)
+{
+  Entry entry;
+  entry.pipeline = pipeline;
+  push(entry);
+}
+
+void DeletionQueue::push(Entry& entry)
+{
+  entry.retirePoint = queues->submitted();
+  entries.push_back(entry);
+}
+
+void DeletionQueue::collect()
+{
+  while (!entries.empty() && queues->hasFinished(entries.front().retirePoint))
+  {
+    destroyEntry(entries.front());
+    entries.pop_front();
+  }
+}
+
+void DeletionQueue::destroyEntry(Entry& entry)
+{
+  if (entry.buffer != VK_NULL_HANDLE)
+    allocator->destroyBuffer(entry.buffer, entry.allocation);
+  if (entry.image != VK_NULL_HANDLE)
+    allocator->destroyImage(entry.image, entry.allocation);
+  if (entry.view != VK_NULL_HANDLE)
+    vkDestroyImageView(device, entry.view, nullptr);
+  if (entry.pipeline != VK_NULL_HANDLE)
+    vkDestroyPipeline(device, entry.pipeline, nullptr);
+}
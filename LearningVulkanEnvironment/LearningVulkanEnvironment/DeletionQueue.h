@@ -0,0 +1,57 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <deque>
+
+#include "DeviceQueues.h"
+#include "GpuAllocator.h"
+
+/*
+  Destroys resources once the GPU is done with them instead of waiting for
+  the device to go idle. Everything queued is stamped with what was
+  submitted so far on every queue (its retire point), collect() destroys
+  whatever the queues have passed since.
+
+  Whatever might still use the resource must have been submitted before it
+  is queued here: command buffers recorded later have to use its
+  replacement.
+*/
+class DeletionQueue
+{
+public:
+  void create(VkDevice device, GpuAllocator& allocator, DeviceQueues& queues);
+  // Destroys everything still queued, the device must be idle
+  void destroy();
+
+  void destroyBuffer(VkBuffer buffer, GpuAllocation& allocation);
+  void destroyImage(VkImage image, GpuAllocation& allocation);
+  void destroyImageView(VkImageView view);
+  void destroyPipeline(VkPipeline pipeline);
+
+  // Destroys what the GPU has finished with, never blocks. Once a frame.
+  void collect();
+
+  size_t pendingCount() const { return entries.size(); }
+
+private:
+  // One resource, the handles it doesn't have are null
+  struct Entry
+  {
+    SubmitPoint retirePoint;
+    VkBuffer buffer = VK_NULL_HANDLE;
+    VkImage image = VK_NULL_HANDLE;
+    VkImageView view = VK_NULL_HANDLE;
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    GpuAllocation allocation;
+  };
+
+  void push(Entry& entry);
+  void destroyEntry(Entry& entry);
+
+  VkDevice device = VK_NULL_HANDLE;
+  GpuAllocator* allocator = nullptr;
+  DeviceQueues* queues = nullptr;
+  // Retire points only ever grow, so the oldest entry retires first
+  std::deque<Entry> entries;
+};
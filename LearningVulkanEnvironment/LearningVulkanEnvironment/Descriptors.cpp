@@ -0,0 +1,180 @@
+#include "Descriptors.h"
+
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+
+namespace
+{
+  // Descriptors of each type per set a pool is sized for, times setsPerPool
+  const struct
+  {
+    VkDescriptorType type;
+    float perSet;
+  } POOL_RATIOS[] =
+  {
+    { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1.0f },
+    { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2.0f },
+    { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1.0f },
+    { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2.0f },
+    { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 4.0f },
+    { VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 1.0f },
+    { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1.0f },
+    { VK_DESCRIPTOR_TYPE_SAMPLER, 0.5f },
+    { VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, 0.5f }
+  };
+
+  void hashCombine(size_t& seed, size_t value)
+  {
+    seed ^= value + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+  }
+
+  bool sameBinding(const VkDescriptorSetLayoutBinding& a, const VkDescriptorSetLayoutBinding& b)
+  {
+    return a.binding == b.binding && a.descriptorType == b.descriptorType &&
+      a.descriptorCount == b.descriptorCount && a.stageFlags == b.stageFlags;
+  }
+}
+
+void DescriptorLayoutCache::create(VkDevice logicalDevice)
+{
+  device = logicalDevice;
+}
+
+void DescriptorLayoutCache::destroy()
+{
+  for (auto& bucket : layouts)
+  {
+    for (auto& entry : bucket.second)
+      vkDestroyDescriptorSetLayout(device, entry.layout, nullptr);
+  }
+  layouts.clear();
+}
+
+VkDescriptorSetLayout DescriptorLayoutCache::get(const VkDescriptorSetLayoutBinding* bindings, uint32_t bindingCount)
+{
+  // Sorted by binding number so the order they were listed in doesn't matter
+  std::vector<VkDescriptorSetLayoutBinding> sorted(bindings, bindings + bindingCount);
+  std::sort(sorted.begin(), sorted.end(),
+    [](const VkDescriptorSetLayoutBinding& a, const VkDescriptorSetLayoutBinding& b) { return a.binding < b.binding; });
+
+  size_t hash = std::hash<size_t>()(sorted.size());
+  for (const auto& binding : sorted)
+  {
+    if (binding.pImmutableSamplers)
+      throw std::runtime_error("cached descriptor set layouts can't have immutable samplers!");
+
+    hashCombine(hash, binding.binding);
+    hashCombine(hash, binding.descriptorType);
+    hashCombine(hash, binding.descriptorCount);
+    hashCombine(hash, binding.stageFlags);
+  }
+
+  std::lock_guard<std::mutex> lock(mutex);
+
+  std::vector<Entry>& bucket = layouts[hash];
+  for (const auto& entry : bucket)
+  {
+    if (std::equal(sorted.begin(), sorted.end(), entry.bindings.begin(), entry.bindings.end(), sameBinding))
+      return entry.layout;
+  }
+
+  VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+  layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+  layoutInfo.bindingCount = static_cast<uint32_t>(sorted.size());
+  layoutInfo.pBindings = sorted.data();
+
+  Entry entry;
+  if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &entry.layout) != VK_SUCCESS)
+    throw std::runtime_error("failed to create descriptor set layout!");
+  entry.bindings.swap(sorted);
+  bucket.push_back(std::move(entry));
+  return bucket.back().layout;
+}
+
+void DescriptorAllocator::create(VkDevice logicalDevice, uint32_t poolSetCount)
+{
+  device = logicalDevice;
+  setsPerPool = poolSetCount;
+}
+
+void DescriptorAllocator::destroy()
+{
+  for (auto pool : usedPools)
+    vkDestroyDescriptorPool(device, pool, nullptr);
+  for (auto pool : freePools)
+    vkDestroyDescriptorPool(device, pool, nullptr);
+  usedPools.clear();
+  freePools.clear();
+  currentPool = VK_NULL_HANDLE;
+}
+
+VkDescriptorPool DescriptorAllocator::createPool()
+{
+  const size_t typeCount = sizeof(POOL_RATIOS) / sizeof(POOL_RATIOS[0]);
+  VkDescriptorPoolSize sizes[typeCount];
+  for (size_t i = 0; i < typeCount; ++i)
+  {
+    sizes[i].type = POOL_RATIOS[i].type;
+    sizes[i].descriptorCount = std::max(1u, static_cast<uint32_t>(POOL_RATIOS[i].perSet * setsPerPool));
+  }
+
+  // No FREE_DESCRIPTOR_SET_BIT, sets are only ever released by a reset
+  VkDescriptorPoolCreateInfo poolInfo = {};
+  poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  poolInfo.maxSets = setsPerPool;
+  poolInfo.poolSizeCount = static_cast<uint32_t>(typeCount);
+  poolInfo.pPoolSizes = sizes;
+
+  VkDescriptorPool pool;
+  if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &pool) != VK_SUCCESS)
+    throw std::runtime_error("failed to create descriptor pool!");
+  return pool;
+}
+
+void DescriptorAllocator::nextPool()
+{
+  if (!freePools.empty())
+  {
+    currentPool = freePools.back();
+    freePools.pop_back();
+  }
+  else
+    currentPool = createPool();
+  usedPools.push_back(currentPool);
+}
+
+VkDescriptorSet DescriptorAllocator::allocate(VkDescriptorSetLayout layout)
+{
+  if (currentPool == VK_NULL_HANDLE)
+    nextPool();
+
+  VkDescriptorSetAllocateInfo allocInfo = {};
+  allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+  allocInfo.descriptorPool = currentPool;
+  allocInfo.descriptorSetCount = 1;
+  allocInfo.pSetLayouts = &layout;
+
+  VkDescriptorSet set;
+  if (vkAllocateDescriptorSets(device, &allocInfo, &set) == VK_SUCCESS)
+    return set;
+
+  // The pool is full (VK_ERROR_OUT_OF_POOL_MEMORY_KHR or FRAGMENTED_POOL,
+  // older drivers may report out of memory instead), retry with a new one
+  nextPool();
+  allocInfo.descriptorPool = currentPool;
+  if (vkAllocateDescriptorSets(device, &allocInfo, &set) != VK_SUCCESS)
+    throw std::runtime_error("failed to allocate descriptor set!");
+  return set;
+}
+
+void DescriptorAllocator::reset()
+{
+  for (auto pool : usedPools)
+  {
+    vkResetDescriptorPool(device, pool, 0);
+    freePools.push_back(pool);
+  }
+  usedPools.clear();
+  currentPool = VK_NULL_HANDLE;
+}
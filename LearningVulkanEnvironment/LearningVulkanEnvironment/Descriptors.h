@@ -0,0 +1,75 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstddef>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+/*
+  Hands out one VkDescriptorSetLayout per distinct set of bindings. Layouts
+  are looked up by a hash of their bindings, so every pipeline that
+  describes the same set gets the same handle back and sets stay
+  compatible between pipelines. Immutable samplers aren't supported.
+
+  Safe to call from several threads, pipelines are built on workers.
+*/
+class DescriptorLayoutCache
+{
+public:
+  void create(VkDevice device);
+  // Destroys every layout it handed out
+  void destroy();
+
+  // Binding order doesn't matter
+  VkDescriptorSetLayout get(const VkDescriptorSetLayoutBinding* bindings, uint32_t bindingCount);
+
+private:
+  struct Entry
+  {
+    std::vector<VkDescriptorSetLayoutBinding> bindings;
+    VkDescriptorSetLayout layout;
+  };
+
+  VkDevice device = VK_NULL_HANDLE;
+  // Several entries per hash in the unlikely case of a collision
+  std::unordered_map<size_t, std::vector<Entry>> layouts;
+  std::mutex mutex;
+};
+
+/*
+  Allocates descriptor sets out of a list of pools that all get reset at
+  once. Keep one per frame in flight: sets are allocated while recording,
+  and reset() throws the whole frame's sets away with one
+  vkResetDescriptorPool per pool instead of freeing them one by one. Pools
+  are never destroyed before destroy(), a full pool just moves on to the
+  next one so steady state doesn't create anything.
+
+  Not thread safe, one per recording thread if several threads allocate.
+*/
+class DescriptorAllocator
+{
+public:
+  // setsPerPool also scales the descriptor counts of every pool
+  void create(VkDevice device, uint32_t setsPerPool = 256);
+  void destroy();
+
+  VkDescriptorSet allocate(VkDescriptorSetLayout layout);
+  // Every set allocated since the last reset becomes invalid
+  void reset();
+
+  size_t poolCount() const { return usedPools.size() + freePools.size(); }
+
+private:
+  VkDescriptorPool createPool();
+  // Makes a fresh pool current, a reset one if there is one
+  void nextPool();
+
+  VkDevice device = VK_NULL_HANDLE;
+  uint32_t setsPerPool = 0;
+  VkDescriptorPool currentPool = VK_NULL_HANDLE;
+  // Pools handed sets since the last reset, current one included
+  std::vector<VkDescriptorPool> usedPools;
+  std::vector<VkDescriptorPool> freePools;
+};
@@ -0,0 +1,432 @@
+#include "DeviceQueues.h"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+namespace
+{
+  // Dependencies a single frame can use, a few per queue
+  const uint32_t DEPENDENCIES_PER_FRAME = 8;
+
+  const char* roleName(uint32_t role)
+  {
+    static const char* NAMES[QUEUE_ROLE_COUNT] = { "graphics", "compute", "transfer", "present" };
+    return NAMES[role];
+  }
+
+  // The frame is never held up by background work when the device has to
+  // pick between queues
+  const float ROLE_PRIORITIES[QUEUE_ROLE_COUNT] = { 1.0f, 0.75f, 0.5f, 1.0f };
+
+  std::string flagNames(VkQueueFlags flags)
+  {
+    std::string names;
+    if (flags & VK_QUEUE_GRAPHICS_BIT)
+      names += "graphics ";
+    if (flags & VK_QUEUE_COMPUTE_BIT)
+      names += "compute ";
+    if (flags & VK_QUEUE_TRANSFER_BIT)
+      names += "transfer ";
+    if (!names.empty())
+      names.pop_back();
+    return names;
+  }
+}
+
+void QueueSubmission::wait(VkSemaphore semaphore, VkPipelineStageFlags stages)
+{
+  if (waitCount == MAX_WAITS)
+    throw std::runtime_error("too many semaphores to wait on in one submission!");
+  waitSemaphores[waitCount] = semaphore;
+  waitStages[waitCount++] = stages;
+}
+
+void QueueSubmission::signal(VkSemaphore semaphore)
+{
+  if (signalCount == MAX_SIGNALS)
+    throw std::runtime_error("too many semaphores to signal in one submission!");
+  signalSemaphores[signalCount++] = semaphore;
+}
+
+void QueueSubmission::execute(VkCommandBuffer commandBuffer)
+{
+  if (commandBufferCount == MAX_COMMAND_BUFFERS)
+    throw std::runtime_error("too many command buffers in one submission!");
+  commandBuffers[commandBufferCount++] = commandBuffer;
+}
+
+void DeviceQueues::plan(const std::vector<VkQueueFamilyProperties>& queueFamilies, uint32_t graphicsFamily,
+  uint32_t presentFamily)
+{
+  families = queueFamilies;
+  priorities.assign(families.size(), std::vector<float>());
+
+  Assignment& graphics = roles[index(QueueRole::Graphics)];
+  graphics.family = graphicsFamily;
+  graphics.queueIndex = claimQueue(graphicsFamily, ROLE_PRIORITIES[index(QueueRole::Graphics)]);
+
+  // Presenting from the graphics queue saves a semaphore between the two
+  Assignment& present = roles[index(QueueRole::Present)];
+  present.family = presentFamily;
+  present.queueIndex = presentFamily == graphicsFamily ? graphics.queueIndex :
+    claimQueue(presentFamily, ROLE_PRIORITIES[index(QueueRole::Present)]);
+
+  uint32_t computeOnly = findFamily(VK_QUEUE_COMPUTE_BIT, VK_QUEUE_GRAPHICS_BIT);
+  Assignment& compute = roles[index(QueueRole::Compute)];
+  compute.family = computeOnly != UINT32_MAX ? computeOnly : graphicsFamily;
+  compute.queueIndex = claimQueue(compute.family, ROLE_PRIORITIES[index(QueueRole::Compute)]);
+
+  // Without DMA engines of its own the copies are still better off on a
+  // compute queue than behind the frame's draws
+  uint32_t transferOnly = findFamily(VK_QUEUE_TRANSFER_BIT, VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT);
+  Assignment& transfer = roles[index(QueueRole::Transfer)];
+  transfer.family = transferOnly != UINT32_MAX ? transferOnly : computeOnly != UINT32_MAX ? computeOnly : graphicsFamily;
+  transfer.queueIndex = claimQueue(transfer.family, ROLE_PRIORITIES[index(QueueRole::Transfer)]);
+
+  createInfos.clear();
+  for (uint32_t family = 0; family < priorities.size(); ++family)
+  {
+    if (priorities[family].empty())
+      continue;
+
+    VkDeviceQueueCreateInfo queueCreateInfo = {};
+    queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+    queueCreateInfo.queueFamilyIndex = family;
+    queueCreateInfo.queueCount = static_cast<uint32_t>(priorities[family].size());
+    queueCreateInfo.pQueuePriorities = priorities[family].data();
+    createInfos.push_back(queueCreateInfo);
+  }
+}
+
+uint32_t DeviceQueues::claimQueue(uint32_t family, float queuePriority)
+{
+  std::vector<float>& familyPriorities = priorities[family];
+  if (familyPriorities.size() < families[family].queueCount)
+    familyPriorities.push_back(queuePriority);
+  return static_cast<uint32_t>(familyPriorities.size() - 1);
+}
+
+uint32_t DeviceQueues::findFamily(VkQueueFlags want, VkQueueFlags avoid) const
+{
+  for (uint32_t family = 0; family < families.size(); ++family)
+  {
+    VkQueueFlags flags = families[family].queueFlags;
+    if (families[family].queueCount > 0 && (flags & want) == want && !(flags & avoid))
+      return family;
+  }
+  return UINT32_MAX;
+}
+
+void DeviceQueues::create(VkDevice logicalDevice, uint32_t frameCount, const TimelineFunctions& timeline)
+{
+  device = logicalDevice;
+  timelineFunctions = timeline;
+
+#ifdef VK_VERSION_1_2
+  VkSemaphoreTypeCreateInfo typeInfo = {};
+  typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+  typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+  typeInfo.initialValue = 0;
+
+  VkSemaphoreCreateInfo timelineInfo = {};
+  timelineInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+  timelineInfo.pNext = &typeInfo;
+#endif
+
+  // Roles on the same queue share its timeline
+  for (uint32_t role = 0; role < QUEUE_ROLE_COUNT; ++role)
+  {
+    Assignment& assignment = roles[role];
+    vkGetDeviceQueue(device, assignment.family, assignment.queueIndex, &assignment.queue);
+
+    for (uint32_t earlier = 0; earlier < role && !assignment.timeline; ++earlier)
+    {
+      if (roles[earlier].queue == assignment.queue)
+        assignment.timeline = roles[earlier].timeline;
+    }
+    if (assignment.timeline)
+      continue;
+
+    timelines.emplace_back(new QueueTimeline());
+    assignment.timeline = timelines.back().get();
+    assignment.timeline->queue = assignment.queue;
+    assignment.timeline->index = static_cast<uint32_t>(timelines.size() - 1);
+#ifdef VK_VERSION_1_2
+    if (usesTimelineSemaphores() &&
+      vkCreateSemaphore(device, &timelineInfo, nullptr, &assignment.timeline->semaphore) != VK_SUCCESS)
+      throw std::runtime_error("failed to create queue timeline semaphore!");
+#endif
+  }
+
+  VkSemaphoreCreateInfo semaphoreInfo = {};
+  semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+  frames.resize(frameCount);
+  for (auto& frame : frames)
+  {
+    frame.semaphores.resize(DEPENDENCIES_PER_FRAME);
+    for (auto& semaphore : frame.semaphores)
+    {
+      if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &semaphore) != VK_SUCCESS)
+        throw std::runtime_error("failed to create queue dependency semaphore!");
+    }
+  }
+}
+
+void DeviceQueues::destroy()
+{
+  for (auto& frame : frames)
+  {
+    for (auto semaphore : frame.semaphores)
+      vkDestroySemaphore(device, semaphore, nullptr);
+  }
+  frames.clear();
+
+  for (auto& timeline : timelines)
+  {
+    if (timeline->semaphore != VK_NULL_HANDLE)
+      vkDestroySemaphore(device, timeline->semaphore, nullptr);
+    for (const auto& pending : timeline->pendingFences)
+      vkDestroyFence(device, pending.second, nullptr);
+    for (auto fence : timeline->freeFences)
+      vkDestroyFence(device, fence, nullptr);
+  }
+  timelines.clear();
+  for (auto& assignment : roles)
+  {
+    assignment.queue = VK_NULL_HANDLE;
+    assignment.timeline = nullptr;
+  }
+}
+
+float DeviceQueues::priority(QueueRole role) const
+{
+  const Assignment& assignment = roles[index(role)];
+  return priorities[assignment.family][assignment.queueIndex];
+}
+
+bool DeviceQueues::isDedicated(QueueRole role) const
+{
+  const Assignment& graphics = roles[index(QueueRole::Graphics)];
+  const Assignment& assignment = roles[index(role)];
+  return assignment.family != graphics.family || assignment.queueIndex != graphics.queueIndex;
+}
+
+void DeviceQueues::beginFrame(uint32_t frame)
+{
+  currentFrame = frame;
+  frames[currentFrame].used = 0;
+}
+
+VkSemaphore DeviceQueues::dependency()
+{
+  FrameDependencies& frame = frames[currentFrame];
+  if (frame.used == frame.semaphores.size())
+    throw std::runtime_error("out of queue dependency semaphores this frame!");
+  return frame.semaphores[frame.used++];
+}
+
+uint64_t DeviceQueues::submit(QueueRole role, const QueueSubmission& submission, VkFence fence)
+{
+  QueueTimeline& timeline = *roles[index(role)].timeline;
+  std::lock_guard<std::mutex> guard(timeline.lock);
+  uint64_t value = timeline.submitted + 1;
+
+  VkSemaphore signalSemaphores[QueueSubmission::MAX_SIGNALS + 1];
+  std::copy(submission.signalSemaphores, submission.signalSemaphores + submission.signalCount, signalSemaphores);
+  uint32_t signalCount = submission.signalCount;
+
+  VkSubmitInfo submitInfo = {};
+  submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+
+#ifdef VK_VERSION_1_2
+  // Binary semaphores ignore their value
+  uint64_t signalValues[QueueSubmission::MAX_SIGNALS + 1] = {};
+  VkTimelineSemaphoreSubmitInfo timelineInfo = {};
+  timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+  if (timeline.semaphore != VK_NULL_HANDLE)
+  {
+    signalValues[signalCount] = value;
+    signalSemaphores[signalCount++] = timeline.semaphore;
+    timelineInfo.signalSemaphoreValueCount = signalCount;
+    timelineInfo.pSignalSemaphoreValues = signalValues;
+    submitInfo.pNext = &timelineInfo;
+  }
+#endif
+
+  submitInfo.waitSemaphoreCount = submission.waitCount;
+  submitInfo.pWaitSemaphores = submission.waitSemaphores;
+  submitInfo.pWaitDstStageMask = submission.waitStages;
+  submitInfo.commandBufferCount = submission.commandBufferCount;
+  submitInfo.pCommandBuffers = submission.commandBuffers;
+  submitInfo.signalSemaphoreCount = signalCount;
+  submitInfo.pSignalSemaphores = signalSemaphores;
+
+  if (vkQueueSubmit(timeline.queue, 1, &submitInfo, fence) != VK_SUCCESS)
+    throw std::runtime_error(std::string("failed to submit to the ") + roleName(index(role)) + " queue!");
+
+  // An empty submit's fence signals once everything before it finished
+  if (timeline.semaphore == VK_NULL_HANDLE)
+  {
+    VkFence valueFence = takeFence(timeline);
+    if (vkQueueSubmit(timeline.queue, 0, nullptr, valueFence) != VK_SUCCESS)
+      throw std::runtime_error(std::string("failed to submit to the ") + roleName(index(role)) + " queue!");
+    timeline.pendingFences.push_back(std::make_pair(value, valueFence));
+  }
+
+  timeline.submitted = value;
+  return value;
+}
+
+void DeviceQueues::waitIdle(QueueRole role)
+{
+  QueueTimeline& timeline = *roles[index(role)].timeline;
+  std::lock_guard<std::mutex> guard(timeline.lock);
+  vkQueueWaitIdle(timeline.queue);
+}
+
+VkFence DeviceQueues::takeFence(QueueTimeline& timeline)
+{
+  // Recycle whatever finished first, a steady state needs no new fences
+  updateFinished(timeline);
+  if (!timeline.freeFences.empty())
+  {
+    VkFence fence = timeline.freeFences.back();
+    timeline.freeFences.pop_back();
+    return fence;
+  }
+
+  VkFenceCreateInfo fenceInfo = {};
+  fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+  VkFence fence;
+  if (vkCreateFence(device, &fenceInfo, nullptr, &fence) != VK_SUCCESS)
+    throw std::runtime_error("failed to create queue timeline fence!");
+  return fence;
+}
+
+void DeviceQueues::updateFinished(QueueTimeline& timeline)
+{
+#ifdef VK_VERSION_1_2
+  if (timeline.semaphore != VK_NULL_HANDLE)
+  {
+    uint64_t value = 0;
+    if (timelineFunctions.getCounterValue(device, timeline.semaphore, &value) != VK_SUCCESS)
+      throw std::runtime_error("failed to read a queue timeline!");
+    timeline.finished = value;
+    return;
+  }
+#endif
+
+  // The queue finishes its submissions in order
+  while (!timeline.pendingFences.empty() &&
+    vkGetFenceStatus(device, timeline.pendingFences.front().second) == VK_SUCCESS)
+  {
+    timeline.finished = timeline.pendingFences.front().first;
+    VkFence fence = timeline.pendingFences.front().second;
+    vkResetFences(device, 1, &fence);
+    timeline.freeFences.push_back(fence);
+    timeline.pendingFences.pop_front();
+  }
+}
+
+bool DeviceQueues::hasFinished(QueueTimeline& timeline, uint64_t value)
+{
+  if (value <= timeline.finished)
+    return true;
+  updateFinished(timeline);
+  return value <= timeline.finished;
+}
+
+void DeviceQueues::wait(QueueTimeline& timeline, uint64_t value)
+{
+  if (hasFinished(timeline, value))
+    return;
+
+#ifdef VK_VERSION_1_2
+  if (timeline.semaphore != VK_NULL_HANDLE)
+  {
+    VkSemaphoreWaitInfo waitInfo = {};
+    waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    waitInfo.semaphoreCount = 1;
+    waitInfo.pSemaphores = &timeline.semaphore;
+    waitInfo.pValues = &value;
+    if (timelineFunctions.waitSemaphores(device, &waitInfo, std::numeric_limits<uint64_t>::max()) != VK_SUCCESS)
+      throw std::runtime_error("failed to wait for a queue timeline!");
+    updateFinished(timeline);
+    return;
+  }
+#endif
+
+  // The first fence at or past the value, the ones before it are done then
+  // too
+  for (const auto& pending : timeline.pendingFences)
+  {
+    if (pending.first >= value)
+    {
+      vkWaitForFences(device, 1, &pending.second, VK_TRUE, std::numeric_limits<uint64_t>::max());
+      break;
+    }
+  }
+  updateFinished(timeline);
+}
+
+bool DeviceQueues::hasFinished(QueueRole role, uint64_t value)
+{
+  QueueTimeline& timeline = *roles[index(role)].timeline;
+  std::lock_guard<std::mutex> guard(timeline.lock);
+  return hasFinished(timeline, value);
+}
+
+void DeviceQueues::wait(QueueRole role, uint64_t value)
+{
+  QueueTimeline& timeline = *roles[index(role)].timeline;
+  std::lock_guard<std::mutex> guard(timeline.lock);
+  wait(timeline, value);
+}
+
+SubmitPoint DeviceQueues::submitted()
+{
+  SubmitPoint point;
+  for (auto& timeline : timelines)
+  {
+    std::lock_guard<std::mutex> guard(timeline->lock);
+    point.values[timeline->index] = timeline->submitted;
+  }
+  return point;
+}
+
+bool DeviceQueues::hasFinished(const SubmitPoint& point)
+{
+  for (auto& timeline : timelines)
+  {
+    std::lock_guard<std::mutex> guard(timeline->lock);
+    if (!hasFinished(*timeline, point.values[timeline->index]))
+      return false;
+  }
+  return true;
+}
+
+void DeviceQueues::wait(const SubmitPoint& point)
+{
+  for (auto& timeline : timelines)
+  {
+    std::lock_guard<std::mutex> guard(timeline->lock);
+    wait(*timeline, point.values[timeline->index]);
+  }
+}
+
+void DeviceQueues::writeReport(std::ostream& out) const
+{
+  out << "queue_role,family,family_flags,queue_index,priority,dedicated,sync\n";
+  for (uint32_t role = 0; role < QUEUE_ROLE_COUNT; ++role)
+  {
+    const Assignment& assignment = roles[role];
+    out << roleName(role) << ',' << assignment.family << ',' << flagNames(families[assignment.family].queueFlags)
+      << ',' << assignment.queueIndex << ',' << priorities[assignment.family][assignment.queueIndex] << ','
+      << (isDedicated(static_cast<QueueRole>(role)) ? "yes" : "no") << ','
+      << (usesTimelineSemaphores() ? "timeline" : "fences") << '\n';
+  }
+}
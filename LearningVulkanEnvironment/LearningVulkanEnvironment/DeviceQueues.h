@@ -0,0 +1,209 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+// What a queue is used for. Several roles can end up on the same queue.
+enum class QueueRole
+{
+  Graphics,
+  Compute,
+  Transfer,
+  Present
+};
+
+const uint32_t QUEUE_ROLE_COUNT = 4;
+
+/*
+  Where every queue's timeline was at some moment: the value of its last
+  submission. Once each queue has passed its value, everything submitted
+  before that moment has finished.
+*/
+struct SubmitPoint
+{
+  // Per queue, roles sharing one share its entry
+  uint64_t values[QUEUE_ROLE_COUNT] = {};
+};
+
+// From Vulkan 1.2 or VK_KHR_timeline_semaphore, whichever the device has.
+// Null without either. Headers older than 1.2 only get the fences.
+struct TimelineFunctions
+{
+#ifdef VK_VERSION_1_2
+  PFN_vkGetSemaphoreCounterValue getCounterValue = nullptr;
+  PFN_vkWaitSemaphores waitSemaphores = nullptr;
+#endif
+};
+
+/*
+  One vkQueueSubmit batch. The arrays have a fixed capacity so building a
+  submission never allocates, adding more than that throws.
+*/
+struct QueueSubmission
+{
+  static const uint32_t MAX_WAITS = 4;
+  static const uint32_t MAX_SIGNALS = 4;
+  static const uint32_t MAX_COMMAND_BUFFERS = 4;
+
+  // Nothing at stages of the batch starts before the semaphore signaled
+  void wait(VkSemaphore semaphore, VkPipelineStageFlags stages);
+  // Signaled once every command buffer of the batch has finished
+  void signal(VkSemaphore semaphore);
+  void execute(VkCommandBuffer commandBuffer);
+
+  VkSemaphore waitSemaphores[MAX_WAITS];
+  VkPipelineStageFlags waitStages[MAX_WAITS];
+  uint32_t waitCount = 0;
+  VkSemaphore signalSemaphores[MAX_SIGNALS];
+  uint32_t signalCount = 0;
+  VkCommandBuffer commandBuffers[MAX_COMMAND_BUFFERS];
+  uint32_t commandBufferCount = 0;
+};
+
+/*
+  Finds a queue for every role and submits to them. Compute and transfer
+  work gets a queue of its own where the device has one: a compute only
+  family runs on the async compute engines and a transfer only family on
+  the DMA engines, both next to rendering instead of after it in the
+  graphics queue. Failing that a second queue of the graphics family is
+  used if it has one to spare (drivers may still schedule it in parallel),
+  and the graphics queue itself as a last resort.
+
+  Queues get priorities by role, graphics highest, so a frame isn't held
+  up behind background uploads when the device has to choose.
+
+  Work on different queues is only ordered by semaphores. dependency()
+  hands out binary semaphores for that, one signal and one wait each,
+  which are recycled with the frame slot.
+
+  Every submission to a queue gets the next value of the queue's timeline
+  and the host waits for values instead of fences. With timeline
+  semaphores the submission signals its value itself. Without them a
+  fence, submitted with no work right after it, stands in for the value.
+
+  Usage: plan(), create the device with queueCreateInfos(), then create().
+*/
+class DeviceQueues
+{
+public:
+  // present is the family that can present to the surface (or the graphics
+  // family when headless)
+  void plan(const std::vector<VkQueueFamilyProperties>& families, uint32_t graphicsFamily, uint32_t presentFamily);
+  // For VkDeviceCreateInfo, valid until the DeviceQueues goes away
+  const std::vector<VkDeviceQueueCreateInfo>& queueCreateInfos() const { return createInfos; }
+
+  // Gets the queues of the created device and frameCount slots of
+  // dependency semaphores. Without timeline functions every submission
+  // gets a fence.
+  void create(VkDevice device, uint32_t frameCount, const TimelineFunctions& timeline);
+  // The device must be idle
+  void destroy();
+
+  uint32_t family(QueueRole role) const { return roles[index(role)].family; }
+  // minImageTransferGranularity of the role's family, in texels or in
+  // blocks of compressed formats. (0,0,0) only allows whole mip levels.
+  VkExtent3D imageTransferGranularity(QueueRole role) const { return families[family(role)].minImageTransferGranularity; }
+  VkQueue queue(QueueRole role) const { return roles[index(role)].queue; }
+  float priority(QueueRole role) const;
+  // Whether the role has a queue the graphics work doesn't go to
+  bool isDedicated(QueueRole role) const;
+  // Whether the role's work runs in another family than graphics, so
+  // resources it shares with graphics need concurrent sharing or ownership
+  // transfers
+  bool isSeparateFamily(QueueRole role) const { return family(role) != family(QueueRole::Graphics); }
+
+  // Call once the frame slot's last submission has finished. Every
+  // semaphore of the slot has been waited on by then, the frame's last
+  // submission waited on all the others.
+  void beginFrame(uint32_t frame);
+  // Unsignaled semaphore for one signal and one wait within the frame.
+  // Throws when the frame runs out of them.
+  VkSemaphore dependency();
+
+#ifdef VK_VERSION_1_2
+  bool usesTimelineSemaphores() const { return timelineFunctions.waitSemaphores != nullptr; }
+#else
+  bool usesTimelineSemaphores() const { return false; }
+#endif
+
+  // Thread safe, submissions to the same queue are serialized. Returns the
+  // value the queue's timeline reaches once the submission has finished.
+  uint64_t submit(QueueRole role, const QueueSubmission& submission, VkFence fence = VK_NULL_HANDLE);
+  // Also thread safe, for the device going idle or the queue being dropped
+  void waitIdle(QueueRole role);
+
+  // Whether the role's queue has finished the submission value was returned
+  // for, never blocks. 0 has always finished.
+  bool hasFinished(QueueRole role, uint64_t value);
+  void wait(QueueRole role, uint64_t value);
+
+  // Now, on every queue
+  SubmitPoint submitted();
+  bool hasFinished(const SubmitPoint& point);
+  void wait(const SubmitPoint& point);
+
+  // Which family and queue every role ended up with
+  void writeReport(std::ostream& out) const;
+
+private:
+  static uint32_t index(QueueRole role) { return static_cast<uint32_t>(role); }
+
+  // One per queue, shared by every role on it
+  struct QueueTimeline
+  {
+    VkQueue queue = VK_NULL_HANDLE;
+    // Index into SubmitPoint::values
+    uint32_t index = 0;
+    std::mutex lock;
+    // Timeline semaphore, null when fences stand in for it
+    VkSemaphore semaphore = VK_NULL_HANDLE;
+    uint64_t submitted = 0;
+    // Highest value known to have finished
+    uint64_t finished = 0;
+    // Fence of every value not known to have finished yet, oldest first
+    std::deque<std::pair<uint64_t, VkFence>> pendingFences;
+    std::vector<VkFence> freeFences;
+  };
+
+  struct Assignment
+  {
+    uint32_t family = 0;
+    uint32_t queueIndex = 0;
+    VkQueue queue = VK_NULL_HANDLE;
+    QueueTimeline* timeline = nullptr;
+  };
+
+  struct FrameDependencies
+  {
+    std::vector<VkSemaphore> semaphores;
+    uint32_t used = 0;
+  };
+
+  // Queue index for role in family, a new one if the family has one left
+  // and shared with the family's last queue otherwise
+  uint32_t claimQueue(uint32_t family, float queuePriority);
+  uint32_t findFamily(VkQueueFlags want, VkQueueFlags avoid) const;
+  // With the timeline's lock held
+  VkFence takeFence(QueueTimeline& timeline);
+  void updateFinished(QueueTimeline& timeline);
+  bool hasFinished(QueueTimeline& timeline, uint64_t value);
+  void wait(QueueTimeline& timeline, uint64_t value);
+
+  VkDevice device = VK_NULL_HANDLE;
+  std::vector<VkQueueFamilyProperties> families;
+  Assignment roles[QUEUE_ROLE_COUNT];
+  // Per family, one priority per queue created there
+  std::vector<std::vector<float>> priorities;
+  std::vector<VkDeviceQueueCreateInfo> createInfos;
+  TimelineFunctions timelineFunctions;
+  std::vector<std::unique_ptr<QueueTimeline>> timelines;
+
+  std::vector<FrameDependencies> frames;
+  uint32_t currentFrame = 0;
+};
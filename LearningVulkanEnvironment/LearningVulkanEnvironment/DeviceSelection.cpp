@@ -0,0 +1,260 @@
+#include "DeviceSelection.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <stdexcept>
+
+namespace
+{
+  // Features the requirements can name. Others aren't checked.
+  struct NamedFeature
+  {
+    const char* name;
+    VkBool32 VkPhysicalDeviceFeatures::*member;
+  };
+
+  const NamedFeature FEATURES[] =
+  {
+    { "drawIndirectFirstInstance", &VkPhysicalDeviceFeatures::drawIndirectFirstInstance },
+    { "multiDrawIndirect", &VkPhysicalDeviceFeatures::multiDrawIndirect },
+    { "textureCompressionBC", &VkPhysicalDeviceFeatures::textureCompressionBC },
+    { "textureCompressionETC2", &VkPhysicalDeviceFeatures::textureCompressionETC2 },
+    { "textureCompressionASTC_LDR", &VkPhysicalDeviceFeatures::textureCompressionASTC_LDR },
+    { "samplerAnisotropy", &VkPhysicalDeviceFeatures::samplerAnisotropy },
+    { "sampleRateShading", &VkPhysicalDeviceFeatures::sampleRateShading },
+    { "fillModeNonSolid", &VkPhysicalDeviceFeatures::fillModeNonSolid },
+    { "occlusionQueryPrecise", &VkPhysicalDeviceFeatures::occlusionQueryPrecise },
+    { "pipelineStatisticsQuery", &VkPhysicalDeviceFeatures::pipelineStatisticsQuery }
+  };
+
+  const char* typeName(VkPhysicalDeviceType type)
+  {
+    switch (type)
+    {
+    case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU: return "discrete";
+    case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: return "integrated";
+    case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU: return "virtual";
+    case VK_PHYSICAL_DEVICE_TYPE_CPU: return "cpu";
+    default: return "other";
+    }
+  }
+
+  VkDeviceSize largestLocalHeap(const VkPhysicalDeviceMemoryProperties& memory)
+  {
+    VkDeviceSize largest = 0;
+    for (uint32_t i = 0; i < memory.memoryHeapCount; ++i)
+    {
+      if (memory.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)
+        largest = std::max(largest, memory.memoryHeaps[i].size);
+    }
+    return largest;
+  }
+
+  // Families that have the bits of want and none of the bits of avoid
+  uint32_t countFamilies(const DeviceInfo& device, VkQueueFlags want, VkQueueFlags avoid)
+  {
+    uint32_t count = 0;
+    for (const auto& family : device.queueFamilies)
+    {
+      if (family.queueCount > 0 && (family.queueFlags & want) == want && !(family.queueFlags & avoid))
+        ++count;
+    }
+    return count;
+  }
+
+  uint32_t highestSampleCount(VkSampleCountFlags counts)
+  {
+    uint32_t highest = 1;
+    for (uint32_t samples = 1; samples <= 64; samples <<= 1)
+    {
+      if (counts & samples)
+        highest = samples;
+    }
+    return highest;
+  }
+
+  std::string apiVersionString(uint32_t version)
+  {
+    return std::to_string(VK_VERSION_MAJOR(version)) + '.' + std::to_string(VK_VERSION_MINOR(version)) + '.' +
+      std::to_string(VK_VERSION_PATCH(version));
+  }
+
+  // Lower case hex digits only, for comparing UUIDs however they were typed
+  std::string normalizeHex(const std::string& text)
+  {
+    std::string digits;
+    for (char c : text)
+    {
+      if (c != '-')
+        digits += static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    }
+    return digits;
+  }
+
+  // Free text such as device names can hold commas, quotes are doubled
+  std::string csvQuoted(const std::string& text)
+  {
+    std::string quoted = "\"";
+    for (char c : text)
+    {
+      if (c == '"')
+        quoted += '"';
+      quoted += c;
+    }
+    return quoted + '"';
+  }
+}
+
+DeviceInfo describeDevice(VkPhysicalDevice device, uint32_t index,
+  PFN_vkGetPhysicalDeviceProperties2KHR getProperties2)
+{
+  DeviceInfo info;
+  info.handle = device;
+  info.index = index;
+  vkGetPhysicalDeviceProperties(device, &info.properties);
+  vkGetPhysicalDeviceFeatures(device, &info.features);
+  vkGetPhysicalDeviceMemoryProperties(device, &info.memory);
+
+  uint32_t familyCount = 0;
+  vkGetPhysicalDeviceQueueFamilyProperties(device, &familyCount, nullptr);
+  info.queueFamilies.resize(familyCount);
+  vkGetPhysicalDeviceQueueFamilyProperties(device, &familyCount, info.queueFamilies.data());
+
+  if (getProperties2)
+  {
+    VkPhysicalDeviceIDPropertiesKHR idProperties = {};
+    idProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES_KHR;
+
+    VkPhysicalDeviceProperties2KHR properties = {};
+    properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2_KHR;
+    properties.pNext = &idProperties;
+    getProperties2(device, &properties);
+
+    memcpy(info.uuid, idProperties.deviceUUID, VK_UUID_SIZE);
+    info.hasUuid = true;
+  }
+
+  return info;
+}
+
+void scoreDevice(DeviceInfo& device, const DeviceRequirements& requirements)
+{
+  for (const auto& feature : FEATURES)
+  {
+    if (requirements.requiredFeatures.*feature.member && !(device.features.*feature.member))
+    {
+      if (!device.unsuitableReason.empty())
+        device.unsuitableReason += "; ";
+      device.unsuitableReason += std::string("no ") + feature.name;
+    }
+  }
+
+  DeviceScore& score = device.score;
+  switch (device.properties.deviceType)
+  {
+  case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU: score.type = 10000; break;
+  case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: score.type = 5000; break;
+  case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU: score.type = 2000; break;
+  case VK_PHYSICAL_DEVICE_TYPE_CPU: score.type = 0; break;
+  default: score.type = 1000; break;
+  }
+
+  // 64 per GiB, capped well below the gap between device types. Integrated
+  // GPUs report shared system memory here, which is why the cap matters.
+  score.memory = std::min<int64_t>(static_cast<int64_t>(largestLocalHeap(device.memory) >> 24), 2048);
+
+  const VkPhysicalDeviceLimits& limits = device.properties.limits;
+  score.limits = limits.maxImageDimension2D / 256 +
+    8 * highestSampleCount(limits.framebufferColorSampleCounts & limits.framebufferDepthSampleCounts);
+
+  if (countFamilies(device, VK_QUEUE_COMPUTE_BIT, VK_QUEUE_GRAPHICS_BIT) > 0)
+    score.queues += 300;
+  if (countFamilies(device, VK_QUEUE_TRANSFER_BIT, VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT) > 0)
+    score.queues += 300;
+
+  for (const auto& feature : FEATURES)
+  {
+    if (requirements.optionalFeatures.*feature.member && device.features.*feature.member)
+      score.features += 100;
+  }
+}
+
+size_t selectDevice(const std::vector<DeviceInfo>& devices, const std::string& overrideDevice)
+{
+  if (!overrideDevice.empty())
+  {
+    size_t chosen = devices.size();
+    // A UUID has 32 digits, an index never comes close
+    bool isIndex = overrideDevice.size() <= 9 && std::all_of(overrideDevice.begin(), overrideDevice.end(),
+      [](char c) { return std::isdigit(static_cast<unsigned char>(c)) != 0; });
+    if (isIndex)
+    {
+      unsigned long index = std::stoul(overrideDevice);
+      if (index < devices.size())
+        chosen = static_cast<size_t>(index);
+    }
+    else
+    {
+      std::string wanted = normalizeHex(overrideDevice);
+      for (size_t i = 0; i < devices.size() && chosen == devices.size(); ++i)
+      {
+        if (devices[i].hasUuid && normalizeHex(formatUuid(devices[i].uuid)) == wanted)
+          chosen = i;
+      }
+    }
+
+    if (chosen == devices.size())
+      throw std::runtime_error("--device " + overrideDevice + " matches no physical device!");
+    if (!devices[chosen].unsuitableReason.empty())
+      throw std::runtime_error("--device " + overrideDevice + " can't be used: " + devices[chosen].unsuitableReason + "!");
+    return chosen;
+  }
+
+  size_t best = devices.size();
+  for (size_t i = 0; i < devices.size(); ++i)
+  {
+    if (devices[i].unsuitableReason.empty() &&
+      (best == devices.size() || devices[i].score.total() > devices[best].score.total()))
+      best = i;
+  }
+  if (best == devices.size())
+    throw std::runtime_error("failed to find a suitable GPU!");
+  return best;
+}
+
+std::string formatUuid(const uint8_t* uuid)
+{
+  static const char* HEX = "0123456789abcdef";
+  std::string text;
+  for (uint32_t i = 0; i < VK_UUID_SIZE; ++i)
+  {
+    if (i == 4 || i == 6 || i == 8 || i == 10)
+      text += '-';
+    text += HEX[uuid[i] >> 4];
+    text += HEX[uuid[i] & 15];
+  }
+  return text;
+}
+
+void writeDeviceReport(std::ostream& out, const std::vector<DeviceInfo>& devices, size_t selected)
+{
+  out << "device,name,type,api,vram_mib,compute_families,transfer_families,max_image_2d,max_samples,"
+    "type_score,memory_score,limits_score,queue_score,feature_score,score,uuid,status\n";
+  for (size_t i = 0; i < devices.size(); ++i)
+  {
+    const DeviceInfo& device = devices[i];
+    const VkPhysicalDeviceLimits& limits = device.properties.limits;
+    std::string status = i == selected ? "selected" : device.unsuitableReason.empty() ? "suitable" : device.unsuitableReason;
+
+    out << device.index << ',' << csvQuoted(device.properties.deviceName) << ',' << typeName(device.properties.deviceType) << ','
+      << apiVersionString(device.properties.apiVersion) << ',' << (largestLocalHeap(device.memory) >> 20) << ','
+      << countFamilies(device, VK_QUEUE_COMPUTE_BIT, VK_QUEUE_GRAPHICS_BIT) << ','
+      << countFamilies(device, VK_QUEUE_TRANSFER_BIT, VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT) << ','
+      << limits.maxImageDimension2D << ','
+      << highestSampleCount(limits.framebufferColorSampleCounts & limits.framebufferDepthSampleCounts) << ','
+      << device.score.type << ',' << device.score.memory << ',' << device.score.limits << ','
+      << device.score.queues << ',' << device.score.features << ',' << device.score.total() << ','
+      << (device.hasUuid ? formatUuid(device.uuid) : std::string("unknown")) << ',' << csvQuoted(status) << '\n';
+  }
+}
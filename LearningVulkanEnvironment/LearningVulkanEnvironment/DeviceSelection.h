@@ -0,0 +1,79 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// What the app needs from a device beyond queues, extensions and a surface
+struct DeviceRequirements
+{
+  // Devices without any of these can't run the app
+  VkPhysicalDeviceFeatures requiredFeatures = {};
+  // Used when present, every one the device has adds to its score
+  VkPhysicalDeviceFeatures optionalFeatures = {};
+};
+
+// The terms of a device's score, kept apart for the report
+struct DeviceScore
+{
+  // Device type dominates: a discrete GPU beats an integrated one whatever
+  // the rest says, and software rasterizers come last
+  int64_t type = 0;
+  // Largest device local heap
+  int64_t memory = 0;
+  // Maximum image size and sample counts
+  int64_t limits = 0;
+  // Compute only and transfer only families, work there overlaps graphics
+  int64_t queues = 0;
+  int64_t features = 0;
+
+  int64_t total() const { return type + memory + limits + queues + features; }
+};
+
+// Everything the selection and the report look at for one physical device
+struct DeviceInfo
+{
+  VkPhysicalDevice handle = VK_NULL_HANDLE;
+  // Position in vkEnumeratePhysicalDevices, what --device takes
+  uint32_t index = 0;
+  VkPhysicalDeviceProperties properties = {};
+  VkPhysicalDeviceFeatures features = {};
+  VkPhysicalDeviceMemoryProperties memory = {};
+  std::vector<VkQueueFamilyProperties> queueFamilies;
+  // deviceUUID, stable across runs and the same in every API. Only known
+  // when the instance has VK_KHR_get_physical_device_properties2.
+  bool hasUuid = false;
+  uint8_t uuid[VK_UUID_SIZE] = {};
+  // Why the app can't use the device, empty if it can
+  std::string unsuitableReason;
+  DeviceScore score;
+};
+
+/*
+  Queries the device. getProperties2 is vkGetPhysicalDeviceProperties2KHR
+  when the instance enabled VK_KHR_get_physical_device_properties2 and
+  VK_KHR_external_memory_capabilities, nullptr otherwise, and only needed
+  for the UUID.
+*/
+DeviceInfo describeDevice(VkPhysicalDevice device, uint32_t index,
+  PFN_vkGetPhysicalDeviceProperties2KHR getProperties2);
+
+// Fills in score, and unsuitableReason if a required feature is missing
+void scoreDevice(DeviceInfo& device, const DeviceRequirements& requirements);
+
+/*
+  Index into devices of the one to use. overrideDevice picks one by its
+  index or by its UUID (hex, dashes optional), otherwise the suitable
+  device with the highest score wins, the first one on a tie. Throws if the
+  override matches no device or an unsuitable one, or nothing is suitable.
+*/
+size_t selectDevice(const std::vector<DeviceInfo>& devices, const std::string& overrideDevice);
+
+// 8-4-4-4-12 hex digits, like the UUIDs vulkaninfo prints
+std::string formatUuid(const uint8_t* uuid);
+
+// One row per device with its capabilities and score terms
+void writeDeviceReport(std::ostream& out, const std::vector<DeviceInfo>& devices, size_t selected);
@@ -0,0 +1,63 @@
+#include "DrawSort.h"
+
+#include <cstring>
+#include <utility>
+
+namespace
+{
+  // Bits of the float that sort as unsigned integers in the order of the
+  // values: positive ones get the sign bit set, negative ones are flipped
+  uint32_t sortableBits(float value)
+  {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return (bits & 0x80000000u) ? ~bits : bits | 0x80000000u;
+  }
+}
+
+uint64_t makeOpaqueSortKey(uint32_t pipeline, uint32_t material, float depth)
+{
+  return (static_cast<uint64_t>(pipeline & 0xFFu) << 56) | (static_cast<uint64_t>(material & 0xFFFFFFu) << 32) |
+    sortableBits(depth);
+}
+
+void radixSort(std::vector<DrawSortEntry>& entries, std::vector<DrawSortEntry>& scratch)
+{
+  size_t count = entries.size();
+  scratch.resize(count);
+  if (count < 2)
+    return;
+
+  size_t histograms[8][256] = {};
+  for (const auto& entry : entries)
+  {
+    for (uint32_t byte = 0; byte < 8; ++byte)
+      ++histograms[byte][(entry.key >> (8 * byte)) & 0xFF];
+  }
+
+  DrawSortEntry* source = entries.data();
+  DrawSortEntry* destination = scratch.data();
+  for (uint32_t byte = 0; byte < 8; ++byte)
+  {
+    const size_t* histogram = histograms[byte];
+    uint32_t shift = 8 * byte;
+    // Every key has the first key's byte, nothing would move
+    if (histogram[(source[0].key >> shift) & 0xFF] == count)
+      continue;
+
+    size_t offsets[256];
+    size_t sum = 0;
+    for (uint32_t digit = 0; digit < 256; ++digit)
+    {
+      offsets[digit] = sum;
+      sum += histogram[digit];
+    }
+    for (size_t i = 0; i < count; ++i)
+      destination[offsets[(source[i].key >> shift) & 0xFF]++] = source[i];
+    std::swap(source, destination);
+  }
+
+  // An odd number of passes leaves the result in scratch
+  if (source != entries.data())
+    entries.swap(scratch);
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+/*
+  Sort key of an opaque draw, most significant first: pipeline (8 bits),
+  material (24 bits), depth (32 bits). Sorted keys group the draws by the
+  most expensive state to change first, and run each group front to back
+  so early depth testing rejects hidden fragments before they are shaded.
+  Only the low bits of pipeline and material are kept.
+*/
+uint64_t makeOpaqueSortKey(uint32_t pipeline, uint32_t material, float depth);
+
+// item is whatever the caller draws by, the sort only moves it along
+struct DrawSortEntry
+{
+  uint64_t key;
+  uint32_t item;
+};
+
+/*
+  Stable LSD radix sort by key, 8 bits per pass. One read over the keys
+  builds the histograms of all eight bytes, and passes over a byte every
+  key shares are skipped, which is the usual case for the pipeline and
+  material bytes. scratch ends up the size of entries and can be kept
+  between calls so sorting doesn't allocate.
+*/
+void radixSort(std::vector<DrawSortEntry>& entries, std::vector<DrawSortEntry>& scratch);
@@ -0,0 +1,80 @@
+#include "DynamicUniformBuffer.h"
+
+#include <algorithm>
+
+namespace
+{
+  // Largest nonCoherentAtomSize allowed, keeps the flush of one slot from
+  // rounding into the next
+  const VkDeviceSize SLOT_ALIGNMENT = 256;
+
+  VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+  {
+    return (value + alignment - 1) / alignment * alignment;
+  }
+}
+
+void DynamicUniformBuffer::create(VkDevice logicalDevice, VkPhysicalDevice physicalDevice, GpuAllocator& gpuAllocator,
+  VkDeviceSize entrySize, uint32_t entryCount, uint32_t frameCount)
+{
+  device = logicalDevice;
+  allocator = &gpuAllocator;
+  size = entrySize;
+  count = entryCount;
+
+  // Every dynamic offset has to be a multiple of the alignment
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+  VkDeviceSize alignment = std::max<VkDeviceSize>(properties.limits.minUniformBufferOffsetAlignment, 1);
+
+  entryStride = alignUp(size, alignment);
+  frameStride = alignUp(entryStride * count, std::max(alignment, SLOT_ALIGNMENT));
+
+  createBuffer(frameCount);
+}
+
+void DynamicUniformBuffer::destroy()
+{
+  if (buffer != VK_NULL_HANDLE)
+    allocator->destroyBuffer(buffer, memory);
+  buffer = VK_NULL_HANDLE;
+  frames = 0;
+}
+
+void DynamicUniformBuffer::reserveFrames(uint32_t frameCount)
+{
+  if (!isEnabled() || frameCount <= frames)
+    return;
+
+  allocator->destroyBuffer(buffer, memory);
+  createBuffer(frameCount);
+}
+
+void DynamicUniformBuffer::createBuffer(uint32_t frameCount)
+{
+  frames = frameCount;
+
+  // Written by the CPU every frame and read once by the GPU
+  allocator->createBuffer(frameStride * frames, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, buffer, memory);
+}
+
+void* DynamicUniformBuffer::entry(uint32_t frame, uint32_t index)
+{
+  return static_cast<char*>(memory.mapped) + offset(frame, index);
+}
+
+void DynamicUniformBuffer::flush(uint32_t frame)
+{
+  allocator->flush(memory, offset(frame, 0), frameStride);
+}
+
+VkDescriptorBufferInfo DynamicUniformBuffer::descriptorInfo() const
+{
+  // The range is one entry, the dynamic offset moves it through the buffer
+  VkDescriptorBufferInfo info = {};
+  info.buffer = buffer;
+  info.offset = 0;
+  info.range = size;
+  return info;
+}
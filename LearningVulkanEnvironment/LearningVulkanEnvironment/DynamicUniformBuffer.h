@@ -0,0 +1,59 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include "GpuAllocator.h"
+
+/*
+  One big uniform buffer holding small per draw structs, read through a
+  single VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC descriptor. Switching to
+  the next draw's data is just another dynamic offset in
+  vkCmdBindDescriptorSets, no new descriptor set and no descriptor write.
+
+  Entries are padded to minUniformBufferOffsetAlignment. Like
+  InstanceStreams the buffer stays mapped and holds one region per frame
+  slot, so the CPU rewrites a slot once its last reader has finished:
+
+    | slot 0: entry 0 | entry 1 | ... | slot 1: entry 0 | ...
+*/
+class DynamicUniformBuffer
+{
+public:
+  void create(VkDevice device, VkPhysicalDevice physicalDevice, GpuAllocator& allocator,
+    VkDeviceSize entrySize, uint32_t entryCount, uint32_t frameCount);
+  void destroy();
+
+  // Grows to frameCount slots, only call while the device is idle. Sets
+  // pointing at the buffer have to be written again.
+  void reserveFrames(uint32_t frameCount);
+
+  bool isEnabled() const { return buffer != VK_NULL_HANDLE; }
+  uint32_t entryCount() const { return count; }
+
+  // Mapped memory of one entry of the slot
+  void* entry(uint32_t frame, uint32_t index);
+  // The dynamic offset that selects the entry
+  uint32_t offset(uint32_t frame, uint32_t index) const
+  {
+    return static_cast<uint32_t>(frame * frameStride + index * entryStride);
+  }
+  // Call once the slot is written, before the submit that reads it
+  void flush(uint32_t frame);
+
+  // What the descriptor points at, offsets are added on top
+  VkDescriptorBufferInfo descriptorInfo() const;
+
+private:
+  void createBuffer(uint32_t frameCount);
+
+  VkDevice device = VK_NULL_HANDLE;
+  GpuAllocator* allocator = nullptr;
+  VkDeviceSize size = 0;
+  uint32_t count = 0;
+  uint32_t frames = 0;
+  VkDeviceSize entryStride = 0;
+  VkDeviceSize frameStride = 0;
+
+  VkBuffer buffer = VK_NULL_HANDLE;
+  GpuAllocation memory;
+};
@@ -0,0 +1,524 @@
+#include "GpuAllocator.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+struct GpuMemoryBlock
+{
+  VkDeviceMemory memory = VK_NULL_HANDLE;
+  uint32_t memoryType = 0;
+  // Pool the block belongs to, unused for dedicated blocks
+  size_t pool = 0;
+  VkDeviceSize size = 0;
+  void* mapped = nullptr;
+  // Null for dedicated blocks, which hold exactly one resource
+  std::unique_ptr<BuddyAllocator> allocator;
+};
+
+namespace
+{
+  // Smallest piece handed out. Also covers the usual uniform buffer offset
+  // and non coherent atom alignments.
+  const VkDeviceSize MIN_SUBALLOCATION = 256;
+
+  VkDeviceSize roundUpToPowerOfTwo(VkDeviceSize value)
+  {
+    VkDeviceSize result = 1;
+    while (result < value)
+      result <<= 1;
+    return result;
+  }
+
+  VkDeviceSize roundDownToPowerOfTwo(VkDeviceSize value)
+  {
+    VkDeviceSize result = 1;
+    while (result <= value / 2)
+      result <<= 1;
+    return result;
+  }
+
+  VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+  {
+    return (value + alignment - 1) / alignment * alignment;
+  }
+
+  void accumulate(const GpuMemoryBlock& block, GpuMemoryStats& stats, VkDeviceSize& freeBytes)
+  {
+    ++stats.blockCount;
+    stats.reservedBytes += block.size;
+    if (block.allocator)
+    {
+      stats.allocationCount += block.allocator->allocationCount();
+      stats.usedBytes += block.allocator->usedBytes();
+      stats.largestFreeBlock = std::max(stats.largestFreeBlock, block.allocator->largestFreeBlock());
+      freeBytes += block.size - block.allocator->usedBytes();
+    }
+    else
+    {
+      ++stats.allocationCount;
+      stats.usedBytes += block.size;
+    }
+  }
+
+  void finish(GpuMemoryStats& stats, VkDeviceSize freeBytes)
+  {
+    stats.fragmentation = freeBytes > 0 ? 1.0 - double(stats.largestFreeBlock) / double(freeBytes) : 0.0;
+  }
+}
+
+BuddyAllocator::BuddyAllocator(VkDeviceSize size, VkDeviceSize minBlockSize)
+  : totalSize(roundDownToPowerOfTwo(size))
+  , minBlock(std::min(roundUpToPowerOfTwo(minBlockSize), totalSize))
+  , maxOrder(0)
+{
+  while (blockSize(maxOrder) < totalSize)
+    ++maxOrder;
+
+  // Starts out as one free block spanning everything
+  freeLists.resize(maxOrder + 1);
+  freeLists[maxOrder].insert(0);
+}
+
+bool BuddyAllocator::allocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset)
+{
+  // Blocks are aligned to their size, so a block at least as large as the
+  // alignment is always aligned well enough
+  VkDeviceSize needed = roundUpToPowerOfTwo(std::max(std::max(size, alignment), minBlock));
+  if (needed > totalSize)
+    return false;
+
+  uint32_t order = 0;
+  while (blockSize(order) < needed)
+    ++order;
+
+  // Smallest free block that fits
+  uint32_t found = order;
+  while (found <= maxOrder && freeLists[found].empty())
+    ++found;
+  if (found > maxOrder)
+    return false;
+
+  // Lowest offset first keeps allocations packed at the start of the block
+  offset = *freeLists[found].begin();
+  freeLists[found].erase(freeLists[found].begin());
+
+  // Split until it has the right size, the upper halves become free blocks
+  while (found > order)
+  {
+    --found;
+    freeLists[found].insert(offset + blockSize(found));
+  }
+
+  allocated[offset] = order;
+  used += blockSize(order);
+  return true;
+}
+
+void BuddyAllocator::free(VkDeviceSize offset)
+{
+  auto it = allocated.find(offset);
+  if (it == allocated.end())
+    throw std::runtime_error("freeing an offset that was never allocated!");
+
+  uint32_t order = it->second;
+  allocated.erase(it);
+  used -= blockSize(order);
+
+  // Merge with the buddy for as long as the buddy is free as well
+  while (order < maxOrder)
+  {
+    VkDeviceSize buddy = offset ^ blockSize(order);
+    auto buddyIt = freeLists[order].find(buddy);
+    if (buddyIt == freeLists[order].end())
+      break;
+
+    freeLists[order].erase(buddyIt);
+    offset = std::min(offset, buddy);
+    ++order;
+  }
+
+  freeLists[order].insert(offset);
+}
+
+VkDeviceSize BuddyAllocator::largestFreeBlock() const
+{
+  for (uint32_t order = maxOrder + 1; order > 0; --order)
+  {
+    if (!freeLists[order - 1].empty())
+      return blockSize(order - 1);
+  }
+  return 0;
+}
+
+void RingAllocator::reset(VkDeviceSize capacity, uint32_t frameCount)
+{
+  ringSize = capacity;
+  head = 0;
+  tail = 0;
+  // The extra slot holds whatever is allocated before the first frame
+  // begins, it is released once any frame after it retires
+  frameEnds.assign(frameCount + 1, 0);
+  currentFrame = frameCount;
+}
+
+void RingAllocator::beginFrame(uint32_t frame)
+{
+  // Everything up to here belongs to the frame that was being recorded
+  frameEnds[currentFrame] = head;
+  currentFrame = frame;
+
+  // That frame's previous use is done, so is everything allocated before it
+  tail = std::max(tail, frameEnds[frame]);
+}
+
+bool RingAllocator::allocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset)
+{
+  if (size > ringSize)
+    return false;
+
+  VkDeviceSize start = head % ringSize;
+  VkDeviceSize aligned = alignUp(start, std::max<VkDeviceSize>(alignment, 1));
+  VkDeviceSize newHead = head + (aligned - start) + size;
+
+  // Doesn't fit before the end, skip the rest and start over at 0
+  if (aligned + size > ringSize)
+  {
+    aligned = 0;
+    newHead = head + (ringSize - start) + size;
+  }
+
+  if (newHead - tail > ringSize)
+    return false;
+
+  head = newHead;
+  offset = aligned;
+  return true;
+}
+
+GpuAllocator::GpuAllocator()
+{
+}
+
+GpuAllocator::~GpuAllocator()
+{
+}
+
+void GpuAllocator::create(VkDevice logicalDevice, VkPhysicalDevice physicalDevice, VkDeviceSize blockSize)
+{
+  device = logicalDevice;
+  preferredBlockSize = roundUpToPowerOfTwo(blockSize);
+
+  vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+  bufferImageGranularity = properties.limits.bufferImageGranularity;
+  nonCoherentAtomSize = properties.limits.nonCoherentAtomSize;
+
+  pools.resize(memoryProperties.memoryTypeCount * 2);
+}
+
+void GpuAllocator::destroy()
+{
+  std::lock_guard<std::mutex> lock(mutex);
+
+  for (auto& pool : pools)
+  {
+    for (auto& block : pool.blocks)
+      freeBlock(block.get());
+  }
+  for (auto& block : dedicatedBlocks)
+    freeBlock(block.get());
+
+  pools.clear();
+  dedicatedBlocks.clear();
+}
+
+uint32_t GpuAllocator::findMemoryType(uint32_t typeBits, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred) const
+{
+  // Types are ordered by the driver from fastest to slowest, so the first
+  // one that fits is the one to take. Preferred flags first, then without.
+  VkMemoryPropertyFlags wanted[] = { required | preferred, required };
+  for (auto flags : wanted)
+  {
+    for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; ++i)
+    {
+      if ((typeBits & (1 << i)) && (memoryProperties.memoryTypes[i].propertyFlags & flags) == flags)
+        return i;
+    }
+  }
+
+  throw std::runtime_error("failed to find suitable memory type!");
+}
+
+bool GpuAllocator::isHostCoherent(const GpuAllocation& allocation) const
+{
+  return (memoryProperties.memoryTypes[allocation.block->memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+}
+
+VkDeviceSize GpuAllocator::blockSizeFor(uint32_t memoryType) const
+{
+  // Small heaps (integrated GPUs, the 256MB BAR heap) get smaller blocks so
+  // a single block never takes a big share of the heap
+  VkDeviceSize heapSize = memoryProperties.memoryHeaps[memoryProperties.memoryTypes[memoryType].heapIndex].size;
+  VkDeviceSize size = preferredBlockSize;
+  while (size > heapSize / 8 && size > 1024 * 1024)
+    size /= 2;
+  return size;
+}
+
+GpuAllocation GpuAllocator::allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags required,
+  VkMemoryPropertyFlags preferred, GpuResourceKind kind)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+
+  uint32_t memoryType = findMemoryType(requirements.memoryTypeBits, required, preferred);
+  VkMemoryPropertyFlags flags = memoryProperties.memoryTypes[memoryType].propertyFlags;
+
+  // Flushes work on whole atoms, neighbours must not share one
+  VkDeviceSize alignment = requirements.alignment;
+  if ((flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) && !(flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT))
+    alignment = std::max(alignment, nonCoherentAtomSize);
+
+  GpuAllocation allocation;
+
+  // Big resources would waste most of a block
+  VkDeviceSize blockSize = blockSizeFor(memoryType);
+  if (requirements.size > blockSize / 2)
+  {
+    dedicatedBlocks.push_back(allocateBlock(memoryType, requirements.size, true));
+    GpuMemoryBlock* block = dedicatedBlocks.back().get();
+    allocation.memory = block->memory;
+    allocation.offset = 0;
+    allocation.size = requirements.size;
+    allocation.mapped = block->mapped;
+    allocation.block = block;
+    return allocation;
+  }
+
+  // Linear and optimal resources only need separate pools if the device
+  // has a granularity larger than a byte
+  size_t poolIndex = memoryType * 2;
+  if (bufferImageGranularity > 1 && kind == GpuResourceKind::Optimal)
+    ++poolIndex;
+  Pool& pool = pools[poolIndex];
+
+  VkDeviceSize offset = 0;
+  GpuMemoryBlock* block = nullptr;
+  for (auto& candidate : pool.blocks)
+  {
+    if (candidate->allocator->allocate(requirements.size, alignment, offset))
+    {
+      block = candidate.get();
+      break;
+    }
+  }
+
+  if (!block)
+  {
+    pool.blocks.push_back(allocateBlock(memoryType, blockSize, false));
+    block = pool.blocks.back().get();
+    block->pool = poolIndex;
+    if (!block->allocator->allocate(requirements.size, alignment, offset))
+      throw std::runtime_error("allocation doesn't fit into a new memory block!");
+  }
+
+  allocation.memory = block->memory;
+  allocation.offset = offset;
+  allocation.size = requirements.size;
+  allocation.mapped = block->mapped ? static_cast<char*>(block->mapped) + offset : nullptr;
+  allocation.block = block;
+  return allocation;
+}
+
+void GpuAllocator::free(GpuAllocation& allocation)
+{
+  if (!allocation.block)
+    return;
+
+  std::lock_guard<std::mutex> lock(mutex);
+
+  GpuMemoryBlock* block = allocation.block;
+  VkDeviceSize offset = allocation.offset;
+  allocation = GpuAllocation();
+
+  if (!block->allocator)
+  {
+    auto it = std::find_if(dedicatedBlocks.begin(), dedicatedBlocks.end(),
+      [block](const std::unique_ptr<GpuMemoryBlock>& candidate) { return candidate.get() == block; });
+    freeBlock(block);
+    dedicatedBlocks.erase(it);
+    return;
+  }
+
+  block->allocator->free(offset);
+
+  // Give empty blocks back to the driver, but keep the last one of a pool
+  // around so allocating and freeing in a loop doesn't thrash
+  Pool& pool = pools[block->pool];
+  if (block->allocator->allocationCount() == 0 && pool.blocks.size() > 1)
+  {
+    auto it = std::find_if(pool.blocks.begin(), pool.blocks.end(),
+      [block](const std::unique_ptr<GpuMemoryBlock>& candidate) { return candidate.get() == block; });
+    freeBlock(block);
+    pool.blocks.erase(it);
+  }
+}
+
+void GpuAllocator::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties,
+  VkBuffer& buffer, GpuAllocation& allocation)
+{
+  VkBufferCreateInfo bufferInfo = {};
+  bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  bufferInfo.size = size;
+  bufferInfo.usage = usage;
+  bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+  createBuffer(bufferInfo, properties, buffer, allocation);
+}
+
+void GpuAllocator::createBuffer(const VkBufferCreateInfo& bufferInfo, VkMemoryPropertyFlags properties,
+  VkBuffer& buffer, GpuAllocation& allocation)
+{
+  if (vkCreateBuffer(device, &bufferInfo, nullptr, &buffer) != VK_SUCCESS)
+    throw std::runtime_error("failed to create buffer!");
+
+  VkMemoryRequirements memRequirements;
+  vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
+
+  allocation = allocate(memRequirements, properties, 0, GpuResourceKind::Linear);
+  vkBindBufferMemory(device, buffer, allocation.memory, allocation.offset);
+}
+
+void GpuAllocator::destroyBuffer(VkBuffer buffer, GpuAllocation& allocation)
+{
+  vkDestroyBuffer(device, buffer, nullptr);
+  free(allocation);
+}
+
+void GpuAllocator::createImage(const VkImageCreateInfo& imageInfo, VkMemoryPropertyFlags properties,
+  VkImage& image, GpuAllocation& allocation)
+{
+  if (vkCreateImage(device, &imageInfo, nullptr, &image) != VK_SUCCESS)
+    throw std::runtime_error("failed to create image!");
+
+  VkMemoryRequirements memRequirements;
+  vkGetImageMemoryRequirements(device, image, &memRequirements);
+
+  GpuResourceKind kind = imageInfo.tiling == VK_IMAGE_TILING_OPTIMAL ? GpuResourceKind::Optimal : GpuResourceKind::Linear;
+  allocation = allocate(memRequirements, properties, 0, kind);
+  vkBindImageMemory(device, image, allocation.memory, allocation.offset);
+}
+
+void GpuAllocator::destroyImage(VkImage image, GpuAllocation& allocation)
+{
+  vkDestroyImage(device, image, nullptr);
+  free(allocation);
+}
+
+void GpuAllocator::flush(const GpuAllocation& allocation, VkDeviceSize offset, VkDeviceSize size)
+{
+  if (!allocation.block || isHostCoherent(allocation))
+    return;
+
+  if (size == VK_WHOLE_SIZE)
+    size = allocation.size - offset;
+
+  // The range has to start and end on atom boundaries, rounding outwards is
+  // safe because allocations are aligned to atoms themselves
+  VkDeviceSize start = (allocation.offset + offset) / nonCoherentAtomSize * nonCoherentAtomSize;
+  VkDeviceSize end = std::min(alignUp(allocation.offset + offset + size, nonCoherentAtomSize), allocation.block->size);
+
+  VkMappedMemoryRange range = {};
+  range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+  range.memory = allocation.memory;
+  range.offset = start;
+  range.size = end - start;
+  vkFlushMappedMemoryRanges(device, 1, &range);
+}
+
+std::unique_ptr<GpuMemoryBlock> GpuAllocator::allocateBlock(uint32_t memoryType, VkDeviceSize size, bool dedicated)
+{
+  std::unique_ptr<GpuMemoryBlock> block(new GpuMemoryBlock());
+  block->memoryType = memoryType;
+  block->size = size;
+
+  VkMemoryAllocateInfo allocInfo = {};
+  allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  allocInfo.allocationSize = size;
+  allocInfo.memoryTypeIndex = memoryType;
+
+  if (vkAllocateMemory(device, &allocInfo, nullptr, &block->memory) != VK_SUCCESS)
+    throw std::runtime_error("failed to allocate device memory block!");
+
+  // Mapping once up front is cheaper than mapping around every write
+  if (memoryProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+  {
+    if (vkMapMemory(device, block->memory, 0, VK_WHOLE_SIZE, 0, &block->mapped) != VK_SUCCESS)
+    {
+      vkFreeMemory(device, block->memory, nullptr);
+      throw std::runtime_error("failed to map device memory block!");
+    }
+  }
+
+  if (!dedicated)
+    block->allocator.reset(new BuddyAllocator(size, MIN_SUBALLOCATION));
+
+  return block;
+}
+
+void GpuAllocator::freeBlock(GpuMemoryBlock* block)
+{
+  if (block->mapped)
+    vkUnmapMemory(device, block->memory);
+  vkFreeMemory(device, block->memory, nullptr);
+}
+
+GpuMemoryStats GpuAllocator::stats() const
+{
+  std::lock_guard<std::mutex> lock(mutex);
+
+  GpuMemoryStats total;
+  VkDeviceSize freeBytes = 0;
+  for (const auto& pool : pools)
+  {
+    for (const auto& block : pool.blocks)
+      accumulate(*block, total, freeBytes);
+  }
+  for (const auto& block : dedicatedBlocks)
+    accumulate(*block, total, freeBytes);
+
+  finish(total, freeBytes);
+  return total;
+}
+
+void GpuAllocator::writeReport(std::ostream& out) const
+{
+  std::lock_guard<std::mutex> lock(mutex);
+
+  // One row per memory type that has any blocks
+  std::map<uint32_t, std::pair<GpuMemoryStats, VkDeviceSize>> perType;
+  for (const auto& pool : pools)
+  {
+    for (const auto& block : pool.blocks)
+    {
+      auto& entry = perType[block->memoryType];
+      accumulate(*block, entry.first, entry.second);
+    }
+  }
+  for (const auto& block : dedicatedBlocks)
+  {
+    auto& entry = perType[block->memoryType];
+    accumulate(*block, entry.first, entry.second);
+  }
+
+  out << "memory_type,blocks,allocations,reserved_bytes,used_bytes,largest_free_bytes,fragmentation\n";
+  for (auto& entry : perType)
+  {
+    GpuMemoryStats& stats = entry.second.first;
+    finish(stats, entry.second.second);
+    out << entry.first << ',' << stats.blockCount << ',' << stats.allocationCount << ','
+      << stats.reservedBytes << ',' << stats.usedBytes << ',' << stats.largestFreeBlock << ','
+      << stats.fragmentation << '\n';
+  }
+}
@@ -0,0 +1,176 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <set>
+#include <vector>
+
+/*
+  Buddy allocator over a range of offsets, it never touches Vulkan itself.
+  The range is split in power of two blocks, every block is aligned to its
+  own size so any alignment up to the block size comes for free. Freed
+  blocks merge with their buddy again, which keeps fragmentation bounded.
+*/
+class BuddyAllocator
+{
+public:
+  // size is rounded down and minBlockSize up to a power of two
+  BuddyAllocator(VkDeviceSize size, VkDeviceSize minBlockSize);
+
+  // Returns false if there is no free block large enough
+  bool allocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset);
+  void free(VkDeviceSize offset);
+
+  VkDeviceSize size() const { return totalSize; }
+  // Bytes of the blocks handed out, including rounding up to a power of two
+  VkDeviceSize usedBytes() const { return used; }
+  VkDeviceSize largestFreeBlock() const;
+  size_t allocationCount() const { return allocated.size(); }
+
+private:
+  VkDeviceSize blockSize(uint32_t order) const { return minBlock << order; }
+
+  VkDeviceSize totalSize;
+  VkDeviceSize minBlock;
+  uint32_t maxOrder;
+  VkDeviceSize used = 0;
+  // Free block offsets per order, sets so a buddy can be found and removed
+  std::vector<std::set<VkDeviceSize>> freeLists;
+  // Order of every block handed out, by offset
+  std::map<VkDeviceSize, uint32_t> allocated;
+};
+
+/*
+  Ring of offsets for data that only lives for one frame, like per frame
+  uniforms. Allocating is a pointer bump, nothing is freed one by one: when
+  a frame slot comes around again (its fence was waited on) everything it
+  allocated last time is released at once. Frames retire in order, so the
+  tail simply moves up to where that frame ended.
+*/
+class RingAllocator
+{
+public:
+  void reset(VkDeviceSize capacity, uint32_t frameCount);
+
+  // Call once per frame, after waiting on the fence of the frame slot about
+  // to be recorded. Beginning the same frame again releases its allocations.
+  void beginFrame(uint32_t frame);
+  // Returns false if the frames in flight already use up the ring
+  bool allocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset);
+
+  VkDeviceSize capacity() const { return ringSize; }
+  VkDeviceSize usedBytes() const { return head - tail; }
+
+private:
+  VkDeviceSize ringSize = 0;
+  // Running totals of bytes allocated and released, offsets are taken
+  // modulo the ring size. Wrapping around counts the skipped end as used.
+  VkDeviceSize head = 0;
+  VkDeviceSize tail = 0;
+  std::vector<VkDeviceSize> frameEnds;
+  uint32_t currentFrame = 0;
+};
+
+struct GpuMemoryBlock;
+
+// A piece of a larger VkDeviceMemory block. Bind with memory + offset.
+struct GpuAllocation
+{
+  VkDeviceMemory memory = VK_NULL_HANDLE;
+  VkDeviceSize offset = 0;
+  VkDeviceSize size = 0;
+  // Host visible memory stays mapped for its whole lifetime
+  void* mapped = nullptr;
+  GpuMemoryBlock* block = nullptr;
+};
+
+struct GpuMemoryStats
+{
+  size_t blockCount = 0;
+  size_t allocationCount = 0;
+  VkDeviceSize reservedBytes = 0;
+  VkDeviceSize usedBytes = 0;
+  // Largest single free range over all blocks
+  VkDeviceSize largestFreeBlock = 0;
+  // 0 when all free memory is one range, towards 1 the more it is split up
+  double fragmentation = 0.0;
+};
+
+// Whether the resource is laid out linearly (buffers, linear images) or is
+// an optimal tiling image. The two can't share a bufferImageGranularity page.
+enum class GpuResourceKind
+{
+  Linear,
+  Optimal
+};
+
+/*
+  Sub-allocates resources out of a few large VkDeviceMemory blocks instead of
+  calling vkAllocateMemory per resource, which is slow and limited by
+  maxMemoryAllocationCount (can be as low as 4096). Every memory type gets
+  its own pools of buddy allocated blocks, one for linear and one for
+  optimal resources so neighbours never violate bufferImageGranularity.
+  Resources larger than half a block get a dedicated allocation.
+
+  Safe to call from several threads.
+*/
+class GpuAllocator
+{
+public:
+  // Out of line, GpuMemoryBlock is only complete in the .cpp
+  GpuAllocator();
+  ~GpuAllocator();
+
+  void create(VkDevice device, VkPhysicalDevice physicalDevice, VkDeviceSize preferredBlockSize = 64 * 1024 * 1024);
+  // Every allocation must have been freed before
+  void destroy();
+
+  // required flags must be present, preferred are used if a type has them
+  GpuAllocation allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags required,
+    VkMemoryPropertyFlags preferred, GpuResourceKind kind);
+  void free(GpuAllocation& allocation);
+
+  // Convenience wrappers that create the resource and bind it
+  void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties,
+    VkBuffer& buffer, GpuAllocation& allocation);
+  void createBuffer(const VkBufferCreateInfo& bufferInfo, VkMemoryPropertyFlags properties,
+    VkBuffer& buffer, GpuAllocation& allocation);
+  void destroyBuffer(VkBuffer buffer, GpuAllocation& allocation);
+  void createImage(const VkImageCreateInfo& imageInfo, VkMemoryPropertyFlags properties,
+    VkImage& image, GpuAllocation& allocation);
+  void destroyImage(VkImage image, GpuAllocation& allocation);
+
+  // Makes CPU writes visible to the device, a no-op for coherent memory
+  void flush(const GpuAllocation& allocation, VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE);
+
+  uint32_t findMemoryType(uint32_t typeBits, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred = 0) const;
+  bool isHostCoherent(const GpuAllocation& allocation) const;
+
+  GpuMemoryStats stats() const;
+  void writeReport(std::ostream& out) const;
+
+private:
+  struct Pool
+  {
+    std::vector<std::unique_ptr<GpuMemoryBlock>> blocks;
+  };
+
+  std::unique_ptr<GpuMemoryBlock> allocateBlock(uint32_t memoryType, VkDeviceSize size, bool dedicated);
+  void freeBlock(GpuMemoryBlock* block);
+  VkDeviceSize blockSizeFor(uint32_t memoryType) const;
+
+  VkDevice device = VK_NULL_HANDLE;
+  VkPhysicalDeviceMemoryProperties memoryProperties = {};
+  VkDeviceSize bufferImageGranularity = 1;
+  VkDeviceSize nonCoherentAtomSize = 1;
+  VkDeviceSize preferredBlockSize = 0;
+
+  // Indexed by memory type * 2 + resource kind
+  std::vector<Pool> pools;
+  std::vector<std::unique_ptr<GpuMemoryBlock>> dedicatedBlocks;
+  mutable std::mutex mutex;
+};
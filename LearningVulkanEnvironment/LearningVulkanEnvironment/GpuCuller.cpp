@@ -0,0 +1,227 @@
+#include "GpuCuller.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "PipelineBuilder.h"
+#include "Scene.h"
+
+namespace
+{
+  // local_size_x of cull.comp
+  const uint32_t CULL_GROUP_SIZE = 64;
+  const VkDeviceSize DRAW_STRIDE = sizeof(VkDrawIndexedIndirectCommand);
+
+  void memoryBarrier(VkCommandBuffer commandBuffer, VkPipelineStageFlags srcStage, VkAccessFlags srcAccess,
+    VkPipelineStageFlags dstStage, VkAccessFlags dstAccess)
+  {
+    VkMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = srcAccess;
+    barrier.dstAccessMask = dstAccess;
+    vkCmdPipelineBarrier(commandBuffer, srcStage, dstStage, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+  }
+}
+
+void GpuCuller::create(VkDevice logicalDevice, GpuAllocator& gpuAllocator, VkPipelineCache pipelineCache, const GpuCullerDesc& cullerDesc)
+{
+  device = logicalDevice;
+  allocator = &gpuAllocator;
+  desc = cullerDesc;
+
+  drawLists.resize(std::max(desc.copyCount, 1u));
+  for (auto& list : drawLists)
+  {
+    createBuffer(DRAW_STRIDE * desc.objectCount, list.drawBuffer, list.drawMemory);
+    createBuffer(sizeof(uint32_t), list.countBuffer, list.countMemory);
+  }
+
+  // objects, draws, draw count
+  VkDescriptorSetLayoutBinding bindings[3] = {};
+  for (uint32_t i = 0; i < 3; ++i)
+  {
+    bindings[i].binding = i;
+    bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bindings[i].descriptorCount = 1;
+    bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+  }
+
+  VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+  layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+  layoutInfo.bindingCount = 3;
+  layoutInfo.pBindings = bindings;
+
+  if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &setLayout) != VK_SUCCESS)
+    throw std::runtime_error("failed to create culling descriptor set layout!");
+
+  VkDescriptorPoolSize poolSize = {};
+  poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  poolSize.descriptorCount = 3 * static_cast<uint32_t>(drawLists.size());
+
+  VkDescriptorPoolCreateInfo poolInfo = {};
+  poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  poolInfo.maxSets = static_cast<uint32_t>(drawLists.size());
+  poolInfo.poolSizeCount = 1;
+  poolInfo.pPoolSizes = &poolSize;
+
+  if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS)
+    throw std::runtime_error("failed to create culling descriptor pool!");
+
+  // The buffers never change, so the sets are written once
+  for (auto& list : drawLists)
+  {
+    VkDescriptorSetAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = descriptorPool;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &setLayout;
+
+    if (vkAllocateDescriptorSets(device, &allocInfo, &list.descriptorSet) != VK_SUCCESS)
+      throw std::runtime_error("failed to allocate culling descriptor set!");
+
+    VkDescriptorBufferInfo bufferInfos[3] = {};
+    bufferInfos[0].buffer = desc.objectBuffer;
+    bufferInfos[1].buffer = list.drawBuffer;
+    bufferInfos[2].buffer = list.countBuffer;
+
+    VkWriteDescriptorSet writes[3] = {};
+    for (uint32_t i = 0; i < 3; ++i)
+    {
+      bufferInfos[i].offset = 0;
+      bufferInfos[i].range = VK_WHOLE_SIZE;
+
+      writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+      writes[i].dstSet = list.descriptorSet;
+      writes[i].dstBinding = i;
+      writes[i].descriptorCount = 1;
+      writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+      writes[i].pBufferInfo = &bufferInfos[i];
+    }
+    vkUpdateDescriptorSets(device, 3, writes, 0, nullptr);
+  }
+
+  VkPushConstantRange pushConstants = {};
+  pushConstants.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+  pushConstants.offset = 0;
+  pushConstants.size = sizeof(CullingConstants);
+
+  VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+  pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+  pipelineLayoutInfo.setLayoutCount = 1;
+  pipelineLayoutInfo.pSetLayouts = &setLayout;
+  pipelineLayoutInfo.pushConstantRangeCount = 1;
+  pipelineLayoutInfo.pPushConstantRanges = &pushConstants;
+
+  if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS)
+    throw std::runtime_error("failed to create culling pipeline layout!");
+
+  pipeline = createComputePipeline(device, pipelineCache, desc.shaderCode, pipelineLayout);
+}
+
+// Written by the compute pass and by vkCmdFillBuffer, read by the draws
+void GpuCuller::createBuffer(VkDeviceSize size, VkBuffer& buffer, GpuAllocation& allocation)
+{
+  VkBufferCreateInfo bufferInfo = {};
+  bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  bufferInfo.size = size;
+  bufferInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+    VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+  if (desc.queueFamilies.size() > 1)
+  {
+    bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+    bufferInfo.queueFamilyIndexCount = static_cast<uint32_t>(desc.queueFamilies.size());
+    bufferInfo.pQueueFamilyIndices = desc.queueFamilies.data();
+  }
+  else
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+  allocator->createBuffer(bufferInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, buffer, allocation);
+}
+
+VkPipeline GpuCuller::rebuildPipeline(VkPipelineCache pipelineCache, const Asset& shaderCode)
+{
+  // Built first, a shader that fails to compile leaves the old one in place
+  VkPipeline newPipeline = createComputePipeline(device, pipelineCache, shaderCode, pipelineLayout);
+  VkPipeline oldPipeline = pipeline;
+  pipeline = newPipeline;
+  return oldPipeline;
+}
+
+void GpuCuller::destroy()
+{
+  if (!isEnabled())
+    return;
+
+  vkDestroyPipeline(device, pipeline, nullptr);
+  vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+  // Destroying the pool frees the sets as well
+  vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+  vkDestroyDescriptorSetLayout(device, setLayout, nullptr);
+  for (auto& list : drawLists)
+  {
+    allocator->destroyBuffer(list.drawBuffer, list.drawMemory);
+    allocator->destroyBuffer(list.countBuffer, list.countMemory);
+  }
+  drawLists.clear();
+  pipeline = VK_NULL_HANDLE;
+}
+
+bool GpuCuller::usesDrawCount() const
+{
+#ifdef VK_KHR_draw_indirect_count
+  return desc.drawIndexedIndirectCount && desc.multiDrawIndirect && desc.objectCount <= desc.maxDrawIndirectCount;
+#else
+  return false;
+#endif
+}
+
+void GpuCuller::recordCulling(VkCommandBuffer commandBuffer, uint32_t copy, const float viewProjection[16])
+{
+  const DrawList& list = drawLists[copy];
+
+  // The previous frame's draws may still be reading the list we overwrite
+  memoryBarrier(commandBuffer, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0,
+    VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+
+  vkCmdFillBuffer(commandBuffer, list.countBuffer, 0, VK_WHOLE_SIZE, 0);
+  if (!usesDrawCount())
+    vkCmdFillBuffer(commandBuffer, list.drawBuffer, 0, VK_WHOLE_SIZE, 0);
+
+  memoryBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+    VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+
+  CullingConstants constants = {};
+  frustumPlanes(viewProjection, constants.planes);
+  constants.objectCount = desc.objectCount;
+  constants.indexCount = desc.indexCount;
+
+  vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+  vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &list.descriptorSet, 0, nullptr);
+  vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+  vkCmdDispatch(commandBuffer, (desc.objectCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+
+  memoryBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+    VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT);
+}
+
+void GpuCuller::recordDraws(VkCommandBuffer commandBuffer, uint32_t copy)
+{
+  const DrawList& list = drawLists[copy];
+#ifdef VK_KHR_draw_indirect_count
+  if (usesDrawCount())
+  {
+    desc.drawIndexedIndirectCount(commandBuffer, list.drawBuffer, 0, list.countBuffer, 0,
+      desc.objectCount, static_cast<uint32_t>(DRAW_STRIDE));
+    return;
+  }
+#endif
+
+  // One call per maxDrawIndirectCount entries, or per entry without
+  // multiDrawIndirect. Zeroed entries past the count draw nothing.
+  uint32_t perCall = desc.multiDrawIndirect ? std::max(desc.maxDrawIndirectCount, 1u) : 1u;
+  for (uint32_t first = 0; first < desc.objectCount; first += perCall)
+  {
+    uint32_t count = std::min(perCall, desc.objectCount - first);
+    vkCmdDrawIndexedIndirect(commandBuffer, list.drawBuffer, first * DRAW_STRIDE, count, static_cast<uint32_t>(DRAW_STRIDE));
+  }
+}
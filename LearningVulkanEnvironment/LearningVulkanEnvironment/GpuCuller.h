@@ -0,0 +1,102 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <vector>
+
+#include "AssetIO.h"
+#include "GpuAllocator.h"
+
+struct GpuCullerDesc
+{
+  // Buffer of ObjectData, needs VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+  VkBuffer objectBuffer = VK_NULL_HANDLE;
+  uint32_t objectCount = 0;
+  // Index count of the mesh every object draws
+  uint32_t indexCount = 0;
+
+  // Device features and limits that decide how the draws are issued
+  bool multiDrawIndirect = false;
+  uint32_t maxDrawIndirectCount = 1;
+#ifdef VK_KHR_draw_indirect_count
+  // From VK_KHR_draw_indirect_count, null when the extension isn't enabled.
+  // Headers from before the extension only get the fallback.
+  PFN_vkCmdDrawIndexedIndirectCountKHR drawIndexedIndirectCount = nullptr;
+#endif
+
+  // SPIR-V of cull.comp
+  Asset shaderCode;
+
+  // Draw lists, one per frame in flight when the culling runs on another
+  // queue than the draws: that queue doesn't wait for the previous frame's
+  // draws to finish reading the list before it overwrites it
+  uint32_t copyCount = 1;
+  // Families of the queues culling and drawing, the draw lists are shared
+  // concurrently if there is more than one
+  std::vector<uint32_t> queueFamilies;
+};
+
+/*
+  GPU driven drawing. A compute pass (cull.comp) tests every object's
+  bounding sphere against the view and appends a VkDrawIndexedIndirectCommand
+  for each visible one, counting them in a second buffer. The graphics pass
+  then draws the whole list with a handful of indirect calls, so CPU cost
+  doesn't depend on the number of objects and the commands can even be
+  recorded once.
+
+  With VK_KHR_draw_indirect_count the GPU reads the count itself. Without
+  it the draw list is cleared to zero each frame and drawn in full, the
+  entries past the count then draw nothing.
+*/
+class GpuCuller
+{
+public:
+  void create(VkDevice device, GpuAllocator& allocator, VkPipelineCache pipelineCache, const GpuCullerDesc& desc);
+  void destroy();
+
+  bool isEnabled() const { return pipeline != VK_NULL_HANDLE; }
+
+  // Swaps in a pipeline built from new cull.comp code, for hot reloading.
+  // Returns the old one, which the caller destroys once the command buffers
+  // using it have finished.
+  VkPipeline rebuildPipeline(VkPipelineCache pipelineCache, const Asset& shaderCode);
+
+  // Outside of a render pass: resets the draw list and runs the culling
+  // against the frustum of viewProjection, column major as in GLSL
+  void recordCulling(VkCommandBuffer commandBuffer, uint32_t copy, const float viewProjection[16]);
+  // Inside the render pass, with the graphics pipeline, mesh and object
+  // buffer already bound
+  void recordDraws(VkCommandBuffer commandBuffer, uint32_t copy);
+
+private:
+  // Matches the push constant block of cull.comp
+  struct CullingConstants
+  {
+    float planes[6][4];
+    uint32_t objectCount;
+    uint32_t indexCount;
+  };
+
+  struct DrawList
+  {
+    VkBuffer drawBuffer = VK_NULL_HANDLE;
+    GpuAllocation drawMemory;
+    VkBuffer countBuffer = VK_NULL_HANDLE;
+    GpuAllocation countMemory;
+    VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+  };
+
+  bool usesDrawCount() const;
+  void createBuffer(VkDeviceSize size, VkBuffer& buffer, GpuAllocation& allocation);
+
+  VkDevice device = VK_NULL_HANDLE;
+  GpuAllocator* allocator = nullptr;
+  GpuCullerDesc desc;
+
+  std::vector<DrawList> drawLists;
+
+  VkDescriptorSetLayout setLayout = VK_NULL_HANDLE;
+  VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+  VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+  VkPipeline pipeline = VK_NULL_HANDLE;
+};
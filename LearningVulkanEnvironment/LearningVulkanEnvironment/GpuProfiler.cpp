@@ -0,0 +1,136 @@
+#include "GpuProfiler.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+bool GpuProfiler::create(VkDevice logicalDevice, VkPhysicalDevice physicalDevice, uint32_t queueFamilyIndex,
+  uint32_t slotCount, uint32_t maxScopesPerSlot)
+{
+  device = logicalDevice;
+  maxScopes = maxScopesPerSlot;
+
+  uint32_t queueFamilyCount = 0;
+  vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+  std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+  vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+
+  // Zero valid bits means the queue doesn't support timestamps at all
+  uint32_t validBits = queueFamilies[queueFamilyIndex].timestampValidBits;
+  if (validBits == 0)
+    return false;
+  timestampMask = validBits >= 64 ? ~0ULL : (1ULL << validBits) - 1;
+
+  // Number of nanoseconds per timestamp tick
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+  timestampPeriod = properties.limits.timestampPeriod;
+
+  poolInfo = {};
+  poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+  poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+  poolInfo.queryCount = maxScopes * 2;
+
+  results.resize(maxScopes * 2);
+  // Enabled from here on, isEnabled() looks at the pools
+  reserveSlots(slotCount);
+  return true;
+}
+
+void GpuProfiler::reserveSlots(uint32_t slotCount)
+{
+  if (poolInfo.queryCount == 0 || slotCount <= queryPools.size())
+    return;
+
+  size_t first = queryPools.size();
+  queryPools.resize(slotCount, VK_NULL_HANDLE);
+  slots.resize(slotCount);
+  for (size_t i = first; i < queryPools.size(); ++i)
+  {
+    if (vkCreateQueryPool(device, &poolInfo, nullptr, &queryPools[i]) != VK_SUCCESS)
+      throw std::runtime_error("failed to create timestamp query pool!");
+    slots[i].scopeNames.reserve(maxScopes);
+  }
+}
+
+void GpuProfiler::destroy()
+{
+  for (auto queryPool : queryPools)
+    vkDestroyQueryPool(device, queryPool, nullptr);
+  queryPools.clear();
+  slots.clear();
+  poolInfo.queryCount = 0;
+}
+
+void GpuProfiler::beginFrame(VkCommandBuffer commandBuffer, uint32_t slot)
+{
+  if (!isEnabled())
+    return;
+
+  // Queries have to be reset before they can be written again
+  vkCmdResetQueryPool(commandBuffer, queryPools[slot], 0, maxScopes * 2);
+  slots[slot].scopeNames.clear();
+  slots[slot].recorded = true;
+}
+
+uint32_t GpuProfiler::beginScope(VkCommandBuffer commandBuffer, uint32_t slot, const char* name)
+{
+  if (!isEnabled())
+    return 0;
+
+  Slot& s = slots[slot];
+  if (s.scopeNames.size() >= maxScopes)
+    throw std::runtime_error("too many GPU profiler scopes in one command buffer!");
+
+  uint32_t scope = static_cast<uint32_t>(s.scopeNames.size());
+  s.scopeNames.push_back(name);
+
+  // Top of pipe: written as soon as the previous commands have started
+  vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPools[slot], scope * 2);
+  return scope;
+}
+
+void GpuProfiler::endScope(VkCommandBuffer commandBuffer, uint32_t slot, uint32_t scope)
+{
+  if (!isEnabled())
+    return;
+
+  // Bottom of pipe: written once everything before it has fully finished
+  vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPools[slot], scope * 2 + 1);
+}
+
+void GpuProfiler::collect(uint32_t slot)
+{
+  if (!isEnabled() || !slots[slot].recorded || slots[slot].scopeNames.empty())
+    return;
+
+  uint32_t queryCount = static_cast<uint32_t>(slots[slot].scopeNames.size()) * 2;
+
+  // No WAIT flag, VK_NOT_READY just means the GPU isn't there yet
+  VkResult result = vkGetQueryPoolResults(device, queryPools[slot], 0, queryCount,
+    queryCount * sizeof(uint64_t), results.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+  if (result != VK_SUCCESS)
+    return;
+
+  for (size_t i = 0; i < slots[slot].scopeNames.size(); ++i)
+  {
+    uint64_t ticks = (results[i * 2 + 1] - results[i * 2]) & timestampMask;
+    double ms = ticks * timestampPeriod / 1000000.0;
+
+    ScopeStats& scope = stats[slots[slot].scopeNames[i]];
+    scope.minMs = scope.samples == 0 ? ms : std::min(scope.minMs, ms);
+    scope.maxMs = scope.samples == 0 ? ms : std::max(scope.maxMs, ms);
+    scope.totalMs += ms;
+    ++scope.samples;
+  }
+}
+
+void GpuProfiler::writeReport(std::ostream& out) const
+{
+  out << "gpu_pass,samples,min_ms,mean_ms,max_ms\n";
+  for (const auto& entry : stats)
+  {
+    const ScopeStats& scope = entry.second;
+    out << entry.first << ',' << scope.samples << ',' << scope.minMs << ','
+      << scope.totalMs / scope.samples << ',' << scope.maxMs << '\n';
+  }
+}
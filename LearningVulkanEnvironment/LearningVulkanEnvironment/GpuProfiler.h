@@ -0,0 +1,76 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/*
+  Measures GPU time of named scopes (usually one per render pass) with
+  timestamp queries. Every recorded command buffer gets its own query pool,
+  a "slot", so results are read back only once the fence guarding that
+  command buffer has been waited on and the read never stalls the CPU.
+
+  Usage per command buffer:
+    beginFrame(cmd, slot)
+    scope = beginScope(cmd, slot, "main pass")
+      ... vkCmdBeginRenderPass / vkCmdEndRenderPass ...
+    endScope(cmd, slot, scope)
+  and after the command buffer has finished executing:
+    collect(slot)
+*/
+class GpuProfiler
+{
+public:
+  // Returns false (and stays disabled) if the queue family can't do timestamps
+  bool create(VkDevice device, VkPhysicalDevice physicalDevice, uint32_t queueFamilyIndex,
+    uint32_t slotCount, uint32_t maxScopesPerSlot);
+  void destroy();
+  // Adds slots when there are more command buffers than before, for example
+  // after the swap chain was recreated with more images. Stats are kept.
+  void reserveSlots(uint32_t slotCount);
+
+  bool isEnabled() const { return !queryPools.empty(); }
+
+  // Must be recorded outside of a render pass before any scope of the slot
+  void beginFrame(VkCommandBuffer commandBuffer, uint32_t slot);
+  // name is kept as a pointer, so it has to stay alive (a string literal)
+  uint32_t beginScope(VkCommandBuffer commandBuffer, uint32_t slot, const char* name);
+  void endScope(VkCommandBuffer commandBuffer, uint32_t slot, uint32_t scope);
+
+  // Reads whatever results of the slot are available without waiting and
+  // folds them into the per scope statistics
+  void collect(uint32_t slot);
+
+  void writeReport(std::ostream& out) const;
+
+private:
+  struct ScopeStats
+  {
+    uint64_t samples = 0;
+    double totalMs = 0.0;
+    double minMs = 0.0;
+    double maxMs = 0.0;
+  };
+
+  struct Slot
+  {
+    // Names of the scopes recorded into this slot, in query order. Plain
+    // pointers so recording a scope never allocates.
+    std::vector<const char*> scopeNames;
+    // Only slots whose command buffer has actually been submitted hold data
+    bool recorded = false;
+  };
+
+  VkDevice device = VK_NULL_HANDLE;
+  std::vector<VkQueryPool> queryPools;
+  std::vector<Slot> slots;
+  std::vector<uint64_t> results;
+  uint32_t maxScopes = 0;
+  VkQueryPoolCreateInfo poolInfo = {};
+  double timestampPeriod = 1.0;
+  uint64_t timestampMask = ~0ULL;
+  std::map<std::string, ScopeStats> stats;
+};
@@ -0,0 +1,111 @@
+#include "InstanceStreams.h"
+
+namespace
+{
+  const VkDeviceSize TRANSFORM_SIZE = 4 * sizeof(float);
+  const VkDeviceSize COLOR_SIZE = sizeof(uint32_t);
+  // Largest nonCoherentAtomSize allowed, keeps the flush of one slot from
+  // rounding into the next
+  const VkDeviceSize SLOT_ALIGNMENT = 256;
+
+  VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+  {
+    return (value + alignment - 1) / alignment * alignment;
+  }
+}
+
+void InstanceStreams::create(VkDevice logicalDevice, GpuAllocator& gpuAllocator, uint32_t instanceCount, uint32_t frameCount)
+{
+  device = logicalDevice;
+  allocator = &gpuAllocator;
+  count = instanceCount;
+
+  colorsStart = alignUp(TRANSFORM_SIZE * count, SLOT_ALIGNMENT);
+  frameStride = alignUp(colorsStart + COLOR_SIZE * count, SLOT_ALIGNMENT);
+
+  createBuffer(frameCount);
+}
+
+void InstanceStreams::destroy()
+{
+  if (buffer != VK_NULL_HANDLE)
+    allocator->destroyBuffer(buffer, memory);
+  buffer = VK_NULL_HANDLE;
+  frames = 0;
+}
+
+void InstanceStreams::reserveFrames(uint32_t frameCount)
+{
+  if (!isEnabled() || frameCount <= frames)
+    return;
+
+  allocator->destroyBuffer(buffer, memory);
+  createBuffer(frameCount);
+}
+
+void InstanceStreams::createBuffer(uint32_t frameCount)
+{
+  frames = frameCount;
+
+  // Host visible blocks are mapped for their whole lifetime by the allocator.
+  // The GPU reads every byte once per frame, so there is no point in copying
+  // it into device local memory first.
+  allocator->createBuffer(frameStride * frames, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, buffer, memory);
+}
+
+float* InstanceStreams::transforms(uint32_t frame)
+{
+  return reinterpret_cast<float*>(static_cast<char*>(memory.mapped) + transformsOffset(frame));
+}
+
+uint32_t* InstanceStreams::colors(uint32_t frame)
+{
+  return reinterpret_cast<uint32_t*>(static_cast<char*>(memory.mapped) + colorsOffset(frame));
+}
+
+void InstanceStreams::flush(uint32_t frame)
+{
+  allocator->flush(memory, transformsOffset(frame), frameStride);
+}
+
+void InstanceStreams::bind(VkCommandBuffer commandBuffer, uint32_t frame) const
+{
+  VkBuffer buffers[] = { buffer, buffer };
+  VkDeviceSize offsets[] = { transformsOffset(frame), colorsOffset(frame) };
+  vkCmdBindVertexBuffers(commandBuffer, INSTANCE_TRANSFORM_BINDING, 2, buffers, offsets);
+}
+
+std::array<VkVertexInputBindingDescription, 2> InstanceStreams::bindingDescriptions()
+{
+  // Both advance once per instance, each over its own packed array
+  std::array<VkVertexInputBindingDescription, 2> bindings = {};
+
+  bindings[0].binding = INSTANCE_TRANSFORM_BINDING;
+  bindings[0].stride = static_cast<uint32_t>(TRANSFORM_SIZE);
+  bindings[0].inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+
+  bindings[1].binding = INSTANCE_COLOR_BINDING;
+  bindings[1].stride = static_cast<uint32_t>(COLOR_SIZE);
+  bindings[1].inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+
+  return bindings;
+}
+
+std::array<VkVertexInputAttributeDescription, 2> InstanceStreams::attributeDescriptions()
+{
+  std::array<VkVertexInputAttributeDescription, 2> attributes = {};
+
+  attributes[0].binding = INSTANCE_TRANSFORM_BINDING;
+  attributes[0].location = 2;
+  attributes[0].format = VK_FORMAT_R32G32B32A32_SFLOAT;
+  attributes[0].offset = 0;
+
+  // Unpacked to a 0-1 vec4 by the vertex fetch
+  attributes[1].binding = INSTANCE_COLOR_BINDING;
+  attributes[1].location = 3;
+  attributes[1].format = VK_FORMAT_R8G8B8A8_UNORM;
+  attributes[1].offset = 0;
+
+  return attributes;
+}
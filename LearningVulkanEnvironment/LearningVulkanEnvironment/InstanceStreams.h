@@ -0,0 +1,68 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <array>
+
+#include "GpuAllocator.h"
+
+// Vertex bindings of the two per instance streams, binding 0 is the mesh
+const uint32_t INSTANCE_TRANSFORM_BINDING = 1;
+const uint32_t INSTANCE_COLOR_BINDING = 2;
+
+/*
+  Per instance data for instanced draws, rewritten by the CPU every frame.
+  Each attribute lives in its own tightly packed array (structure of arrays)
+  and is bound as its own VK_VERTEX_INPUT_RATE_INSTANCE binding, so a pass
+  that only touches transforms streams through transforms and nothing else.
+
+  The buffer is host visible and stays mapped. It holds one region per frame
+  slot, used round robin like a ring, so the CPU writes a slot only after
+  the fence of the frame that last read it has signaled:
+
+    | slot 0: transforms | colors | slot 1: transforms | colors | ...
+*/
+class InstanceStreams
+{
+public:
+  void create(VkDevice device, GpuAllocator& allocator, uint32_t instanceCount, uint32_t frameCount);
+  void destroy();
+
+  // Grows the ring to frameCount slots, only call while the device is idle.
+  // Previous contents are lost.
+  void reserveFrames(uint32_t frameCount);
+
+  bool isEnabled() const { return buffer != VK_NULL_HANDLE; }
+  uint32_t instanceCount() const { return count; }
+
+  // Mapped arrays of the slot to write this frame's data into: offset xy
+  // and scale z per instance, and a packed R8G8B8A8 color per instance
+  float* transforms(uint32_t frame);
+  uint32_t* colors(uint32_t frame);
+  // Call once the slot is written, before the submit that reads it
+  void flush(uint32_t frame);
+
+  // Binds both streams of the slot
+  void bind(VkCommandBuffer commandBuffer, uint32_t frame) const;
+
+  static std::array<VkVertexInputBindingDescription, 2> bindingDescriptions();
+  static std::array<VkVertexInputAttributeDescription, 2> attributeDescriptions();
+
+private:
+  void createBuffer(uint32_t frameCount);
+
+  VkDeviceSize transformsOffset(uint32_t frame) const { return frame * frameStride; }
+  VkDeviceSize colorsOffset(uint32_t frame) const { return frame * frameStride + colorsStart; }
+
+  VkDevice device = VK_NULL_HANDLE;
+  GpuAllocator* allocator = nullptr;
+  uint32_t count = 0;
+  uint32_t frames = 0;
+
+  // Colors start here inside a slot, slots are frameStride apart
+  VkDeviceSize colorsStart = 0;
+  VkDeviceSize frameStride = 0;
+
+  VkBuffer buffer = VK_NULL_HANDLE;
+  GpuAllocation memory;
+};
@@ -0,0 +1,24 @@
+#include "LinearArena.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+void LinearArena::create(size_t capacity)
+{
+  memory.reset(new char[capacity]);
+  size = capacity;
+  offset = 0;
+  peak = 0;
+}
+
+void* LinearArena::allocate(size_t bytes, size_t alignment)
+{
+  // alignment is a power of two, new[] memory is aligned for any type
+  size_t start = (offset + alignment - 1) & ~(alignment - 1);
+  if (start + bytes > size)
+    throw std::runtime_error("frame scratch arena is full!");
+
+  offset = start + bytes;
+  peak = std::max(peak, offset);
+  return memory.get() + start;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <type_traits>
+
+/*
+  Bump allocator for scratch memory that only lives for one frame. The
+  memory is allocated once up front, allocate() just moves an offset and
+  reset() releases everything at once, so the hot path never touches the
+  heap. Nothing is ever destroyed, hence only trivially destructible types.
+*/
+class LinearArena
+{
+public:
+  void create(size_t capacity);
+
+  template <typename T>
+  T* allocate(size_t count)
+  {
+    static_assert(std::is_trivially_destructible<T>::value, "arena memory is never destroyed");
+    return static_cast<T*>(allocate(sizeof(T) * count, alignof(T)));
+  }
+  // Throws when the arena is full rather than falling back to the heap
+  void* allocate(size_t bytes, size_t alignment);
+
+  void reset() { offset = 0; }
+
+  size_t usedBytes() const { return offset; }
+  size_t capacity() const { return size; }
+  // Most bytes that were ever in use at once, to size the arena from
+  size_t peakBytes() const { return peak; }
+
+private:
+  std::unique_ptr<char[]> memory;
+  size_t size = 0;
+  size_t offset = 0;
+  size_t peak = 0;
+};
@@ -0,0 +1,171 @@
+#include "Mesh.h"
+
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+
+namespace
+{
+  const char MESH_MAGIC[4] = { 'L', 'V', 'M', 'S' };
+  const uint32_t MESH_VERSION = 1;
+
+  // Followed by the vertices and then the indices, 4 byte aligned throughout
+  struct MeshHeader
+  {
+    char magic[4];
+    uint32_t version;
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint32_t indexSize;
+  };
+}
+
+VkVertexInputBindingDescription Vertex::bindingDescription()
+{
+  // One binding, every vertex is read as a whole struct
+  VkVertexInputBindingDescription binding = {};
+  binding.binding = 0;
+  binding.stride = sizeof(Vertex);
+  binding.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+  return binding;
+}
+
+std::array<VkVertexInputAttributeDescription, 2> Vertex::attributeDescriptions()
+{
+  std::array<VkVertexInputAttributeDescription, 2> attributes = {};
+
+  attributes[0].binding = 0;
+  attributes[0].location = 0;
+  attributes[0].format = VK_FORMAT_R32G32_SFLOAT;
+  attributes[0].offset = offsetof(Vertex, position);
+
+  attributes[1].binding = 0;
+  attributes[1].location = 1;
+  attributes[1].format = VK_FORMAT_R32G32B32_SFLOAT;
+  attributes[1].offset = offsetof(Vertex, color);
+
+  return attributes;
+}
+
+MeshData makeTriangleMesh()
+{
+  // Same triangle shader.vert used to hardcode
+  MeshData mesh;
+  mesh.vertices =
+  {
+    { { 0.0f, -0.5f }, { 1.0f, 0.0f, 0.0f } },
+    { { 0.5f, 0.5f }, { 0.0f, 1.0f, 0.0f } },
+    { { -0.5f, 0.5f }, { 0.0f, 0.0f, 1.0f } }
+  };
+  mesh.indices = { 0, 1, 2 };
+  return mesh;
+}
+
+MeshView meshAssetView(const Asset& asset)
+{
+  MeshHeader header;
+  if (asset.size() < sizeof(header))
+    throw std::runtime_error("mesh asset is too small!");
+  std::memcpy(&header, asset.data(), sizeof(header));
+
+  uint64_t vertexBytes = static_cast<uint64_t>(header.vertexCount) * sizeof(Vertex);
+  uint64_t indexBytes = static_cast<uint64_t>(header.indexCount) * header.indexSize;
+  if (std::memcmp(header.magic, MESH_MAGIC, sizeof(MESH_MAGIC)) != 0 || header.version != MESH_VERSION ||
+    (header.indexSize != 2 && header.indexSize != 4) ||
+    sizeof(header) + vertexBytes + indexBytes > asset.size())
+    throw std::runtime_error("invalid mesh asset!");
+
+  // Every section is 4 byte aligned within the asset, and assets start aligned
+  if (reinterpret_cast<uintptr_t>(asset.data()) % alignof(Vertex) != 0)
+    throw std::runtime_error("mesh asset isn't aligned!");
+
+  MeshView view;
+  view.vertices = reinterpret_cast<const Vertex*>(asset.data() + sizeof(header));
+  view.vertexCount = header.vertexCount;
+  view.indices = asset.data() + sizeof(header) + vertexBytes;
+  view.indexCount = header.indexCount;
+  view.indexType = header.indexSize == 2 ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+  return view;
+}
+
+Asset makeMeshAsset(const MeshData& data)
+{
+  MeshHeader header = {};
+  std::memcpy(header.magic, MESH_MAGIC, sizeof(MESH_MAGIC));
+  header.version = MESH_VERSION;
+  header.vertexCount = static_cast<uint32_t>(data.vertices.size());
+  header.indexCount = static_cast<uint32_t>(data.indices.size());
+  header.indexSize = data.vertices.size() <= 0xFFFF ? 2 : 4;
+
+  size_t vertexBytes = sizeof(Vertex) * data.vertices.size();
+  size_t indexBytes = header.indexSize * data.indices.size();
+  std::vector<uint32_t> words((sizeof(header) + vertexBytes + indexBytes + 3) / 4);
+  char* out = reinterpret_cast<char*>(words.data());
+
+  std::memcpy(out, &header, sizeof(header));
+  std::memcpy(out + sizeof(header), data.vertices.data(), vertexBytes);
+  if (header.indexSize == 2)
+  {
+    std::vector<uint16_t> shortIndices(data.indices.begin(), data.indices.end());
+    std::memcpy(out + sizeof(header) + vertexBytes, shortIndices.data(), indexBytes);
+  }
+  else
+    std::memcpy(out + sizeof(header) + vertexBytes, data.indices.data(), indexBytes);
+
+  return Asset::fromWords(std::move(words));
+}
+
+Mesh createMesh(StagingUploader& uploader, uint32_t graphicsFamily, const MeshData& data)
+{
+  // Half the index bandwidth whenever every vertex can be addressed in 16 bits
+  std::vector<uint16_t> shortIndices;
+  MeshView view;
+  view.vertices = data.vertices.data();
+  view.vertexCount = static_cast<uint32_t>(data.vertices.size());
+  view.indices = data.indices.data();
+  view.indexCount = static_cast<uint32_t>(data.indices.size());
+  if (data.vertices.size() <= 0xFFFF)
+  {
+    shortIndices.assign(data.indices.begin(), data.indices.end());
+    view.indices = shortIndices.data();
+    view.indexType = VK_INDEX_TYPE_UINT16;
+  }
+  return createMesh(uploader, graphicsFamily, view);
+}
+
+Mesh createMesh(StagingUploader& uploader, uint32_t graphicsFamily, const MeshView& view)
+{
+  Mesh mesh;
+  mesh.indexCount = view.indexCount;
+  mesh.indexType = view.indexType;
+
+  VkDeviceSize vertexSize = sizeof(Vertex) * static_cast<VkDeviceSize>(view.vertexCount);
+  uploader.createBuffer(vertexSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, graphicsFamily,
+    mesh.vertexBuffer, mesh.vertexMemory);
+
+  VkDeviceSize indexSize = (view.indexType == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeof(uint32_t)) *
+    static_cast<VkDeviceSize>(view.indexCount);
+  uploader.createBuffer(indexSize, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, graphicsFamily,
+    mesh.indexBuffer, mesh.indexMemory);
+
+  // The only copy on the way, from wherever the view points into staging
+  if (!uploader.uploadBuffer(mesh.vertexBuffer, 0, view.vertices, vertexSize) ||
+    !uploader.uploadBuffer(mesh.indexBuffer, 0, view.indices, indexSize))
+    throw std::runtime_error("not enough staging space left for mesh upload!");
+
+  return mesh;
+}
+
+void destroyMesh(GpuAllocator& allocator, Mesh& mesh)
+{
+  allocator.destroyBuffer(mesh.vertexBuffer, mesh.vertexMemory);
+  allocator.destroyBuffer(mesh.indexBuffer, mesh.indexMemory);
+  mesh = Mesh();
+}
+
+void bindMesh(VkCommandBuffer commandBuffer, const Mesh& mesh)
+{
+  VkDeviceSize offset = 0;
+  vkCmdBindVertexBuffers(commandBuffer, 0, 1, &mesh.vertexBuffer, &offset);
+  vkCmdBindIndexBuffer(commandBuffer, mesh.indexBuffer, 0, mesh.indexType);
+}
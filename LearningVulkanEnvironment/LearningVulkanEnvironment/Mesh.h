@@ -0,0 +1,70 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <array>
+#include <vector>
+
+#include "AssetIO.h"
+#include "GpuAllocator.h"
+#include "StagingUploader.h"
+
+// Interleaved vertex, matches the inputs of shader.vert
+struct Vertex
+{
+  float position[2];
+  float color[3];
+
+  static VkVertexInputBindingDescription bindingDescription();
+  static std::array<VkVertexInputAttributeDescription, 2> attributeDescriptions();
+};
+
+// Mesh on the CPU side, indices are narrowed to 16 bits on upload if they fit
+struct MeshData
+{
+  std::vector<Vertex> vertices;
+  std::vector<uint32_t> indices;
+};
+
+/*
+  A mesh ready to upload, pointing at memory someone else owns, usually a
+  mapped .mesh asset. Indices are already in their final width so the
+  upload copies them straight out of the file.
+
+  .mesh layout: "LVMS" | version | vertex count | index count | index size
+  (2 or 4) | vertices | indices
+*/
+struct MeshView
+{
+  const Vertex* vertices = nullptr;
+  uint32_t vertexCount = 0;
+  const void* indices = nullptr;
+  uint32_t indexCount = 0;
+  VkIndexType indexType = VK_INDEX_TYPE_UINT32;
+};
+
+// Mesh in device local memory
+struct Mesh
+{
+  VkBuffer vertexBuffer = VK_NULL_HANDLE;
+  GpuAllocation vertexMemory;
+  VkBuffer indexBuffer = VK_NULL_HANDLE;
+  GpuAllocation indexMemory;
+  uint32_t indexCount = 0;
+  VkIndexType indexType = VK_INDEX_TYPE_UINT32;
+};
+
+MeshData makeTriangleMesh();
+
+// Throws if the asset isn't a valid .mesh, the view points into the asset
+MeshView meshAssetView(const Asset& asset);
+// The .mesh form of data, with indices narrowed to 16 bits if they fit
+Asset makeMeshAsset(const MeshData& data);
+
+// The buffers can be used by graphicsFamily once the uploader's semaphore
+// of this frame has been waited on
+Mesh createMesh(StagingUploader& uploader, uint32_t graphicsFamily, const MeshData& data);
+Mesh createMesh(StagingUploader& uploader, uint32_t graphicsFamily, const MeshView& view);
+void destroyMesh(GpuAllocator& allocator, Mesh& mesh);
+
+void bindMesh(VkCommandBuffer commandBuffer, const Mesh& mesh);
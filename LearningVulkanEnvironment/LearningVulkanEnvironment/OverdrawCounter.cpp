@@ -0,0 +1,114 @@
+#include "OverdrawCounter.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+void OverdrawCounter::create(VkDevice logicalDevice, uint32_t slotCount, uint32_t maxScopesPerSlot)
+{
+  device = logicalDevice;
+  maxScopes = maxScopesPerSlot;
+
+  // One value per query, only fragment shader invocations are counted
+  poolInfo = {};
+  poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+  poolInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+  poolInfo.queryCount = maxScopes;
+  poolInfo.pipelineStatistics = VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+
+  results.resize(maxScopes);
+  reserveSlots(slotCount);
+}
+
+void OverdrawCounter::reserveSlots(uint32_t slotCount)
+{
+  if (poolInfo.queryCount == 0 || slotCount <= queryPools.size())
+    return;
+
+  size_t first = queryPools.size();
+  queryPools.resize(slotCount, VK_NULL_HANDLE);
+  slots.resize(slotCount);
+  for (size_t i = first; i < queryPools.size(); ++i)
+  {
+    if (vkCreateQueryPool(device, &poolInfo, nullptr, &queryPools[i]) != VK_SUCCESS)
+      throw std::runtime_error("failed to create pipeline statistics query pool!");
+    slots[i].scopeNames.reserve(maxScopes);
+  }
+}
+
+void OverdrawCounter::destroy()
+{
+  for (auto queryPool : queryPools)
+    vkDestroyQueryPool(device, queryPool, nullptr);
+  queryPools.clear();
+  slots.clear();
+  poolInfo.queryCount = 0;
+}
+
+void OverdrawCounter::beginFrame(VkCommandBuffer commandBuffer, uint32_t slot)
+{
+  if (!isEnabled())
+    return;
+
+  vkCmdResetQueryPool(commandBuffer, queryPools[slot], 0, maxScopes);
+  slots[slot].scopeNames.clear();
+  slots[slot].recorded = true;
+}
+
+uint32_t OverdrawCounter::beginScope(VkCommandBuffer commandBuffer, uint32_t slot, const char* name)
+{
+  if (!isEnabled())
+    return 0;
+
+  Slot& s = slots[slot];
+  if (s.scopeNames.size() >= maxScopes)
+    throw std::runtime_error("too many overdraw scopes in one command buffer!");
+
+  uint32_t scope = static_cast<uint32_t>(s.scopeNames.size());
+  s.scopeNames.push_back(name);
+  vkCmdBeginQuery(commandBuffer, queryPools[slot], scope, 0);
+  return scope;
+}
+
+void OverdrawCounter::endScope(VkCommandBuffer commandBuffer, uint32_t slot, uint32_t scope)
+{
+  if (!isEnabled())
+    return;
+
+  vkCmdEndQuery(commandBuffer, queryPools[slot], scope);
+}
+
+void OverdrawCounter::collect(uint32_t slot)
+{
+  if (!isEnabled() || !slots[slot].recorded || slots[slot].scopeNames.empty())
+    return;
+
+  uint32_t queryCount = static_cast<uint32_t>(slots[slot].scopeNames.size());
+
+  // No WAIT flag, VK_NOT_READY just means the GPU isn't there yet
+  VkResult result = vkGetQueryPoolResults(device, queryPools[slot], 0, queryCount,
+    queryCount * sizeof(uint64_t), results.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+  if (result != VK_SUCCESS)
+    return;
+
+  for (size_t i = 0; i < queryCount; ++i)
+  {
+    uint64_t invocations = results[i];
+    ScopeStats& scope = stats[slots[slot].scopeNames[i]];
+    scope.minInvocations = scope.samples == 0 ? invocations : std::min(scope.minInvocations, invocations);
+    scope.maxInvocations = scope.samples == 0 ? invocations : std::max(scope.maxInvocations, invocations);
+    scope.totalInvocations += invocations;
+    ++scope.samples;
+  }
+}
+
+void OverdrawCounter::writeReport(std::ostream& out, uint64_t pixels) const
+{
+  out << "overdraw_pass,samples,min_fragments,mean_fragments,max_fragments,pixels,overdraw\n";
+  for (const auto& entry : stats)
+  {
+    const ScopeStats& scope = entry.second;
+    double mean = static_cast<double>(scope.totalInvocations) / scope.samples;
+    out << entry.first << ',' << scope.samples << ',' << scope.minInvocations << ',' << mean << ','
+      << scope.maxInvocations << ',' << pixels << ',' << mean / static_cast<double>(pixels) << '\n';
+  }
+}
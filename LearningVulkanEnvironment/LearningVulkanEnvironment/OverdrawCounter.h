@@ -0,0 +1,67 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/*
+  Counts fragment shader invocations of named scopes (usually one per
+  subpass) with pipeline statistics queries. Divided by the pixels drawn
+  to, that is the overdraw: how often the average pixel was shaded. Works
+  like GpuProfiler, one query pool per recorded command buffer ("slot")
+  read back without waiting once the command buffer finished.
+
+  Needs the pipelineStatisticsQuery feature. A scope has to begin and end
+  within one subpass, and can't contain secondary command buffers unless
+  they inherit the query, which the app doesn't do.
+*/
+class OverdrawCounter
+{
+public:
+  void create(VkDevice device, uint32_t slotCount, uint32_t maxScopesPerSlot);
+  void destroy();
+  // Adds slots when there are more command buffers than before, stats are
+  // kept
+  void reserveSlots(uint32_t slotCount);
+
+  bool isEnabled() const { return !queryPools.empty(); }
+
+  // Must be recorded outside of a render pass before any scope of the slot
+  void beginFrame(VkCommandBuffer commandBuffer, uint32_t slot);
+  // name is kept as a pointer, so it has to stay alive (a string literal)
+  uint32_t beginScope(VkCommandBuffer commandBuffer, uint32_t slot, const char* name);
+  void endScope(VkCommandBuffer commandBuffer, uint32_t slot, uint32_t scope);
+
+  // Reads whatever results of the slot are available without waiting
+  void collect(uint32_t slot);
+
+  // pixels is the size of the render area, the same for every scope
+  void writeReport(std::ostream& out, uint64_t pixels) const;
+
+private:
+  struct ScopeStats
+  {
+    uint64_t samples = 0;
+    uint64_t totalInvocations = 0;
+    uint64_t minInvocations = 0;
+    uint64_t maxInvocations = 0;
+  };
+
+  struct Slot
+  {
+    std::vector<const char*> scopeNames;
+    bool recorded = false;
+  };
+
+  VkDevice device = VK_NULL_HANDLE;
+  std::vector<VkQueryPool> queryPools;
+  std::vector<Slot> slots;
+  std::vector<uint64_t> results;
+  uint32_t maxScopes = 0;
+  VkQueryPoolCreateInfo poolInfo = {};
+  std::map<std::string, ScopeStats> stats;
+};
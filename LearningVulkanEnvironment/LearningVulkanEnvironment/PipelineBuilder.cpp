@@ -0,0 +1,249 @@
+#include "PipelineBuilder.h"
+
+#include <chrono>
+#include <stdexcept>
+
+namespace
+{
+  // Points info at spec, or returns null when there is nothing to specialize
+  const VkSpecializationInfo* specializationInfo(const ShaderSpecialization& spec, VkSpecializationInfo& info)
+  {
+    if (spec.empty())
+      return nullptr;
+
+    info.mapEntryCount = static_cast<uint32_t>(spec.entries.size());
+    info.pMapEntries = spec.entries.data();
+    info.dataSize = spec.data.size() * sizeof(uint32_t);
+    info.pData = spec.data.data();
+    return &info;
+  }
+}
+
+void ShaderSpecialization::set(uint32_t constantId, uint32_t value)
+{
+  for (const auto& entry : entries)
+  {
+    if (entry.constantID == constantId)
+    {
+      data[entry.offset / sizeof(uint32_t)] = value;
+      return;
+    }
+  }
+
+  VkSpecializationMapEntry entry = {};
+  entry.constantID = constantId;
+  entry.offset = static_cast<uint32_t>(data.size() * sizeof(uint32_t));
+  entry.size = sizeof(uint32_t);
+  entries.push_back(entry);
+  data.push_back(value);
+}
+
+VkShaderModule createShaderModule(VkDevice device, const Asset& code)
+{
+  VkShaderModuleCreateInfo createInfo = {};
+  createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+  createInfo.codeSize = code.size();
+  // Throws instead of handing the driver misaligned words
+  createInfo.pCode = code.words();
+
+  VkShaderModule shaderModule;
+  if (vkCreateShaderModule(device, &createInfo, nullptr, &shaderModule) != VK_SUCCESS)
+    throw std::runtime_error("failed to create shader module!");
+
+  return shaderModule;
+}
+
+VkPipeline createComputePipeline(VkDevice device, VkPipelineCache pipelineCache,
+  const Asset& shaderCode, VkPipelineLayout layout)
+{
+  VkShaderModule shaderModule = createShaderModule(device, shaderCode);
+
+  VkComputePipelineCreateInfo pipelineInfo = {};
+  pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+  pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+  pipelineInfo.stage.module = shaderModule;
+  pipelineInfo.stage.pName = "main";
+  pipelineInfo.layout = layout;
+
+  VkPipeline pipeline;
+  VkResult result = vkCreateComputePipelines(device, pipelineCache, 1, &pipelineInfo, nullptr, &pipeline);
+  vkDestroyShaderModule(device, shaderModule, nullptr);
+
+  if (result != VK_SUCCESS)
+    throw std::runtime_error("failed to create compute pipeline!");
+
+  return pipeline;
+}
+
+PipelineBuilder::PipelineBuilder(VkDevice logicalDevice, VkPipelineCache cache, ShaderCompiler& compiler, unsigned threadCount)
+  : device(logicalDevice)
+  , pipelineCache(cache)
+  , shaderCompiler(compiler)
+  , workers(threadCount)
+{
+}
+
+std::future<VkPipeline> PipelineBuilder::build(const GraphicsPipelineDesc& desc)
+{
+  // The description is copied into the task, the caller's copy can go away
+  return workers.submit([this, desc]() { return buildGraphicsPipeline(desc); });
+}
+
+std::vector<std::future<VkPipeline>> PipelineBuilder::buildAll(const std::vector<GraphicsPipelineDesc>& descs)
+{
+  std::vector<std::future<VkPipeline>> pipelines;
+  pipelines.reserve(descs.size());
+  for (const auto& desc : descs)
+    pipelines.push_back(build(desc));
+  return pipelines;
+}
+
+std::vector<PipelineBuildRecord> PipelineBuilder::buildRecords() const
+{
+  std::lock_guard<std::mutex> lock(recordsMutex);
+  return records;
+}
+
+VkPipeline PipelineBuilder::buildGraphicsPipeline(const GraphicsPipelineDesc& desc)
+{
+  auto start = std::chrono::steady_clock::now();
+
+  // Compiled here on the worker if the sources changed since the last run
+  bool hasFragmentShader = !desc.fragmentShaderPath.empty();
+  auto vertShaderCode = shaderCompiler.load(desc.vertexShaderPath, desc.shaderDefines);
+
+  VkShaderModule vertShaderModule;
+  VkShaderModule fragShaderModule = VK_NULL_HANDLE;
+
+  vertShaderModule = createShaderModule(device, vertShaderCode);
+  if (hasFragmentShader)
+  {
+    auto fragShaderCode = shaderCompiler.load(desc.fragmentShaderPath, desc.shaderDefines);
+    fragShaderModule = createShaderModule(device, fragShaderCode);
+  }
+
+  VkPipelineShaderStageCreateInfo vertShaderStageInfo = {};
+  vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
+  vertShaderStageInfo.module = vertShaderModule;
+  vertShaderStageInfo.pName = "main";
+  VkSpecializationInfo vertSpecialization = {};
+  vertShaderStageInfo.pSpecializationInfo = specializationInfo(desc.vertexSpecialization, vertSpecialization);
+
+  VkPipelineShaderStageCreateInfo fragShaderStageInfo = {};
+  fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+  fragShaderStageInfo.module = fragShaderModule;
+  fragShaderStageInfo.pName = "main";
+  VkSpecializationInfo fragSpecialization = {};
+  fragShaderStageInfo.pSpecializationInfo = specializationInfo(desc.fragmentSpecialization, fragSpecialization);
+
+  VkPipelineShaderStageCreateInfo shaderStages[] = { vertShaderStageInfo, fragShaderStageInfo };
+
+  VkPipelineVertexInputStateCreateInfo vertexInputInfo = {};
+  vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+  vertexInputInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(desc.vertexBindings.size());
+  vertexInputInfo.pVertexBindingDescriptions = desc.vertexBindings.data();
+  vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(desc.vertexAttributes.size());
+  vertexInputInfo.pVertexAttributeDescriptions = desc.vertexAttributes.data();
+
+  VkPipelineInputAssemblyStateCreateInfo inputAssembly = {};
+  inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+  inputAssembly.topology = desc.topology;
+  inputAssembly.primitiveRestartEnable = VK_FALSE;
+
+  // Only the counts matter, the rectangles are set while recording
+  VkPipelineViewportStateCreateInfo viewportState = {};
+  viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+  viewportState.viewportCount = 1;
+  viewportState.pViewports = nullptr;
+  viewportState.scissorCount = 1;
+  viewportState.pScissors = nullptr;
+
+  VkDynamicState dynamicStates[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+
+  VkPipelineDynamicStateCreateInfo dynamicState = {};
+  dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+  dynamicState.dynamicStateCount = 2;
+  dynamicState.pDynamicStates = dynamicStates;
+
+  VkPipelineRasterizationStateCreateInfo rasterizer = {};
+  rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+  rasterizer.depthClampEnable = VK_FALSE;
+  rasterizer.rasterizerDiscardEnable = VK_FALSE;
+  rasterizer.polygonMode = desc.polygonMode;
+  rasterizer.lineWidth = 1.0f;
+  rasterizer.cullMode = desc.cullMode;
+  rasterizer.frontFace = desc.frontFace;
+  rasterizer.depthBiasEnable = VK_FALSE;
+  rasterizer.depthBiasConstantFactor = 0.0f;
+  rasterizer.depthBiasClamp = 0.0f;
+  rasterizer.depthBiasSlopeFactor = 0.0f;
+
+  VkPipelineMultisampleStateCreateInfo multisampling = {};
+  multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+  multisampling.sampleShadingEnable = VK_FALSE;
+  multisampling.rasterizationSamples = desc.samples;
+  multisampling.minSampleShading = 1.0f;
+  multisampling.pSampleMask = nullptr;
+  multisampling.alphaToCoverageEnable = VK_FALSE;
+  multisampling.alphaToOneEnable = VK_FALSE;
+
+  VkPipelineColorBlendAttachmentState colorBlendAttachment = {};
+  colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+  colorBlendAttachment.blendEnable = VK_FALSE;
+
+  // Every color attachment gets the same state
+  std::vector<VkPipelineColorBlendAttachmentState> colorBlendAttachments(desc.colorAttachmentCount, colorBlendAttachment);
+
+  VkPipelineColorBlendStateCreateInfo colorBlending = {};
+  colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+  colorBlending.logicOpEnable = VK_FALSE;
+  colorBlending.attachmentCount = desc.colorAttachmentCount;
+  colorBlending.pAttachments = colorBlendAttachments.data();
+
+  VkPipelineDepthStencilStateCreateInfo depthStencil = {};
+  depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+  depthStencil.depthTestEnable = desc.depthTest ? VK_TRUE : VK_FALSE;
+  depthStencil.depthWriteEnable = desc.depthWrite ? VK_TRUE : VK_FALSE;
+  depthStencil.depthCompareOp = desc.depthCompareOp;
+  depthStencil.depthBoundsTestEnable = VK_FALSE;
+  depthStencil.stencilTestEnable = VK_FALSE;
+
+  VkGraphicsPipelineCreateInfo pipelineInfo = {};
+  pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+  pipelineInfo.stageCount = hasFragmentShader ? 2 : 1;
+  pipelineInfo.pStages = shaderStages;
+  pipelineInfo.pVertexInputState = &vertexInputInfo;
+  pipelineInfo.pInputAssemblyState = &inputAssembly;
+  pipelineInfo.pViewportState = &viewportState;
+  pipelineInfo.pRasterizationState = &rasterizer;
+  pipelineInfo.pMultisampleState = &multisampling;
+  pipelineInfo.pDepthStencilState = desc.depthTest || desc.depthWrite ? &depthStencil : nullptr;
+  pipelineInfo.pColorBlendState = &colorBlending;
+  pipelineInfo.pDynamicState = &dynamicState;
+  pipelineInfo.layout = desc.layout;
+  pipelineInfo.renderPass = desc.renderPass;
+  pipelineInfo.subpass = desc.subpass;
+  pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+
+  VkPipeline pipeline;
+  VkResult result = vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineInfo, nullptr, &pipeline);
+
+  // Modules are only needed while the pipeline is being compiled
+  vkDestroyShaderModule(device, vertShaderModule, nullptr);
+  if (hasFragmentShader)
+    vkDestroyShaderModule(device, fragShaderModule, nullptr);
+
+  if (result != VK_SUCCESS)
+    throw std::runtime_error("failed to create graphics pipeline!");
+
+  // Includes loading the shaders, which is small next to the driver compile
+  // unless they had to be compiled from GLSL
+  std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+  std::lock_guard<std::mutex> lock(recordsMutex);
+  records.push_back({ desc.name, elapsed.count() });
+
+  return pipeline;
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <future>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "ShaderCompiler.h"
+#include "ThreadPool.h"
+
+/*
+  Specialization constant values for one shader stage. They are baked in
+  when the pipeline is compiled, so the driver treats them like literals:
+  branches on them are removed and loops over them can be unrolled. One
+  SPIR-V module gives several variants without any runtime cost. Only 32-bit
+  constants (int, uint, float bits and bool) are supported.
+*/
+struct ShaderSpecialization
+{
+  std::vector<VkSpecializationMapEntry> entries;
+  std::vector<uint32_t> data;
+
+  // Overrides the default value of constant_id in the shader
+  void set(uint32_t constantId, uint32_t value);
+  bool empty() const { return entries.empty(); }
+};
+
+/*
+  Everything that can differ between two graphics pipelines we build. The
+  fixed function state that never changes is filled in by the builder. The
+  layout and render pass have to outlive the build. Viewport and scissor are
+  dynamic state, so the same pipeline keeps working when the window resizes
+  and command buffers have to set them with vkCmdSetViewport/vkCmdSetScissor.
+*/
+struct GraphicsPipelineDesc
+{
+  // Only used to report build times
+  std::string name = "graphics";
+
+  // SPIR-V files or GLSL sources, see ShaderCompiler. Without a fragment
+  // shader the pipeline only writes depth.
+  std::string vertexShaderPath;
+  std::string fragmentShaderPath;
+  // Preprocessor defines for GLSL sources of both stages, NAME or NAME=VALUE
+  std::vector<std::string> shaderDefines;
+  ShaderSpecialization vertexSpecialization;
+  ShaderSpecialization fragmentSpecialization;
+
+  VkPipelineLayout layout = VK_NULL_HANDLE;
+  VkRenderPass renderPass = VK_NULL_HANDLE;
+  uint32_t subpass = 0;
+
+  // Empty for shaders that make up their own vertices
+  std::vector<VkVertexInputBindingDescription> vertexBindings;
+  std::vector<VkVertexInputAttributeDescription> vertexAttributes;
+
+  VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+  VkPolygonMode polygonMode = VK_POLYGON_MODE_FILL;
+  VkCullModeFlags cullMode = VK_CULL_MODE_BACK_BIT;
+  VkFrontFace frontFace = VK_FRONT_FACE_CLOCKWISE;
+  VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+  // Of the subpass, none for a depth only pass
+  uint32_t colorAttachmentCount = 1;
+
+  // Pipelines of a subpass with a depth attachment need depthTest, the
+  // depth state is left out without it or depthWrite
+  bool depthTest = false;
+  bool depthWrite = false;
+  VkCompareOp depthCompareOp = VK_COMPARE_OP_LESS;
+};
+
+// How long the driver took to compile one pipeline
+struct PipelineBuildRecord
+{
+  std::string name;
+  double milliseconds;
+};
+
+// Straight from the asset's memory, which is 4 byte aligned whether it was
+// mapped or compiled
+VkShaderModule createShaderModule(VkDevice device, const Asset& code);
+// Compute pipelines are few and quick to build, they are created in place
+VkPipeline createComputePipeline(VkDevice device, VkPipelineCache pipelineCache,
+  const Asset& shaderCode, VkPipelineLayout layout);
+
+/*
+  Compiles pipelines on a pool of worker threads. Driver compilation from
+  SPIR-V is the slow part of startup and vkCreateGraphicsPipelines may be
+  called from several threads at once, sharing one VkPipelineCache (caches
+  are internally synchronized). The caller gets futures back and can keep
+  creating other objects until it actually needs the pipelines.
+*/
+class PipelineBuilder
+{
+public:
+  // threadCount of 0 uses one thread per core. Shaders are loaded through
+  // shaderCompiler, which has to outlive the builder.
+  PipelineBuilder(VkDevice device, VkPipelineCache pipelineCache, ShaderCompiler& shaderCompiler, unsigned threadCount = 0);
+
+  std::future<VkPipeline> build(const GraphicsPipelineDesc& desc);
+  std::vector<std::future<VkPipeline>> buildAll(const std::vector<GraphicsPipelineDesc>& descs);
+
+  size_t threadCount() const { return workers.size(); }
+
+  // Every pipeline built so far in the order they finished, each one is a
+  // variant as far as the driver is concerned
+  std::vector<PipelineBuildRecord> buildRecords() const;
+
+private:
+  VkPipeline buildGraphicsPipeline(const GraphicsPipelineDesc& desc);
+
+  VkDevice device;
+  VkPipelineCache pipelineCache;
+  ShaderCompiler& shaderCompiler;
+
+  mutable std::mutex recordsMutex;
+  std::vector<PipelineBuildRecord> records;
+
+  // Declared last so the workers are joined before anything they use goes away
+  ThreadPool workers;
+};
@@ -0,0 +1,127 @@
+#include "PipelineCache.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#endif
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+#include <vector>
+
+namespace
+{
+  // Layout of VK_PIPELINE_CACHE_HEADER_VERSION_ONE, every field little endian
+  struct CacheHeader
+  {
+    uint32_t headerSize;
+    uint32_t headerVersion;
+    uint32_t vendorID;
+    uint32_t deviceID;
+    uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+  };
+
+  bool replaceFile(const std::string& from, const std::string& to)
+  {
+#ifdef _WIN32
+    // rename() refuses to overwrite an existing file on Windows
+    return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+    return std::rename(from.c_str(), to.c_str()) == 0;
+#endif
+  }
+}
+
+void PipelineCache::create(VkDevice logicalDevice, VkPhysicalDevice physicalDevice, const std::string& path)
+{
+  device = logicalDevice;
+  filename = path;
+  warm = false;
+
+  std::string data;
+  if (!filename.empty())
+  {
+    std::ifstream file(filename, std::ios::binary);
+    if (file.is_open())
+      data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+  }
+
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+  if (!data.empty() && !headerMatches(data, properties))
+  {
+    std::cerr << "pipeline cache " << filename << " is from another device or driver, ignoring it" << std::endl;
+    data.clear();
+  }
+
+  VkPipelineCacheCreateInfo cacheInfo = {};
+  cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+  cacheInfo.initialDataSize = data.size();
+  cacheInfo.pInitialData = data.empty() ? nullptr : data.data();
+
+  if (vkCreatePipelineCache(device, &cacheInfo, nullptr, &cache) != VK_SUCCESS)
+    throw std::runtime_error("failed to create pipeline cache!");
+
+  warm = !data.empty();
+}
+
+bool PipelineCache::headerMatches(const std::string& data, const VkPhysicalDeviceProperties& properties) const
+{
+  CacheHeader header;
+  if (data.size() < sizeof(header))
+    return false;
+  std::memcpy(&header, data.data(), sizeof(header));
+
+  return header.headerSize >= sizeof(header)
+    && header.headerSize <= data.size()
+    && header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+    && header.vendorID == properties.vendorID
+    && header.deviceID == properties.deviceID
+    && std::memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+void PipelineCache::save()
+{
+  if (cache == VK_NULL_HANDLE || filename.empty())
+    return;
+
+  size_t size = 0;
+  if (vkGetPipelineCacheData(device, cache, &size, nullptr) != VK_SUCCESS || size == 0)
+    return;
+
+  std::vector<char> data(size);
+  if (vkGetPipelineCacheData(device, cache, &size, data.data()) != VK_SUCCESS)
+    return;
+
+  // Losing the cache only costs startup time, so failures are reported but
+  // never fatal
+  std::string tempName = filename + ".tmp";
+  {
+    std::ofstream file(tempName, std::ios::binary | std::ios::trunc);
+    if (!file.is_open() || !file.write(data.data(), size))
+    {
+      std::cerr << "failed to write pipeline cache " << tempName << std::endl;
+      return;
+    }
+  }
+
+  if (!replaceFile(tempName, filename))
+  {
+    std::cerr << "failed to replace pipeline cache " << filename << std::endl;
+    std::remove(tempName.c_str());
+  }
+}
+
+void PipelineCache::destroy()
+{
+  if (cache != VK_NULL_HANDLE)
+    vkDestroyPipelineCache(device, cache, nullptr);
+  cache = VK_NULL_HANDLE;
+}
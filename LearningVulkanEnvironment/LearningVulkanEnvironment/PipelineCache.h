@@ -0,0 +1,35 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <string>
+
+/*
+  VkPipelineCache that survives between runs. The blob written by the driver
+  starts with a header identifying the vendor, device and driver build
+  (pipelineCacheUUID). Data from a different GPU or driver is useless and
+  may even be rejected, so the header is checked against the current
+  physical device before it is handed to vkCreatePipelineCache.
+*/
+class PipelineCache
+{
+public:
+  // An empty path gives an in-memory cache that is never written out
+  void create(VkDevice device, VkPhysicalDevice physicalDevice, const std::string& path);
+  // Writes the cache to a temporary file and renames it over the old one so
+  // a crash mid-write never leaves a truncated cache behind
+  void save();
+  void destroy();
+
+  VkPipelineCache handle() const { return cache; }
+  // True if valid data from a previous run was loaded
+  bool isWarm() const { return warm; }
+
+private:
+  bool headerMatches(const std::string& data, const VkPhysicalDeviceProperties& properties) const;
+
+  VkDevice device = VK_NULL_HANDLE;
+  VkPipelineCache cache = VK_NULL_HANDLE;
+  std::string filename;
+  bool warm = false;
+};
@@ -0,0 +1,965 @@
+#include "RenderGraph.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace
+{
+  // Stage, access and layout of each access type, in the order of AccessType
+  const VkPipelineStageFlags ACCESS_STAGES[] =
+  {
+    VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+    VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+    VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+    VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+    VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT
+  };
+  // Loads read the attachment too, resolves never load
+  const VkAccessFlags ACCESS_MASKS[] =
+  {
+    VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+    VK_ACCESS_INPUT_ATTACHMENT_READ_BIT,
+    VK_ACCESS_SHADER_READ_BIT,
+    VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+    VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT
+  };
+  const VkImageLayout ACCESS_LAYOUTS[] =
+  {
+    VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+    VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+    VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+    VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+    VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL
+  };
+  const char* ACCESS_NAMES[] = { "color", "input", "texture", "resolve", "depth" };
+
+  bool isDepthFormat(VkFormat format)
+  {
+    return format == VK_FORMAT_D16_UNORM || format == VK_FORMAT_D32_SFLOAT || format == VK_FORMAT_X8_D24_UNORM_PACK32 ||
+      format == VK_FORMAT_D24_UNORM_S8_UINT || format == VK_FORMAT_D32_SFLOAT_S8_UINT;
+  }
+
+  VkImageAspectFlags aspectMask(VkFormat format)
+  {
+    if (format == VK_FORMAT_D24_UNORM_S8_UINT || format == VK_FORMAT_D32_SFLOAT_S8_UINT)
+      return VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+    return isDepthFormat(format) ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
+  }
+
+  /*
+    Adds a hazard to the dependency between the two subpasses, creating it
+    if there is none yet. Every hazard between the same pair shares one
+    dependency, by region only if all of them are.
+  */
+  void addDependency(std::vector<VkSubpassDependency>& dependencies, uint32_t srcSubpass, uint32_t dstSubpass,
+    VkPipelineStageFlags srcStages, VkAccessFlags srcAccessMask, VkPipelineStageFlags dstStages,
+    VkAccessFlags dstAccessMask, bool byRegion)
+  {
+    VkDependencyFlags flags = byRegion ? VK_DEPENDENCY_BY_REGION_BIT : 0;
+    for (auto& dependency : dependencies)
+    {
+      if (dependency.srcSubpass == srcSubpass && dependency.dstSubpass == dstSubpass)
+      {
+        dependency.srcStageMask |= srcStages;
+        dependency.srcAccessMask |= srcAccessMask;
+        dependency.dstStageMask |= dstStages;
+        dependency.dstAccessMask |= dstAccessMask;
+        dependency.dependencyFlags &= flags;
+        return;
+      }
+    }
+
+    VkSubpassDependency dependency = {};
+    dependency.srcSubpass = srcSubpass;
+    dependency.dstSubpass = dstSubpass;
+    dependency.srcStageMask = srcStages;
+    dependency.srcAccessMask = srcAccessMask;
+    dependency.dstStageMask = dstStages;
+    dependency.dstAccessMask = dstAccessMask;
+    dependency.dependencyFlags = flags;
+    dependencies.push_back(dependency);
+  }
+
+  const char* layoutName(VkImageLayout layout)
+  {
+    switch (layout)
+    {
+    case VK_IMAGE_LAYOUT_UNDEFINED: return "undefined";
+    case VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL: return "color_attachment";
+    case VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL: return "depth_attachment";
+    case VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL: return "shader_read_only";
+    case VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL: return "transfer_src";
+    case VK_IMAGE_LAYOUT_PRESENT_SRC_KHR: return "present_src";
+    default: return "other";
+    }
+  }
+
+  const char* loadOpName(VkAttachmentLoadOp op)
+  {
+    return op == VK_ATTACHMENT_LOAD_OP_LOAD ? "load" : op == VK_ATTACHMENT_LOAD_OP_CLEAR ? "clear" : "dont_care";
+  }
+
+  std::string subpassName(uint32_t subpass)
+  {
+    return subpass == VK_SUBPASS_EXTERNAL ? std::string("external") : std::to_string(subpass);
+  }
+
+  // Per sample, for the traffic estimate. Formats the app doesn't render to
+  // count as 4 bytes.
+  uint32_t formatBytes(VkFormat format)
+  {
+    switch (format)
+    {
+    case VK_FORMAT_D16_UNORM: return 2;
+    case VK_FORMAT_R16G16B16A16_SFLOAT:
+    case VK_FORMAT_R32G32_SFLOAT:
+    case VK_FORMAT_D32_SFLOAT_S8_UINT: return 8;
+    case VK_FORMAT_R32G32B32A32_SFLOAT: return 16;
+    default: return 4;
+    }
+  }
+}
+
+void RenderGraph::create(VkDevice logicalDevice, GpuAllocator& gpuAllocator)
+{
+  device = logicalDevice;
+  allocator = &gpuAllocator;
+}
+
+void RenderGraph::destroy()
+{
+  destroyResources();
+  for (auto& compiled : renderPasses)
+    vkDestroyRenderPass(device, compiled.handle, nullptr);
+  renderPasses.clear();
+  memorySlots.clear();
+  passes.clear();
+  resources.clear();
+}
+
+GraphResource RenderGraph::importImage(const std::string& name, VkFormat format, VkImageLayout finalLayout)
+{
+  Resource resource;
+  resource.name = name;
+  resource.format = format;
+  resource.samples = VK_SAMPLE_COUNT_1_BIT;
+  resource.imported = true;
+  resource.finalLayout = finalLayout;
+  resources.push_back(resource);
+  return static_cast<GraphResource>(resources.size() - 1);
+}
+
+GraphResource RenderGraph::createImage(const std::string& name, VkFormat format, VkSampleCountFlagBits samples)
+{
+  Resource resource;
+  resource.name = name;
+  resource.format = format;
+  resource.samples = samples;
+  resource.imported = false;
+  resource.finalLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  resources.push_back(resource);
+  return static_cast<GraphResource>(resources.size() - 1);
+}
+
+GraphPass RenderGraph::addPass(const std::string& name, VkSubpassContents contents)
+{
+  Pass pass;
+  pass.name = name;
+  pass.contents = contents;
+  passes.push_back(pass);
+  return static_cast<GraphPass>(passes.size() - 1);
+}
+
+void RenderGraph::writeColor(GraphPass pass, GraphResource image, const VkClearColorValue* clear)
+{
+  Access access = {};
+  access.image = image;
+  access.type = AccessType::ColorWrite;
+  access.clear = clear != nullptr;
+  if (clear)
+    access.clearValue.color = *clear;
+  passes[pass].accesses.push_back(access);
+}
+
+void RenderGraph::writeDepth(GraphPass pass, GraphResource image, const VkClearDepthStencilValue* clear)
+{
+  Access access = {};
+  access.image = image;
+  access.type = AccessType::DepthWrite;
+  access.clear = clear != nullptr;
+  if (clear)
+    access.clearValue.depthStencil = *clear;
+  passes[pass].accesses.push_back(access);
+}
+
+void RenderGraph::resolve(GraphPass pass, GraphResource multisampled, GraphResource image)
+{
+  Access access = {};
+  access.image = image;
+  access.type = AccessType::ResolveWrite;
+  access.resolveSource = multisampled;
+  passes[pass].accesses.push_back(access);
+}
+
+void RenderGraph::readAttachment(GraphPass pass, GraphResource image)
+{
+  Access access = {};
+  access.image = image;
+  access.type = AccessType::AttachmentRead;
+  passes[pass].accesses.push_back(access);
+}
+
+void RenderGraph::readTexture(GraphPass pass, GraphResource image)
+{
+  Access access = {};
+  access.image = image;
+  access.type = AccessType::TextureRead;
+  passes[pass].accesses.push_back(access);
+}
+
+const RenderGraph::Access* RenderGraph::findAccess(GraphPass pass, GraphResource image) const
+{
+  for (const auto& access : passes[pass].accesses)
+  {
+    if (access.image == image)
+      return &access;
+  }
+  return nullptr;
+}
+
+void RenderGraph::compile(bool mergePasses)
+{
+  // Reads need an earlier write, the contents of every image are undefined
+  // when the frame starts
+  std::vector<bool> written(resources.size(), false);
+  for (GraphPass p = 0; p < passes.size(); ++p)
+  {
+    const Pass& pass = passes[p];
+    for (const auto& access : pass.accesses)
+    {
+      for (const auto& other : pass.accesses)
+      {
+        if (&other != &access && other.image == access.image)
+          throw std::runtime_error("render graph pass " + pass.name + " uses " + resources[access.image].name + " twice!");
+      }
+      if (!access.isWrite() && !written[access.image])
+        throw std::runtime_error("render graph pass " + pass.name + " reads " + resources[access.image].name +
+          " before anything wrote it!");
+
+      // Reading samples would need subpassInputMS and sampler2DMS
+      const Resource& resource = resources[access.image];
+      if (!access.isWrite() && resource.samples != VK_SAMPLE_COUNT_1_BIT)
+        throw std::runtime_error("render graph pass " + pass.name + " reads multisampled " + resource.name +
+          ", resolve it first!");
+      if ((access.type == AccessType::ColorWrite || access.type == AccessType::DepthWrite) && resource.samples != samples(p))
+        throw std::runtime_error("render graph pass " + pass.name + " mixes sample counts!");
+      if (access.type == AccessType::ResolveWrite)
+      {
+        const Access* source = findAccess(p, access.resolveSource);
+        if (!source || source->type != AccessType::ColorWrite ||
+          resources[access.resolveSource].samples == VK_SAMPLE_COUNT_1_BIT || resource.samples != VK_SAMPLE_COUNT_1_BIT)
+          throw std::runtime_error("render graph pass " + pass.name + " resolves " + resource.name +
+            " from something other than a multisampled color attachment of its own!");
+      }
+    }
+    if (std::count_if(pass.accesses.begin(), pass.accesses.end(),
+      [](const Access& access) { return access.type == AccessType::DepthWrite; }) > 1)
+      throw std::runtime_error("render graph pass " + pass.name + " has more than one depth attachment!");
+    for (const auto& access : pass.accesses)
+      written[access.image] = written[access.image] || access.isWrite();
+  }
+
+  cullPasses();
+
+  auto groups = groupPasses(mergePasses);
+  renderPasses.resize(groups.size());
+  hazardCount = 0;
+  for (uint32_t i = 0; i < groups.size(); ++i)
+  {
+    renderPasses[i].passes = groups[i];
+    for (uint32_t subpassIndex = 0; subpassIndex < groups[i].size(); ++subpassIndex)
+    {
+      Pass& pass = passes[groups[i][subpassIndex]];
+      pass.renderPass = i;
+      pass.subpass = subpassIndex;
+      for (const auto& access : pass.accesses)
+      {
+        Resource& resource = resources[access.image];
+        resource.firstUse = std::min(resource.firstUse, i);
+        resource.lastUse = std::max(resource.lastUse, i);
+        static const VkImageUsageFlags USAGES[] =
+        {
+          VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
+          VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT,
+          VK_IMAGE_USAGE_SAMPLED_BIT,
+          VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
+          VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT
+        };
+        resource.usage |= USAGES[static_cast<int>(access.type)];
+      }
+    }
+  }
+
+  std::vector<ImageState> states(resources.size());
+  for (uint32_t i = 0; i < renderPasses.size(); ++i)
+    compileRenderPass(i, states);
+
+  for (auto& resource : resources)
+  {
+    // Used in one render pass only: tilers never have to write it out
+    resource.transient = !resource.imported && resource.firstUse == resource.lastUse;
+    if (resource.transient)
+      resource.usage |= VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+  }
+  assignMemory();
+}
+
+void RenderGraph::cullPasses()
+{
+  // Walks back from the imported images: a pass is needed if a needed pass
+  // or an imported image takes what it writes. A cleared write ends the
+  // chain, and so does a resolve: the passes before it don't matter to the
+  // image anymore.
+  std::vector<bool> needed(resources.size(), false);
+  for (size_t i = passes.size(); i-- > 0;)
+  {
+    Pass& pass = passes[i];
+    pass.culled = true;
+    for (const auto& access : pass.accesses)
+    {
+      if (access.isWrite() && (resources[access.image].imported || needed[access.image]))
+        pass.culled = false;
+    }
+    if (pass.culled)
+      continue;
+
+    for (const auto& access : pass.accesses)
+    {
+      if (access.isWrite())
+        needed[access.image] = !access.replacesContents();
+    }
+    for (const auto& access : pass.accesses)
+    {
+      if (!access.isWrite())
+        needed[access.image] = true;
+    }
+  }
+}
+
+std::vector<std::vector<GraphPass>> RenderGraph::groupPasses(bool mergePasses) const
+{
+  // A pass joins the render pass of the one before unless it samples an
+  // attachment of it, or uses an image the render pass samples as an
+  // attachment. Both would need the image in two layouts at once.
+  std::vector<std::vector<GraphPass>> groups;
+  std::vector<bool> attachment(resources.size(), false);
+  std::vector<bool> sampled(resources.size(), false);
+  for (GraphPass i = 0; i < passes.size(); ++i)
+  {
+    const Pass& pass = passes[i];
+    if (pass.culled)
+      continue;
+
+    bool split = groups.empty() || !mergePasses;
+    for (const auto& access : pass.accesses)
+    {
+      if (access.type == AccessType::TextureRead ? attachment[access.image] : sampled[access.image])
+        split = true;
+    }
+    if (split)
+    {
+      groups.push_back(std::vector<GraphPass>());
+      attachment.assign(resources.size(), false);
+      sampled.assign(resources.size(), false);
+    }
+
+    groups.back().push_back(i);
+    for (const auto& access : pass.accesses)
+    {
+      if (access.type == AccessType::TextureRead)
+        sampled[access.image] = true;
+      else
+        attachment[access.image] = true;
+    }
+  }
+  return groups;
+}
+
+const RenderGraph::Access* RenderGraph::nextUse(GraphResource image, uint32_t afterRenderPass) const
+{
+  for (uint32_t i = afterRenderPass + 1; i < renderPasses.size(); ++i)
+  {
+    for (GraphPass pass : renderPasses[i].passes)
+    {
+      if (const Access* access = findAccess(pass, image))
+        return access;
+    }
+  }
+  return nullptr;
+}
+
+void RenderGraph::compileRenderPass(uint32_t index, std::vector<ImageState>& states)
+{
+  CompiledRenderPass& compiled = renderPasses[index];
+  const std::vector<GraphPass>& group = compiled.passes;
+  uint32_t subpassCount = static_cast<uint32_t>(group.size());
+
+  // Attachments in the order of their first use
+  for (GraphPass pass : group)
+  {
+    for (const auto& access : passes[pass].accesses)
+    {
+      if (access.type != AccessType::TextureRead &&
+        std::find(compiled.attachments.begin(), compiled.attachments.end(), access.image) == compiled.attachments.end())
+        compiled.attachments.push_back(access.image);
+    }
+  }
+
+  uint32_t attachmentCount = static_cast<uint32_t>(compiled.attachments.size());
+  compiled.descriptions.resize(attachmentCount);
+  compiled.clearValues.resize(attachmentCount);
+  std::vector<std::vector<VkAttachmentReference>> colorRefs(subpassCount);
+  std::vector<std::vector<VkAttachmentReference>> inputRefs(subpassCount);
+  std::vector<std::vector<VkAttachmentReference>> resolveRefs(subpassCount);
+  std::vector<VkAttachmentReference> depthRefs(subpassCount, VkAttachmentReference{ VK_ATTACHMENT_UNUSED, VK_IMAGE_LAYOUT_UNDEFINED });
+  std::vector<std::vector<uint32_t>> preserved(subpassCount);
+
+  for (uint32_t a = 0; a < attachmentCount; ++a)
+  {
+    GraphResource image = compiled.attachments[a];
+    const Resource& resource = resources[image];
+    ImageState& state = states[image];
+
+    // Subpass of every use, for references, preserves and dependencies
+    std::vector<uint32_t> users;
+    for (uint32_t s = 0; s < subpassCount; ++s)
+    {
+      if (const Access* access = findAccess(group[s], image))
+      {
+        users.push_back(s);
+        // Resolve references have to line up with the color ones, they
+        // are added once those are all known
+        VkAttachmentReference reference = { a, ACCESS_LAYOUTS[static_cast<int>(access->type)] };
+        if (access->type == AccessType::ColorWrite)
+          colorRefs[s].push_back(reference);
+        else if (access->type == AccessType::AttachmentRead)
+          inputRefs[s].push_back(reference);
+        else if (access->type == AccessType::DepthWrite)
+          depthRefs[s] = reference;
+      }
+    }
+    for (uint32_t s = users.front() + 1; s < users.back(); ++s)
+    {
+      if (std::find(users.begin(), users.end(), s) == users.end())
+        preserved[s].push_back(a);
+    }
+
+    const Access& first = *findAccess(group[users.front()], image);
+    const Access& last = *findAccess(group[users.back()], image);
+    const Access* next = nextUse(image, index);
+    int firstType = static_cast<int>(first.type);
+    int lastType = static_cast<int>(last.type);
+
+    VkAttachmentDescription& description = compiled.descriptions[a];
+    description.format = resource.format;
+    description.samples = resource.samples;
+    description.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    description.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    if (first.clear)
+    {
+      description.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+      compiled.clearValues[a] = first.clearValue;
+    }
+    else
+      description.loadOp = state.written && !first.replacesContents() ? VK_ATTACHMENT_LOAD_OP_LOAD :
+        VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    // Old contents that aren't loaded don't need a transition either
+    description.initialLayout = description.loadOp == VK_ATTACHMENT_LOAD_OP_LOAD ? state.layout : VK_IMAGE_LAYOUT_UNDEFINED;
+
+    // Stored for whoever uses the contents next, nothing is if that one
+    // clears or resolves over them anyway. Multisampled images are
+    // normally resolved in the same subpass and never stored.
+    bool contentsUsed = next && !next->replacesContents();
+    description.storeOp = contentsUsed || resource.imported ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+
+    // The hazard with the previous use goes into the first subpass using
+    // it. Before any use this frame that is the previous frame, or the
+    // presentation engine for the swap chain, and for images sharing
+    // memory the ones that used it before, depth attachments among them.
+    VkPipelineStageFlags srcStages = state.stages;
+    VkAccessFlags srcAccessMask = state.access;
+    if (srcStages == 0)
+    {
+      srcStages = resource.imported ?
+        static_cast<VkPipelineStageFlags>(VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT) :
+        static_cast<VkPipelineStageFlags>(VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+          VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | ACCESS_STAGES[static_cast<int>(AccessType::DepthWrite)]);
+      srcAccessMask = resource.imported ? 0 : VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    }
+    addDependency(compiled.dependencies, VK_SUBPASS_EXTERNAL, users.front(), srcStages, srcAccessMask,
+      ACCESS_STAGES[firstType], ACCESS_MASKS[firstType], false);
+    ++hazardCount;
+
+    // Between the subpasses: every write waits for the accesses since the
+    // previous write, every read for the previous write
+    int lastWriter = -1;
+    const Access* lastWrite = nullptr;
+    std::vector<uint32_t> readers;
+    for (uint32_t s : users)
+    {
+      const Access* access = findAccess(group[s], image);
+      int type = static_cast<int>(access->type);
+      if (access->isWrite())
+      {
+        if (lastWrite && readers.empty())
+        {
+          addDependency(compiled.dependencies, lastWriter, s, ACCESS_STAGES[static_cast<int>(lastWrite->type)],
+            lastWrite->writeAccess(), ACCESS_STAGES[type], ACCESS_MASKS[type], true);
+          ++hazardCount;
+        }
+        for (uint32_t reader : readers)
+        {
+          addDependency(compiled.dependencies, reader, s, ACCESS_STAGES[static_cast<int>(AccessType::AttachmentRead)], 0,
+            ACCESS_STAGES[type], ACCESS_MASKS[type], true);
+          ++hazardCount;
+        }
+        lastWriter = static_cast<int>(s);
+        lastWrite = access;
+        readers.clear();
+      }
+      else
+      {
+        if (lastWrite)
+        {
+          addDependency(compiled.dependencies, lastWriter, s, ACCESS_STAGES[static_cast<int>(lastWrite->type)],
+            lastWrite->writeAccess(), ACCESS_STAGES[type], ACCESS_MASKS[type], true);
+          ++hazardCount;
+        }
+        readers.push_back(s);
+      }
+    }
+
+    // Sampling needs the transition at the end of this render pass, with a
+    // dependency of its own. Every other next use transitions in its own
+    // render pass, from the layout of the last use here.
+    if (next && next->type == AccessType::TextureRead)
+    {
+      description.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+      int textureRead = static_cast<int>(AccessType::TextureRead);
+      addDependency(compiled.dependencies, users.back(), VK_SUBPASS_EXTERNAL, ACCESS_STAGES[lastType], last.writeAccess(),
+        ACCESS_STAGES[textureRead], ACCESS_MASKS[textureRead], false);
+      ++hazardCount;
+      state.stages = ACCESS_STAGES[textureRead];
+      state.access = 0;
+    }
+    else if (!next && resource.imported)
+    {
+      description.finalLayout = resource.finalLayout;
+      // Presenting waits on a semaphore, which is enough. Reading the image
+      // back is a transfer in a later submit.
+      if (resource.finalLayout == VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL)
+      {
+        addDependency(compiled.dependencies, users.back(), VK_SUBPASS_EXTERNAL, ACCESS_STAGES[lastType],
+          last.writeAccess(), VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT, false);
+        ++hazardCount;
+      }
+    }
+    else
+    {
+      description.finalLayout = ACCESS_LAYOUTS[lastType];
+      state.stages = ACCESS_STAGES[lastType];
+      state.access = last.writeAccess();
+    }
+    state.layout = description.finalLayout;
+    state.written = state.written || lastWriter >= 0;
+  }
+
+  // A resolve target for every color attachment, unused where there is
+  // nothing to resolve
+  for (uint32_t s = 0; s < subpassCount; ++s)
+  {
+    for (const auto& access : passes[group[s]].accesses)
+    {
+      if (access.type != AccessType::ResolveWrite)
+        continue;
+      if (resolveRefs[s].empty())
+        resolveRefs[s].assign(colorRefs[s].size(), VkAttachmentReference{ VK_ATTACHMENT_UNUSED, VK_IMAGE_LAYOUT_UNDEFINED });
+
+      auto attachmentIndex = [&compiled](GraphResource image)
+      {
+        return static_cast<uint32_t>(std::find(compiled.attachments.begin(), compiled.attachments.end(), image) -
+          compiled.attachments.begin());
+      };
+      uint32_t source = attachmentIndex(access.resolveSource);
+      for (size_t c = 0; c < colorRefs[s].size(); ++c)
+      {
+        if (colorRefs[s][c].attachment == source)
+          resolveRefs[s][c] = { attachmentIndex(access.image), ACCESS_LAYOUTS[static_cast<int>(AccessType::ResolveWrite)] };
+      }
+    }
+  }
+
+  std::vector<VkSubpassDescription> subpasses(subpassCount);
+  for (uint32_t s = 0; s < subpassCount; ++s)
+  {
+    VkSubpassDescription& subpass = subpasses[s];
+    subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpass.colorAttachmentCount = static_cast<uint32_t>(colorRefs[s].size());
+    subpass.pColorAttachments = colorRefs[s].data();
+    subpass.pResolveAttachments = resolveRefs[s].empty() ? nullptr : resolveRefs[s].data();
+    subpass.pDepthStencilAttachment = depthRefs[s].attachment != VK_ATTACHMENT_UNUSED ? &depthRefs[s] : nullptr;
+    subpass.inputAttachmentCount = static_cast<uint32_t>(inputRefs[s].size());
+    subpass.pInputAttachments = inputRefs[s].data();
+    subpass.preserveAttachmentCount = static_cast<uint32_t>(preserved[s].size());
+    subpass.pPreserveAttachments = preserved[s].data();
+  }
+
+  VkRenderPassCreateInfo renderPassInfo = {};
+  renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+  renderPassInfo.attachmentCount = attachmentCount;
+  renderPassInfo.pAttachments = compiled.descriptions.data();
+  renderPassInfo.subpassCount = subpassCount;
+  renderPassInfo.pSubpasses = subpasses.data();
+  renderPassInfo.dependencyCount = static_cast<uint32_t>(compiled.dependencies.size());
+  renderPassInfo.pDependencies = compiled.dependencies.data();
+
+  if (vkCreateRenderPass(device, &renderPassInfo, nullptr, &compiled.handle) != VK_SUCCESS)
+    throw std::runtime_error("failed to create render pass!");
+}
+
+void RenderGraph::assignMemory()
+{
+  // Greedy interval coloring by first use: an image goes into the first
+  // slot whose images are all done by the time it is first used. Lazily
+  // allocated memory only takes transient images, so they stay apart.
+  std::vector<GraphResource> order;
+  for (GraphResource i = 0; i < resources.size(); ++i)
+  {
+    if (!resources[i].imported && resources[i].firstUse <= resources[i].lastUse)
+      order.push_back(i);
+  }
+  std::stable_sort(order.begin(), order.end(), [this](GraphResource a, GraphResource b)
+  {
+    return resources[a].firstUse < resources[b].firstUse;
+  });
+
+  memorySlots.clear();
+  for (GraphResource image : order)
+  {
+    Resource& resource = resources[image];
+    for (uint32_t i = 0; i < memorySlots.size() && resource.memorySlot == UINT32_MAX; ++i)
+    {
+      const MemorySlot& slot = memorySlots[i];
+      if (slot.lazy == resource.transient && resources[slot.images.back()].lastUse < resource.firstUse)
+        resource.memorySlot = i;
+    }
+    if (resource.memorySlot == UINT32_MAX)
+    {
+      resource.memorySlot = static_cast<uint32_t>(memorySlots.size());
+      memorySlots.push_back(MemorySlot());
+      memorySlots.back().lazy = resource.transient;
+    }
+    memorySlots[resource.memorySlot].images.push_back(image);
+  }
+}
+
+void RenderGraph::setImportedViews(GraphResource image, const std::vector<VkImageView>& views)
+{
+  resources[image].importedViews = views;
+}
+
+void RenderGraph::createResources(VkExtent2D imageExtent)
+{
+  extent = imageExtent;
+
+  instanceCount = 0;
+  for (const auto& resource : resources)
+  {
+    if (!resource.imported || resource.firstUse > resource.lastUse)
+      continue;
+    if (instanceCount != 0 && resource.importedViews.size() != instanceCount)
+      throw std::runtime_error("every imported render graph image needs the same number of views!");
+    instanceCount = static_cast<uint32_t>(resource.importedViews.size());
+  }
+  instanceCount = std::max(instanceCount, 1u);
+
+  // The images of a slot share one allocation large enough for any of them
+  for (auto& slot : memorySlots)
+  {
+    VkMemoryRequirements slotRequirements = {};
+    slotRequirements.memoryTypeBits = ~0u;
+    for (GraphResource image : slot.images)
+    {
+      Resource& resource = resources[image];
+
+      VkImageCreateInfo imageInfo = {};
+      imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+      imageInfo.imageType = VK_IMAGE_TYPE_2D;
+      imageInfo.format = resource.format;
+      imageInfo.extent.width = extent.width;
+      imageInfo.extent.height = extent.height;
+      imageInfo.extent.depth = 1;
+      imageInfo.mipLevels = 1;
+      imageInfo.arrayLayers = 1;
+      imageInfo.samples = resource.samples;
+      imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+      imageInfo.usage = resource.usage;
+      imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+      imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+      if (vkCreateImage(device, &imageInfo, nullptr, &resource.image) != VK_SUCCESS)
+        throw std::runtime_error("failed to create render graph image!");
+
+      VkMemoryRequirements requirements;
+      vkGetImageMemoryRequirements(device, resource.image, &requirements);
+      resource.size = requirements.size;
+      slotRequirements.size = std::max(slotRequirements.size, requirements.size);
+      slotRequirements.alignment = std::max(slotRequirements.alignment, requirements.alignment);
+      slotRequirements.memoryTypeBits &= requirements.memoryTypeBits;
+    }
+    if (slotRequirements.memoryTypeBits == 0)
+      throw std::runtime_error("render graph images sharing memory have no memory type in common!");
+
+    // Lazily allocated memory is only committed if a tiler has to spill
+    slot.memory = allocator->allocate(slotRequirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+      slot.lazy ? VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT : 0, GpuResourceKind::Optimal);
+
+    for (GraphResource image : slot.images)
+    {
+      Resource& resource = resources[image];
+      vkBindImageMemory(device, resource.image, slot.memory.memory, slot.memory.offset);
+
+      VkImageViewCreateInfo viewInfo = {};
+      viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+      viewInfo.image = resource.image;
+      viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+      viewInfo.format = resource.format;
+      viewInfo.subresourceRange.aspectMask = aspectMask(resource.format);
+      viewInfo.subresourceRange.baseMipLevel = 0;
+      viewInfo.subresourceRange.levelCount = 1;
+      viewInfo.subresourceRange.baseArrayLayer = 0;
+      viewInfo.subresourceRange.layerCount = 1;
+
+      if (vkCreateImageView(device, &viewInfo, nullptr, &resource.view) != VK_SUCCESS)
+        throw std::runtime_error("failed to create render graph image view!");
+    }
+  }
+
+  for (auto& compiled : renderPasses)
+  {
+    compiled.framebuffers.resize(instanceCount);
+    std::vector<VkImageView> attachments(compiled.attachments.size());
+    for (uint32_t instance = 0; instance < instanceCount; ++instance)
+    {
+      for (size_t a = 0; a < attachments.size(); ++a)
+      {
+        const Resource& resource = resources[compiled.attachments[a]];
+        attachments[a] = resource.imported ? resource.importedViews[instance] : resource.view;
+      }
+
+      VkFramebufferCreateInfo framebufferInfo = {};
+      framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+      framebufferInfo.renderPass = compiled.handle;
+      framebufferInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+      framebufferInfo.pAttachments = attachments.data();
+      framebufferInfo.width = extent.width;
+      framebufferInfo.height = extent.height;
+      framebufferInfo.layers = 1;
+
+      if (vkCreateFramebuffer(device, &framebufferInfo, nullptr, &compiled.framebuffers[instance]) != VK_SUCCESS)
+        throw std::runtime_error("failed to create framebuffer!");
+    }
+  }
+}
+
+void RenderGraph::destroyResources()
+{
+  for (auto& compiled : renderPasses)
+  {
+    for (auto framebuffer : compiled.framebuffers)
+      vkDestroyFramebuffer(device, framebuffer, nullptr);
+    compiled.framebuffers.clear();
+  }
+
+  for (auto& resource : resources)
+  {
+    if (resource.view != VK_NULL_HANDLE)
+      vkDestroyImageView(device, resource.view, nullptr);
+    if (resource.image != VK_NULL_HANDLE)
+      vkDestroyImage(device, resource.image, nullptr);
+    resource.view = VK_NULL_HANDLE;
+    resource.image = VK_NULL_HANDLE;
+  }
+
+  for (auto& slot : memorySlots)
+  {
+    if (slot.memory.memory != VK_NULL_HANDLE)
+      allocator->free(slot.memory);
+    slot.memory = GpuAllocation();
+  }
+}
+
+VkRenderPass RenderGraph::renderPass(GraphPass pass) const
+{
+  return passes[pass].culled ? VK_NULL_HANDLE : renderPasses[passes[pass].renderPass].handle;
+}
+
+uint32_t RenderGraph::subpass(GraphPass pass) const
+{
+  return passes[pass].subpass;
+}
+
+VkSampleCountFlagBits RenderGraph::samples(GraphPass pass) const
+{
+  for (const auto& access : passes[pass].accesses)
+  {
+    if (access.type == AccessType::ColorWrite || access.type == AccessType::DepthWrite)
+      return resources[access.image].samples;
+  }
+  return VK_SAMPLE_COUNT_1_BIT;
+}
+
+VkImageView RenderGraph::view(GraphResource image) const
+{
+  return resources[image].view;
+}
+
+GraphPassContext RenderGraph::beginSubpass(VkCommandBuffer commandBuffer, uint32_t renderPassIndex,
+  uint32_t subpassIndex, uint32_t instance) const
+{
+  const CompiledRenderPass& compiled = renderPasses[renderPassIndex];
+  GraphPass pass = compiled.passes[subpassIndex];
+
+  if (subpassIndex == 0)
+  {
+    VkRenderPassBeginInfo renderPassInfo = {};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    renderPassInfo.renderPass = compiled.handle;
+    renderPassInfo.framebuffer = compiled.framebuffers[instance];
+    renderPassInfo.renderArea.offset = { 0, 0 };
+    renderPassInfo.renderArea.extent = extent;
+    renderPassInfo.clearValueCount = static_cast<uint32_t>(compiled.clearValues.size());
+    renderPassInfo.pClearValues = compiled.clearValues.data();
+
+    vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, passes[pass].contents);
+  }
+  else
+    vkCmdNextSubpass(commandBuffer, passes[pass].contents);
+
+  GraphPassContext context;
+  context.pass = pass;
+  context.commandBuffer = commandBuffer;
+  context.renderPass = compiled.handle;
+  context.subpass = subpassIndex;
+  context.framebuffer = compiled.framebuffers[instance];
+  return context;
+}
+
+void RenderGraph::dump(std::ostream& out) const
+{
+  uint32_t dependencyCount = 0;
+  for (const auto& compiled : renderPasses)
+    dependencyCount += static_cast<uint32_t>(compiled.dependencies.size());
+
+  out << "render graph: " << passes.size() << " passes, " << renderPasses.size() << " render passes, "
+    << hazardCount << " hazards in " << dependencyCount << " dependencies\n";
+  for (const auto& pass : passes)
+  {
+    if (pass.culled)
+      out << "  culled pass " << pass.name << '\n';
+  }
+
+  for (size_t i = 0; i < renderPasses.size(); ++i)
+  {
+    const CompiledRenderPass& compiled = renderPasses[i];
+    out << "render pass " << i << '\n';
+    for (size_t a = 0; a < compiled.attachments.size(); ++a)
+    {
+      const Resource& resource = resources[compiled.attachments[a]];
+      const VkAttachmentDescription& description = compiled.descriptions[a];
+      out << "  attachment " << a << ' ' << resource.name << " format " << description.format << ' ';
+      if (description.samples != VK_SAMPLE_COUNT_1_BIT)
+        out << description.samples << "x ";
+      out
+        << loadOpName(description.loadOp) << '/'
+        << (description.storeOp == VK_ATTACHMENT_STORE_OP_STORE ? "store" : "dont_care") << ' '
+        << layoutName(description.initialLayout) << " -> " << layoutName(description.finalLayout)
+        << (resource.transient ? " transient" : "") << '\n';
+    }
+    for (size_t s = 0; s < compiled.passes.size(); ++s)
+    {
+      const Pass& pass = passes[compiled.passes[s]];
+      out << "  subpass " << s << ' ' << pass.name
+        << (pass.contents == VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS ? " (secondary)" : "") << ':';
+      for (const auto& access : pass.accesses)
+      {
+        out << ' ' << ACCESS_NAMES[static_cast<int>(access.type)] << ' ';
+        if (access.type == AccessType::ResolveWrite)
+          out << resources[access.resolveSource].name << " -> ";
+        out << resources[access.image].name;
+      }
+      out << '\n';
+    }
+    for (const auto& dependency : compiled.dependencies)
+    {
+      out << "  dependency " << subpassName(dependency.srcSubpass) << " -> " << subpassName(dependency.dstSubpass)
+        << std::hex << " stages 0x" << dependency.srcStageMask << " -> 0x" << dependency.dstStageMask
+        << " access 0x" << dependency.srcAccessMask << " -> 0x" << dependency.dstAccessMask << std::dec
+        << ((dependency.dependencyFlags & VK_DEPENDENCY_BY_REGION_BIT) ? " by region" : "") << '\n';
+    }
+  }
+
+  // Sizes are only known once createResources() ran
+  VkDeviceSize separateBytes = 0;
+  VkDeviceSize aliasedBytes = 0;
+  VkDeviceSize lazyBytes = 0;
+  for (const auto& slot : memorySlots)
+  {
+    VkDeviceSize slotBytes = 0;
+    out << "memory slot" << (slot.lazy ? " (lazily allocated)" : "") << ':';
+    for (GraphResource image : slot.images)
+    {
+      const Resource& resource = resources[image];
+      out << ' ' << resource.name << " [" << resource.firstUse << ',' << resource.lastUse << ']';
+      separateBytes += resource.size;
+      slotBytes = std::max(slotBytes, resource.size);
+    }
+    out << '\n';
+    (slot.lazy ? lazyBytes : aliasedBytes) += slotBytes;
+  }
+  out << "image memory: " << separateBytes << " bytes without aliasing, " << aliasedBytes
+    << " bytes aliased plus " << lazyBytes << " bytes lazily allocated" << std::endl;
+
+  Traffic frameTraffic = traffic();
+  out << "attachment traffic per frame: " << frameTraffic.loaded << " bytes loaded, " << frameTraffic.stored
+    << " bytes stored, " << frameTraffic.resolved << " bytes resolved" << std::endl;
+}
+
+RenderGraph::Traffic RenderGraph::traffic() const
+{
+  Traffic total;
+  uint64_t pixels = static_cast<uint64_t>(extent.width) * extent.height;
+  for (const auto& compiled : renderPasses)
+  {
+    for (size_t a = 0; a < compiled.attachments.size(); ++a)
+    {
+      GraphResource image = compiled.attachments[a];
+      const VkAttachmentDescription& description = compiled.descriptions[a];
+      uint64_t bytes = pixels * formatBytes(description.format) * description.samples;
+
+      // What a resolve target stores are the resolved pixels
+      bool resolved = false;
+      for (GraphPass pass : compiled.passes)
+      {
+        const Access* access = findAccess(pass, image);
+        resolved = resolved || (access && access->type == AccessType::ResolveWrite);
+      }
+
+      if (description.loadOp == VK_ATTACHMENT_LOAD_OP_LOAD)
+        total.loaded += bytes;
+      if (description.storeOp == VK_ATTACHMENT_STORE_OP_STORE)
+        (resolved ? total.resolved : total.stored) += bytes;
+    }
+  }
+  return total;
+}
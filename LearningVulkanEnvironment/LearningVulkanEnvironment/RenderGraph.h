@@ -0,0 +1,261 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "GpuAllocator.h"
+
+typedef uint32_t GraphResource;
+typedef uint32_t GraphPass;
+
+// Where a pass records its commands, and what a secondary command buffer
+// recorded for it has to inherit
+struct GraphPassContext
+{
+  GraphPass pass;
+  VkCommandBuffer commandBuffer;
+  VkRenderPass renderPass;
+  uint32_t subpass;
+  VkFramebuffer framebuffer;
+};
+
+/*
+  Builds the frame's render passes from passes that declare which images
+  they write and read, in the order they run. Nothing is hand written per
+  pass: compile()
+
+  - culls passes whose results nothing uses,
+  - merges passes that only read earlier results at the same pixel (input
+    attachments) into subpasses of one render pass, so tilers keep those
+    images in tile memory,
+  - picks load and store ops and layouts from the previous and the next
+    use, and puts every barrier into the render passes as subpass
+    dependencies, one per pair of subpasses with the stage and access
+    masks of all its hazards combined,
+  - lets images whose lifetimes don't overlap share memory, and backs
+    images that never leave a render pass with lazily allocated memory.
+
+  Multisampled images are resolved at the end of the subpass that draws
+  them (resolve()), so on tilers the samples stay in tile memory and only
+  the resolved pixels are written out.
+
+  Images the graph creates are shared by every instance (swap chain image),
+  frames in flight are ordered by the dependencies into each image's first
+  use. Imported images, like the swap chain, have a view per instance.
+
+  Usage: declare, compile() once, then setImportedViews() and
+  createResources() again whenever the extent or the imported views change.
+*/
+class RenderGraph
+{
+public:
+  void create(VkDevice device, GpuAllocator& allocator);
+  // Everything the graph created, the device must be idle
+  void destroy();
+
+  // An image from outside the graph. Its contents are discarded at the
+  // start of the frame and it is left in finalLayout.
+  GraphResource importImage(const std::string& name, VkFormat format, VkImageLayout finalLayout);
+  // An image the graph creates, at the extent passed to createResources()
+  GraphResource createImage(const std::string& name, VkFormat format,
+    VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT);
+  // contents is how the pass records its subpass
+  GraphPass addPass(const std::string& name, VkSubpassContents contents = VK_SUBPASS_CONTENTS_INLINE);
+  // A color attachment, locations in the order of the calls. Cleared first
+  // if clear is given, otherwise what earlier passes wrote is loaded (left
+  // undefined if nothing did).
+  void writeColor(GraphPass pass, GraphResource image, const VkClearColorValue* clear = nullptr);
+  // The depth attachment, one per pass, tested and written the same way
+  void writeDepth(GraphPass pass, GraphResource image, const VkClearDepthStencilValue* clear = nullptr);
+  // Resolves multisampled, a color attachment of the pass, into image at
+  // the end of the subpass. Everything image held before is replaced.
+  void resolve(GraphPass pass, GraphResource multisampled, GraphResource image);
+  // Read at the same pixel as an input attachment, input_attachment_index
+  // in the order of the calls
+  void readAttachment(GraphPass pass, GraphResource image);
+  // Sampled anywhere from the fragment shader
+  void readTexture(GraphPass pass, GraphResource image);
+
+  // Creates the render passes, throws if an image is read before anything
+  // wrote it, or a pass mixes sample counts, has two depth attachments or
+  // reads multisampled images.
+  // Without mergePasses every pass gets a render pass of its own.
+  void compile(bool mergePasses = true);
+
+  // One view per instance, every imported image needs the same count
+  void setImportedViews(GraphResource image, const std::vector<VkImageView>& views);
+  // Images, memory and framebuffers
+  void createResources(VkExtent2D extent);
+  void destroyResources();
+
+  // VK_NULL_HANDLE if the pass was culled
+  VkRenderPass renderPass(GraphPass pass) const;
+  uint32_t subpass(GraphPass pass) const;
+  // Of the pass's attachments, what its pipelines rasterize with
+  VkSampleCountFlagBits samples(GraphPass pass) const;
+  // Of an image the graph created, for input attachment descriptors
+  VkImageView view(GraphResource image) const;
+
+  /*
+    Records every render pass for the instance. recordPass(const
+    GraphPassContext&) is called once per pass that wasn't culled, inside
+    its subpass. A template so recording never allocates.
+  */
+  template <typename RecordPass>
+  void execute(VkCommandBuffer commandBuffer, uint32_t instance, RecordPass&& recordPass) const
+  {
+    for (uint32_t i = 0; i < renderPasses.size(); ++i)
+    {
+      const CompiledRenderPass& compiled = renderPasses[i];
+      for (uint32_t subpassIndex = 0; subpassIndex < compiled.passes.size(); ++subpassIndex)
+      {
+        GraphPassContext context = beginSubpass(commandBuffer, i, subpassIndex, instance);
+        recordPass(context);
+      }
+      vkCmdEndRenderPass(commandBuffer);
+    }
+  }
+
+  // The compiled graph: render passes, subpasses, attachments with their
+  // load/store ops and layouts, dependencies and image memory
+  void dump(std::ostream& out) const;
+
+  /*
+    Bytes a frame moves between attachments and memory on a tiler: loads,
+    stores and resolves at the extent of createResources(). Transient
+    attachments cost nothing here. Immediate mode GPUs also write every
+    sample of them out, which this doesn't count.
+  */
+  struct Traffic
+  {
+    uint64_t loaded = 0;
+    uint64_t stored = 0;
+    uint64_t resolved = 0;
+  };
+  Traffic traffic() const;
+
+private:
+  enum class AccessType
+  {
+    ColorWrite,
+    AttachmentRead,
+    TextureRead,
+    ResolveWrite,
+    DepthWrite
+  };
+
+  struct Access
+  {
+    GraphResource image;
+    AccessType type;
+    bool clear;
+    VkClearValue clearValue;
+    // Of a ResolveWrite
+    GraphResource resolveSource;
+
+    bool isWrite() const
+    {
+      return type == AccessType::ColorWrite || type == AccessType::ResolveWrite || type == AccessType::DepthWrite;
+    }
+    // Only what has to be made visible, reads have nothing to flush
+    VkAccessFlags writeAccess() const
+    {
+      if (!isWrite())
+        return 0;
+      return type == AccessType::DepthWrite ? VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT : VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    }
+    // Whatever the image held before doesn't matter
+    bool replacesContents() const { return clear || type == AccessType::ResolveWrite; }
+  };
+
+  struct Pass
+  {
+    std::string name;
+    VkSubpassContents contents;
+    std::vector<Access> accesses;
+    bool culled = false;
+    uint32_t renderPass = 0;
+    uint32_t subpass = 0;
+  };
+
+  struct Resource
+  {
+    std::string name;
+    VkFormat format;
+    VkSampleCountFlagBits samples;
+    bool imported;
+    VkImageLayout finalLayout;
+    std::vector<VkImageView> importedViews;
+
+    // Set by compile() for images the graph creates
+    VkImageUsageFlags usage = 0;
+    // Render passes of the first and the last use, unused if first > last
+    uint32_t firstUse = UINT32_MAX;
+    uint32_t lastUse = 0;
+    // Never leaves its render pass, nothing has to be stored
+    bool transient = false;
+    uint32_t memorySlot = UINT32_MAX;
+
+    // Set by createResources()
+    VkImage image = VK_NULL_HANDLE;
+    VkImageView view = VK_NULL_HANDLE;
+    VkDeviceSize size = 0;
+  };
+
+  // Images that take turns in the same memory
+  struct MemorySlot
+  {
+    std::vector<GraphResource> images;
+    bool lazy = false;
+    GpuAllocation memory;
+  };
+
+  struct CompiledRenderPass
+  {
+    VkRenderPass handle = VK_NULL_HANDLE;
+    std::vector<GraphPass> passes;
+    std::vector<GraphResource> attachments;
+    // Kept for dump()
+    std::vector<VkAttachmentDescription> descriptions;
+    std::vector<VkSubpassDependency> dependencies;
+    std::vector<VkClearValue> clearValues;
+    // Per instance
+    std::vector<VkFramebuffer> framebuffers;
+  };
+
+  // Where an image was left by the render passes compiled so far
+  struct ImageState
+  {
+    bool written = false;
+    VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+    // Of the last access not covered by a dependency yet, 0 before the
+    // first use this frame
+    VkPipelineStageFlags stages = 0;
+    VkAccessFlags access = 0;
+  };
+
+  GraphPassContext beginSubpass(VkCommandBuffer commandBuffer, uint32_t renderPassIndex, uint32_t subpassIndex,
+    uint32_t instance) const;
+  void cullPasses();
+  std::vector<std::vector<GraphPass>> groupPasses(bool mergePasses) const;
+  void compileRenderPass(uint32_t index, std::vector<ImageState>& states);
+  void assignMemory();
+  const Access* findAccess(GraphPass pass, GraphResource image) const;
+  // First access after the render pass, nullptr if there is none
+  const Access* nextUse(GraphResource image, uint32_t afterRenderPass) const;
+
+  VkDevice device = VK_NULL_HANDLE;
+  GpuAllocator* allocator = nullptr;
+  std::vector<Resource> resources;
+  std::vector<Pass> passes;
+  std::vector<CompiledRenderPass> renderPasses;
+  std::vector<MemorySlot> memorySlots;
+  VkExtent2D extent = {};
+  uint32_t instanceCount = 1;
+  // Dependencies before merging, to show what merging saved
+  uint32_t hazardCount = 0;
+};
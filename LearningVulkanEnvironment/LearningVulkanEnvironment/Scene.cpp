@@ -0,0 +1,113 @@
+#include "Scene.h"
+
+#include <cmath>
+#include <cstddef>
+
+namespace
+{
+  // The mesh is the tutorial triangle, no vertex is further than this from
+  // the origin at scale 1
+  const float MESH_RADIUS = 0.71f;
+  // Half size of the area the grid covers, the view spans -1 to 1
+  const float GRID_EXTENT = 2.0f;
+}
+
+VkVertexInputBindingDescription ObjectData::bindingDescription()
+{
+  // Advances once per instance instead of once per vertex
+  VkVertexInputBindingDescription binding = {};
+  binding.binding = OBJECT_BINDING;
+  binding.stride = sizeof(ObjectData);
+  binding.inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+  return binding;
+}
+
+VkVertexInputAttributeDescription ObjectData::attributeDescription()
+{
+  // Only the transform is needed for drawing, bounds are for culling
+  VkVertexInputAttributeDescription attribute = {};
+  attribute.binding = OBJECT_BINDING;
+  attribute.location = 2;
+  attribute.format = VK_FORMAT_R32G32B32A32_SFLOAT;
+  attribute.offset = offsetof(ObjectData, transform);
+  return attribute;
+}
+
+std::vector<ObjectData> makeObjectGrid(uint32_t count, float overlap)
+{
+  std::vector<ObjectData> objects(count);
+  if (count == 1)
+  {
+    objects[0] = { { 0.0f, 0.0f, overlap, 0.5f }, { 0.0f, 0.0f, 0.5f, MESH_RADIUS * overlap } };
+    return objects;
+  }
+
+  uint32_t side = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(count))));
+  float cell = 2.0f * GRID_EXTENT / side;
+  float scale = cell * 0.8f * overlap;
+
+  for (uint32_t i = 0; i < count; ++i)
+  {
+    float x = -GRID_EXTENT + cell * (i % side + 0.5f);
+    float y = -GRID_EXTENT + cell * (i / side + 0.5f);
+    // Between 0.05 and 0.95, clear of both clip planes
+    uint32_t hash = (i + 1) * 2246822519u;
+    float depth = 0.05f + 0.9f * static_cast<float>(hash >> 8) / 16777216.0f;
+    objects[i] = { { x, y, scale, depth }, { x, y, depth, MESH_RADIUS * scale } };
+  }
+  return objects;
+}
+
+void animateObjects(const std::vector<ObjectData>& objects, double seconds, float* transforms)
+{
+  // Phase offset per object so neighbours don't pulse in lockstep
+  float time = static_cast<float>(seconds);
+  for (size_t i = 0; i < objects.size(); ++i)
+  {
+    const float* transform = objects[i].transform;
+    float pulse = 1.0f + 0.1f * std::sin(2.0f * time + 0.37f * static_cast<float>(i));
+    transforms[4 * i + 0] = transform[0];
+    transforms[4 * i + 1] = transform[1];
+    transforms[4 * i + 2] = transform[2] * pulse;
+    transforms[4 * i + 3] = transform[3];
+  }
+}
+
+void frustumPlanes(const float viewProjection[16], float planes[6][4])
+{
+  // Row i of the matrix, element j of the column major storage
+  auto row = [&](int i, int j) { return viewProjection[4 * j + i]; };
+
+  // A point is inside when -w <= x <= w, -w <= y <= w and 0 <= z <= w in
+  // clip space, each bound is a plane combining two rows of the matrix
+  const int axes[6] = { 0, 0, 1, 1, 2, 2 };
+  const float signs[6] = { 1.0f, -1.0f, 1.0f, -1.0f, 1.0f, -1.0f };
+  for (int p = 0; p < 6; ++p)
+  {
+    for (int j = 0; j < 4; ++j)
+    {
+      // The near plane is z >= 0 alone, without the w row
+      float w = p == 4 ? 0.0f : row(3, j);
+      planes[p][j] = w + signs[p] * row(axes[p], j);
+    }
+
+    float length = std::sqrt(planes[p][0] * planes[p][0] + planes[p][1] * planes[p][1] + planes[p][2] * planes[p][2]);
+    for (int j = 0; j < 4; ++j)
+      planes[p][j] /= length;
+  }
+}
+
+std::vector<uint32_t> makeObjectColors(uint32_t count)
+{
+  std::vector<uint32_t> colors(count);
+  for (uint32_t i = 0; i < count; ++i)
+  {
+    // Cheap integer hash, bright enough that the vertex colors still show
+    uint32_t hash = i * 2654435761u;
+    uint32_t r = 128 + (hash & 0x7F);
+    uint32_t g = 128 + ((hash >> 8) & 0x7F);
+    uint32_t b = 128 + ((hash >> 16) & 0x7F);
+    colors[i] = r | (g << 8) | (b << 16) | (255u << 24);
+  }
+  return colors;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <vector>
+
+/*
+  One object of the scene. The same buffer feeds the per instance vertex
+  attribute of shader.vert (firstInstance selects the object) and the
+  storage buffer cull.comp reads, so the layout has to match both.
+*/
+struct ObjectData
+{
+  // Offset in xy, uniform scale in z, depth (0 near, 1 far) in w
+  float transform[4];
+  // Bounding sphere, center in xyz and radius in w
+  float bounds[4];
+
+  static VkVertexInputBindingDescription bindingDescription();
+  static VkVertexInputAttributeDescription attributeDescription();
+};
+
+// Vertex binding the object buffer is bound to
+const uint32_t OBJECT_BINDING = 1;
+
+// A single object at the origin for count 1. Otherwise a grid of objects
+// over an area twice the size of the view in each direction, so about a
+// quarter of them is visible and culling has something to do. overlap
+// scales every object up from filling most of its cell, so that about
+// overlap squared of them cover each pixel. Depths are scattered so the
+// grid order is neither front to back nor back to front.
+std::vector<ObjectData> makeObjectGrid(uint32_t count, float overlap = 1.0f);
+
+// Writes the transform of every object into a tightly packed array of 4
+// floats per object, with the scale pulsing over time so the data really
+// changes from frame to frame. Depths stay.
+void animateObjects(const std::vector<ObjectData>& objects, double seconds, float* transforms);
+
+// The six planes of the view frustum, taken from a column major view
+// projection matrix (as GLSL stores it) and Vulkan's 0 to 1 clip space depth.
+// Each is normalized, xyz is the normal pointing inwards and w the distance,
+// in the order left, right, bottom, top, near, far.
+void frustumPlanes(const float viewProjection[16], float planes[6][4]);
+
+// A fixed tint per object, packed as R8G8B8A8 with red in the low byte
+// (the byte order of VK_FORMAT_R8G8B8A8_UNORM on little endian hosts)
+std::vector<uint32_t> makeObjectColors(uint32_t count);
@@ -0,0 +1,313 @@
+#include "ShaderCompiler.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <direct.h>
+#endif
+
+#ifdef USE_SHADERC
+#include <shaderc/shaderc.h>
+#include <vulkan/vulkan.h>
+#endif
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#include "Benchmark.h"
+
+namespace
+{
+  const uint32_t SPIRV_MAGIC = 0x07230203;
+  // Bump when anything else that changes the output is added to the
+  // options below, it is part of every key
+  const uint32_t CACHE_FORMAT = 2;
+  // How often ShaderWatcher looks at the files
+  const std::chrono::milliseconds WATCH_INTERVAL(250);
+
+  // FNV-1a, 64 bit. Only has to tell shaders apart, not resist attacks.
+  void hashBytes(uint64_t& hash, const void* data, size_t size)
+  {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; ++i)
+    {
+      hash ^= bytes[i];
+      hash *= 1099511628211ull;
+    }
+  }
+
+  void hashString(uint64_t& hash, const std::string& text)
+  {
+    // The terminator keeps "ab" + "c" apart from "a" + "bc"
+    hashBytes(hash, text.c_str(), text.size() + 1);
+  }
+
+  bool endsWith(const std::string& text, const std::string& suffix)
+  {
+    return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+  }
+
+  // At least a header's worth of words starting with the magic number
+  bool isSpirv(const Asset& code)
+  {
+    return code.size() >= 5 * sizeof(uint32_t) && code.size() % sizeof(uint32_t) == 0 &&
+      code.words()[0] == SPIRV_MAGIC;
+  }
+
+  bool replaceFile(const std::string& from, const std::string& to)
+  {
+#ifdef _WIN32
+    return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    return std::rename(from.c_str(), to.c_str()) == 0;
+#endif
+  }
+
+  void makeDirectory(const std::string& path)
+  {
+    // Fails harmlessly when it already exists
+#ifdef _WIN32
+    _mkdir(path.c_str());
+#else
+    mkdir(path.c_str(), 0755);
+#endif
+  }
+
+#ifdef USE_SHADERC
+  shaderc_shader_kind shaderKind(const std::string& path)
+  {
+    if (endsWith(path, ".vert"))
+      return shaderc_vertex_shader;
+    if (endsWith(path, ".frag"))
+      return shaderc_fragment_shader;
+    if (endsWith(path, ".comp"))
+      return shaderc_compute_shader;
+    throw std::runtime_error("unknown shader stage of " + path + "!");
+  }
+#endif
+}
+
+void ShaderCompiler::create(const std::string& cacheDirectory, AssetLoader& assetLoader)
+{
+  directory = cacheDirectory;
+  assets = &assetLoader;
+  if (!directory.empty())
+    makeDirectory(directory);
+
+#ifdef USE_SHADERC
+  compiler = shaderc_compiler_initialize();
+  if (!compiler)
+    throw std::runtime_error("failed to create shader compiler!");
+#endif
+}
+
+void ShaderCompiler::destroy()
+{
+#ifdef USE_SHADERC
+  if (compiler)
+    shaderc_compiler_release(static_cast<shaderc_compiler_t>(compiler));
+#endif
+  compiler = nullptr;
+}
+
+bool ShaderCompiler::canCompile()
+{
+#ifdef USE_SHADERC
+  return true;
+#else
+  return false;
+#endif
+}
+
+Asset ShaderCompiler::load(const std::string& path, const std::vector<std::string>& defines)
+{
+  if (endsWith(path, ".spv"))
+  {
+    Asset code = assets->open(path);
+    if (!isSpirv(code))
+      throw std::runtime_error(path + " isn't SPIR-V!");
+    return code;
+  }
+
+  if (!canCompile())
+    throw std::runtime_error("can't compile " + path + ", built without USE_SHADERC!");
+
+  auto start = std::chrono::steady_clock::now();
+
+  Asset source = assets->open(path);
+
+  // Sorted so the order the defines were given in doesn't matter
+  std::vector<std::string> sortedDefines(defines);
+  std::sort(sortedDefines.begin(), sortedDefines.end());
+
+  uint64_t key = 14695981039346656037ull;
+  uint32_t format = CACHE_FORMAT;
+  hashBytes(key, &format, sizeof(format));
+#ifdef USE_SHADERC
+  // shaderc can't report its own build, the SDK it ships with stands in
+  uint32_t sdkVersion = VK_HEADER_VERSION;
+  hashBytes(key, &sdkVersion, sizeof(sdkVersion));
+  shaderc_shader_kind kind = shaderKind(path);
+  hashBytes(key, &kind, sizeof(kind));
+#endif
+  for (const auto& define : sortedDefines)
+    hashString(key, define);
+  hashBytes(key, source.data(), source.size());
+
+  // Cache entries are always loose files, packs are read only
+  std::string cacheFile = directory.empty() ? std::string() : cachePath(key);
+  if (!cacheFile.empty())
+  {
+    Asset code = Asset::map(cacheFile);
+    if (isSpirv(code))
+    {
+      std::lock_guard<std::mutex> lock(statsMutex);
+      ++hits;
+      hitMs += millisecondsSince(start);
+      return code;
+    }
+  }
+
+  std::vector<uint32_t> code = compile(path, source, sortedDefines);
+  if (!cacheFile.empty())
+    store(cacheFile, code);
+
+  std::lock_guard<std::mutex> lock(statsMutex);
+  ++misses;
+  missMs += millisecondsSince(start);
+  return Asset::fromWords(std::move(code));
+}
+
+std::vector<uint32_t> ShaderCompiler::compile(const std::string& path, const Asset& source, const std::vector<std::string>& defines)
+{
+#ifdef USE_SHADERC
+  // Options aren't thread safe, the compiler is
+  shaderc_compile_options_t compileOptions = shaderc_compile_options_initialize();
+  shaderc_compile_options_set_target_env(compileOptions, shaderc_target_env_vulkan, shaderc_env_version_vulkan_1_0);
+  shaderc_compile_options_set_optimization_level(compileOptions, shaderc_optimization_level_performance);
+  for (const auto& define : defines)
+  {
+    size_t equals = define.find('=');
+    std::string name = define.substr(0, equals);
+    std::string value = equals == std::string::npos ? std::string() : define.substr(equals + 1);
+    shaderc_compile_options_add_macro_definition(compileOptions, name.c_str(), name.size(), value.c_str(), value.size());
+  }
+
+  shaderc_compilation_result_t result = shaderc_compile_into_spv(static_cast<shaderc_compiler_t>(compiler),
+    source.data(), source.size(), shaderKind(path), path.c_str(), "main", compileOptions);
+  shaderc_compile_options_release(compileOptions);
+
+  if (shaderc_result_get_compilation_status(result) != shaderc_compilation_status_success)
+  {
+    std::string message = shaderc_result_get_error_message(result);
+    shaderc_result_release(result);
+    throw std::runtime_error("failed to compile " + path + ":\n" + message);
+  }
+
+  const char* bytes = shaderc_result_get_bytes(result);
+  std::vector<uint32_t> code(shaderc_result_get_length(result) / sizeof(uint32_t));
+  std::copy(bytes, bytes + code.size() * sizeof(uint32_t), reinterpret_cast<char*>(code.data()));
+  shaderc_result_release(result);
+  return code;
+#else
+  (void)source;
+  (void)defines;
+  throw std::runtime_error("can't compile " + path + ", built without USE_SHADERC!");
+#endif
+}
+
+std::string ShaderCompiler::cachePath(uint64_t key) const
+{
+  std::ostringstream name;
+  name << directory << '/' << std::hex << std::setw(16) << std::setfill('0') << key << ".spv";
+  return name.str();
+}
+
+void ShaderCompiler::store(const std::string& filename, const std::vector<uint32_t>& code) const
+{
+  // A temporary name per thread, two workers may compile the same shader at
+  // once. Losing an entry only costs a compile, so failures are ignored.
+  std::ostringstream tempName;
+  tempName << filename << '.' << std::hash<std::thread::id>()(std::this_thread::get_id()) << ".tmp";
+  {
+    std::ofstream file(tempName.str(), std::ios::binary | std::ios::trunc);
+    if (!file.is_open() || !file.write(reinterpret_cast<const char*>(code.data()), code.size() * sizeof(uint32_t)))
+      return;
+  }
+
+  if (!replaceFile(tempName.str(), filename))
+    std::remove(tempName.str().c_str());
+}
+
+void ShaderCompiler::writeReport(std::ostream& out) const
+{
+  std::lock_guard<std::mutex> lock(statsMutex);
+  out << "shader_load,count,total_ms,average_ms\n"
+    << "cache_hit," << hits << ',' << hitMs << ',' << (hits ? hitMs / hits : 0.0) << '\n'
+    << "compiled," << misses << ',' << missMs << ',' << (misses ? missMs / misses : 0.0) << std::endl;
+}
+
+bool ShaderWatcher::readStamp(const std::string& path, FileStamp& stamp)
+{
+#ifdef _WIN32
+  WIN32_FILE_ATTRIBUTE_DATA info;
+  if (!GetFileAttributesExA(path.c_str(), GetFileExInfoStandard, &info))
+    return false;
+  stamp.time = static_cast<int64_t>((static_cast<uint64_t>(info.ftLastWriteTime.dwHighDateTime) << 32) |
+    info.ftLastWriteTime.dwLowDateTime);
+  stamp.size = (static_cast<uint64_t>(info.nFileSizeHigh) << 32) | info.nFileSizeLow;
+#else
+  struct stat info;
+  if (stat(path.c_str(), &info) != 0)
+    return false;
+#ifdef __APPLE__
+  const struct timespec& time = info.st_mtimespec;
+#else
+  const struct timespec& time = info.st_mtim;
+#endif
+  stamp.time = static_cast<int64_t>(time.tv_sec) * 1000000000 + time.tv_nsec;
+  stamp.size = static_cast<uint64_t>(info.st_size);
+#endif
+  return true;
+}
+
+void ShaderWatcher::watch(const std::string& path)
+{
+  FileStamp stamp;
+  readStamp(path, stamp);
+  modified[path] = stamp;
+}
+
+std::vector<std::string> ShaderWatcher::poll()
+{
+  std::vector<std::string> changed;
+
+  auto now = std::chrono::steady_clock::now();
+  if (now - lastPoll < WATCH_INTERVAL)
+    return changed;
+  lastPoll = now;
+
+  for (auto& file : modified)
+  {
+    // A file that is missing for a moment, while an editor saves it, is
+    // picked up again once it is back
+    FileStamp stamp;
+    if (readStamp(file.first, stamp) && stamp != file.second)
+    {
+      file.second = stamp;
+      changed.push_back(file.first);
+    }
+  }
+  return changed;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "AssetIO.h"
+
+/*
+  Loads the SPIR-V of a shader. Paths ending in .spv are mapped as they
+  are, GLSL sources (.vert, .frag, .comp) are compiled in process with
+  shaderc. Both are opened through the AssetLoader, so they can come from
+  an asset pack.
+
+  Compiled code goes into a disk cache keyed by a hash of the source text,
+  the defines and the Vulkan SDK version, so an unchanged shader is read
+  back instead of compiled again and any change to one of them misses.
+  Sources can't #include other files, the key only covers the file itself.
+  shaderc has no version to put in the key, so the SDK headers the app is
+  built with stand in for it: clear the cache directory after upgrading a
+  shaderc that didn't come with a new SDK.
+
+  shaderc ships with the Vulkan SDK (1.1.70 and later) as
+  shaderc_combined.lib. Define USE_SHADERC and link it to enable compiling.
+  Without it loading a GLSL source throws, use the .spv files built
+  offline by compile.bat instead.
+
+  Safe to call from several threads, pipelines are built on workers.
+*/
+class ShaderCompiler
+{
+public:
+  // An empty directory disables the disk cache, the directory is created
+  // if it doesn't exist yet. assets has to outlive the compiler.
+  void create(const std::string& cacheDirectory, AssetLoader& assets);
+  void destroy();
+
+  // Whether this build can compile GLSL at all
+  static bool canCompile();
+
+  // defines are NAME or NAME=VALUE and only apply to GLSL sources
+  Asset load(const std::string& path, const std::vector<std::string>& defines = std::vector<std::string>());
+
+  // Cache hits and misses and the time spent on each
+  void writeReport(std::ostream& out) const;
+
+private:
+  std::vector<uint32_t> compile(const std::string& path, const Asset& source, const std::vector<std::string>& defines);
+  std::string cachePath(uint64_t key) const;
+  void store(const std::string& filename, const std::vector<uint32_t>& code) const;
+
+  std::string directory;
+  AssetLoader* assets = nullptr;
+  // shaderc_compiler_t, kept opaque so only the .cpp needs shaderc headers
+  void* compiler = nullptr;
+
+  mutable std::mutex statsMutex;
+  uint32_t hits = 0;
+  uint32_t misses = 0;
+  double hitMs = 0.0;
+  double missMs = 0.0;
+};
+
+/*
+  Polls the modification time and size of shader files, for hot reloading.
+  Cheap enough to call every frame, but only checks the disk every interval.
+*/
+class ShaderWatcher
+{
+public:
+  void watch(const std::string& path);
+  // Files written since the last call that returned them
+  std::vector<std::string> poll();
+
+private:
+  // Times are as fine as the platform keeps them (nanoseconds, 100ns on
+  // Windows), the size catches a save a coarser file system can't tell apart
+  struct FileStamp
+  {
+    int64_t time = 0;
+    uint64_t size = 0;
+
+    bool operator!=(const FileStamp& other) const { return time != other.time || size != other.size; }
+  };
+
+  static bool readStamp(const std::string& path, FileStamp& stamp);
+
+  std::unordered_map<std::string, FileStamp> modified;
+  std::chrono::steady_clock::time_point lastPoll;
+};
@@ -0,0 +1,264 @@
+#include "StagingUploader.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace
+{
+  // Every mip level and layer of a color image
+  VkImageMemoryBarrier wholeImageBarrier(VkImage image)
+  {
+    VkImageMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.baseMipLevel = 0;
+    barrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+    return barrier;
+  }
+}
+
+void StagingUploader::create(VkDevice logicalDevice, GpuAllocator& gpuAllocator, DeviceQueues& deviceQueues,
+  uint32_t frameCount, VkDeviceSize stagingSize)
+{
+  device = logicalDevice;
+  allocator = &gpuAllocator;
+  queues = &deviceQueues;
+  queueFamilyIndex = queues->family(QueueRole::Transfer);
+  granularity = queues->imageTransferGranularity(QueueRole::Transfer);
+
+  allocator->createBuffer(stagingSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, stagingBuffer, stagingMemory);
+  ring.reset(stagingSize, frameCount);
+
+  // Transient, the command buffer is rerecorded every frame that uploads
+  VkCommandPoolCreateInfo poolInfo = {};
+  poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+  poolInfo.queueFamilyIndex = queueFamilyIndex;
+  poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+  VkSemaphoreCreateInfo semaphoreInfo = {};
+  semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+  frames.resize(frameCount);
+  for (auto& frame : frames)
+  {
+    if (vkCreateCommandPool(device, &poolInfo, nullptr, &frame.commandPool) != VK_SUCCESS)
+      throw std::runtime_error("failed to create upload command pool");
+
+    VkCommandBufferAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.commandPool = frame.commandPool;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandBufferCount = 1;
+
+    if (vkAllocateCommandBuffers(device, &allocInfo, &frame.commandBuffer) != VK_SUCCESS)
+      throw std::runtime_error("failed to allocate upload command buffer!");
+
+    if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &frame.uploaded) != VK_SUCCESS)
+      throw std::runtime_error("failed to create upload semaphore!");
+  }
+}
+
+void StagingUploader::destroy()
+{
+  for (auto& frame : frames)
+  {
+    vkDestroySemaphore(device, frame.uploaded, nullptr);
+    vkDestroyCommandPool(device, frame.commandPool, nullptr);
+  }
+  frames.clear();
+
+  if (stagingBuffer != VK_NULL_HANDLE)
+    allocator->destroyBuffer(stagingBuffer, stagingMemory);
+  stagingBuffer = VK_NULL_HANDLE;
+}
+
+void StagingUploader::beginFrame(uint32_t frame)
+{
+  // The graphics work of the frame waited on its upload, so the fence the
+  // caller waited on covers the transfer too
+  currentFrame = frame;
+  ring.beginFrame(frame);
+}
+
+void StagingUploader::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, uint32_t graphicsFamily,
+  VkBuffer& buffer, GpuAllocation& allocation)
+{
+  createBuffer(size, usage, &graphicsFamily, 1, buffer, allocation);
+}
+
+void StagingUploader::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, const uint32_t* readerFamilies,
+  uint32_t readerCount, VkBuffer& buffer, GpuAllocation& allocation)
+{
+  // Concurrent sharing lets the transfer queue write the buffer and the
+  // other queues read it without ownership transfer barriers
+  uint32_t queueFamilies[QUEUE_ROLE_COUNT] = { queueFamilyIndex };
+  uint32_t familyCount = 1;
+  for (uint32_t i = 0; i < readerCount; ++i)
+  {
+    if (std::find(queueFamilies, queueFamilies + familyCount, readerFamilies[i]) == queueFamilies + familyCount)
+    {
+      if (familyCount == QUEUE_ROLE_COUNT)
+        throw std::runtime_error("too many queue families share an upload buffer!");
+      queueFamilies[familyCount++] = readerFamilies[i];
+    }
+  }
+
+  VkBufferCreateInfo bufferInfo = {};
+  bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  bufferInfo.size = size;
+  bufferInfo.usage = usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+  if (familyCount > 1)
+  {
+    bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+    bufferInfo.queueFamilyIndexCount = familyCount;
+    bufferInfo.pQueueFamilyIndices = queueFamilies;
+  }
+  else
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+  allocator->createBuffer(bufferInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, buffer, allocation);
+}
+
+bool StagingUploader::uploadBuffer(VkBuffer destination, VkDeviceSize destinationOffset, const void* data, VkDeviceSize size)
+{
+  if (size > ring.capacity())
+    throw std::runtime_error("upload is larger than the staging buffer!");
+
+  // 16 covers the alignment vkCmdCopyBuffer wants for any texel format
+  VkDeviceSize offset;
+  if (!ring.allocate(size, 16, offset))
+    return false;
+
+  std::memcpy(static_cast<char*>(stagingMemory.mapped) + offset, data, static_cast<size_t>(size));
+  allocator->flush(stagingMemory, offset, size);
+
+  PendingCopy copy;
+  copy.destination = destination;
+  copy.region.srcOffset = offset;
+  copy.region.dstOffset = destinationOffset;
+  copy.region.size = size;
+  pending.push_back(copy);
+  return true;
+}
+
+bool StagingUploader::uploadImage(VkImage destination, const VkBufferImageCopy& region, const void* data, VkDeviceSize size,
+  bool firstUpload)
+{
+  if (size > ring.capacity())
+    throw std::runtime_error("upload is larger than the staging buffer!");
+
+  // 16 is a multiple of every texel and compressed block size, which is
+  // what vkCmdCopyBufferToImage wants the offset aligned to
+  VkDeviceSize offset;
+  if (!ring.allocate(size, 16, offset))
+    return false;
+
+  std::memcpy(static_cast<char*>(stagingMemory.mapped) + offset, data, static_cast<size_t>(size));
+  allocator->flush(stagingMemory, offset, size);
+
+  PendingImageCopy copy;
+  copy.destination = destination;
+  copy.region = region;
+  copy.region.bufferOffset = offset;
+  copy.region.bufferRowLength = 0;
+  copy.region.bufferImageHeight = 0;
+  copy.firstUpload = firstUpload;
+  pendingImages.push_back(copy);
+  return true;
+}
+
+void StagingUploader::releaseImage(VkImage image, uint32_t dstFamily)
+{
+  if (dstFamily == queueFamilyIndex)
+    return;
+
+  // Ownership moves without a layout change, the graphics side does that
+  VkImageMemoryBarrier barrier = wholeImageBarrier(image);
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask = 0;
+  barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  barrier.srcQueueFamilyIndex = queueFamilyIndex;
+  barrier.dstQueueFamilyIndex = dstFamily;
+  releases.push_back(barrier);
+}
+
+VkImageMemoryBarrier StagingUploader::acquireBarrier(VkImage image, uint32_t dstFamily) const
+{
+  // Has to match the release in everything but the access masks
+  VkImageMemoryBarrier barrier = wholeImageBarrier(image);
+  barrier.srcAccessMask = 0;
+  barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  if (dstFamily != queueFamilyIndex)
+  {
+    barrier.srcQueueFamilyIndex = queueFamilyIndex;
+    barrier.dstQueueFamilyIndex = dstFamily;
+  }
+  return barrier;
+}
+
+VkSemaphore StagingUploader::submit()
+{
+  if (pending.empty() && pendingImages.empty() && releases.empty())
+    return VK_NULL_HANDLE;
+
+  Frame& frame = frames[currentFrame];
+  vkResetCommandPool(device, frame.commandPool, 0);
+
+  VkCommandBufferBeginInfo beginInfo = {};
+  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+  vkBeginCommandBuffer(frame.commandBuffer, &beginInfo);
+
+    for (const auto& copy : pending)
+      vkCmdCopyBuffer(frame.commandBuffer, stagingBuffer, copy.destination, 1, &copy.region);
+
+    // Images written for the first time don't have anything worth keeping
+    barriers.clear();
+    for (const auto& copy : pendingImages)
+    {
+      if (!copy.firstUpload)
+        continue;
+      VkImageMemoryBarrier barrier = wholeImageBarrier(copy.destination);
+      barrier.srcAccessMask = 0;
+      barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+      barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+      barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+      barriers.push_back(barrier);
+    }
+    if (!barriers.empty())
+      vkCmdPipelineBarrier(frame.commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+        0, nullptr, 0, nullptr, static_cast<uint32_t>(barriers.size()), barriers.data());
+
+    for (const auto& copy : pendingImages)
+      vkCmdCopyBufferToImage(frame.commandBuffer, stagingBuffer, copy.destination,
+        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy.region);
+
+    if (!releases.empty())
+      vkCmdPipelineBarrier(frame.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+        0, nullptr, 0, nullptr, static_cast<uint32_t>(releases.size()), releases.data());
+
+  if (vkEndCommandBuffer(frame.commandBuffer) != VK_SUCCESS)
+    throw std::runtime_error("failed to record upload command buffer!");
+
+  // The semaphore signal makes the copies visible to whoever waits on it
+  QueueSubmission submission;
+  submission.execute(frame.commandBuffer);
+  submission.signal(frame.uploaded);
+  queues->submit(QueueRole::Transfer, submission);
+
+  pending.clear();
+  pendingImages.clear();
+  releases.clear();
+  return frame.uploaded;
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <vector>
+
+#include "DeviceQueues.h"
+#include "GpuAllocator.h"
+
+/*
+  Copies data into device local buffers through a host visible staging
+  ring. Uploads are only queued when requested, everything queued during a
+  frame goes out in a single command buffer and a single vkQueueSubmit on
+  the transfer queue. The frame's first submit that reads the uploads waits
+  on the returned semaphore, and the frame's fence comes after that
+  submit, which guarantees the staging space of the frame is free again
+  once the fence has signaled.
+
+  Destination buffers must be usable from the transfer queue family,
+  createBuffer makes them so. Images are exclusive to one family instead
+  (concurrent sharing can cost optimal tiling images their compression),
+  so once written they are released to the graphics family, which has to
+  record the matching acquire barrier.
+*/
+class StagingUploader
+{
+public:
+  // Submits to the transfer queue of queues
+  void create(VkDevice device, GpuAllocator& allocator, DeviceQueues& queues, uint32_t frameCount,
+    VkDeviceSize stagingSize);
+  void destroy();
+
+  // Call once the fence of the frame slot has been waited on
+  void beginFrame(uint32_t frame);
+
+  // Device local buffer the uploader can write and graphicsFamily can read,
+  // shared concurrently when the two queue families differ
+  void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, uint32_t graphicsFamily,
+    VkBuffer& buffer, GpuAllocation& allocation);
+  // Same for a buffer more than one queue family reads, like a compute
+  // queue's next to the graphics queue's
+  void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, const uint32_t* readerFamilies,
+    uint32_t readerCount, VkBuffer& buffer, GpuAllocation& allocation);
+
+  // Copies the data into staging memory right away. Returns false if the
+  // staging ring is full this frame, the caller can try again next frame.
+  bool uploadBuffer(VkBuffer destination, VkDeviceSize destinationOffset, const void* data, VkDeviceSize size);
+
+  // Same for a part of an image, the data is tightly packed and
+  // region.bufferOffset is ignored. The region's offset has to be a
+  // multiple of imageGranularity(), and its extent too unless it reaches
+  // the end of the mip level. The first upload to an image passes
+  // firstUpload, it moves every mip level of the image from
+  // VK_IMAGE_LAYOUT_UNDEFINED to VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL.
+  bool uploadImage(VkImage destination, const VkBufferImageCopy& region, const void* data, VkDeviceSize size,
+    bool firstUpload);
+  // Queued after this frame's image copies: hands every mip level of the
+  // image, still in VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, over to dstFamily.
+  // Nothing to do if that is the uploader's own family.
+  void releaseImage(VkImage image, uint32_t dstFamily);
+  // The barrier dstFamily records to take over a released image, in a
+  // submit that waits on this frame's semaphore at the transfer stage
+  VkImageMemoryBarrier acquireBarrier(VkImage image, uint32_t dstFamily) const;
+
+  // Submits every upload of the frame. Returns the semaphore the frame's
+  // first submit that reads them has to wait on, or VK_NULL_HANDLE if
+  // nothing was uploaded.
+  VkSemaphore submit();
+
+  uint32_t queueFamily() const { return queueFamilyIndex; }
+  // Of the transfer queue, see DeviceQueues::imageTransferGranularity
+  VkExtent3D imageGranularity() const { return granularity; }
+
+private:
+  struct PendingCopy
+  {
+    VkBuffer destination;
+    VkBufferCopy region;
+  };
+
+  struct PendingImageCopy
+  {
+    VkImage destination;
+    VkBufferImageCopy region;
+    bool firstUpload;
+  };
+
+  struct Frame
+  {
+    VkCommandPool commandPool = VK_NULL_HANDLE;
+    VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+    VkSemaphore uploaded = VK_NULL_HANDLE;
+  };
+
+  VkDevice device = VK_NULL_HANDLE;
+  GpuAllocator* allocator = nullptr;
+  DeviceQueues* queues = nullptr;
+  uint32_t queueFamilyIndex = 0;
+  VkExtent3D granularity = {};
+
+  VkBuffer stagingBuffer = VK_NULL_HANDLE;
+  GpuAllocation stagingMemory;
+  RingAllocator ring;
+
+  std::vector<Frame> frames;
+  uint32_t currentFrame = 0;
+  // Reused every frame so queuing uploads doesn't allocate
+  std::vector<PendingCopy> pending;
+  std::vector<PendingImageCopy> pendingImages;
+  // Scratch for the barriers of pendingImages, and the images to release
+  std::vector<VkImageMemoryBarrier> barriers;
+  std::vector<VkImageMemoryBarrier> releases;
+};
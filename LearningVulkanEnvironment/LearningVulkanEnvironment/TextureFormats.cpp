@@ -0,0 +1,476 @@
+#include "TextureFormats.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <stdexcept>
+
+namespace
+{
+  const uint8_t KTX2_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+  // Everything up to the level index, little endian like the whole file
+  struct Ktx2Header
+  {
+    uint8_t identifier[12];
+    uint32_t vkFormat;
+    uint32_t typeSize;
+    uint32_t pixelWidth;
+    uint32_t pixelHeight;
+    uint32_t pixelDepth;
+    uint32_t layerCount;
+    uint32_t faceCount;
+    uint32_t levelCount;
+    uint32_t supercompressionScheme;
+    uint32_t dfdByteOffset;
+    uint32_t dfdByteLength;
+    uint32_t kvdByteOffset;
+    uint32_t kvdByteLength;
+    uint64_t sgdByteOffset;
+    uint64_t sgdByteLength;
+  };
+
+  struct Ktx2Level
+  {
+    uint64_t byteOffset;
+    uint64_t byteLength;
+    uint64_t uncompressedByteLength;
+  };
+
+  // ETC1 intensity modifiers, per table codeword: +a, +b, -a, -b
+  const int ETC_MODIFIERS[8][4] =
+  {
+    { 2, 8, -2, -8 }, { 5, 17, -5, -17 }, { 9, 29, -9, -29 }, { 13, 42, -13, -42 },
+    { 18, 60, -18, -60 }, { 24, 80, -24, -80 }, { 33, 106, -33, -106 }, { 47, 183, -47, -183 }
+  };
+  // Distances of the T and H modes
+  const int ETC_DISTANCES[8] = { 3, 6, 11, 16, 23, 32, 41, 64 };
+  // EAC alpha modifiers, per table index
+  const int EAC_MODIFIERS[16][8] =
+  {
+    { -3, -6, -9, -15, 2, 5, 8, 14 }, { -3, -7, -10, -13, 2, 6, 9, 12 },
+    { -2, -5, -8, -13, 1, 4, 7, 12 }, { -2, -4, -6, -13, 1, 3, 5, 12 },
+    { -3, -6, -8, -12, 2, 5, 7, 11 }, { -3, -7, -9, -11, 2, 6, 8, 10 },
+    { -4, -7, -8, -11, 3, 6, 7, 10 }, { -3, -5, -8, -11, 2, 4, 7, 10 },
+    { -2, -6, -8, -10, 1, 5, 7, 9 }, { -2, -5, -8, -10, 1, 4, 7, 9 },
+    { -2, -4, -8, -10, 1, 3, 7, 9 }, { -2, -5, -7, -10, 1, 4, 6, 9 },
+    { -3, -4, -7, -10, 2, 3, 6, 9 }, { -1, -2, -3, -10, 0, 1, 2, 9 },
+    { -4, -6, -8, -9, 3, 5, 7, 8 }, { -3, -5, -7, -9, 2, 4, 6, 8 }
+  };
+
+  uint8_t clampByte(int value)
+  {
+    return static_cast<uint8_t>(std::min(std::max(value, 0), 255));
+  }
+
+  int extend4(int value) { return (value << 4) | value; }
+  int extend5(int value) { return (value << 3) | (value >> 2); }
+  int extend6(int value) { return (value << 2) | (value >> 4); }
+  int extend7(int value) { return (value << 1) | (value >> 6); }
+
+  int signExtend3(int value)
+  {
+    return value >= 4 ? value - 8 : value;
+  }
+
+  // Bytes of a level of the given size, whole blocks
+  size_t levelSize(const TexelBlock& block, uint32_t width, uint32_t height)
+  {
+    size_t blocksWide = (width + block.width - 1) / block.width;
+    size_t blocksHigh = (height + block.height - 1) / block.height;
+    return blocksWide * blocksHigh * block.bytes;
+  }
+
+  /*
+    One 4x4 ETC2 RGB block to RGBA texels, rowPitch bytes apart. The block
+    is a 64-bit big endian word. Differential mode bases that overflow
+    select the T, H and planar modes ETC2 added on top of ETC1.
+  */
+  void decodeEtc2Color(const uint8_t* block, uint8_t* texels, size_t rowPitch, uint32_t width, uint32_t height)
+  {
+    int colors[4][3];
+    bool perSubblock = false;
+    bool planar = false;
+    int baseColors[2][3];
+    int tables[2] = { (block[3] >> 5) & 7, (block[3] >> 2) & 7 };
+    bool flip = (block[3] & 1) != 0;
+    int planarColors[3][3];
+
+    if ((block[3] & 2) == 0)
+    {
+      // Individual: two 4-bit colors per channel
+      perSubblock = true;
+      for (int c = 0; c < 3; ++c)
+      {
+        baseColors[0][c] = extend4(block[c] >> 4);
+        baseColors[1][c] = extend4(block[c] & 15);
+      }
+    }
+    else
+    {
+      int base[3];
+      int second[3];
+      for (int c = 0; c < 3; ++c)
+      {
+        base[c] = block[c] >> 3;
+        second[c] = base[c] + signExtend3(block[c] & 7);
+      }
+
+      if (second[0] < 0 || second[0] > 31)
+      {
+        // T mode: one color, and a second one with a distance either way
+        int color1[3] = { extend4(((block[0] >> 1) & 12) | (block[0] & 3)), extend4(block[1] >> 4), extend4(block[1] & 15) };
+        int color2[3] = { extend4(block[2] >> 4), extend4(block[2] & 15), extend4(block[3] >> 4) };
+        int distance = ETC_DISTANCES[((block[3] >> 1) & 6) | (block[3] & 1)];
+        for (int c = 0; c < 3; ++c)
+        {
+          colors[0][c] = color1[c];
+          colors[1][c] = color2[c] + distance;
+          colors[2][c] = color2[c];
+          colors[3][c] = color2[c] - distance;
+        }
+      }
+      else if (second[1] < 0 || second[1] > 31)
+      {
+        // H mode: two colors, each with a distance either way
+        int raw1[3] = { (block[0] >> 3) & 15, ((block[0] & 7) << 1) | ((block[1] >> 4) & 1),
+          (block[1] & 8) | ((block[1] & 3) << 1) | (block[2] >> 7) };
+        int raw2[3] = { (block[2] >> 3) & 15, ((block[2] & 7) << 1) | (block[3] >> 7), (block[3] >> 3) & 15 };
+        int order = ((raw1[0] << 8) | (raw1[1] << 4) | raw1[2]) >= ((raw2[0] << 8) | (raw2[1] << 4) | raw2[2]) ? 1 : 0;
+        int distance = ETC_DISTANCES[(block[3] & 4) | ((block[3] & 1) << 1) | order];
+        for (int c = 0; c < 3; ++c)
+        {
+          colors[0][c] = extend4(raw1[c]) + distance;
+          colors[1][c] = extend4(raw1[c]) - distance;
+          colors[2][c] = extend4(raw2[c]) + distance;
+          colors[3][c] = extend4(raw2[c]) - distance;
+        }
+      }
+      else if (second[2] < 0 || second[2] > 31)
+      {
+        // Planar: a color at the origin and at the ends of both axes
+        planar = true;
+        int origin[3] = { (block[0] >> 1) & 63, ((block[0] & 1) << 6) | ((block[1] >> 1) & 63),
+          ((block[1] & 1) << 5) | (block[2] & 0x18) | ((block[2] & 3) << 1) | (block[3] >> 7) };
+        int horizontal[3] = { ((block[3] >> 1) & 0x3E) | (block[3] & 1), block[4] >> 1, ((block[4] & 1) << 5) | (block[5] >> 3) };
+        int vertical[3] = { ((block[5] & 7) << 3) | (block[6] >> 5), ((block[6] & 31) << 2) | (block[7] >> 6), block[7] & 63 };
+        int* points[3] = { origin, horizontal, vertical };
+        for (int p = 0; p < 3; ++p)
+        {
+          planarColors[p][0] = extend6(points[p][0]);
+          planarColors[p][1] = extend7(points[p][1]);
+          planarColors[p][2] = extend6(points[p][2]);
+        }
+      }
+      else
+      {
+        // Differential: a 5-bit color and a 3-bit offset to the second
+        perSubblock = true;
+        for (int c = 0; c < 3; ++c)
+        {
+          baseColors[0][c] = extend5(base[c]);
+          baseColors[1][c] = extend5(second[c]);
+        }
+      }
+    }
+
+    // Two bits per texel, column major: high bits in bytes 4-5, low in 6-7
+    uint32_t indices = (static_cast<uint32_t>(block[4]) << 24) | (static_cast<uint32_t>(block[5]) << 16) |
+      (static_cast<uint32_t>(block[6]) << 8) | block[7];
+
+    for (uint32_t y = 0; y < std::min(height, 4u); ++y)
+    {
+      for (uint32_t x = 0; x < std::min(width, 4u); ++x)
+      {
+        uint8_t* texel = texels + y * rowPitch + x * 4;
+        int rgb[3];
+        if (planar)
+        {
+          for (int c = 0; c < 3; ++c)
+            rgb[c] = (static_cast<int>(x) * (planarColors[1][c] - planarColors[0][c]) +
+              static_cast<int>(y) * (planarColors[2][c] - planarColors[0][c]) + 4 * planarColors[0][c] + 2) >> 2;
+        }
+        else
+        {
+          uint32_t bit = x * 4 + y;
+          int index = static_cast<int>(((indices >> (bit + 16)) & 1) << 1 | ((indices >> bit) & 1));
+          if (perSubblock)
+          {
+            int subblock = (flip ? y : x) >= 2 ? 1 : 0;
+            for (int c = 0; c < 3; ++c)
+              rgb[c] = baseColors[subblock][c] + ETC_MODIFIERS[tables[subblock]][index];
+          }
+          else
+          {
+            for (int c = 0; c < 3; ++c)
+              rgb[c] = colors[index][c];
+          }
+        }
+        texel[0] = clampByte(rgb[0]);
+        texel[1] = clampByte(rgb[1]);
+        texel[2] = clampByte(rgb[2]);
+        texel[3] = 255;
+      }
+    }
+  }
+
+  // The EAC alpha half of an ETC2 RGBA block, into the texels' alpha
+  void decodeEacAlpha(const uint8_t* block, uint8_t* texels, size_t rowPitch, uint32_t width, uint32_t height)
+  {
+    int base = block[0];
+    int multiplier = block[1] >> 4;
+    const int* modifiers = EAC_MODIFIERS[block[1] & 15];
+
+    // Three bits per texel, column major, first texel in the high bits
+    uint64_t indices = 0;
+    for (int i = 2; i < 8; ++i)
+      indices = (indices << 8) | block[i];
+
+    for (uint32_t y = 0; y < std::min(height, 4u); ++y)
+    {
+      for (uint32_t x = 0; x < std::min(width, 4u); ++x)
+      {
+        int index = static_cast<int>((indices >> (45 - 3 * (x * 4 + y))) & 7);
+        texels[y * rowPitch + x * 4 + 3] = clampByte(base + modifiers[index] * multiplier);
+      }
+    }
+  }
+}
+
+TexelBlock texelBlock(VkFormat format)
+{
+  TexelBlock block;
+  switch (format)
+  {
+  case VK_FORMAT_R8G8B8A8_UNORM:
+  case VK_FORMAT_R8G8B8A8_SRGB:
+    block.bytes = 4;
+    break;
+  case VK_FORMAT_BC7_UNORM_BLOCK:
+  case VK_FORMAT_BC7_SRGB_BLOCK:
+  case VK_FORMAT_ASTC_4x4_UNORM_BLOCK:
+  case VK_FORMAT_ASTC_4x4_SRGB_BLOCK:
+  case VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK:
+  case VK_FORMAT_ETC2_R8G8B8A8_SRGB_BLOCK:
+    block.width = block.height = 4;
+    block.bytes = 16;
+    break;
+  case VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK:
+  case VK_FORMAT_ETC2_R8G8B8_SRGB_BLOCK:
+    block.width = block.height = 4;
+    block.bytes = 8;
+    break;
+  default:
+    break;
+  }
+  return block;
+}
+
+const char* formatName(VkFormat format)
+{
+  switch (format)
+  {
+  case VK_FORMAT_R8G8B8A8_UNORM: return "rgba8";
+  case VK_FORMAT_R8G8B8A8_SRGB: return "rgba8_srgb";
+  case VK_FORMAT_BC7_UNORM_BLOCK: return "bc7";
+  case VK_FORMAT_BC7_SRGB_BLOCK: return "bc7_srgb";
+  case VK_FORMAT_ASTC_4x4_UNORM_BLOCK: return "astc_4x4";
+  case VK_FORMAT_ASTC_4x4_SRGB_BLOCK: return "astc_4x4_srgb";
+  case VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK: return "etc2_rgba8";
+  case VK_FORMAT_ETC2_R8G8B8A8_SRGB_BLOCK: return "etc2_rgba8_srgb";
+  case VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK: return "etc2_rgb8";
+  case VK_FORMAT_ETC2_R8G8B8_SRGB_BLOCK: return "etc2_rgb8_srgb";
+  default: return "unknown";
+  }
+}
+
+DecodedImage decodePpm(const Asset& file, const std::string& name)
+{
+  const char* data = file.data();
+  size_t size = file.size();
+  size_t position = 2;
+
+  if (size < 2 || data[0] != 'P' || data[1] != '6')
+    throw std::runtime_error(name + " isn't a binary PPM!");
+
+  // Header fields are separated by whitespace, # comments run to the end
+  // of the line
+  auto readNumber = [&]() -> uint32_t
+  {
+    while (position < size)
+    {
+      if (std::isspace(static_cast<unsigned char>(data[position])))
+        ++position;
+      else if (data[position] == '#')
+      {
+        while (position < size && data[position] != '\n')
+          ++position;
+      }
+      else
+        break;
+    }
+
+    size_t start = position;
+    uint64_t value = 0;
+    while (position < size && std::isdigit(static_cast<unsigned char>(data[position])))
+    {
+      value = value * 10 + static_cast<uint64_t>(data[position] - '0');
+      if (value > UINT32_MAX)
+        throw std::runtime_error(name + " has a broken PPM header!");
+      ++position;
+    }
+    if (position == start)
+      throw std::runtime_error(name + " has a broken PPM header!");
+    return static_cast<uint32_t>(value);
+  };
+
+  uint32_t width = readNumber();
+  uint32_t height = readNumber();
+  uint32_t maxValue = readNumber();
+  if (width == 0 || height == 0 || maxValue != 255)
+    throw std::runtime_error(name + " has to be a non-empty PPM with 8-bit channels!");
+
+  // Exactly one whitespace character separates the header from the pixels
+  if (position >= size || !std::isspace(static_cast<unsigned char>(data[position])))
+    throw std::runtime_error(name + " has a broken PPM header!");
+  ++position;
+
+  uint64_t texelCount = static_cast<uint64_t>(width) * height;
+  if (texelCount * 3 > size - position)
+    throw std::runtime_error(name + " is truncated!");
+
+  // Straight out of the mapping, there is no RGB8 format worth uploading
+  std::vector<uint8_t> pixels(static_cast<size_t>(texelCount * 4));
+  const unsigned char* source = reinterpret_cast<const unsigned char*>(data + position);
+  uint8_t* destination = pixels.data();
+  for (uint64_t i = 0; i < texelCount; ++i)
+  {
+    destination[0] = source[0];
+    destination[1] = source[1];
+    destination[2] = source[2];
+    destination[3] = 255;
+    source += 3;
+    destination += 4;
+  }
+
+  DecodedImage image;
+  image.width = width;
+  image.height = height;
+  ImageLevel level;
+  level.width = width;
+  level.height = height;
+  level.size = pixels.size();
+  image.levels.push_back(level);
+  image.data = Asset::fromBytes(std::move(pixels));
+  return image;
+}
+
+DecodedImage decodeKtx2(const Asset& file, const std::string& name)
+{
+  Ktx2Header header;
+  if (file.size() < sizeof(header))
+    throw std::runtime_error(name + " isn't a KTX2 file!");
+  std::memcpy(&header, file.data(), sizeof(header));
+  if (std::memcmp(header.identifier, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) != 0)
+    throw std::runtime_error(name + " isn't a KTX2 file!");
+
+  if (header.supercompressionScheme != 0)
+    throw std::runtime_error(name + " is supercompressed, only plain KTX2 is supported!");
+  if (header.pixelWidth == 0 || header.pixelHeight == 0 || header.pixelDepth > 1 ||
+    header.layerCount > 1 || header.faceCount != 1)
+    throw std::runtime_error(name + " isn't a single 2D image!");
+
+  DecodedImage image;
+  image.format = static_cast<VkFormat>(header.vkFormat);
+  image.width = header.pixelWidth;
+  image.height = header.pixelHeight;
+  TexelBlock block = texelBlock(image.format);
+  if (block.bytes == 0)
+    throw std::runtime_error(name + " has an unsupported format!");
+
+  // 0 asks for the mips to be generated, there is just the base level then
+  uint32_t levelCount = std::max(header.levelCount, 1u);
+  if (levelCount > 32 || sizeof(header) + static_cast<uint64_t>(levelCount) * sizeof(Ktx2Level) > file.size())
+    throw std::runtime_error(name + " has a broken level index!");
+
+  for (uint32_t i = 0; i < levelCount; ++i)
+  {
+    Ktx2Level entry;
+    std::memcpy(&entry, file.data() + sizeof(header) + i * sizeof(Ktx2Level), sizeof(entry));
+
+    ImageLevel level;
+    level.width = std::max(image.width >> i, 1u);
+    level.height = std::max(image.height >> i, 1u);
+    level.offset = static_cast<size_t>(entry.byteOffset);
+    level.size = levelSize(block, level.width, level.height);
+    if (entry.byteLength != level.size || entry.byteOffset > file.size() || entry.byteLength > file.size() - entry.byteOffset)
+      throw std::runtime_error(name + " has a broken level index!");
+    image.levels.push_back(level);
+  }
+
+  image.data = file;
+  return image;
+}
+
+bool canTranscode(VkFormat format)
+{
+  return format == VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK || format == VK_FORMAT_ETC2_R8G8B8_SRGB_BLOCK ||
+    format == VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK || format == VK_FORMAT_ETC2_R8G8B8A8_SRGB_BLOCK;
+}
+
+DecodedImage transcodeToRgba8(const DecodedImage& image)
+{
+  if (!canTranscode(image.format))
+    throw std::runtime_error(std::string("can't transcode ") + formatName(image.format) + " textures!");
+
+  bool srgb = image.format == VK_FORMAT_ETC2_R8G8B8_SRGB_BLOCK || image.format == VK_FORMAT_ETC2_R8G8B8A8_SRGB_BLOCK;
+  bool alpha = image.format == VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK || image.format == VK_FORMAT_ETC2_R8G8B8A8_SRGB_BLOCK;
+  TexelBlock block = texelBlock(image.format);
+
+  DecodedImage result;
+  result.format = srgb ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM;
+  result.width = image.width;
+  result.height = image.height;
+  result.transcoded = true;
+
+  size_t totalSize = 0;
+  for (const auto& level : image.levels)
+  {
+    ImageLevel decoded;
+    decoded.width = level.width;
+    decoded.height = level.height;
+    decoded.offset = totalSize;
+    decoded.size = static_cast<size_t>(level.width) * level.height * 4;
+    totalSize += decoded.size;
+    result.levels.push_back(decoded);
+  }
+
+  // Each block lands in place, edge blocks only write the texels that exist
+  std::vector<uint8_t> pixels(totalSize);
+  for (size_t i = 0; i < image.levels.size(); ++i)
+  {
+    const ImageLevel& level = image.levels[i];
+    const uint8_t* source = reinterpret_cast<const uint8_t*>(image.data.data() + level.offset);
+    uint8_t* destination = pixels.data() + result.levels[i].offset;
+    size_t rowPitch = static_cast<size_t>(level.width) * 4;
+
+    for (uint32_t y = 0; y < level.height; y += block.height)
+    {
+      for (uint32_t x = 0; x < level.width; x += block.width)
+      {
+        uint8_t* texels = destination + y * rowPitch + x * 4;
+        uint32_t width = level.width - x;
+        uint32_t height = level.height - y;
+        // The alpha block comes first and is written after the color
+        const uint8_t* color = alpha ? source + 8 : source;
+        decodeEtc2Color(color, texels, rowPitch, width, height);
+        if (alpha)
+          decodeEacAlpha(source, texels, rowPitch, width, height);
+        source += block.bytes;
+      }
+    }
+  }
+
+  result.data = Asset::fromBytes(std::move(pixels));
+  return result;
+}
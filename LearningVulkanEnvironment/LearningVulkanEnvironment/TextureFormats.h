@@ -0,0 +1,66 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "AssetIO.h"
+
+// Texels and bytes of one block of a format, 1x1 for uncompressed formats
+struct TexelBlock
+{
+  uint32_t width = 1;
+  uint32_t height = 1;
+  // 0 for formats textures can't be made of
+  uint32_t bytes = 0;
+};
+
+TexelBlock texelBlock(VkFormat format);
+const char* formatName(VkFormat format);
+
+// One mip level of DecodedImage::data, whole blocks tightly packed
+struct ImageLevel
+{
+  uint32_t width = 0;
+  uint32_t height = 0;
+  size_t offset = 0;
+  size_t size = 0;
+};
+
+// An image ready to be copied into a texture as it is
+struct DecodedImage
+{
+  VkFormat format = VK_FORMAT_R8G8B8A8_UNORM;
+  uint32_t width = 0;
+  uint32_t height = 0;
+  // Level 0 first. Just the base level when the file has no mips, the rest
+  // is then blit on the GPU if the format allows.
+  std::vector<ImageLevel> levels;
+  // Decoded into memory, or the file mapping itself when the file already
+  // holds the data in a format the device can sample
+  Asset data;
+  // Whether the CPU had to decode a compressed format the device lacks
+  bool transcoded = false;
+  double decodeMs = 0.0;
+};
+
+// Binary PPM (P6) with 8-bit channels, the format --output writes, as
+// R8G8B8A8. Throws if the data isn't one.
+DecodedImage decodePpm(const Asset& file, const std::string& name);
+
+/*
+  KTX2 container of a single 2D image, with or without its mip chain.
+  Levels are used straight out of the mapping, nothing is copied. Array
+  layers, cube faces, 3D images and supercompression (Basis Universal,
+  zstd) aren't supported and throw, as does a format texelBlock() doesn't
+  know.
+*/
+DecodedImage decodeKtx2(const Asset& file, const std::string& name);
+
+// Whether transcodeToRgba8 can decode the format: ETC2 RGB and RGBA
+bool canTranscode(VkFormat format);
+// Every level decoded to R8G8B8A8, sRGB if the source was
+DecodedImage transcodeToRgba8(const DecodedImage& image);
@@ -0,0 +1,601 @@
+#include "TextureStreamer.h"
+
+#include <algorithm>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+
+#include "Benchmark.h"
+
+namespace
+{
+  const uint32_t TEXEL_SIZE = 4;
+  // Suffixes of the KTX2 variants of a texture, in order of preference
+  const char* const KTX2_VARIANTS[] = { ".bc7", ".astc", ".etc2", "" };
+  // Decoding mostly waits on page faults, two threads keep a queue moving
+  // without competing with the recording threads
+  const unsigned DECODE_THREADS = 2;
+  // Placeholder checkerboard: size in texels and size of one square
+  const uint32_t PLACEHOLDER_SIZE = 8;
+  const uint32_t PLACEHOLDER_SQUARE = 4;
+
+  // Every level down to 1x1
+  uint32_t fullMipCount(uint32_t width, uint32_t height)
+  {
+    uint32_t levels = 1;
+    for (uint32_t size = std::max(width, height); size > 1; size /= 2)
+      ++levels;
+    return levels;
+  }
+
+  VkDeviceSize rgba8ChainSize(uint32_t width, uint32_t height, uint32_t levels)
+  {
+    VkDeviceSize size = 0;
+    for (uint32_t level = 0; level < levels; ++level)
+      size += static_cast<VkDeviceSize>(std::max(width >> level, 1u)) * std::max(height >> level, 1u) * TEXEL_SIZE;
+    return size;
+  }
+
+  DecodedImage makePlaceholder()
+  {
+    std::vector<uint8_t> pixels(PLACEHOLDER_SIZE * PLACEHOLDER_SIZE * TEXEL_SIZE);
+    for (uint32_t y = 0; y < PLACEHOLDER_SIZE; ++y)
+    {
+      for (uint32_t x = 0; x < PLACEHOLDER_SIZE; ++x)
+      {
+        bool light = ((x / PLACEHOLDER_SQUARE) + (y / PLACEHOLDER_SQUARE)) % 2 == 0;
+        uint8_t* texel = &pixels[(y * PLACEHOLDER_SIZE + x) * TEXEL_SIZE];
+        texel[0] = texel[1] = texel[2] = light ? 192 : 96;
+        texel[3] = 255;
+      }
+    }
+
+    DecodedImage image;
+    image.width = PLACEHOLDER_SIZE;
+    image.height = PLACEHOLDER_SIZE;
+    ImageLevel level;
+    level.width = PLACEHOLDER_SIZE;
+    level.height = PLACEHOLDER_SIZE;
+    level.size = pixels.size();
+    image.levels.push_back(level);
+    image.data = Asset::fromBytes(std::move(pixels));
+    return image;
+  }
+
+  bool endsWith(const std::string& text, const std::string& suffix)
+  {
+    return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+  }
+
+  /*
+    The first variant of a KTX2 texture the device can sample, or an ETC2
+    one decoded to RGBA8 if there is none. Anything else is a PPM.
+  */
+  DecodedImage loadImage(AssetLoader& loader, const std::string& path, const std::vector<VkFormat>& sampleable)
+  {
+    if (!endsWith(path, ".ktx2"))
+      return decodePpm(loader.open(path), path);
+
+    std::string stem = path.substr(0, path.size() - 5);
+    bool found = false;
+    DecodedImage fallback;
+    for (const char* variant : KTX2_VARIANTS)
+    {
+      std::string variantPath = stem + variant + ".ktx2";
+      Asset file = loader.tryOpen(variantPath);
+      if (file.empty())
+        continue;
+      found = true;
+
+      DecodedImage image = decodeKtx2(file, variantPath);
+      if (texelBlock(image.format).width == 1 ||
+        std::find(sampleable.begin(), sampleable.end(), image.format) != sampleable.end())
+        return image;
+      if (fallback.levels.empty() && canTranscode(image.format))
+        fallback = image;
+    }
+
+    if (!found)
+      throw std::runtime_error("failed to find " + path + " or any of its variants!");
+    if (fallback.levels.empty())
+      throw std::runtime_error(path + " has no variant the device can sample or that can be transcoded!");
+    return transcodeToRgba8(fallback);
+  }
+
+  const char* stateName(int state)
+  {
+    static const char* NAMES[] = { "decoding", "uploading", "resident", "failed" };
+    return NAMES[state];
+  }
+}
+
+void TextureStreamer::create(VkDevice logicalDevice, VkPhysicalDevice gpu, const VkPhysicalDeviceFeatures& enabledFeatures,
+  GpuAllocator& gpuAllocator, StagingUploader& stagingUploader, AssetLoader& assetLoader, uint32_t graphicsQueueFamily,
+  uint32_t frameCount, VkDeviceSize uploadBudget, bool allowCompressed)
+{
+  device = logicalDevice;
+  physicalDevice = gpu;
+  allocator = &gpuAllocator;
+  uploader = &stagingUploader;
+  assets = &assetLoader;
+  graphicsFamily = graphicsQueueFamily;
+  budget = uploadBudget;
+
+  // A whole family of formats comes with its feature, but a format can
+  // still lack sampling on its own
+  struct CompressedFamily
+  {
+    VkBool32 enabled;
+    VkFormat formats[4];
+  };
+  const CompressedFamily families[] =
+  {
+    { enabledFeatures.textureCompressionBC, { VK_FORMAT_BC7_UNORM_BLOCK, VK_FORMAT_BC7_SRGB_BLOCK } },
+    { enabledFeatures.textureCompressionASTC_LDR, { VK_FORMAT_ASTC_4x4_UNORM_BLOCK, VK_FORMAT_ASTC_4x4_SRGB_BLOCK } },
+    { enabledFeatures.textureCompressionETC2, { VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK, VK_FORMAT_ETC2_R8G8B8_SRGB_BLOCK,
+      VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK, VK_FORMAT_ETC2_R8G8B8A8_SRGB_BLOCK } }
+  };
+
+  sampleableFormats.clear();
+  for (const auto& family : families)
+  {
+    if (!allowCompressed || !family.enabled)
+      continue;
+    for (VkFormat format : family.formats)
+    {
+      if (format == VK_FORMAT_UNDEFINED)
+        continue;
+      VkFormatProperties formatProperties;
+      vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &formatProperties);
+      if ((formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) != 0)
+        sampleableFormats.push_back(format);
+    }
+  }
+
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+  maxDimension = properties.limits.maxImageDimension2D;
+
+  VkSamplerCreateInfo samplerInfo = {};
+  samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+  samplerInfo.magFilter = VK_FILTER_LINEAR;
+  samplerInfo.minFilter = VK_FILTER_LINEAR;
+  samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+  samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+  samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+  samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+  samplerInfo.anisotropyEnable = VK_FALSE;
+  samplerInfo.maxAnisotropy = 1.0f;
+  samplerInfo.minLod = 0.0f;
+  samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+  samplerInfo.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
+
+  if (vkCreateSampler(device, &samplerInfo, nullptr, &sampler) != VK_SUCCESS)
+    throw std::runtime_error("failed to create texture sampler!");
+
+  // Rerecorded every frame that has textures to transition
+  VkCommandPoolCreateInfo poolInfo = {};
+  poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+  poolInfo.queueFamilyIndex = graphicsFamily;
+  poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+  frames.resize(frameCount);
+  for (auto& frame : frames)
+  {
+    if (vkCreateCommandPool(device, &poolInfo, nullptr, &frame.commandPool) != VK_SUCCESS)
+      throw std::runtime_error("failed to create texture command pool!");
+
+    VkCommandBufferAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.commandPool = frame.commandPool;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandBufferCount = 1;
+
+    if (vkAllocateCommandBuffers(device, &allocInfo, &frame.commandBuffer) != VK_SUCCESS)
+      throw std::runtime_error("failed to allocate texture command buffer!");
+  }
+
+  decoders.reset(new ThreadPool(DECODE_THREADS));
+
+  // The placeholder goes up with the first frame, outside the budget
+  textures.resize(1);
+  Texture& placeholder = textures[PLACEHOLDER];
+  placeholder.path = "placeholder";
+  placeholder.requested = std::chrono::steady_clock::now();
+  DecodedImage image = makePlaceholder();
+  createTexture(placeholder, image);
+  budgetLeft = std::numeric_limits<VkDeviceSize>::max();
+  if (!uploadRows(placeholder))
+    throw std::runtime_error("not enough staging space left for the placeholder texture!");
+  placeholder.state = State::Resident;
+  staged.push_back(PLACEHOLDER);
+  ++resident;
+}
+
+void TextureStreamer::destroy()
+{
+  // Lets the decodes that already started finish, they use the asset loader
+  decoders.reset();
+  decoding.clear();
+  uploadQueue.clear();
+  staged.clear();
+
+  for (auto& texture : textures)
+  {
+    if (texture.view != VK_NULL_HANDLE)
+      vkDestroyImageView(device, texture.view, nullptr);
+    if (texture.image != VK_NULL_HANDLE)
+      allocator->destroyImage(texture.image, texture.memory);
+  }
+  textures.clear();
+
+  for (auto& frame : frames)
+    vkDestroyCommandPool(device, frame.commandPool, nullptr);
+  frames.clear();
+
+  if (sampler != VK_NULL_HANDLE)
+    vkDestroySampler(device, sampler, nullptr);
+  sampler = VK_NULL_HANDLE;
+}
+
+TextureHandle TextureStreamer::request(const std::string& path)
+{
+  TextureHandle handle = static_cast<TextureHandle>(textures.size());
+  textures.push_back(Texture());
+  textures.back().path = path;
+  textures.back().requested = std::chrono::steady_clock::now();
+
+  // Opening maps the file, the pages are only read while decoding
+  AssetLoader* loader = assets;
+  std::vector<VkFormat> sampleable = sampleableFormats;
+  decoding.push_back(std::make_pair(handle, decoders->submit([loader, path, sampleable]()
+  {
+    auto start = std::chrono::steady_clock::now();
+    DecodedImage image = loadImage(*loader, path, sampleable);
+    image.decodeMs = millisecondsSince(start);
+    return image;
+  })));
+  return handle;
+}
+
+void TextureStreamer::beginFrame(uint32_t frame)
+{
+  currentFrame = frame;
+  budgetLeft = budget;
+
+  // Only picks up decodes that are done, never waits on one
+  for (auto entry = decoding.begin(); entry != decoding.end();)
+  {
+    if (entry->second.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+    {
+      ++entry;
+      continue;
+    }
+
+    Texture& texture = textures[entry->first];
+    try
+    {
+      DecodedImage decoded = entry->second.get();
+      texture.decodeMs = decoded.decodeMs;
+      createTexture(texture, decoded);
+      texture.state = State::Uploading;
+      uploadQueue.push_back(entry->first);
+    }
+    catch (const std::exception& e)
+    {
+      texture.state = State::Failed;
+      std::cerr << "failed to load texture, keeping the placeholder: " << e.what() << std::endl;
+    }
+    entry = decoding.erase(entry);
+  }
+
+  if (uploadQueue.empty())
+    return;
+
+  ++framesUploading;
+  while (!uploadQueue.empty())
+  {
+    Texture& texture = textures[uploadQueue.front()];
+    if (!uploadRows(texture))
+    {
+      ++framesAtBudget;
+      break;
+    }
+
+    // Resident as of this frame: recordTransitions() runs ahead of anything
+    // the frame draws with it
+    texture.state = State::Resident;
+    texture.residentMs = millisecondsSince(texture.requested);
+    staged.push_back(uploadQueue.front());
+    ++resident;
+    uploadQueue.pop_front();
+  }
+}
+
+void TextureStreamer::createTexture(Texture& texture, DecodedImage& decoded)
+{
+  if (decoded.width > maxDimension || decoded.height > maxDimension)
+    throw std::runtime_error(texture.path + " is larger than the device supports!");
+
+  texture.format = decoded.format;
+  texture.width = decoded.width;
+  texture.height = decoded.height;
+  texture.levels.swap(decoded.levels);
+  texture.data = decoded.data;
+  texture.transcoded = decoded.transcoded;
+  texture.uploadLevel = 0;
+  texture.blockRowsUploaded = 0;
+
+  // Mips that came with the file are used as they are
+  if (texture.levels.size() > 1)
+    texture.mipLevels = static_cast<uint32_t>(texture.levels.size());
+  else
+    texture.mipLevels = canGenerateMips(texture.format) ? fullMipCount(texture.width, texture.height) : 1;
+  texture.rgba8Bytes = rgba8ChainSize(texture.width, texture.height, texture.mipLevels);
+
+  // Exclusive to one family at a time, the uploader transfers ownership
+  VkImageCreateInfo imageInfo = {};
+  imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+  imageInfo.imageType = VK_IMAGE_TYPE_2D;
+  imageInfo.format = texture.format;
+  imageInfo.extent.width = texture.width;
+  imageInfo.extent.height = texture.height;
+  imageInfo.extent.depth = 1;
+  imageInfo.mipLevels = texture.mipLevels;
+  imageInfo.arrayLayers = 1;
+  imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+  imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+  imageInfo.usage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+  imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+  allocator->createImage(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, texture.image, texture.memory);
+
+  VkMemoryRequirements memRequirements;
+  vkGetImageMemoryRequirements(device, texture.image, &memRequirements);
+  texture.gpuBytes = memRequirements.size;
+
+  VkImageViewCreateInfo viewInfo = {};
+  viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+  viewInfo.image = texture.image;
+  viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+  viewInfo.format = texture.format;
+  viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  viewInfo.subresourceRange.baseMipLevel = 0;
+  viewInfo.subresourceRange.levelCount = texture.mipLevels;
+  viewInfo.subresourceRange.baseArrayLayer = 0;
+  viewInfo.subresourceRange.layerCount = 1;
+
+  if (vkCreateImageView(device, &viewInfo, nullptr, &texture.view) != VK_SUCCESS)
+    throw std::runtime_error("failed to create texture image view!");
+}
+
+bool TextureStreamer::uploadRows(Texture& texture)
+{
+  // Compressed formats are copied in whole blocks, a band is a number of
+  // rows of blocks
+  TexelBlock block = texelBlock(texture.format);
+  // In block rows for compressed formats, like the bands
+  uint32_t granularityRows = uploader->imageGranularity().height;
+  bool uploading = false;
+  while (texture.uploadLevel < texture.levels.size())
+  {
+    const ImageLevel& level = texture.levels[texture.uploadLevel];
+    uint32_t blockRows = (level.height + block.height - 1) / block.height;
+    if (texture.blockRowsUploaded == blockRows)
+    {
+      ++texture.uploadLevel;
+      texture.blockRowsUploaded = 0;
+      continue;
+    }
+
+    // Bands start at a multiple of the granularity and span one too,
+    // except for the last band of the level. A granularity of 0 means
+    // the whole level in one go.
+    uint32_t rowStep = granularityRows == 0 ? blockRows : granularityRows;
+    VkDeviceSize rowPitch = level.size / blockRows;
+    uint32_t rowsLeft = blockRows - texture.blockRowsUploaded;
+    uint32_t rows = static_cast<uint32_t>(std::min<VkDeviceSize>(budgetLeft / rowPitch, rowsLeft));
+    if (rows < rowsLeft)
+      rows -= rows % rowStep;
+    if (rows == 0)
+    {
+      // A band larger than the whole budget still has to go up, on its own
+      if (budgetLeft < budget)
+        break;
+      rows = std::min(rowStep, rowsLeft);
+    }
+
+    uint32_t y = texture.blockRowsUploaded * block.height;
+    VkBufferImageCopy region = {};
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.mipLevel = texture.uploadLevel;
+    region.imageSubresource.baseArrayLayer = 0;
+    region.imageSubresource.layerCount = 1;
+    region.imageOffset = { 0, static_cast<int32_t>(y), 0 };
+    region.imageExtent = { level.width, std::min(rows * block.height, level.height - y), 1 };
+
+    VkDeviceSize size = rows * rowPitch;
+    const char* data = texture.data.data() + level.offset + texture.blockRowsUploaded * rowPitch;
+    bool firstUpload = texture.uploadLevel == 0 && texture.blockRowsUploaded == 0;
+    if (!uploader->uploadImage(texture.image, region, data, size, firstUpload))
+      break;
+
+    texture.blockRowsUploaded += rows;
+    budgetLeft -= std::min(size, budgetLeft);
+    bytesUploaded += size;
+    uploading = true;
+  }
+
+  if (uploading)
+    ++texture.uploadFrames;
+  if (texture.uploadLevel < texture.levels.size())
+    return false;
+
+  // Drops the mapping or the decoded copy
+  texture.data = Asset();
+  uploader->releaseImage(texture.image, graphicsFamily);
+  return true;
+}
+
+VkCommandBuffer TextureStreamer::recordTransitions()
+{
+  if (staged.empty())
+    return VK_NULL_HANDLE;
+
+  // The caller waited on the frame's fence, which covers this buffer too
+  Frame& frame = frames[currentFrame];
+  vkResetCommandPool(device, frame.commandPool, 0);
+
+  VkCommandBufferBeginInfo beginInfo = {};
+  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+  vkBeginCommandBuffer(frame.commandBuffer, &beginInfo);
+
+    // Takes ownership from the transfer queue. With a single family it is
+    // still the dependency that orders the copies before the blits.
+    acquires.clear();
+    for (TextureHandle handle : staged)
+      acquires.push_back(uploader->acquireBarrier(textures[handle].image, graphicsFamily));
+    vkCmdPipelineBarrier(frame.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+      0, nullptr, 0, nullptr, static_cast<uint32_t>(acquires.size()), acquires.data());
+
+    for (TextureHandle handle : staged)
+      recordMipChain(frame.commandBuffer, textures[handle]);
+
+  if (vkEndCommandBuffer(frame.commandBuffer) != VK_SUCCESS)
+    throw std::runtime_error("failed to record texture command buffer!");
+
+  staged.clear();
+  return frame.commandBuffer;
+}
+
+void TextureStreamer::recordMipChain(VkCommandBuffer commandBuffer, const Texture& texture)
+{
+  VkImageMemoryBarrier barrier = {};
+  barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.image = texture.image;
+  barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  barrier.subresourceRange.levelCount = 1;
+  barrier.subresourceRange.baseArrayLayer = 0;
+  barrier.subresourceRange.layerCount = 1;
+
+  // Every level was uploaded, there is nothing to blit
+  if (texture.levels.size() > 1)
+  {
+    barrier.subresourceRange.baseMipLevel = 0;
+    barrier.subresourceRange.levelCount = texture.mipLevels;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+      0, nullptr, 0, nullptr, 1, &barrier);
+    return;
+  }
+
+  // Each level is blit from the one above once that one is complete
+  int32_t width = static_cast<int32_t>(texture.width);
+  int32_t height = static_cast<int32_t>(texture.height);
+  for (uint32_t level = 1; level < texture.mipLevels; ++level)
+  {
+    barrier.subresourceRange.baseMipLevel = level - 1;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+      0, nullptr, 0, nullptr, 1, &barrier);
+
+    int32_t nextWidth = std::max(width / 2, 1);
+    int32_t nextHeight = std::max(height / 2, 1);
+
+    VkImageBlit blit = {};
+    blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    blit.srcSubresource.mipLevel = level - 1;
+    blit.srcSubresource.baseArrayLayer = 0;
+    blit.srcSubresource.layerCount = 1;
+    blit.srcOffsets[1] = { width, height, 1 };
+    blit.dstSubresource = blit.srcSubresource;
+    blit.dstSubresource.mipLevel = level;
+    blit.dstOffsets[1] = { nextWidth, nextHeight, 1 };
+    vkCmdBlitImage(commandBuffer, texture.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+      texture.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_LINEAR);
+
+    width = nextWidth;
+    height = nextHeight;
+  }
+
+  // Every level but the last was a blit source, the last one was written
+  VkImageMemoryBarrier toShader[2] = { barrier, barrier };
+  uint32_t barrierCount = 0;
+  if (texture.mipLevels > 1)
+  {
+    VkImageMemoryBarrier& sources = toShader[barrierCount++];
+    sources.subresourceRange.baseMipLevel = 0;
+    sources.subresourceRange.levelCount = texture.mipLevels - 1;
+    sources.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    sources.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    sources.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    sources.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+  }
+  VkImageMemoryBarrier& last = toShader[barrierCount++];
+  last.subresourceRange.baseMipLevel = texture.mipLevels - 1;
+  last.subresourceRange.levelCount = 1;
+  last.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  last.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+  last.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  last.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+    0, nullptr, 0, nullptr, barrierCount, toShader);
+}
+
+bool TextureStreamer::canGenerateMips(VkFormat format) const
+{
+  // Mips are blit from the level above, which needs linear filtering of
+  // the format. Compressed formats can't be blit into at all.
+  VkFormatProperties formatProperties;
+  vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &formatProperties);
+  VkFormatFeatureFlags blitFeatures = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT |
+    VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+  return (formatProperties.optimalTilingFeatures & blitFeatures) == blitFeatures;
+}
+
+bool TextureStreamer::isResident(TextureHandle texture) const
+{
+  return texture < textures.size() && textures[texture].state == State::Resident;
+}
+
+VkDescriptorImageInfo TextureStreamer::descriptorInfo(TextureHandle texture) const
+{
+  const Texture& shown = textures[isResident(texture) ? texture : PLACEHOLDER];
+
+  VkDescriptorImageInfo imageInfo = {};
+  imageInfo.sampler = sampler;
+  imageInfo.imageView = shown.view;
+  imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+  return imageInfo;
+}
+
+void TextureStreamer::writeReport(std::ostream& out) const
+{
+  out << "texture,format,width,height,mip_levels,gpu_bytes,rgba8_bytes,transcoded,upload_frames,state,decode_ms,resident_ms\n";
+  for (size_t i = PLACEHOLDER + 1; i < textures.size(); ++i)
+  {
+    const Texture& texture = textures[i];
+    out << texture.path << ',' << formatName(texture.format) << ',' << texture.width << ',' << texture.height << ','
+      << texture.mipLevels << ',' << texture.gpuBytes << ',' << texture.rgba8Bytes << ','
+      << (texture.transcoded ? 1 : 0) << ',' << texture.uploadFrames << ','
+      << stateName(static_cast<int>(texture.state)) << ',' << texture.decodeMs << ',' << texture.residentMs << '\n';
+  }
+
+  out << "texture_upload,value\n"
+    << "budget_bytes," << budget << '\n'
+    << "bytes_uploaded," << bytesUploaded << '\n'
+    << "frames_uploading," << framesUploading << '\n'
+    << "frames_at_budget," << framesAtBudget << std::endl;
+}
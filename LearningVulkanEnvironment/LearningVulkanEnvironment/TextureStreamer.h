@@ -0,0 +1,167 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "AssetIO.h"
+#include "GpuAllocator.h"
+#include "StagingUploader.h"
+#include "TextureFormats.h"
+#include "ThreadPool.h"
+
+typedef uint32_t TextureHandle;
+
+/*
+  Streams textures in without ever blocking a frame. A request returns a
+  handle right away, the file is opened and decoded on worker threads, and
+  every frame beginFrame() picks up whatever finished decoding and hands up
+  to the frame's byte budget of it to the StagingUploader. Large images are
+  split into bands of block rows, so one texture can take several frames
+  but no frame uploads more than the budget (at least one band goes up per
+  frame). Bands are cut at the transfer queue's image granularity, a queue
+  that can only copy whole mip levels gets one level per band.
+
+  KTX2 files can come in several variants next to each other, e.g.
+  rock.bc7.ktx2, rock.astc.ktx2 and rock.etc2.ktx2 for a request of
+  rock.ktx2. The first one in a format the device can sample is uploaded
+  as it is, straight out of the mapping. If there is none, an ETC2 variant
+  is decoded to RGBA8 on the worker instead, at four to eight times the
+  memory and upload bytes.
+
+  Once every row is up, the transfer queue releases the image and the
+  command buffer recordTransitions() returns acquires it on the graphics
+  queue, blits the mip chain and moves it to shader read. That command
+  buffer has to go into the same graphics submit as the frame, ahead of the
+  frame's own, waiting on the uploader's semaphore at the transfer stage.
+
+  Until then view() hands out a small checkerboard placeholder, so callers
+  can always bind something. A texture that fails to load keeps it.
+*/
+class TextureStreamer
+{
+public:
+  // Handle of the placeholder, always resident
+  static const TextureHandle PLACEHOLDER = 0;
+
+  // enabledFeatures are the ones the device was created with, compressed
+  // formats are only used if their texture compression feature is on.
+  // Without allowCompressed every compressed texture is transcoded.
+  void create(VkDevice device, VkPhysicalDevice physicalDevice, const VkPhysicalDeviceFeatures& enabledFeatures,
+    GpuAllocator& allocator, StagingUploader& uploader, AssetLoader& assets, uint32_t graphicsFamily,
+    uint32_t frameCount, VkDeviceSize uploadBudget, bool allowCompressed);
+  // The device must be idle
+  void destroy();
+
+  // Starts loading the file, the handle shows the placeholder until then
+  TextureHandle request(const std::string& path);
+
+  // Call after the uploader's beginFrame, before its submit
+  void beginFrame(uint32_t frame);
+  // The graphics work for textures that became resident this frame, or
+  // VK_NULL_HANDLE if there is none
+  VkCommandBuffer recordTransitions();
+
+  bool isResident(TextureHandle texture) const;
+  // Goes up every time a texture becomes resident, command buffers that
+  // were recorded before a change still sample the placeholder
+  uint32_t residentCount() const { return resident; }
+
+  // For a combined image sampler, in shader read only layout
+  VkDescriptorImageInfo descriptorInfo(TextureHandle texture) const;
+
+  // Per texture format, memory, how many frames its upload was spread over
+  // and how long decoding and becoming resident took
+  void writeReport(std::ostream& out) const;
+
+private:
+  enum class State
+  {
+    Decoding,
+    Uploading,
+    Resident,
+    Failed
+  };
+
+  struct Texture
+  {
+    std::string path;
+    State state = State::Decoding;
+    VkImage image = VK_NULL_HANDLE;
+    GpuAllocation memory;
+    VkImageView view = VK_NULL_HANDLE;
+    VkFormat format = VK_FORMAT_R8G8B8A8_UNORM;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    // Levels in the file, the rest of mipLevels is blit on the GPU
+    std::vector<ImageLevel> levels;
+    uint32_t mipLevels = 1;
+    // Released once the last row is staged
+    Asset data;
+    uint32_t uploadLevel = 0;
+    uint32_t blockRowsUploaded = 0;
+    uint32_t uploadFrames = 0;
+    VkDeviceSize gpuBytes = 0;
+    // What the same image would take as RGBA8 with every level
+    VkDeviceSize rgba8Bytes = 0;
+    bool transcoded = false;
+    std::chrono::steady_clock::time_point requested;
+    double decodeMs = 0.0;
+    double residentMs = 0.0;
+  };
+
+  struct Frame
+  {
+    VkCommandPool commandPool = VK_NULL_HANDLE;
+    VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+  };
+
+  void createTexture(Texture& texture, DecodedImage& decoded);
+  // Stages block rows of the texture within the budget left, true once it
+  // is completely staged
+  bool uploadRows(Texture& texture);
+  void recordMipChain(VkCommandBuffer commandBuffer, const Texture& texture);
+  // Whether the format can be blit with linear filtering, no mips otherwise
+  bool canGenerateMips(VkFormat format) const;
+
+  VkDevice device = VK_NULL_HANDLE;
+  VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+  GpuAllocator* allocator = nullptr;
+  StagingUploader* uploader = nullptr;
+  AssetLoader* assets = nullptr;
+  uint32_t graphicsFamily = 0;
+  VkDeviceSize budget = 0;
+  VkDeviceSize budgetLeft = 0;
+  uint32_t maxDimension = 0;
+  // Compressed formats the device samples with the features enabled
+  std::vector<VkFormat> sampleableFormats;
+
+  VkSampler sampler = VK_NULL_HANDLE;
+  // Handles index into here
+  std::vector<Texture> textures;
+  uint32_t resident = 0;
+
+  std::unique_ptr<ThreadPool> decoders;
+  std::vector<std::pair<TextureHandle, std::future<DecodedImage>>> decoding;
+  // Decoded and waiting for budget, first come first served
+  std::deque<TextureHandle> uploadQueue;
+  // Completely staged this frame, their transitions still have to be recorded
+  std::vector<TextureHandle> staged;
+  // Reused by recordTransitions so it doesn't allocate
+  std::vector<VkImageMemoryBarrier> acquires;
+
+  std::vector<Frame> frames;
+  uint32_t currentFrame = 0;
+
+  // Budget stats for the report
+  uint64_t bytesUploaded = 0;
+  uint32_t framesUploading = 0;
+  uint32_t framesAtBudget = 0;
+};
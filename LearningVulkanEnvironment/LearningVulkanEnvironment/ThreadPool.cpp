@@ -0,0 +1,100 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(unsigned threadCount)
+{
+  if (threadCount == 0)
+    threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+  workers.reserve(threadCount);
+  for (unsigned i = 0; i < threadCount; ++i)
+    workers.emplace_back(&ThreadPool::workerLoop, this);
+}
+
+ThreadPool::~ThreadPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  condition.notify_all();
+
+  for (auto& worker : workers)
+    worker.join();
+}
+
+void ThreadPool::workerLoop()
+{
+  std::unique_lock<std::mutex> lock(mutex);
+  for (;;)
+  {
+    condition.wait(lock, [this]() { return stopping || !tasks.empty() || batchNext < batchCount; });
+
+    // Batches first, the caller of parallelFor is blocked on them
+    if (batchNext < batchCount)
+    {
+      runBatchIndex(lock);
+      continue;
+    }
+    if (stopping && tasks.empty())
+      return;
+
+    {
+      std::function<void()> task = std::move(tasks.front());
+      tasks.pop();
+
+      lock.unlock();
+      task();
+    }
+    lock.lock();
+  }
+}
+
+void ThreadPool::runBatch(uint32_t count, BatchFunction function, void* context)
+{
+  std::unique_lock<std::mutex> lock(mutex);
+  batchFunction = function;
+  batchContext = context;
+  batchNext = 0;
+  batchCount = count;
+  batchPending = count;
+  condition.notify_all();
+
+  while (batchNext < batchCount)
+    runBatchIndex(lock);
+  batchDone.wait(lock, [this]() { return batchPending == 0; });
+
+  batchCount = 0;
+  batchNext = 0;
+  std::exception_ptr error = batchError;
+  batchError = nullptr;
+  lock.unlock();
+
+  if (error)
+    std::rethrow_exception(error);
+}
+
+void ThreadPool::runBatchIndex(std::unique_lock<std::mutex>& lock)
+{
+  uint32_t index = batchNext++;
+  BatchFunction function = batchFunction;
+  void* context = batchContext;
+  lock.unlock();
+
+  std::exception_ptr error;
+  try
+  {
+    function(context, index);
+  }
+  catch (...)
+  {
+    error = std::current_exception();
+  }
+
+  lock.lock();
+  if (error && !batchError)
+    batchError = error;
+  if (--batchPending == 0)
+    batchDone.notify_all();
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+/*
+  Fixed set of worker threads pulling tasks off a shared queue. submit()
+  hands back a future so the caller can carry on and only block once it
+  really needs the result. Exceptions thrown by a task end up in its future.
+
+  parallelFor() is the per frame alternative: it doesn't allocate and the
+  calling thread helps out instead of sitting idle.
+*/
+class ThreadPool
+{
+public:
+  // 0 uses one thread per hardware core
+  explicit ThreadPool(unsigned threadCount = 0);
+  // Finishes every task that was already queued before joining
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  template <typename Task>
+  auto submit(Task task) -> std::future<decltype(task())>
+  {
+    // packaged_task isn't copyable but std::function needs a copyable target
+    auto packaged = std::make_shared<std::packaged_task<decltype(task())()>>(std::move(task));
+    std::future<decltype(task())> result = packaged->get_future();
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      tasks.push([packaged]() { (*packaged)(); });
+    }
+    condition.notify_one();
+    return result;
+  }
+
+  /*
+    Calls body(i) for every i in [0, count) on the workers and the calling
+    thread, and returns once every call has finished. Nothing is allocated
+    since only a pointer to body is shared. The first exception a call
+    throws is rethrown here. One batch at a time, from a single thread.
+  */
+  template <typename Body>
+  void parallelFor(uint32_t count, Body& body)
+  {
+    runBatch(count, [](void* context, uint32_t index) { (*static_cast<Body*>(context))(index); }, &body);
+  }
+
+  size_t size() const { return workers.size(); }
+
+private:
+  typedef void (*BatchFunction)(void* context, uint32_t index);
+
+  void workerLoop();
+  void runBatch(uint32_t count, BatchFunction function, void* context);
+  // Runs the next index of the batch, called and returns with the lock held
+  void runBatchIndex(std::unique_lock<std::mutex>& lock);
+
+  std::vector<std::thread> workers;
+  std::queue<std::function<void()>> tasks;
+  std::mutex mutex;
+  std::condition_variable condition;
+  bool stopping = false;
+
+  // Current parallelFor batch, all guarded by mutex. Indices are handed out
+  // under the lock too, each one is a whole job so that is cheap enough.
+  BatchFunction batchFunction = nullptr;
+  void* batchContext = nullptr;
+  uint32_t batchCount = 0;
+  uint32_t batchNext = 0;
+  uint32_t batchPending = 0;
+  std::exception_ptr batchError;
+  std::condition_variable batchDone;
+};
@@ -1,3 +1,21 @@
-C:/VulkanSDK/1.0.61.1/Bin32/glslangValidator.exe -V shader.vert
-C:/VulkanSDK/1.0.61.1/Bin32/glslangValidator.exe -V shader.frag
-pause
\ No newline at end of file
+rem Builds the SPIR-V the app loads when it was built without USE_SHADERC
+rem from the GLSL sources next to it. Uses the glslangValidator of whichever
+rem Vulkan SDK is installed, the SDK installer sets VULKAN_SDK. The project
+rem runs it before every build with nopause, so the .spv files are never
+rem checked in.
+setlocal
+cd /d "%~dp0shaders"
+set GLSLANG="%VULKAN_SDK%/Bin/glslangValidator.exe"
+%GLSLANG% -V shader.vert -o vert.spv || goto failed
+%GLSLANG% -V shader.frag -o frag.spv || goto failed
+%GLSLANG% -V cull.comp -o cull.spv || goto failed
+%GLSLANG% -V instanced.vert -o instanced.spv || goto failed
+%GLSLANG% -V post.vert -o postvert.spv || goto failed
+%GLSLANG% -V post.frag -o postfrag.spv || goto failed
+if not "%1"=="nopause" pause
+exit /b 0
+
+:failed
+echo compiling the shaders failed
+if not "%1"=="nopause" pause
+exit /b 1
@@ -0,0 +1,12 @@
+@echo off
+rem Headless benchmark of CPU recorded draws against GPU culling with
+rem indirect draws, from 1k to 1M objects. Run from this directory so the
+rem shaders are found, pass the executable if it isn't the x64 Release build.
+set EXE=%1
+if "%EXE%"=="" set EXE=..\x64\Release\LearningVulkanEnvironment.exe
+
+for %%n in (1000 10000 100000 1000000) do (
+  %EXE% --headless --benchmark --gpu-timings --frames 300 --objects %%n --benchmark-output culling_cpu_%%n.csv
+  %EXE% --headless --benchmark --gpu-timings --frames 300 --objects %%n --gpu-culling --benchmark-output culling_gpu_%%n.csv
+)
+pause
@@ -0,0 +1,13 @@
+@echo off
+rem Headless benchmark of one instanced draw against one draw per object,
+rem both reading the same per instance streams that are rewritten every
+rem frame. Run from this directory so the shaders are found, pass the
+rem executable if it isn't the x64 Release build.
+set EXE=%1
+if "%EXE%"=="" set EXE=..\x64\Release\LearningVulkanEnvironment.exe
+
+for %%n in (100 1000 10000 100000) do (
+  %EXE% --headless --benchmark --gpu-timings --frames 300 --objects %%n --instancing --benchmark-output instancing_single_%%n.csv
+  %EXE% --headless --benchmark --gpu-timings --frames 300 --objects %%n --instancing --per-object-draws --benchmark-output instancing_per_object_%%n.csv
+)
+pause
@@ -1,5 +1,9 @@
+// Native window system only matters on Windows, everywhere else GLFW picks the
+// platform surface for us (and headless mode needs no surface at all)
+#ifdef _WIN32
 #define VK_USE_PLATFORM_WIN32_KHR
 #define GLFW_EXPOSE_NATIVE_WIN32
+#endif
 
 #ifndef NOMINMAX
 #define NOMINMAX
@@ -8,7 +12,9 @@
 
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
+#ifdef _WIN32
 #include <GLFW/glfw3native.h>
+#endif
 
 #include <iostream>
 #include <stdexcept>
@@ -16,10 +22,46 @@
 #include <vector> // extension property list
 #include <set>
 #include <fstream>
+#include <string>
+#include <sstream>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <future>
+#include <memory>
+
+#include "AssetIO.h"
+#include "Benchmark.h"
+#include "DeletionQueue.h"
+#include "Descriptors.h"
+#include "DrawSort.h"
+#include "DeviceQueues.h"
+#include "DeviceSelection.h"
+#include "DynamicUniformBuffer.h"
+#include "GpuAllocator.h"
+#include "GpuCuller.h"
+#include "GpuProfiler.h"
+#include "InstanceStreams.h"
+#include "LinearArena.h"
+#include "Mesh.h"
+#include "OverdrawCounter.h"
+#include "PipelineCache.h"
+#include "PipelineBuilder.h"
+#include "RenderGraph.h"
+#include "Scene.h"
+#include "ShaderCompiler.h"
+#include "StagingUploader.h"
+#include "TextureStreamer.h"
+#include "ThreadPool.h"
 
 const int WIDTH = 800;
 const int HEIGHT = 600;
 
+// Upper bound on how many frames the CPU may record and submit before it has
+// to wait on the GPU. The actual count is chosen at startup (1 reproduces the
+// old fully serialized behaviour), but per-frame objects are sized from this.
+const int MAX_FRAMES_IN_FLIGHT = 3;
+
 /*
   Implicity enables a whole range of useful diagnostic layers.
   Example: 
@@ -55,6 +97,291 @@ struct SwapChainSupportDetails
   std::vector<VkPresentModeKHR> presentModes;
 };
 
+// Settings chosen on the command line at startup
+struct AppOptions
+{
+  int framesInFlight = 2;
+  // Render into offscreen images instead of a window/swap chain. Works on
+  // machines without a display or GPU, e.g. with lavapipe or SwiftShader
+  // selected through VK_ICD_FILENAMES.
+  bool headless = false;
+  // Stop after this many frames and/or seconds, 0 means no limit. Headless
+  // and benchmark runs always get a limit so they can't run forever.
+  int frameCount = 0;
+  double seconds = 0.0;
+  // If set, the last headless frame is written here as a binary PPM
+  std::string outputPath;
+  // Record per-frame CPU timings and print a summary when the run ends
+  bool benchmark = false;
+  std::string benchmarkFormat = "csv";
+  // Summary goes to stdout when empty
+  std::string benchmarkOutput;
+  // Wrap render passes in timestamp queries and print their GPU time at exit
+  bool gpuTimings = false;
+  // Where compiled pipelines are kept between runs, empty disables it
+  std::string pipelineCachePath = "pipeline_cache.bin";
+  // Worker threads compiling pipelines, 0 means one per core
+  int pipelineThreads = 0;
+  // Where shader sources and prebuilt SPIR-V are looked up
+  std::string shaderDirectory = "shaders";
+  // SPIR-V compiled at runtime is kept here, empty disables it
+  std::string shaderCachePath = "shader_cache";
+  // Watch the shader files and rebuild the pipelines using one that changed
+  bool hotReload = false;
+  // Print shader cache hits and misses at exit
+  bool shaderStats = false;
+  // Asset packs searched before loose files, later ones win
+  std::vector<std::string> assetPacks;
+  // Pack the shaders and the default mesh into this file and exit
+  std::string writeAssetPack;
+  // .mesh asset drawn instead of the built in triangle
+  std::string meshPath;
+  // Print how many files were mapped and how many bytes at exit
+  bool assetStats = false;
+  // PPM or KTX2 image streamed in and multiplied with the scene's color.
+  // For a .ktx2 path its .bc7, .astc and .etc2 variants are tried first.
+  std::string texturePath;
+  // Decode compressed textures to RGBA8 even if the device can sample them,
+  // to compare memory and upload bytes
+  bool transcodeTextures = false;
+  // Most texture bytes handed to the transfer queue per frame
+  uint64_t uploadBudget = 1024 * 1024;
+  // Print per texture load times and how busy the upload budget was at exit
+  bool textureStats = false;
+  // Command buffers are recorded every frame. With 0 the main thread records
+  // the whole frame, above 0 this many threads record secondary command
+  // buffers in parallel.
+  int recordThreads = 0;
+  // Record one command buffer per swap chain image once at startup instead,
+  // the way the tutorial does. Kept to compare against.
+  bool staticCommands = false;
+  // How many times the triangle is drawn, to give the recorder some work
+  int drawCount = 1;
+  // Print how much device memory the allocator holds and how fragmented it is
+  bool memoryStats = false;
+  // Objects in the scene, each one is a copy of the mesh at its own offset
+  int objectCount = 1;
+  // Cull objects in a compute pass and draw them with indirect draws,
+  // instead of one vkCmdDrawIndexed per object recorded by the CPU
+  bool gpuCulling = false;
+  // Draw every object with a single instanced draw, fed by per instance
+  // streams the CPU rewrites every frame
+  bool instancing = false;
+  // With --instancing, still issue one draw per object over the same
+  // streams. Only there to compare against the single instanced draw.
+  bool perObjectDraws = false;
+  // Time descriptor set allocation against dynamic offsets once at startup
+  bool descriptorBenchmark = false;
+  // Hand each draw its tint with vkCmdPushConstants instead of a dynamic
+  // offset into the draw uniforms
+  bool pushConstants = false;
+  // Also build every specialization of the scene pipeline at startup and
+  // print how many there are and how long each took to compile
+  bool pipelineVariants = false;
+  // Draw the scene into an image of its own and tone map it onto the swap
+  // chain image in a second pass, which reads it as an input attachment
+  bool postProcess = false;
+  // Give every render graph pass a render pass of its own instead of merging
+  // them into subpasses. Only there to compare against.
+  bool separatePasses = false;
+  // Print the compiled render graph at startup
+  bool renderGraphDump = false;
+  // Physical device to use, by index or UUID, instead of the best scoring
+  std::string device;
+  // Print every physical device with its capabilities and score at startup,
+  // and which queue every role got
+  bool deviceReport = false;
+  // Run the --gpu-culling pass on the compute queue, overlapping the
+  // previous frame's rendering, instead of ahead of the draws in the
+  // graphics queue. Its GPU time isn't profiled there.
+  bool asyncCompute = false;
+  // Samples per pixel of the scene, resolved onto the swap chain image at
+  // the end of its subpass. Lowered to what the device supports.
+  int msaaSamples = 1;
+  // Spread the objects' sizes by this factor, above 1 they overlap and every
+  // pixel gets drawn several times
+  float overlap = 1.0f;
+  // Draw the objects in the order they were created instead of front to back
+  bool unsorted = false;
+  // Lay down the scene's depth in a vertex only pass first, the scene then
+  // only shades the fragments that end up visible
+  bool depthPrepass = false;
+  // Count fragment shader invocations of the scene passes and print the
+  // overdraw at exit. Can't be combined with --record-threads.
+  bool overdraw = false;
+};
+
+AppOptions parseCommandLine(int argc, char* argv[])
+{
+  AppOptions options;
+
+  for (int i = 1; i < argc; ++i)
+  {
+    std::string arg = argv[i];
+
+    if (arg == "--frames-in-flight" && i + 1 < argc)
+    {
+      options.framesInFlight = std::atoi(argv[++i]);
+      if (options.framesInFlight < 1 || options.framesInFlight > MAX_FRAMES_IN_FLIGHT)
+        throw std::runtime_error("--frames-in-flight must be between 1 and " + std::to_string(MAX_FRAMES_IN_FLIGHT));
+    }
+    else if (arg == "--headless")
+      options.headless = true;
+    else if (arg == "--frames" && i + 1 < argc)
+    {
+      options.frameCount = std::atoi(argv[++i]);
+      if (options.frameCount < 1)
+        throw std::runtime_error("--frames must be at least 1");
+    }
+    else if (arg == "--seconds" && i + 1 < argc)
+    {
+      options.seconds = std::atof(argv[++i]);
+      if (options.seconds <= 0.0)
+        throw std::runtime_error("--seconds must be greater than 0");
+    }
+    else if (arg == "--output" && i + 1 < argc)
+      options.outputPath = argv[++i];
+    else if (arg == "--benchmark")
+      options.benchmark = true;
+    else if (arg == "--benchmark-format" && i + 1 < argc)
+    {
+      options.benchmarkFormat = argv[++i];
+      if (options.benchmarkFormat != "csv" && options.benchmarkFormat != "json")
+        throw std::runtime_error("--benchmark-format must be csv or json");
+    }
+    else if (arg == "--benchmark-output" && i + 1 < argc)
+      options.benchmarkOutput = argv[++i];
+    else if (arg == "--gpu-timings")
+      options.gpuTimings = true;
+    else if (arg == "--pipeline-cache" && i + 1 < argc)
+      options.pipelineCachePath = argv[++i];
+    else if (arg == "--no-pipeline-cache")
+      options.pipelineCachePath.clear();
+    else if (arg == "--shader-dir" && i + 1 < argc)
+      options.shaderDirectory = argv[++i];
+    else if (arg == "--shader-cache" && i + 1 < argc)
+      options.shaderCachePath = argv[++i];
+    else if (arg == "--no-shader-cache")
+      options.shaderCachePath.clear();
+    else if (arg == "--hot-reload")
+      options.hotReload = true;
+    else if (arg == "--shader-stats")
+      options.shaderStats = true;
+    else if (arg == "--asset-pack" && i + 1 < argc)
+      options.assetPacks.push_back(argv[++i]);
+    else if (arg == "--write-asset-pack" && i + 1 < argc)
+      options.writeAssetPack = argv[++i];
+    else if (arg == "--mesh" && i + 1 < argc)
+      options.meshPath = argv[++i];
+    else if (arg == "--asset-stats")
+      options.assetStats = true;
+    else if (arg == "--texture" && i + 1 < argc)
+      options.texturePath = argv[++i];
+    else if (arg == "--upload-budget" && i + 1 < argc)
+    {
+      long long budget = std::atoll(argv[++i]);
+      if (budget < 1)
+        throw std::runtime_error("--upload-budget must be at least 1 byte");
+      options.uploadBudget = static_cast<uint64_t>(budget);
+    }
+    else if (arg == "--texture-stats")
+      options.textureStats = true;
+    else if (arg == "--transcode-textures")
+      options.transcodeTextures = true;
+    else if (arg == "--record-threads" && i + 1 < argc)
+    {
+      options.recordThreads = std::atoi(argv[++i]);
+      if (options.recordThreads < 0)
+        throw std::runtime_error("--record-threads can't be negative");
+    }
+    else if (arg == "--static-commands")
+      options.staticCommands = true;
+    else if (arg == "--descriptor-benchmark")
+      options.descriptorBenchmark = true;
+    else if (arg == "--push-constants")
+      options.pushConstants = true;
+    else if (arg == "--pipeline-variants")
+      options.pipelineVariants = true;
+    else if (arg == "--post-process")
+      options.postProcess = true;
+    else if (arg == "--separate-passes")
+      options.separatePasses = true;
+    else if (arg == "--render-graph-dump")
+      options.renderGraphDump = true;
+    else if (arg == "--device" && i + 1 < argc)
+      options.device = argv[++i];
+    else if (arg == "--device-report")
+      options.deviceReport = true;
+    else if (arg == "--async-compute")
+      options.asyncCompute = true;
+    else if (arg == "--msaa" && i + 1 < argc)
+    {
+      options.msaaSamples = std::atoi(argv[++i]);
+      if (options.msaaSamples != 1 && options.msaaSamples != 2 && options.msaaSamples != 4 && options.msaaSamples != 8)
+        throw std::runtime_error("--msaa must be 1, 2, 4 or 8");
+    }
+    else if (arg == "--overlap" && i + 1 < argc)
+    {
+      options.overlap = static_cast<float>(std::atof(argv[++i]));
+      if (options.overlap <= 0.0f)
+        throw std::runtime_error("--overlap must be positive");
+    }
+    else if (arg == "--unsorted")
+      options.unsorted = true;
+    else if (arg == "--depth-prepass")
+      options.depthPrepass = true;
+    else if (arg == "--overdraw")
+      options.overdraw = true;
+    else if (arg == "--memory-stats")
+      options.memoryStats = true;
+    else if (arg == "--draws" && i + 1 < argc)
+    {
+      options.drawCount = std::atoi(argv[++i]);
+      if (options.drawCount < 1)
+        throw std::runtime_error("--draws must be at least 1");
+    }
+    else if (arg == "--objects" && i + 1 < argc)
+    {
+      options.objectCount = std::atoi(argv[++i]);
+      if (options.objectCount < 1)
+        throw std::runtime_error("--objects must be at least 1");
+    }
+    else if (arg == "--gpu-culling")
+      options.gpuCulling = true;
+    else if (arg == "--instancing")
+      options.instancing = true;
+    else if (arg == "--per-object-draws")
+      options.perObjectDraws = true;
+    else if (arg == "--pipeline-threads" && i + 1 < argc)
+    {
+      options.pipelineThreads = std::atoi(argv[++i]);
+      if (options.pipelineThreads < 0)
+        throw std::runtime_error("--pipeline-threads can't be negative");
+    }
+    else
+      throw std::runtime_error("unknown command line argument: " + arg);
+  }
+
+  if (options.instancing && options.gpuCulling)
+    throw std::runtime_error("--instancing and --gpu-culling can't be combined");
+  if (options.perObjectDraws && !options.instancing)
+    throw std::runtime_error("--per-object-draws needs --instancing");
+  if (options.asyncCompute && (!options.gpuCulling || options.staticCommands))
+    throw std::runtime_error("--async-compute needs --gpu-culling and can't be combined with --static-commands");
+  if (options.overdraw && options.recordThreads > 0)
+    throw std::runtime_error("--overdraw can't be combined with --record-threads");
+
+  if (options.frameCount == 0 && options.seconds == 0.0)
+  {
+    if (options.benchmark)
+      options.frameCount = 1000;
+    else if (options.headless)
+      options.frameCount = 1;
+  }
+
+  return options;
+}
+
 bool checkValidationLayerSupport()
 {
   uint32_t layerCount;
@@ -104,63 +431,314 @@ public:
       return graphicsFamily >= 0 && presentFamily >= 0;
     }
   };
+  explicit HelloTriangleApplication(const AppOptions& appOptions)
+    : options(appOptions)
+  {
+  }
+
   void run()
   {
+    if (!options.writeAssetPack.empty())
+    {
+      writeAssetPack(options.writeAssetPack);
+      return;
+    }
+
     initWindow();
+
+    auto startupStart = std::chrono::steady_clock::now();
     initVulkan();
+    startupMs = millisecondsSince(startupStart);
+
+    if (options.descriptorBenchmark)
+      runDescriptorBenchmark();
+
     mainLoop();
     cleanup();
   }
 private:
-  VkSemaphore imageAvailableSemaphore;
-  VkSemaphore renderFinishedSemaphore;
+  AppOptions options;
+  // One set of sync objects per frame in flight. The graphics queue's
+  // timeline value of the frame's submission tells the CPU when the GPU is
+  // done with it so the slot can be reused, 0 before the first one.
+  std::vector<VkSemaphore> imageAvailableSemaphores;
+  std::vector<VkSemaphore> renderFinishedSemaphores;
+  std::vector<uint64_t> frameSubmissions;
+  // Graphics timeline value of the frame that is currently using each swap
+  // chain image, or 0. Images can come back out of order from the
+  // presentation engine so we can't assume the image belongs to the frame we
+  // waited on.
+  std::vector<uint64_t> imageSubmissions;
+  size_t currentFrame = 0;
   std::vector<VkCommandBuffer> commandBuffers;
   VkCommandPool commandPool;
-  VkRenderPass renderPass;
+  // The frame's passes, its render passes and framebuffers are built from them
+  RenderGraph renderGraph;
+  GraphResource backbuffer = 0;
+  GraphPass scenePass = 0;
+  // Only used with --depth-prepass
+  GraphPass prepassPass = 0;
+  // Only used with --post-process
+  GraphResource sceneColor = 0;
+  GraphPass postPass = 0;
+  // --msaa capped by the device, the scene draws into a multisampled image
+  // resolved in its subpass when above 1
+  VkSampleCountFlagBits msaaSamples = VK_SAMPLE_COUNT_1_BIT;
+  // Of the scene's depth image, picked by what the device can render to
+  VkFormat depthFormat = VK_FORMAT_D32_SFLOAT;
   VkPipelineLayout pipelineLayout;
   VkPipeline graphicsPipeline;
-  GLFWwindow* window;
+  GLFWwindow* window = nullptr;
+  // Set by GLFW when the window size changes. Drivers aren't guaranteed to
+  // report VK_ERROR_OUT_OF_DATE_KHR on resize so we check it ourselves too.
+  bool framebufferResized = false;
+  // Headless mode renders into these instead of swap chain images. They are
+  // also stored in swapChainImages so image views, framebuffers and command
+  // buffers are created the same way for both modes.
+  std::vector<GpuAllocation> offscreenImageMemory;
+  // Every buffer and image gets its memory from here instead of its own
+  // vkAllocateMemory call
+  GpuAllocator gpuAllocator;
+  // Fills device local buffers, one transfer submit per frame at most
+  StagingUploader uploader;
+  // Size of the staging ring shared by the frames in flight
+  static const VkDeviceSize STAGING_BUFFER_SIZE = 8 * 1024 * 1024;
+  // Textures decode on its workers and go up through uploader within the
+  // frame's budget. sceneTexture is the placeholder without --texture.
+  TextureStreamer textureStreamer;
+  TextureHandle sceneTexture = TextureStreamer::PLACEHOLDER;
+  // Resident textures when the prerecorded command buffers were recorded
+  uint32_t recordedResidentCount = 0;
+  Mesh sceneMesh;
+  // ObjectData of every object, per instance vertex data and culling input
+  VkBuffer objectBuffer = VK_NULL_HANDLE;
+  GpuAllocation objectMemory;
+  // Only created with --gpu-culling
+  GpuCuller gpuCuller;
+  // Only created with --instancing. sceneObjects and objectColors are the
+  // source the streams are rewritten from every frame.
+  InstanceStreams instanceStreams;
+  std::vector<ObjectData> sceneObjects;
+  // shader.vert places objects straight in clip space, so the scene's view
+  // projection is the identity. Culling takes its frustum from here.
+  float viewProjection[16] =
+  {
+    1.0f, 0.0f, 0.0f, 0.0f,
+    0.0f, 1.0f, 0.0f, 0.0f,
+    0.0f, 0.0f, 1.0f, 0.0f,
+    0.0f, 0.0f, 0.0f, 1.0f
+  };
+  // Objects front to back, empty when the draws go in creation order:
+  // with --unsorted, and when one draw covers every object anyway
+  std::vector<uint32_t> drawOrder;
+  // How long sorting took, reported by --benchmark
+  double drawSortMs = 0.0;
+  std::vector<uint32_t> objectColors;
+  // Time base of the instance animation
+  std::chrono::steady_clock::time_point sceneStart;
+  // Every set layout comes from here, so equal layouts are shared
+  DescriptorLayoutCache descriptorLayouts;
+  // One dynamic uniform buffer binding with the draw's DrawUniforms
+  VkDescriptorSetLayout drawSetLayout = VK_NULL_HANDLE;
+  // The scene texture as a combined image sampler
+  VkDescriptorSetLayout textureSetLayout = VK_NULL_HANDLE;
+  // Matches DrawData and DrawConstants in shader.frag
+  struct DrawUniforms
+  {
+    float tint[4];
+  };
+  // Values of the TINT_SOURCE specialization constant in shader.frag
+  enum TintSource
+  {
+    TINT_NONE = 0,
+    TINT_UNIFORM_BUFFER = 1,
+    TINT_PUSH_CONSTANTS = 2
+  };
+  // Per draw data, indexed by draw item. Draws past the last entry wrap
+  // around and share entries.
+  DynamicUniformBuffer drawUniforms;
+  static const uint32_t MAX_DRAW_UNIFORMS = 16384;
+  // Per frame slot: the descriptor pools the slot's sets come from, reset
+  // as a whole when the slot is recorded again, and the slot's draw and
+  // texture sets
+  std::vector<DescriptorAllocator> frameDescriptors;
+  std::vector<VkDescriptorSet> drawSets;
+  std::vector<VkDescriptorSet> textureSets;
+  // With --post-process: sceneColor as an input attachment, per frame slot
+  // like the other sets since its view changes with the swap chain
+  VkDescriptorSetLayout postSetLayout = VK_NULL_HANDLE;
+  VkPipelineLayout postPipelineLayout = VK_NULL_HANDLE;
+  VkPipeline postPipeline = VK_NULL_HANDLE;
+  std::future<VkPipeline> postPipelineFuture;
+  // What postPipeline was built from, kept to rebuild it on a reload
+  GraphicsPipelineDesc postDesc;
+  std::vector<VkDescriptorSet> postSets;
+  // Features createLogicalDevice turned on, the indirect paths depend on them
+  VkPhysicalDeviceFeatures enabledFeatures = {};
+#ifdef VK_KHR_draw_indirect_count
+  // Loaded when VK_KHR_draw_indirect_count is enabled, null otherwise
+  PFN_vkCmdDrawIndexedIndirectCountKHR drawIndexedIndirectCount = nullptr;
+#endif
+  uint32_t lastImageIndex = 0;
+  // Phase timings of the frame drawFrame is currently working on
+  FrameTiming frameTiming;
+  // One query slot per recorded command buffer
+  GpuProfiler gpuProfiler;
+  // Upper bound of profiled passes in a single command buffer
+  static const uint32_t MAX_PROFILED_PASSES = 8;
+  // Only created with --overdraw, slots like gpuProfiler
+  OverdrawCounter overdrawCounter;
+  // The depth prepass and the scene
+  static const uint32_t MAX_OVERDRAW_PASSES = 2;
+  // Shared by every pipeline we create and saved back to disk at cleanup
+  PipelineCache pipelineCache;
+  // Every file the app reads goes through here, packs or loose files
+  AssetLoader assets;
+  // Loads every shader, compiling GLSL at runtime when the build can
+  ShaderCompiler shaderCompiler;
+  // Compiles pipelines in the background, shares pipelineCache between threads
+  std::unique_ptr<PipelineBuilder> pipelineBuilder;
+  // What graphicsPipeline was built from, kept to rebuild it on a reload
+  GraphicsPipelineDesc sceneDesc;
+  std::future<VkPipeline> graphicsPipelineFuture;
+  // Only used with --depth-prepass
+  VkPipeline prepassPipeline = VK_NULL_HANDLE;
+  std::future<VkPipeline> prepassPipelineFuture;
+  // Only used with --hot-reload
+  ShaderWatcher shaderWatcher;
+  std::string cullShaderPath;
+  // Variants the scene doesn't use, built with --pipeline-variants
+  std::vector<std::future<VkPipeline>> variantFutures;
+  // How long initVulkan and pipeline creation took, reported by --benchmark
+  // so cold and warm pipeline cache starts can be compared. Pipeline time is
+  // wall time from the first build request until every pipeline is ready.
+  double startupMs = 0.0;
+  double pipelineCreationMs = 0.0;
+  std::chrono::steady_clock::time_point pipelineBuildStart;
+
+  // Draw items one recording thread puts into its secondary command buffer
+  struct RecordJob
+  {
+    VkCommandBuffer commandBuffer;
+    int firstDraw;
+    int lastDraw;
+  };
+
+  /*
+    Command buffers of one frame in flight when recording every frame. Each
+    recording job owns a transient pool so jobs never share a pool between
+    threads, and a whole pool is reset at once when the frame comes around
+    again instead of resetting buffers one by one.
+
+    Nothing on the recording path allocates: the vectors are sized once at
+    startup and per frame scratch data comes out of the frame's arena,
+    which is reset along with the pools.
+  */
+  struct FrameCommands
+  {
+    VkCommandPool primaryPool = VK_NULL_HANDLE;
+    VkCommandBuffer primary = VK_NULL_HANDLE;
+    // Culling on the compute queue, with --async-compute
+    VkCommandPool computePool = VK_NULL_HANDLE;
+    VkCommandBuffer compute = VK_NULL_HANDLE;
+    std::vector<VkCommandPool> workerPools;
+    std::vector<VkCommandBuffer> secondaries;
+    LinearArena scratch;
+  };
+  std::vector<FrameCommands> frameCommands;
+  // Scratch space per frame, far more than the recording jobs need
+  static const size_t FRAME_SCRATCH_SIZE = 64 * 1024;
+  std::unique_ptr<ThreadPool> recordWorkers;
   VkInstance instance;
+  // Version the instance was created for, 1.2 where the loader has it
+  uint32_t instanceApiVersion = VK_API_VERSION_1_0;
+  // Whether the instance can query extended device features, and device
+  // UUIDs
+  bool features2Queries = false;
+  bool deviceIdQueries = false;
   VkPhysicalDevice physicalDevice;
   VkDevice device;
-  VkQueue presentQueue;
-  VkQueue graphicsQueue;
+  DeviceQueues deviceQueues;
+  // Resources replaced while rendering go here instead of waiting for the
+  // device to go idle
+  DeletionQueue deletionQueue;
   VkSwapchainKHR swapChain;
   std::vector<VkImage> swapChainImages;
   VkFormat swapChainImageFormat;
   VkExtent2D swapChainExtent;
-  std::vector<VkFramebuffer> swapChainFramebuffers;
   VkDebugReportCallbackEXT callback;
   VkSurfaceKHR surface;
   void initWindow()
   {
+    if (options.headless)
+      return;
+
     glfwInit();
 
     glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-    glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+    glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
 
     window = glfwCreateWindow(WIDTH, HEIGHT, "Vulkan", nullptr, nullptr);
+    // The callback is a plain function, it finds us again through the window
+    glfwSetWindowUserPointer(window, this);
+    glfwSetFramebufferSizeCallback(window, framebufferResizeCallback);
+  }
+
+  static void framebufferResizeCallback(GLFWwindow* window, int /*width*/, int /*height*/)
+  {
+    auto app = reinterpret_cast<HelloTriangleApplication*>(glfwGetWindowUserPointer(window));
+    app->framebufferResized = true;
   }
 
   std::vector<const char*> getRequiredExtensions()
   {
     std::vector<const char*> extensions;
 
-    unsigned int glfwExtensionCount = 0;
-    const char** glfwExtensions;
-    glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+    // Surface extensions are only needed when we present to a window
+    if (!options.headless)
+    {
+      unsigned int glfwExtensionCount = 0;
+      const char** glfwExtensions;
+      glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
 
-    for (unsigned i = 0; i < glfwExtensionCount; ++i)
-      extensions.push_back(glfwExtensions[i]);
+      for (unsigned i = 0; i < glfwExtensionCount; ++i)
+        extensions.push_back(glfwExtensions[i]);
+    }
 
     // If we are in debug we want to pop this extension in to allow us to add
     // debugging validation layers into the current vulkan instance
     if (enableValidationLayers)
       extensions.push_back(VK_EXT_DEBUG_REPORT_EXTENSION_NAME);
 
+    // Extended features, to find timeline semaphores on devices older than
+    // Vulkan 1.2, and device UUIDs for --device. The ID properties come with
+    // the external memory capabilities extension.
+    features2Queries = instanceSupportsExtension(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+    deviceIdQueries = features2Queries && instanceSupportsExtension(VK_KHR_EXTERNAL_MEMORY_CAPABILITIES_EXTENSION_NAME);
+    if (features2Queries)
+      extensions.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+    if (deviceIdQueries)
+      extensions.push_back(VK_KHR_EXTERNAL_MEMORY_CAPABILITIES_EXTENSION_NAME);
+
     return extensions;
   }
 
+  bool instanceSupportsExtension(const char* name)
+  {
+    uint32_t extensionCount;
+    vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, nullptr);
+
+    std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+    vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, availableExtensions.data());
+
+    for (const auto& extension : availableExtensions)
+    {
+      if (strcmp(extension.extensionName, name) == 0)
+        return true;
+    }
+    return false;
+  }
+
   void createInstance()
   {
     // The validation layers that we want arent available on this computer
@@ -175,7 +753,18 @@ private:
     appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
     appInfo.pEngineName = "No Engine";
     appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-    appInfo.apiVersion = VK_API_VERSION_1_0;
+    // Vulkan 1.2 has timeline semaphores in core. A 1.0 loader doesn't know
+    // vkEnumerateInstanceVersion and fails to create instances above 1.0.
+    // Built with headers older than 1.2 the app stays on 1.0 and fences.
+#ifdef VK_VERSION_1_2
+    PFN_vkEnumerateInstanceVersion enumerateInstanceVersion =
+      (PFN_vkEnumerateInstanceVersion)vkGetInstanceProcAddr(nullptr, "vkEnumerateInstanceVersion");
+    uint32_t loaderVersion = VK_API_VERSION_1_0;
+    if (enumerateInstanceVersion)
+      enumerateInstanceVersion(&loaderVersion);
+    instanceApiVersion = std::min<uint32_t>(loaderVersion, VK_API_VERSION_1_2);
+#endif
+    appInfo.apiVersion = instanceApiVersion;
     // There is also a pNext member which we are leaving to default, but pNext
     // is used to point to extension information in the future.
 
@@ -231,6 +820,9 @@ private:
 
   void createSurface()
   {
+    if (options.headless)
+      return;
+
     //VkWin32SurfaceCreateInfoKHR createInfo = {};
     //createInfo.sType = VK_STRUCTURE_TYPE_WIN32_SURFACE_CREATE_INFO_KHR;
     //// Window handle
@@ -279,34 +871,215 @@ private:
 
   void initVulkan()
   {
+    for (const auto& pack : options.assetPacks)
+      assets.mount(pack);
     createInstance();
     setupDebugCallback();
     createSurface();
     pickPhysicalDevice();
     createLogicalDevice();
-    createSwapChain();
+    gpuAllocator.create(device, physicalDevice);
+    deletionQueue.create(device, gpuAllocator, deviceQueues);
+    if (options.headless)
+      createOffscreenImages();
+    else
+      createSwapChain();
     createImageViews();
-    createRenderPass();
+    createRenderGraph();
+    descriptorLayouts.create(device);
+    pipelineCache.create(device, physicalDevice, options.pipelineCachePath);
+    shaderCompiler.create(options.shaderCachePath, assets);
+    pipelineBuilder.reset(new PipelineBuilder(device, pipelineCache.handle(), shaderCompiler, options.pipelineThreads));
     createGraphicsPipeline();
     createFrameBuffers();
+    if (options.renderGraphDump)
+      renderGraph.dump(std::cout);
     createCommandPool();
-    createCommandBuffers();
-    createSemaphores();
+    createUploader();
+    createSceneMesh();
+    createSceneObjects();
+    createTextureStreamer();
+    createGpuCuller();
+    createFrameCommandPools();
+    createGpuProfiler();
+    createOverdrawCounter();
+    createInstanceStreams();
+    createDrawUniforms();
+    // Recording needs the pipeline, everything before it overlapped compilation
+    waitForPipelines();
+    if (!recordsEveryFrame())
+      createCommandBuffers();
+    createSyncObjects();
+    if (options.hotReload)
+      watchShaders();
+  }
+
+  /*
+    GLSL sources when this build compiles them at runtime, the SPIR-V that
+    compile.bat built from them otherwise
+  */
+  std::string shaderPath(const char* source, const char* compiled) const
+  {
+    return options.shaderDirectory + '/' + (ShaderCompiler::canCompile() ? source : compiled);
+  }
+
+  void watchShaders()
+  {
+    shaderWatcher.watch(sceneDesc.vertexShaderPath);
+    shaderWatcher.watch(sceneDesc.fragmentShaderPath);
+    if (gpuCuller.isEnabled())
+      shaderWatcher.watch(cullShaderPath);
+    if (options.postProcess)
+    {
+      shaderWatcher.watch(postDesc.vertexShaderPath);
+      shaderWatcher.watch(postDesc.fragmentShaderPath);
+    }
+  }
+
+  /*
+    Rebuilds the pipelines that use a shader file that changed on disk. The
+    new pipelines are built while the old ones keep rendering, and the old
+    ones are destroyed once the frames in flight that use them have
+    finished. A shader that fails to compile is reported and the old
+    pipeline stays.
+  */
+  void reloadChangedShaders()
+  {
+    std::vector<std::string> changed = shaderWatcher.poll();
+    if (changed.empty())
+      return;
+
+    auto isChanged = [&changed](const std::string& path)
+    {
+      return std::find(changed.begin(), changed.end(), path) != changed.end();
+    };
+    bool sceneChanged = isChanged(sceneDesc.vertexShaderPath) || isChanged(sceneDesc.fragmentShaderPath);
+    bool cullChanged = gpuCuller.isEnabled() && isChanged(cullShaderPath);
+    bool postChanged = options.postProcess &&
+      (isChanged(postDesc.vertexShaderPath) || isChanged(postDesc.fragmentShaderPath));
+
+    VkPipeline newScenePipeline = VK_NULL_HANDLE;
+    VkPipeline newPrepassPipeline = VK_NULL_HANDLE;
+    VkPipeline newPostPipeline = VK_NULL_HANDLE;
+    Asset cullCode;
+    try
+    {
+      if (sceneChanged)
+      {
+        newScenePipeline = pipelineBuilder->build(sceneDesc).get();
+        if (prepassPipeline != VK_NULL_HANDLE)
+          newPrepassPipeline = pipelineBuilder->build(prepassPipelineDesc(sceneDesc)).get();
+      }
+      if (postChanged)
+        newPostPipeline = pipelineBuilder->build(postDesc).get();
+      if (cullChanged)
+        cullCode = shaderCompiler.load(cullShaderPath);
+    }
+    catch (const std::exception& e)
+    {
+      std::cerr << "shader reload failed, keeping the old pipelines: " << e.what() << std::endl;
+      if (newScenePipeline != VK_NULL_HANDLE)
+        vkDestroyPipeline(device, newScenePipeline, nullptr);
+      if (newPrepassPipeline != VK_NULL_HANDLE)
+        vkDestroyPipeline(device, newPrepassPipeline, nullptr);
+      if (newPostPipeline != VK_NULL_HANDLE)
+        vkDestroyPipeline(device, newPostPipeline, nullptr);
+      return;
+    }
+
+    if (sceneChanged)
+    {
+      deletionQueue.destroyPipeline(graphicsPipeline);
+      graphicsPipeline = newScenePipeline;
+      // Both or neither, the prepass has to stay in step with the scene's
+      // vertex shader for the EQUAL test
+      if (newPrepassPipeline != VK_NULL_HANDLE)
+      {
+        deletionQueue.destroyPipeline(prepassPipeline);
+        prepassPipeline = newPrepassPipeline;
+      }
+      std::cout << "reloaded scene pipeline" << std::endl;
+    }
+    if (postChanged)
+    {
+      deletionQueue.destroyPipeline(postPipeline);
+      postPipeline = newPostPipeline;
+      std::cout << "reloaded post pipeline" << std::endl;
+    }
+    if (cullChanged)
+    {
+      try
+      {
+        deletionQueue.destroyPipeline(gpuCuller.rebuildPipeline(pipelineCache.handle(), cullCode));
+        std::cout << "reloaded culling pipeline" << std::endl;
+      }
+      catch (const std::exception& e)
+      {
+        std::cerr << "culling shader reload failed: " << e.what() << std::endl;
+      }
+    }
+
+    // Command buffers recorded once at startup still point at the old ones
+    if (!recordsEveryFrame())
+      recordCommandBuffersAgain();
   }
 
-  void createSemaphores()
+  void createSyncObjects()
   {
+    imageAvailableSemaphores.resize(options.framesInFlight);
+    renderFinishedSemaphores.resize(options.framesInFlight);
+    // 0 has always finished, so the very first wait in drawFrame doesn't
+    // block forever on a frame that was never submitted
+    frameSubmissions.resize(options.framesInFlight, 0);
+    imageSubmissions.resize(swapChainImages.size(), 0);
+
     VkSemaphoreCreateInfo semaphoreInfo = {};
     semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-    if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &imageAvailableSemaphore) != VK_SUCCESS ||
-      vkCreateSemaphore(device, &semaphoreInfo, nullptr, &renderFinishedSemaphore) != VK_SUCCESS)
-      throw std::runtime_error("failed to create semaphores!");
+    for (int i = 0; i < options.framesInFlight; ++i)
+    {
+      if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &imageAvailableSemaphores[i]) != VK_SUCCESS ||
+        vkCreateSemaphore(device, &semaphoreInfo, nullptr, &renderFinishedSemaphores[i]) != VK_SUCCESS)
+        throw std::runtime_error("failed to create synchronization objects for a frame!");
+    }
+  }
+
+  void createGpuProfiler()
+  {
+    if (!options.gpuTimings)
+      return;
+
+    if (!gpuProfiler.create(device, physicalDevice, deviceQueues.family(QueueRole::Graphics),
+      frameSlotCount(), MAX_PROFILED_PASSES))
+      std::cerr << "graphics queue does not support timestamps, GPU timings disabled" << std::endl;
+  }
+
+  // The depth prepass and the scene are counted separately
+  void createOverdrawCounter()
+  {
+    if (!options.overdraw)
+      return;
+
+    if (enabledFeatures.pipelineStatisticsQuery)
+      overdrawCounter.create(device, frameSlotCount(), MAX_OVERDRAW_PASSES);
+    else
+      std::cerr << "device does not support pipeline statistics queries, overdraw disabled" << std::endl;
+  }
+
+  /*
+    Per frame resources (timestamp queries, instance data) are indexed by the
+    command buffer that uses them: swap chain images for prerecorded command
+    buffers and frames in flight when recording every frame.
+  */
+  uint32_t frameSlotCount() const
+  {
+    return static_cast<uint32_t>(std::max(swapChainImageViews.size(), frameCommands.size()));
   }
 
   void createCommandBuffers()
   {
-    commandBuffers.resize(swapChainFramebuffers.size());
+    recordedResidentCount = textureStreamer.residentCount();
+    commandBuffers.resize(swapChainImageViews.size());
     VkCommandBufferAllocateInfo allocInfo = {};
     allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
     allocInfo.commandPool = commandPool;
@@ -325,108 +1098,784 @@ private:
 
       vkBeginCommandBuffer(commandBuffers[i], &beginInfo);
 
-      VkRenderPassBeginInfo renderPassInfo = {};
-      renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-      renderPassInfo.renderPass = renderPass;
-      renderPassInfo.framebuffer = swapChainFramebuffers[i];
-      renderPassInfo.renderArea.offset = { 0,0 };
-      renderPassInfo.renderArea.extent = swapChainExtent;
+      uint32_t slot = static_cast<uint32_t>(i);
+      gpuProfiler.beginFrame(commandBuffers[i], slot);
+      overdrawCounter.beginFrame(commandBuffers[i], slot);
+      allocateDrawSet(slot);
+
+      recordCulling(commandBuffers[i], slot);
+
+      // Every render pass of the graph, into this swap chain image
+      uint32_t mainPassScope = gpuProfiler.beginScope(commandBuffers[i], slot, "main pass");
+      renderGraph.execute(commandBuffers[i], slot, [this, slot](const GraphPassContext& context)
+      {
+        if (context.pass == scenePass)
+        {
+          uint32_t sceneScope = overdrawCounter.beginScope(context.commandBuffer, slot, "scene");
+          vkCmdBindPipeline(context.commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+          setViewportAndScissor(context.commandBuffer);
+          bindScene(context.commandBuffer, slot);
+          recordDraws(context.commandBuffer, slot, 0, drawItemCount());
+          overdrawCounter.endScope(context.commandBuffer, slot, sceneScope);
+        }
+        else if (options.depthPrepass && context.pass == prepassPass)
+          recordDepthPrepass(context.commandBuffer, slot);
+        else
+          recordPost(context.commandBuffer, slot);
+      });
+      gpuProfiler.endScope(commandBuffers[i], slot, mainPassScope);
 
-      VkClearValue clearColor = { 0.0f, 0.0f, 0.0f, 1.0f };
-      renderPassInfo.clearValueCount = 1;
-      renderPassInfo.pClearValues = &clearColor;
+      if (vkEndCommandBuffer(commandBuffers[i]) != VK_SUCCESS)
+        throw std::runtime_error("failed to record command buffer!");
+    }
+  }
 
-      vkCmdBeginRenderPass(commandBuffers[i], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+  // Prerecorded command buffers can be pending on any frame in flight, so
+  // this waits for everything submitted so far first
+  void recordCommandBuffersAgain()
+  {
+    deviceQueues.wait(deviceQueues.submitted());
+    collectPendingGpuTimings();
+    vkFreeCommandBuffers(device, commandPool, static_cast<uint32_t>(commandBuffers.size()), commandBuffers.data());
+    createCommandBuffers();
+  }
 
-        vkCmdBindPipeline(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+  // Viewport and scissor are dynamic pipeline state, so the pipeline doesn't
+  // depend on the window size and survives swap chain recreation
+  void setViewportAndScissor(VkCommandBuffer commandBuffer)
+  {
+    VkViewport viewport = {};
+    viewport.x = 0.0f;
+    viewport.y = 0.0f;
+    viewport.width = (float)swapChainExtent.width;
+    viewport.height = (float)swapChainExtent.height;
+    viewport.minDepth = 0.0f;
+    viewport.maxDepth = 1.0f;
 
-        vkCmdDraw(commandBuffers[i], 3, 1, 0, 0);
+    VkRect2D scissor = {};
+    scissor.offset = { 0, 0 };
+    scissor.extent = swapChainExtent;
 
-      vkCmdEndRenderPass(commandBuffers[i]);
+    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+    vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+  }
 
-      if (vkEndCommandBuffer(commandBuffers[i]) != VK_SUCCESS)
-        throw std::runtime_error("failed to record command buffer!");
+  // Binds the mesh and its per instance data: the instance streams of the
+  // frame slot with --instancing, the static object buffer otherwise. The
+  // texture set stays bound while the draws rebind set 0.
+  void bindScene(VkCommandBuffer commandBuffer, uint32_t slot)
+  {
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 1, 1, &textureSets[slot], 0, nullptr);
+    bindMesh(commandBuffer, sceneMesh);
+    if (instanceStreams.isEnabled())
+      instanceStreams.bind(commandBuffer, slot);
+    else
+    {
+      VkDeviceSize offset = 0;
+      vkCmdBindVertexBuffers(commandBuffer, OBJECT_BINDING, 1, &objectBuffer, &offset);
     }
   }
 
-  void createCommandPool()
+  // Whether every object is drawn by one instanced vkCmdDrawIndexed
+  bool drawsInstanced() const
+  {
+    return options.instancing && !options.perObjectDraws;
+  }
+
+  /*
+    Units of recording work the draws are split into. With GPU culling one
+    item is a full set of indirect draws over every object, otherwise it is
+    a single object of one of the --draws repetitions. Instanced draws work
+    like the GPU culling case, one item draws every object.
+  */
+  int drawItemCount() const
+  {
+    if (gpuCuller.isEnabled() || drawsInstanced())
+      return options.drawCount;
+    return options.drawCount * options.objectCount;
+  }
+
+  // The item drawn at position, front to back within every --draws
+  // repetition when the draws were sorted
+  int sortedItem(int position) const
   {
-    QueueFamilyIndices queueFamilyIndices = findQueueFamilies(physicalDevice);
+    if (drawOrder.empty())
+      return position;
+    int object = position % options.objectCount;
+    return position - object + static_cast<int>(drawOrder[object]);
+  }
+
+  void recordDraws(VkCommandBuffer commandBuffer, uint32_t slot, int firstItem, int lastItem)
+  {
+    VkDescriptorSet drawSet = drawSets[slot];
+    uint32_t entryCount = drawUniforms.entryCount();
+
+    // The pipeline was specialized not to read the uniforms, the set is
+    // only bound once because the layout still has it
+    if (options.pushConstants)
+    {
+      uint32_t dynamicOffset = drawUniforms.offset(slot, 0);
+      vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &drawSet, 1, &dynamicOffset);
+    }
+
+    for (int position = firstItem; position < lastItem; ++position)
+    {
+      int item = sortedItem(position);
+      if (options.pushConstants)
+      {
+        // Goes straight into the command buffer, nothing to write or flush
+        DrawUniforms constants;
+        drawTint(static_cast<uint32_t>(item), constants.tint);
+        vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(constants), &constants);
+      }
+      else
+      {
+        // Same set every draw, only the offset to the draw's data changes
+        uint32_t dynamicOffset = drawUniforms.offset(slot, static_cast<uint32_t>(item) % entryCount);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &drawSet, 1, &dynamicOffset);
+      }
+
+      if (gpuCuller.isEnabled())
+        gpuCuller.recordDraws(commandBuffer, cullingCopy(slot));
+      else if (drawsInstanced())
+        vkCmdDrawIndexed(commandBuffer, sceneMesh.indexCount, static_cast<uint32_t>(options.objectCount), 0, 0, 0);
+      else
+      {
+        // firstInstance selects the object's per instance attributes
+        uint32_t object = static_cast<uint32_t>(item % options.objectCount);
+        vkCmdDrawIndexed(commandBuffer, sceneMesh.indexCount, 1, 0, 0, object);
+      }
+    }
+  }
+
+  // Has to be outside the render pass, dispatches aren't allowed inside one
+  void recordCulling(VkCommandBuffer commandBuffer, uint32_t slot)
+  {
+    if (!gpuCuller.isEnabled())
+      return;
+
+    uint32_t cullingScope = gpuProfiler.beginScope(commandBuffer, slot, "culling");
+    gpuCuller.recordCulling(commandBuffer, cullingCopy(slot), viewProjection);
+    gpuProfiler.endScope(commandBuffer, slot, cullingScope);
+  }
+
+  /*
+    The culling of the frame in a command buffer of its own for the compute
+    queue. The draw list it writes belongs to the frame slot, so it can't
+    overwrite the one the previous frame is still drawing from.
+  */
+  void recordAsyncCulling(FrameCommands& commands, uint32_t slot)
+  {
+    vkResetCommandPool(device, commands.computePool, 0);
+
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    vkBeginCommandBuffer(commands.compute, &beginInfo);
+    gpuCuller.recordCulling(commands.compute, cullingCopy(slot), viewProjection);
+    if (vkEndCommandBuffer(commands.compute) != VK_SUCCESS)
+      throw std::runtime_error("failed to record culling command buffer!");
+  }
+
+  // Without --async-compute the queue orders the frames' culling and draws,
+  // one draw list does
+  uint32_t cullingCopy(uint32_t slot) const
+  {
+    return options.asyncCompute ? slot : 0;
+  }
+
+  bool recordsEveryFrame() const
+  {
+    return !options.staticCommands;
+  }
+
+  void createFrameCommandPools()
+  {
+    if (!recordsEveryFrame())
+      return;
+
+    // Transient: buffers are short lived and rerecorded all the time
+    VkCommandPoolCreateInfo poolInfo = {};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.queueFamilyIndex = deviceQueues.family(QueueRole::Graphics);
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+    frameCommands.resize(options.framesInFlight);
+    for (auto& frame : frameCommands)
+    {
+      if (vkCreateCommandPool(device, &poolInfo, nullptr, &frame.primaryPool) != VK_SUCCESS)
+        throw std::runtime_error("failed to create frame command pool");
+
+      VkCommandBufferAllocateInfo allocInfo = {};
+      allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+      allocInfo.commandPool = frame.primaryPool;
+      allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+      allocInfo.commandBufferCount = 1;
+
+      if (vkAllocateCommandBuffers(device, &allocInfo, &frame.primary) != VK_SUCCESS)
+        throw std::runtime_error("failed to allocate frame command buffer!");
+
+      frame.scratch.create(FRAME_SCRATCH_SIZE);
+
+      if (options.asyncCompute)
+      {
+        VkCommandPoolCreateInfo computePoolInfo = poolInfo;
+        computePoolInfo.queueFamilyIndex = deviceQueues.family(QueueRole::Compute);
+        if (vkCreateCommandPool(device, &computePoolInfo, nullptr, &frame.computePool) != VK_SUCCESS)
+          throw std::runtime_error("failed to create frame compute command pool");
+
+        allocInfo.commandPool = frame.computePool;
+        if (vkAllocateCommandBuffers(device, &allocInfo, &frame.compute) != VK_SUCCESS)
+          throw std::runtime_error("failed to allocate frame compute command buffer!");
+      }
+
+      frame.workerPools.resize(options.recordThreads);
+      frame.secondaries.resize(options.recordThreads);
+      for (int i = 0; i < options.recordThreads; ++i)
+      {
+        if (vkCreateCommandPool(device, &poolInfo, nullptr, &frame.workerPools[i]) != VK_SUCCESS)
+          throw std::runtime_error("failed to create recording thread command pool");
+
+        allocInfo.commandPool = frame.workerPools[i];
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+
+        if (vkAllocateCommandBuffers(device, &allocInfo, &frame.secondaries[i]) != VK_SUCCESS)
+          throw std::runtime_error("failed to allocate secondary command buffer!");
+      }
+    }
+
+    if (options.recordThreads > 0)
+      recordWorkers.reset(new ThreadPool(options.recordThreads));
+  }
+
+  // Records draw items [firstDraw, lastDraw) of the scene into a secondary
+  // command buffer that continues the scene's subpass
+  void recordSecondary(VkCommandBuffer commandBuffer, uint32_t slot, const GraphPassContext& context,
+    int firstDraw, int lastDraw)
+  {
+    VkCommandBufferInheritanceInfo inheritanceInfo = {};
+    inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritanceInfo.renderPass = context.renderPass;
+    inheritanceInfo.subpass = context.subpass;
+    inheritanceInfo.framebuffer = context.framebuffer;
+
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+    beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+    vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+      // Pipeline and dynamic state aren't inherited from the primary
+      vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+      setViewportAndScissor(commandBuffer);
+      bindScene(commandBuffer, slot);
+      recordDraws(commandBuffer, slot, firstDraw, lastDraw);
+
+    if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+      throw std::runtime_error("failed to record secondary command buffer!");
+  }
+
+  // The scene's subpass of the frame's primary command buffer
+  void recordScenePass(FrameCommands& commands, const GraphPassContext& context, uint32_t slot)
+  {
+    // --overdraw is never combined with recording threads, a query can't
+    // be active across secondary command buffers that don't inherit it
+    if (!recordWorkers)
+    {
+      uint32_t sceneScope = overdrawCounter.beginScope(context.commandBuffer, slot, "scene");
+      vkCmdBindPipeline(context.commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+      setViewportAndScissor(context.commandBuffer);
+      bindScene(context.commandBuffer, slot);
+      recordDraws(context.commandBuffer, slot, 0, drawItemCount());
+      overdrawCounter.endScope(context.commandBuffer, slot, sceneScope);
+      return;
+    }
+
+    int threadCount = options.recordThreads;
+    int itemCount = drawItemCount();
+    RecordJob* jobs = commands.scratch.allocate<RecordJob>(threadCount);
+    for (int i = 0; i < threadCount; ++i)
+    {
+      // 64 bit so large object counts times threads don't overflow
+      jobs[i].commandBuffer = commands.secondaries[i];
+      jobs[i].firstDraw = static_cast<int>(static_cast<int64_t>(itemCount) * i / threadCount);
+      jobs[i].lastDraw = static_cast<int>(static_cast<int64_t>(itemCount) * (i + 1) / threadCount);
+    }
+
+    // Also rethrows if a recording thread failed
+    auto recordJob = [this, jobs, slot, &context](uint32_t i)
+    {
+      recordSecondary(jobs[i].commandBuffer, slot, context, jobs[i].firstDraw, jobs[i].lastDraw);
+    };
+    recordWorkers->parallelFor(static_cast<uint32_t>(threadCount), recordJob);
+
+    vkCmdExecuteCommands(context.commandBuffer, static_cast<uint32_t>(commands.secondaries.size()), commands.secondaries.data());
+  }
+
+  // The scene's draws in the same order, only writing depth. Always inline,
+  // it's cheap to record even with many objects.
+  void recordDepthPrepass(VkCommandBuffer commandBuffer, uint32_t slot)
+  {
+    uint32_t prepassScope = overdrawCounter.beginScope(commandBuffer, slot, "depth prepass");
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, prepassPipeline);
+    setViewportAndScissor(commandBuffer);
+    bindScene(commandBuffer, slot);
+    recordDraws(commandBuffer, slot, 0, drawItemCount());
+    overdrawCounter.endScope(commandBuffer, slot, prepassScope);
+  }
+
+  // The post pass: one triangle over the whole image, the fragment shader
+  // reads sceneColor at its own pixel
+  void recordPost(VkCommandBuffer commandBuffer, uint32_t slot)
+  {
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, postPipeline);
+    setViewportAndScissor(commandBuffer);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, postPipelineLayout, 0, 1, &postSets[slot], 0, nullptr);
+    vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+  }
+
+  /*
+    Records the frame's primary command buffer. Without recording threads
+    the draws go straight into it. Otherwise they are split evenly over
+    secondary command buffers that the workers and this thread record in
+    parallel, and the primary executes them in order.
+  */
+  void recordFrameCommands(size_t frame, uint32_t imageIndex)
+  {
+    FrameCommands& commands = frameCommands[frame];
+    uint32_t slot = static_cast<uint32_t>(frame);
+
+    // The frame's submission was waited on, nothing of it is still executing
+    vkResetCommandPool(device, commands.primaryPool, 0);
+    for (auto pool : commands.workerPools)
+      vkResetCommandPool(device, pool, 0);
+    commands.scratch.reset();
+    allocateDrawSet(slot);
+
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    vkBeginCommandBuffer(commands.primary, &beginInfo);
+
+    gpuProfiler.beginFrame(commands.primary, slot);
+    overdrawCounter.beginFrame(commands.primary, slot);
+    if (options.asyncCompute)
+      recordAsyncCulling(commands, slot);
+    else
+      recordCulling(commands.primary, slot);
+
+    uint32_t mainPassScope = gpuProfiler.beginScope(commands.primary, slot, "main pass");
+    renderGraph.execute(commands.primary, imageIndex, [this, &commands, slot](const GraphPassContext& context)
+    {
+      if (context.pass == scenePass)
+        recordScenePass(commands, context, slot);
+      else if (options.depthPrepass && context.pass == prepassPass)
+        recordDepthPrepass(context.commandBuffer, slot);
+      else
+        recordPost(context.commandBuffer, slot);
+    });
+    gpuProfiler.endScope(commands.primary, slot, mainPassScope);
+
+    if (vkEndCommandBuffer(commands.primary) != VK_SUCCESS)
+      throw std::runtime_error("failed to record frame command buffer!");
+  }
+
+  void createUploader()
+  {
+    // Big enough for the object buffer to go up in a single copy
+    VkDeviceSize objectBytes = sizeof(ObjectData) * static_cast<VkDeviceSize>(options.objectCount);
+    uploader.create(device, gpuAllocator, deviceQueues, options.framesInFlight,
+      std::max(STAGING_BUFFER_SIZE, objectBytes + 1024 * 1024) + textureStagingSize());
+  }
+
+  // Every frame in flight can have a full budget of texture rows staged
+  VkDeviceSize textureStagingSize() const
+  {
+    return static_cast<VkDeviceSize>(options.uploadBudget) * options.framesInFlight;
+  }
+
+  // Only starts loading, the placeholder is drawn until the texture is in
+  void createTextureStreamer()
+  {
+    textureStreamer.create(device, physicalDevice, enabledFeatures, gpuAllocator, uploader, assets,
+      deviceQueues.family(QueueRole::Graphics), options.framesInFlight, options.uploadBudget, !options.transcodeTextures);
+    if (!options.texturePath.empty())
+      sceneTexture = textureStreamer.request(options.texturePath);
+  }
+
+  // The copies go out with the first frame's upload submit
+  void createSceneMesh()
+  {
+    uint32_t graphicsFamily = deviceQueues.family(QueueRole::Graphics);
+    if (options.meshPath.empty())
+      sceneMesh = createMesh(uploader, graphicsFamily, makeTriangleMesh());
+    else
+    {
+      // Uploaded straight out of the mapping, which can go once it's staged
+      Asset meshAsset = assets.open(options.meshPath);
+      sceneMesh = createMesh(uploader, graphicsFamily, meshAssetView(meshAsset));
+    }
+  }
+
+  void createSceneObjects()
+  {
+    std::vector<ObjectData> objects = makeObjectGrid(static_cast<uint32_t>(options.objectCount), options.overlap);
+    if (!options.unsorted && !options.gpuCulling && !drawsInstanced())
+      sortDraws(objects);
+    VkDeviceSize size = sizeof(ObjectData) * objects.size();
+
+    // Read as vertex data when drawing and as a storage buffer by cull.comp,
+    // which may run on the compute queue
+    uint32_t readers[] = { deviceQueues.family(QueueRole::Graphics), deviceQueues.family(QueueRole::Compute) };
+    uploader.createBuffer(size, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+      readers, options.asyncCompute ? 2 : 1, objectBuffer, objectMemory);
+
+    if (!uploader.uploadBuffer(objectBuffer, 0, objects.data(), size))
+      throw std::runtime_error("not enough staging space left for scene objects!");
+
+    // Kept around to animate the instance streams from
+    if (options.instancing)
+    {
+      sceneObjects.swap(objects);
+      objectColors = makeObjectColors(static_cast<uint32_t>(options.objectCount));
+    }
+  }
+
+  /*
+    Orders the draws for early depth testing. The objects never move in depth,
+    so once is enough. Every object shares the pipeline and the material (the
+    texture set), only the depth part of the keys differs. Nearest first, so
+    the objects behind fail the depth test before their fragments are shaded.
+  */
+  void sortDraws(const std::vector<ObjectData>& objects)
+  {
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<DrawSortEntry> entries(objects.size());
+    for (size_t i = 0; i < objects.size(); ++i)
+    {
+      entries[i].key = makeOpaqueSortKey(0, 0, objects[i].transform[3]);
+      entries[i].item = static_cast<uint32_t>(i);
+    }
+    std::vector<DrawSortEntry> scratch;
+    radixSort(entries, scratch);
+
+    drawOrder.resize(entries.size());
+    for (size_t i = 0; i < entries.size(); ++i)
+      drawOrder[i] = entries[i].item;
+
+    drawSortMs = millisecondsSince(start);
+  }
+
+  void createInstanceStreams()
+  {
+    if (!options.instancing)
+      return;
+
+    instanceStreams.create(device, gpuAllocator, static_cast<uint32_t>(options.objectCount), frameSlotCount());
+    sceneStart = std::chrono::steady_clock::now();
+  }
+
+  void createDrawUniforms()
+  {
+    // Push constants carry the tints, the one entry is only there to bind
+    uint32_t entryCount = std::min(static_cast<uint32_t>(drawItemCount()), MAX_DRAW_UNIFORMS);
+    if (options.pushConstants)
+      entryCount = 1;
+    drawUniforms.create(device, physicalDevice, gpuAllocator, sizeof(DrawUniforms), entryCount, frameSlotCount());
+
+    // Tints come from the object colors, the instancing path made them already
+    if (objectColors.empty())
+      objectColors = makeObjectColors(static_cast<uint32_t>(options.objectCount));
+
+    reserveFrameDescriptors(frameSlotCount());
+  }
+
+  void reserveFrameDescriptors(uint32_t slotCount)
+  {
+    size_t first = frameDescriptors.size();
+    if (slotCount <= first)
+      return;
+
+    frameDescriptors.resize(slotCount);
+    drawSets.resize(slotCount, VK_NULL_HANDLE);
+    textureSets.resize(slotCount, VK_NULL_HANDLE);
+    postSets.resize(slotCount, VK_NULL_HANDLE);
+    for (size_t i = first; i < frameDescriptors.size(); ++i)
+      frameDescriptors[i].create(device, 16);
+  }
+
+  // Throws away the slot's previous sets and points new ones at the draw
+  // uniforms and at the scene texture, or the placeholder while it isn't
+  // resident. The slot's last command buffer must have finished.
+  VkDescriptorSet allocateDrawSet(uint32_t slot)
+  {
+    DescriptorAllocator& descriptors = frameDescriptors[slot];
+    descriptors.reset();
+    VkDescriptorSet set = descriptors.allocate(drawSetLayout);
+    VkDescriptorSet textureSet = descriptors.allocate(textureSetLayout);
+
+    VkDescriptorBufferInfo bufferInfo = drawUniforms.descriptorInfo();
+    VkDescriptorImageInfo imageInfo = textureStreamer.descriptorInfo(sceneTexture);
+
+    VkWriteDescriptorSet writes[2] = {};
+    writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writes[0].dstSet = set;
+    writes[0].dstBinding = 0;
+    writes[0].descriptorCount = 1;
+    writes[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    writes[0].pBufferInfo = &bufferInfo;
+
+    writes[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writes[1].dstSet = textureSet;
+    writes[1].dstBinding = 0;
+    writes[1].descriptorCount = 1;
+    writes[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    writes[1].pImageInfo = &imageInfo;
+    vkUpdateDescriptorSets(device, 2, writes, 0, nullptr);
+
+    drawSets[slot] = set;
+    textureSets[slot] = textureSet;
+
+    if (options.postProcess)
+    {
+      VkDescriptorImageInfo sceneInfo = {};
+      sceneInfo.imageView = renderGraph.view(sceneColor);
+      sceneInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+      VkWriteDescriptorSet postWrite = {};
+      postWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+      postWrite.dstSet = descriptors.allocate(postSetLayout);
+      postWrite.dstBinding = 0;
+      postWrite.descriptorCount = 1;
+      postWrite.descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+      postWrite.pImageInfo = &sceneInfo;
+      vkUpdateDescriptorSets(device, 1, &postWrite, 0, nullptr);
+      postSets[slot] = postWrite.dstSet;
+    }
+    return set;
+  }
+
+  /*
+    Tint of a draw item. A draw of a single object gets the object's color,
+    the draws that cover every object at once (instanced or GPU culled)
+    aren't tinted.
+  */
+  void drawTint(uint32_t item, float tint[4]) const
+  {
+    bool perObject = !gpuCuller.isEnabled() && !drawsInstanced();
+    uint32_t color = perObject ? objectColors[item % objectColors.size()] : 0xFFFFFFFFu;
+    for (int channel = 0; channel < 4; ++channel)
+      tint[channel] = ((color >> (8 * channel)) & 0xFF) / 255.0f;
+  }
+
+  // Writes the tint of every draw into the slot's uniforms
+  void updateDrawUniforms(uint32_t slot)
+  {
+    if (options.pushConstants)
+      return;
+
+    for (uint32_t i = 0; i < drawUniforms.entryCount(); ++i)
+      drawTint(i, static_cast<DrawUniforms*>(drawUniforms.entry(slot, i))->tint);
+    drawUniforms.flush(slot);
+  }
+
+  /*
+    Prints how many descriptor sets per second can be allocated, written
+    and bound, against how many binds per second of a single set with a
+    new dynamic offset each. Both are recorded into command buffers that
+    are never submitted, so only the CPU side is measured.
+  */
+  void runDescriptorBenchmark()
+  {
+    const uint32_t BINDS = 100000;
+    const uint32_t SETS_PER_FRAME = 1000;
+
+    VkCommandBuffer commandBuffers[2];
+    VkCommandBufferAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.commandPool = commandPool;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandBufferCount = 2;
+
+    if (vkAllocateCommandBuffers(device, &allocInfo, commandBuffers) != VK_SUCCESS)
+      throw std::runtime_error("failed to allocate descriptor benchmark command buffers!");
+
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    for (auto commandBuffer : commandBuffers)
+    {
+      vkBeginCommandBuffer(commandBuffer, &beginInfo);
+      vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+    }
+
+    VkDescriptorBufferInfo bufferInfo = drawUniforms.descriptorInfo();
+    VkWriteDescriptorSet write = {};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstBinding = 0;
+    write.descriptorCount = 1;
+    write.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    write.pBufferInfo = &bufferInfo;
+
+    // A new set per draw, the pools reset every SETS_PER_FRAME sets like
+    // they would at the start of each frame
+    DescriptorAllocator allocator;
+    allocator.create(device, SETS_PER_FRAME);
+    uint32_t zeroOffset = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < BINDS; ++i)
+    {
+      if (i % SETS_PER_FRAME == 0)
+        allocator.reset();
+      write.dstSet = allocator.allocate(drawSetLayout);
+      vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+      vkCmdBindDescriptorSets(commandBuffers[0], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &write.dstSet, 1, &zeroOffset);
+    }
+    double perSetMs = millisecondsSince(start);
+
+    // One set for everything, only the dynamic offset changes per draw
+    allocator.reset();
+    VkDescriptorSet set = allocator.allocate(drawSetLayout);
+    write.dstSet = set;
+    vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+    start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < BINDS; ++i)
+    {
+      uint32_t dynamicOffset = drawUniforms.offset(0, i % drawUniforms.entryCount());
+      vkCmdBindDescriptorSets(commandBuffers[1], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &set, 1, &dynamicOffset);
+    }
+    double dynamicOffsetMs = millisecondsSince(start);
+
+    for (auto commandBuffer : commandBuffers)
+      vkEndCommandBuffer(commandBuffer);
+    vkFreeCommandBuffers(device, commandPool, 2, commandBuffers);
+    // Only once nothing refers to the sets anymore
+    allocator.destroy();
+
+    std::cout << "descriptor_path,binds,ms,binds_per_sec\n"
+      << "allocate_write_bind," << BINDS << ',' << perSetMs << ',' << BINDS / (perSetMs / 1000.0) << '\n'
+      << "dynamic_offset_bind," << BINDS << ',' << dynamicOffsetMs << ',' << BINDS / (dynamicOffsetMs / 1000.0) << std::endl;
+  }
+
+  // Rewrites the instance data of the slot, whose last reader has finished
+  void updateInstanceStreams(uint32_t slot)
+  {
+    std::chrono::duration<double> time = std::chrono::steady_clock::now() - sceneStart;
+    animateObjects(sceneObjects, time.count(), instanceStreams.transforms(slot));
+    std::memcpy(instanceStreams.colors(slot), objectColors.data(), sizeof(uint32_t) * objectColors.size());
+    instanceStreams.flush(slot);
+  }
+
+  void createGpuCuller()
+  {
+    if (!options.gpuCulling)
+      return;
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+    GpuCullerDesc desc;
+    desc.objectBuffer = objectBuffer;
+    desc.objectCount = static_cast<uint32_t>(options.objectCount);
+    desc.indexCount = sceneMesh.indexCount;
+    desc.multiDrawIndirect = enabledFeatures.multiDrawIndirect == VK_TRUE;
+    desc.maxDrawIndirectCount = enabledFeatures.multiDrawIndirect ? properties.limits.maxDrawIndirectCount : 1;
+#ifdef VK_KHR_draw_indirect_count
+    desc.drawIndexedIndirectCount = drawIndexedIndirectCount;
+#endif
+    cullShaderPath = shaderPath("cull.comp", "cull.spv");
+    desc.shaderCode = shaderCompiler.load(cullShaderPath);
+    desc.queueFamilies.push_back(deviceQueues.family(QueueRole::Graphics));
+    if (options.asyncCompute)
+    {
+      desc.copyCount = static_cast<uint32_t>(options.framesInFlight);
+      if (deviceQueues.isSeparateFamily(QueueRole::Compute))
+        desc.queueFamilies.push_back(deviceQueues.family(QueueRole::Compute));
+    }
+
+    gpuCuller.create(device, gpuAllocator, pipelineCache.handle(), desc);
+  }
 
+  void createCommandPool()
+  {
     VkCommandPoolCreateInfo poolInfo = {};
     poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-    poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily;
+    poolInfo.queueFamilyIndex = deviceQueues.family(QueueRole::Graphics);
     poolInfo.flags = 0;
 
     if (vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool) != VK_SUCCESS)
       throw std::runtime_error("failed to create command pool");
   }
 
-  void createFrameBuffers()
+  // Framebuffers of every render pass for each swap chain image, and the
+  // images the render graph owns at the swap chain's size
+  void createFrameBuffers()
+  {
+    renderGraph.setImportedViews(backbuffer, swapChainImageViews);
+    renderGraph.createResources(swapChainExtent);
+  }
+
+  /*
+    The frame as render graph passes. The scene clears and draws into the
+    swap chain image, or with --post-process into sceneColor, which the post
+    pass then reads at the same pixel. The graph merges the two into
+    subpasses of one render pass, so on tilers sceneColor never leaves tile
+    memory and gets lazily allocated memory.
+
+    With --msaa the scene draws into a multisampled image instead, resolved
+    into the image above at the end of the scene subpass. Nothing reads the
+    samples later, so they are never stored and get lazily allocated memory
+    too.
+
+    The scene depth tests against a depth image with the scene's samples.
+    With --depth-prepass a vertex only pass writes the depth first and the
+    scene then only tests against it. Both end up as subpasses of the same
+    render pass, so the depth isn't stored either.
+  */
+  void createRenderGraph()
   {
-    swapChainFramebuffers.resize(swapChainImageViews.size());
+    renderGraph.create(device, gpuAllocator);
+    // Offscreen images are never presented, leave them ready to be copied out
+    backbuffer = renderGraph.importImage("backbuffer", swapChainImageFormat,
+      options.headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+
+    // Recording threads continue the scene's subpass in secondary command buffers
+    VkSubpassContents sceneContents = recordsEveryFrame() && options.recordThreads > 0 ?
+      VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE;
+    VkClearColorValue clearColor = { { 0.0f, 0.0f, 0.0f, 1.0f } };
+    VkClearDepthStencilValue clearDepth = { 1.0f, 0 };
+    GraphResource sceneDepth = renderGraph.createImage("scene depth", depthFormat, msaaSamples);
+    if (options.depthPrepass)
+    {
+      prepassPass = renderGraph.addPass("depth prepass");
+      renderGraph.writeDepth(prepassPass, sceneDepth, &clearDepth);
+    }
+    scenePass = renderGraph.addPass("scene", sceneContents);
+    renderGraph.writeDepth(scenePass, sceneDepth, options.depthPrepass ? nullptr : &clearDepth);
+    GraphResource sceneTarget = backbuffer;
+    if (options.postProcess)
+    {
+      sceneColor = renderGraph.createImage("scene color", swapChainImageFormat);
+      sceneTarget = sceneColor;
+      // Covers every pixel, nothing to clear or load
+      postPass = renderGraph.addPass("post");
+      renderGraph.readAttachment(postPass, sceneColor);
+      renderGraph.writeColor(postPass, backbuffer);
+    }
 
-    for (size_t i = 0; i < swapChainImageViews.size(); ++i)
+    if (msaaSamples != VK_SAMPLE_COUNT_1_BIT)
     {
-      VkImageView attachments[] =
-      {
-        swapChainImageViews[i]
-      };
-
-      VkFramebufferCreateInfo framebufferInfo = {};
-      framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-      framebufferInfo.renderPass = renderPass;
-      framebufferInfo.attachmentCount = 1;
-      framebufferInfo.pAttachments = attachments;
-      framebufferInfo.width = swapChainExtent.width;
-      framebufferInfo.height = swapChainExtent.height;
-      framebufferInfo.layers = 1;
-
-      if (vkCreateFramebuffer(device, &framebufferInfo, nullptr, &swapChainFramebuffers[i]) != VK_SUCCESS)
-        throw std::runtime_error("failed to create framebuffer!");
-    }
-  }
-
-  void createRenderPass()
-  {
-    VkAttachmentDescription colorAttachment = {};
-    colorAttachment.format = swapChainImageFormat;
-    colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
-    colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-    colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-    colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-
-    VkAttachmentReference colorAttachmentRef = {};
-    colorAttachmentRef.attachment = 0;
-    colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-
-    VkSubpassDescription subpass = {};
-    subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-    subpass.colorAttachmentCount = 1;
-    subpass.pColorAttachments = &colorAttachmentRef;
-
-    VkSubpassDependency dependency = {};
-    dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-    dependency.dstSubpass = 0;
-    dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    dependency.srcAccessMask = 0;
-    dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-
-    VkRenderPassCreateInfo renderPassInfo = {};
-    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-    renderPassInfo.attachmentCount = 1;
-    renderPassInfo.pAttachments = &colorAttachment;
-    renderPassInfo.subpassCount = 1;
-    renderPassInfo.pSubpasses = &subpass;
-    renderPassInfo.dependencyCount = 1;
-    renderPassInfo.pDependencies = &dependency;
-
-    if (vkCreateRenderPass(device, &renderPassInfo, nullptr, &renderPass) != VK_SUCCESS)
-      throw std::runtime_error("failed to create render pass!");
+      GraphResource samples = renderGraph.createImage("scene samples", swapChainImageFormat, msaaSamples);
+      renderGraph.writeColor(scenePass, samples, &clearColor);
+      renderGraph.resolve(scenePass, samples, sceneTarget);
+    }
+    else
+      renderGraph.writeColor(scenePass, sceneTarget, &clearColor);
+
+    renderGraph.compile(!options.separatePasses);
   }
 
   void createImageViews()
@@ -457,7 +1906,109 @@ private:
     }
   }
 
-  void createSwapChain()
+  /*
+    Stand-in for the swap chain when running headless. One color image per
+    frame in flight, rendered with the exact same render pass and pipeline
+    as the windowed path.
+  */
+  void createOffscreenImages()
+  {
+    // B8G8R8A8_UNORM is one of the formats every implementation must support
+    // as a color attachment, so this works on software drivers too
+    swapChainImageFormat = VK_FORMAT_B8G8R8A8_UNORM;
+    swapChainExtent = { static_cast<uint32_t>(WIDTH), static_cast<uint32_t>(HEIGHT) };
+
+    swapChainImages.resize(options.framesInFlight);
+    offscreenImageMemory.resize(options.framesInFlight);
+
+    for (size_t i = 0; i < swapChainImages.size(); ++i)
+    {
+      VkImageCreateInfo imageInfo = {};
+      imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+      imageInfo.imageType = VK_IMAGE_TYPE_2D;
+      imageInfo.format = swapChainImageFormat;
+      imageInfo.extent.width = swapChainExtent.width;
+      imageInfo.extent.height = swapChainExtent.height;
+      imageInfo.extent.depth = 1;
+      imageInfo.mipLevels = 1;
+      imageInfo.arrayLayers = 1;
+      imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+      imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+      // Transfer source so the result can be read back
+      imageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+      imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+      imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+      gpuAllocator.createImage(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, swapChainImages[i], offscreenImageMemory[i]);
+    }
+  }
+
+  // Copies an offscreen image to host memory and writes it out as a PPM
+  void saveOffscreenImage(uint32_t imageIndex, const std::string& filename)
+  {
+    VkDeviceSize imageSize = static_cast<VkDeviceSize>(swapChainExtent.width) * swapChainExtent.height * 4;
+
+    VkBuffer stagingBuffer;
+    GpuAllocation stagingAllocation;
+    gpuAllocator.createBuffer(imageSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+      stagingBuffer, stagingAllocation);
+
+    VkCommandBufferAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandPool = commandPool;
+    allocInfo.commandBufferCount = 1;
+
+    VkCommandBuffer commandBuffer;
+    vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer);
+
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+      // The render pass already left the image in TRANSFER_SRC_OPTIMAL.
+      // bufferRowLength/bufferImageHeight of 0 means tightly packed.
+      VkBufferImageCopy region = {};
+      region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+      region.imageSubresource.mipLevel = 0;
+      region.imageSubresource.baseArrayLayer = 0;
+      region.imageSubresource.layerCount = 1;
+      region.imageExtent = { swapChainExtent.width, swapChainExtent.height, 1 };
+
+      vkCmdCopyImageToBuffer(commandBuffer, swapChainImages[imageIndex],
+        VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, stagingBuffer, 1, &region);
+
+    vkEndCommandBuffer(commandBuffer);
+
+    QueueSubmission submission;
+    submission.execute(commandBuffer);
+    deviceQueues.submit(QueueRole::Graphics, submission);
+    deviceQueues.waitIdle(QueueRole::Graphics);
+
+    vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
+
+    // Host visible allocations stay mapped
+    const unsigned char* pixels = static_cast<const unsigned char*>(stagingAllocation.mapped);
+
+    std::ofstream file(filename, std::ios::binary);
+    if (!file.is_open())
+      throw std::runtime_error("failed to open output image file!");
+
+    file << "P6\n" << swapChainExtent.width << " " << swapChainExtent.height << "\n255\n";
+    // Pixels are BGRA, PPM wants RGB
+    for (VkDeviceSize i = 0; i < imageSize; i += 4)
+    {
+      char rgb[3] = { (char)pixels[i + 2], (char)pixels[i + 1], (char)pixels[i] };
+      file.write(rgb, 3);
+    }
+
+    gpuAllocator.destroyBuffer(stagingBuffer, stagingAllocation);
+  }
+
+  void createSwapChain(VkSwapchainKHR oldSwapChain = VK_NULL_HANDLE)
   {
     SwapChainSupportDetails swapChainSupport = querySwapChainSupport(physicalDevice);
 
@@ -480,10 +2031,9 @@ private:
     createInfo.imageArrayLayers = 1; // Should always be unless doing 3d steroscopics 
     createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
 
-    QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
-    uint32_t queueFamilyIndicies[] = { (uint32_t)indices.graphicsFamily, (uint32_t)indices.presentFamily };
+    uint32_t queueFamilyIndicies[] = { deviceQueues.family(QueueRole::Graphics), deviceQueues.family(QueueRole::Present) };
 
-    if (indices.graphicsFamily != indices.presentFamily)
+    if (queueFamilyIndicies[0] != queueFamilyIndicies[1])
     {
       createInfo.imageSharingMode = VK_SHARING_MODE_CONCURRENT; // Can be used across multiple queue families
       createInfo.queueFamilyIndexCount = 2;
@@ -500,7 +2050,9 @@ private:
     createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
     createInfo.presentMode = presentMode;
     createInfo.clipped = VK_TRUE;
-    createInfo.oldSwapchain = VK_NULL_HANDLE;
+    // Handing over the old swap chain lets the driver reuse its resources
+    // and keep presenting its images while the new one is set up
+    createInfo.oldSwapchain = oldSwapChain;
 
     if (vkCreateSwapchainKHR(device, &createInfo, nullptr, &swapChain) != VK_SUCCESS)
       throw std::runtime_error("failed to create swap chain!");
@@ -543,9 +2095,13 @@ private:
         indices.graphicsFamily = i;
 
       // Check if queue family supports presenting to surface
-      // (Optimization) Find queue that supports graphics and presenting
+      // (Optimization) Find queue that supports graphics and presenting.
+      // Headless has nothing to present to, so the graphics queue stands in.
       VkBool32 presentSupport = false;
-      vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
+      if (options.headless)
+        presentSupport = queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT ? VK_TRUE : VK_FALSE;
+      else
+        vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
 
       if (queueFamily.queueCount > 0 && presentSupport)
         indices.presentFamily = i;
@@ -559,6 +2115,15 @@ private:
     return indices;
   }
 
+  // The swap chain extension is only needed when we actually present
+  std::vector<const char*> getRequiredDeviceExtensions()
+  {
+    if (options.headless)
+      return {};
+
+    return deviceExtensions;
+  }
+
   bool checkDeviceExtensionSupport(VkPhysicalDevice device)
   {
     uint32_t extensionCount;
@@ -567,7 +2132,8 @@ private:
     std::vector<VkExtensionProperties> availableExtensions(extensionCount);
     vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
 
-    std::set<std::string> requiredExtensions(deviceExtensions.begin(), deviceExtensions.end());
+    std::vector<const char*> wantedExtensions = getRequiredDeviceExtensions();
+    std::set<std::string> requiredExtensions(wantedExtensions.begin(), wantedExtensions.end());
 
     for (const auto& extension : availableExtensions)
       requiredExtensions.erase(extension.extensionName);
@@ -640,7 +2206,10 @@ private:
     }
     else
     {
-      VkExtent2D actualExtent = { WIDTH, HEIGHT };
+      // The window may have been resized since it was created
+      int width, height;
+      glfwGetFramebufferSize(window, &width, &height);
+      VkExtent2D actualExtent = { static_cast<uint32_t>(width), static_cast<uint32_t>(height) };
 
       actualExtent.width = std::max(capabilities.minImageExtent.width, std::min(capabilities.maxImageExtent.width, actualExtent.width));
       actualExtent.height = std::max(capabilities.minImageExtent.height, std::min(capabilities.maxImageExtent.height, actualExtent.height));
@@ -648,47 +2217,32 @@ private:
     }
   }
 
-  bool isDeviceSuitable(VkPhysicalDevice device)
+  // Why the app can't run on the device, empty if it can. Features are
+  // checked by scoreDevice.
+  std::string deviceUnsuitableReason(VkPhysicalDevice device)
   {
     QueueFamilyIndices indices = findQueueFamilies(device);
-    bool extensionsSupported = checkDeviceExtensionSupport(device);
+    if (!indices.isComplete())
+      return "no graphics or present queue";
+    if (!checkDeviceExtensionSupport(device))
+      return "missing device extensions";
 
-    bool swapChainAdequate = false;
-    if (extensionsSupported)
+    if (!options.headless)
     {
       SwapChainSupportDetails swapChainSupport = querySwapChainSupport(device);
-      swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
+      if (swapChainSupport.formats.empty() || swapChainSupport.presentModes.empty())
+        return "can't present to the window";
     }
 
-    return indices.isComplete() && extensionsSupported && swapChainAdequate;
-
-    /*
-      If we did want to find devices with particularly desired properties
-      you could querie the physical information such as name, types and
-      supported vulkan versions
-    */
-
-    /*
-    VkPhysicalDeviceProperties deviceProperties;
-    vkGetPhysicalDeviceProperties(device, &deviceProperties);
-
-    // Checks for optional feature support such as texture compression, 
-    // 64 bit floats and multi viewport rendering
-    VkPhysicalDeviceFeatures deviceFeatures;
-    vkGetPhysicalDeviceFeatures(device, &deviceFeatures);
-
-    // Consider that our device is only usable with graphics cards that
-    // supports geometry shaders
-    return deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU
-        && deviceFeatures.geometryShader;
-    
-     There are several ways of finding the best physical device or even
-     scoring the best possible device
-    */
+    return std::string();
   }
 
-  // Find the physical device or the graphics card in the system that supports
-  // the features we need. (We can select more than one)
+  /*
+    Scores every device the app can run on and takes the best one, or the
+    one --device names. Machines with an integrated and a discrete GPU, or
+    a software rasterizer next to a real GPU, list them in no particular
+    order, so the first suitable device is often the slow one.
+  */
   void pickPhysicalDevice()
   {
     // Gets implicitly destroyed when VkInstance is destroyed
@@ -703,205 +2257,293 @@ private:
     // Stores all the available devices within our list
     vkEnumeratePhysicalDevices(instance, &deviceCount, devices.data());
 
-    for (const auto& device : devices)
+    PFN_vkGetPhysicalDeviceProperties2KHR getProperties2 = nullptr;
+    if (deviceIdQueries)
+      getProperties2 = (PFN_vkGetPhysicalDeviceProperties2KHR)vkGetInstanceProcAddr(instance,
+        "vkGetPhysicalDeviceProperties2KHR");
+
+    // What createLogicalDevice enables
+    DeviceRequirements requirements;
+    requirements.requiredFeatures.drawIndirectFirstInstance = options.gpuCulling ? VK_TRUE : VK_FALSE;
+    requirements.optionalFeatures.multiDrawIndirect = options.gpuCulling ? VK_TRUE : VK_FALSE;
+    requirements.optionalFeatures.textureCompressionBC = VK_TRUE;
+    requirements.optionalFeatures.textureCompressionETC2 = VK_TRUE;
+    requirements.optionalFeatures.textureCompressionASTC_LDR = VK_TRUE;
+    requirements.optionalFeatures.pipelineStatisticsQuery = options.overdraw ? VK_TRUE : VK_FALSE;
+
+    std::vector<DeviceInfo> candidates;
+    for (uint32_t i = 0; i < deviceCount; ++i)
     {
-      if (isDeviceSuitable(device))
-      {
-        physicalDevice = device;
-        break;
-      }
+      DeviceInfo candidate = describeDevice(devices[i], i, getProperties2);
+      candidate.unsuitableReason = deviceUnsuitableReason(devices[i]);
+      scoreDevice(candidate, requirements);
+      candidates.push_back(candidate);
     }
 
-    if (physicalDevice == VK_NULL_HANDLE)
-      throw std::runtime_error("failed to find a suitable GPU!");
+    size_t selected = selectDevice(candidates, options.device);
+    physicalDevice = devices[selected];
+    if (options.deviceReport)
+      writeDeviceReport(std::cout, candidates, selected);
+
+    // The scene's color and depth are always multisampled alike
+    const VkPhysicalDeviceLimits& limits = candidates[selected].properties.limits;
+    msaaSamples = chooseSampleCount(limits.framebufferColorSampleCounts & limits.framebufferDepthSampleCounts);
+    depthFormat = findDepthFormat();
   }
 
-  void createGraphicsPipeline()
+  // The most precise depth format the device can render to, the spec
+  // guarantees that one of them is supported
+  VkFormat findDepthFormat() const
   {
-    auto vertShaderCode = readFile("shaders/vert.spv");
-    auto fragShaderCode = readFile("shaders/frag.spv");
-
-    VkShaderModule vertShaderModule;
-    VkShaderModule fragShaderModule;
-
-    vertShaderModule = createShaderModule(vertShaderCode);
-    fragShaderModule = createShaderModule(fragShaderCode);
-
-
-    VkPipelineShaderStageCreateInfo vertShaderStageInfo = {};
-    vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
-    vertShaderStageInfo.module = vertShaderModule;
-    vertShaderStageInfo.pName = "main";
-
-    VkPipelineShaderStageCreateInfo fragShaderStageInfo = {};
-    fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-    fragShaderStageInfo.module = fragShaderModule;
-    fragShaderStageInfo.pName = "main";
-
-    VkPipelineShaderStageCreateInfo shaderStages[] = { vertShaderStageInfo, fragShaderStageInfo };
-    
-    VkPipelineVertexInputStateCreateInfo vertexInputInfo = {};
-    vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-    vertexInputInfo.vertexBindingDescriptionCount = 0;
-    vertexInputInfo.pVertexBindingDescriptions = nullptr;
-    vertexInputInfo.vertexAttributeDescriptionCount = 0;
-    vertexInputInfo.pVertexAttributeDescriptions = nullptr;
-
-    VkPipelineInputAssemblyStateCreateInfo inputAssembly = {};
-    inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-    inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-    inputAssembly.primitiveRestartEnable = VK_FALSE;
-
-    VkViewport viewport = {};
-    viewport.x = 0.0f;
-    viewport.y = 0.0f;
-    viewport.width = (float)swapChainExtent.width;
-    viewport.height = (float)swapChainExtent.height;
-    viewport.minDepth = 0.0f;
-    viewport.maxDepth = 1.0f;
-
-    VkRect2D scissor = {};
-    scissor.offset = { 0, 0 };
-    scissor.extent = swapChainExtent;
+    const VkFormat candidates[] = { VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT,
+      VK_FORMAT_D16_UNORM };
+    for (VkFormat format : candidates)
+    {
+      VkFormatProperties properties;
+      vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &properties);
+      if (properties.optimalTilingFeatures & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT)
+        return format;
+    }
+    throw std::runtime_error("failed to find a supported depth format!");
+  }
 
-    VkPipelineViewportStateCreateInfo viewportState = {};
-    viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-    viewportState.viewportCount = 1;
-    viewportState.pViewports = &viewport;
-    viewportState.scissorCount = 1;
-    viewportState.pScissors = &scissor;
-
-    VkPipelineRasterizationStateCreateInfo rasterizer = {};
-    rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-    rasterizer.depthClampEnable = VK_FALSE;
-    rasterizer.rasterizerDiscardEnable = VK_FALSE;
-    rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
-    rasterizer.lineWidth = 1.0f;
-    rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
-    rasterizer.frontFace = VK_FRONT_FACE_CLOCKWISE;
-    rasterizer.depthBiasEnable = VK_FALSE;
-    rasterizer.depthBiasConstantFactor = 0.0f;
-    rasterizer.depthBiasClamp = 0.0f;
-    rasterizer.depthBiasSlopeFactor = 0.0f;
-
-    VkPipelineMultisampleStateCreateInfo multisampling = {};
-    multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-    multisampling.sampleShadingEnable = VK_FALSE;
-    multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-    multisampling.minSampleShading = 1.0f;
-    multisampling.pSampleMask = nullptr;
-    multisampling.alphaToCoverageEnable = VK_FALSE;
-    multisampling.alphaToOneEnable = VK_FALSE;
-
-    VkPipelineColorBlendAttachmentState colorBlendAttachment = {};
-    colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-    colorBlendAttachment.blendEnable = VK_FALSE;
-
-    VkPipelineColorBlendStateCreateInfo colorBlending = {};
-    colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-    colorBlending.logicOpEnable = VK_FALSE;
-    colorBlending.attachmentCount = 1;
-    colorBlending.pAttachments = &colorBlendAttachment;
-
-    VkDynamicState dynamicStates[] = {
-      VK_DYNAMIC_STATE_VIEWPORT,
-      VK_DYNAMIC_STATE_LINE_WIDTH
-    };
+  // The highest count up to --msaa the device supports, every device
+  // supports 1
+  VkSampleCountFlagBits chooseSampleCount(VkSampleCountFlags supported) const
+  {
+    uint32_t samples = static_cast<uint32_t>(options.msaaSamples);
+    while (samples > 1 && !(supported & samples))
+      samples >>= 1;
+    if (samples != static_cast<uint32_t>(options.msaaSamples))
+      std::cout << "--msaa " << options.msaaSamples << " isn't supported, using " << samples << " samples" << std::endl;
+    return static_cast<VkSampleCountFlagBits>(samples);
+  }
 
-    VkPipelineDynamicStateCreateInfo dynamicState = {};
-    dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-    dynamicState.dynamicStateCount = 2;
-    dynamicState.pDynamicStates = dynamicStates;
+  /*
+    Creates the layout here and hands the pipeline itself to the pipeline
+    builder. Compilation runs on the worker threads while initVulkan goes on
+    with framebuffers and command pools, waitForPipelines collects it.
+  */
+  void createGraphicsPipeline()
+  {
+    pipelineBuildStart = std::chrono::steady_clock::now();
+
+    // Per draw data for the fragment shader, bound with a dynamic offset
+    VkDescriptorSetLayoutBinding drawBinding = {};
+    drawBinding.binding = 0;
+    drawBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    drawBinding.descriptorCount = 1;
+    drawBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    drawSetLayout = descriptorLayouts.get(&drawBinding, 1);
+
+    // The streamed scene texture, in a set of its own
+    VkDescriptorSetLayoutBinding textureBinding = {};
+    textureBinding.binding = 0;
+    textureBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    textureBinding.descriptorCount = 1;
+    textureBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    textureSetLayout = descriptorLayouts.get(&textureBinding, 1);
+    VkDescriptorSetLayout setLayouts[] = { drawSetLayout, textureSetLayout };
+
+    // The same data again, pushed with the draw. Every variant shares the
+    // layout whether it reads the set, the push constants or neither.
+    VkPushConstantRange pushConstantRange = {};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(DrawUniforms);
 
     VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
     pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 2;
+    pipelineLayoutInfo.pSetLayouts = setLayouts;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
 
     if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS)
       throw std::runtime_error("failed to create pipeline layout");
 
-    VkGraphicsPipelineCreateInfo pipelineInfo = {};
-    pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-    pipelineInfo.stageCount = 2;
-    pipelineInfo.pStages = shaderStages;
-    pipelineInfo.pVertexInputState = &vertexInputInfo;
-    pipelineInfo.pInputAssemblyState = &inputAssembly;
-    pipelineInfo.pViewportState = &viewportState;
-    pipelineInfo.pRasterizationState = &rasterizer;
-    pipelineInfo.pMultisampleState = &multisampling;
-    pipelineInfo.pDepthStencilState = nullptr;
-    pipelineInfo.pColorBlendState = &colorBlending;
-    pipelineInfo.pDynamicState = nullptr;
-    pipelineInfo.layout = pipelineLayout;
-    pipelineInfo.renderPass = renderPass;
-    pipelineInfo.subpass = 0;
-    pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+    TintSource tintSource = options.pushConstants ? TINT_PUSH_CONSTANTS : TINT_UNIFORM_BUFFER;
+    sceneDesc = scenePipelineDesc(options.instancing, tintSource);
+    graphicsPipelineFuture = pipelineBuilder->build(sceneDesc);
+    if (options.depthPrepass)
+      prepassPipelineFuture = pipelineBuilder->build(prepassPipelineDesc(sceneDesc));
 
-    if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &graphicsPipeline) != VK_SUCCESS)
-      throw std::runtime_error("failed to create graphics pipeline!");
+    // Every other combination, only built to be counted and timed
+    if (options.pipelineVariants)
+    {
+      for (int instanced = 0; instanced < 2; ++instanced)
+      {
+        for (int tint = TINT_NONE; tint <= TINT_PUSH_CONSTANTS; ++tint)
+        {
+          if ((instanced != 0) != options.instancing || tint != tintSource)
+            variantFutures.push_back(pipelineBuilder->build(scenePipelineDesc(instanced != 0, static_cast<TintSource>(tint))));
+        }
+      }
+    }
 
-    vkDestroyShaderModule(device, vertShaderModule, nullptr);
-    vkDestroyShaderModule(device, fragShaderModule, nullptr);
+    if (options.postProcess)
+      createPostPipeline();
   }
 
-  VkShaderModule createShaderModule(const std::vector<char>& code)
+  // A single input attachment, and no vertex input: post.vert makes the
+  // fullscreen triangle from the vertex index
+  void createPostPipeline()
   {
-    VkShaderModuleCreateInfo createInfo = {};
-    createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-    createInfo.codeSize = code.size();
-    // pointer to buffer with bytecode takes in a uint32_t but our buffer is a char*
-    createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
-
-    VkShaderModule shaderModule;
-    if (vkCreateShaderModule(device, &createInfo, nullptr, &shaderModule) != VK_SUCCESS)
-      throw std::runtime_error("failed to create shader module!");
+    VkDescriptorSetLayoutBinding sceneBinding = {};
+    sceneBinding.binding = 0;
+    sceneBinding.descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+    sceneBinding.descriptorCount = 1;
+    sceneBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    postSetLayout = descriptorLayouts.get(&sceneBinding, 1);
 
-    return shaderModule;
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &postSetLayout;
+
+    if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &postPipelineLayout) != VK_SUCCESS)
+      throw std::runtime_error("failed to create post pipeline layout");
+
+    postDesc.name = "post";
+    postDesc.vertexShaderPath = shaderPath("post.vert", "postvert.spv");
+    postDesc.fragmentShaderPath = shaderPath("post.frag", "postfrag.spv");
+    postDesc.layout = postPipelineLayout;
+    postDesc.renderPass = renderGraph.renderPass(postPass);
+    postDesc.subpass = renderGraph.subpass(postPass);
+    postDesc.cullMode = VK_CULL_MODE_NONE;
+    postPipelineFuture = pipelineBuilder->build(postDesc);
   }
 
-  static std::vector<char> readFile(const std::string& filename)
+  // One variant of the scene pipeline: which vertex streams feed it and
+  // where the fragment shader takes the tint from
+  GraphicsPipelineDesc scenePipelineDesc(bool instanced, TintSource tintSource) const
   {
-    // ate: starts reading at end of file for buffer reasons
-    // binary: read the file as a binary file
-    std::ifstream file(filename, std::ios::ate | std::ios::binary);
+    static const char* TINT_NAMES[] = { "no_tint", "uniform_tint", "push_constant_tint" };
+
+    GraphicsPipelineDesc desc;
+    desc.name = std::string(instanced ? "instanced/" : "per_object/") + TINT_NAMES[tintSource];
+    desc.vertexShaderPath = shaderPath("shader.vert", "vert.spv");
+    desc.fragmentShaderPath = shaderPath("shader.frag", "frag.spv");
+    desc.fragmentSpecialization.set(0, tintSource);
+    desc.fragmentSpecialization.set(1, options.texturePath.empty() ? VK_FALSE : VK_TRUE);
+    desc.layout = pipelineLayout;
+    desc.renderPass = renderGraph.renderPass(scenePass);
+    desc.subpass = renderGraph.subpass(scenePass);
+    desc.samples = renderGraph.samples(scenePass);
+    // After a depth prepass the depth is final, only the fragments that
+    // match it are shaded
+    desc.depthTest = true;
+    desc.depthWrite = !options.depthPrepass;
+    desc.depthCompareOp = options.depthPrepass ? VK_COMPARE_OP_EQUAL : VK_COMPARE_OP_LESS;
+    desc.vertexBindings.push_back(Vertex::bindingDescription());
+    auto attributes = Vertex::attributeDescriptions();
+    desc.vertexAttributes.assign(attributes.begin(), attributes.end());
+    if (instanced)
+    {
+      // Per instance data comes from two separate streams instead
+      desc.vertexShaderPath = shaderPath("instanced.vert", "instanced.spv");
+      auto instanceBindings = InstanceStreams::bindingDescriptions();
+      auto instanceAttributes = InstanceStreams::attributeDescriptions();
+      desc.vertexBindings.insert(desc.vertexBindings.end(), instanceBindings.begin(), instanceBindings.end());
+      desc.vertexAttributes.insert(desc.vertexAttributes.end(), instanceAttributes.begin(), instanceAttributes.end());
+    }
+    else
+    {
+      desc.vertexBindings.push_back(ObjectData::bindingDescription());
+      desc.vertexAttributes.push_back(ObjectData::attributeDescription());
+    }
+    return desc;
+  }
 
-    if (!file.is_open())
-      throw std::runtime_error("failed to open file!");
+  // The scene pipeline without a fragment shader, so it only writes depth.
+  // Same vertex shader and inputs, and the depth is the object's own passed
+  // straight through, so the scene's EQUAL test matches what this wrote.
+  GraphicsPipelineDesc prepassPipelineDesc(const GraphicsPipelineDesc& scene) const
+  {
+    GraphicsPipelineDesc desc = scene;
+    desc.name = "depth_prepass/" + scene.name;
+    desc.fragmentShaderPath.clear();
+    desc.fragmentSpecialization = ShaderSpecialization();
+    desc.renderPass = renderGraph.renderPass(prepassPass);
+    desc.subpass = renderGraph.subpass(prepassPass);
+    desc.samples = renderGraph.samples(prepassPass);
+    desc.colorAttachmentCount = 0;
+    desc.depthTest = true;
+    desc.depthWrite = true;
+    desc.depthCompareOp = VK_COMPARE_OP_LESS;
+    return desc;
+  }
 
-    size_t fileSize = (size_t)file.tellg(); // use read position to determine size of file for buffer
-    std::vector<char> buffer(fileSize);
-    file.seekg(0); // start at beginning
-    file.read(buffer.data(), fileSize);
-    file.close();
+  void waitForPipelines()
+  {
+    graphicsPipeline = graphicsPipelineFuture.get();
+    if (prepassPipelineFuture.valid())
+      prepassPipeline = prepassPipelineFuture.get();
+    if (postPipelineFuture.valid())
+      postPipeline = postPipelineFuture.get();
+    for (auto& variant : variantFutures)
+      vkDestroyPipeline(device, variant.get(), nullptr);
+    variantFutures.clear();
+    pipelineCreationMs = millisecondsSince(pipelineBuildStart);
+
+    if (options.pipelineVariants)
+      writePipelineVariantReport(std::cout);
+  }
 
-    return buffer;
+  // Driver compile time of every pipeline built at startup. The shared
+  // pipeline cache makes warm runs much faster, compare both.
+  void writePipelineVariantReport(std::ostream& out) const
+  {
+    auto records = pipelineBuilder->buildRecords();
+    double totalMs = 0.0;
+    out << "pipeline_variant,compile_ms\n";
+    for (const auto& record : records)
+    {
+      out << record.name << ',' << record.milliseconds << '\n';
+      totalMs += record.milliseconds;
+    }
+    out << "variants," << records.size() << "\ntotal_compile_ms," << totalMs
+      << "\npipeline_cache," << (pipelineCache.isWarm() ? "warm" : "cold") << std::endl;
   }
 
   void createLogicalDevice()
   {
     QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
 
-    // This structure describes the number of queues we want for a single queue 
-    // family
-    std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-    std::set<int> uniqueQueueFamilies = { indices.graphicsFamily, indices.presentFamily };
+    uint32_t queueFamilyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+
+    // Which families and how many queues of each we want, compute and
+    // transfer on queues of their own where the device has them. Vulkan
+    // lets you assign priorities using a floating point number which will
+    // influence the schedule of buffer execution.
+    deviceQueues.plan(queueFamilies, indices.graphicsFamily, indices.presentFamily);
+    const std::vector<VkDeviceQueueCreateInfo>& queueCreateInfos = deviceQueues.queueCreateInfos();
+
+    // Only what the indirect draws of --gpu-culling want and the texture
+    // compression families, and only if the device has them
+    VkPhysicalDeviceFeatures supportedFeatures;
+    vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
 
-    // Vulkan lets you assign priorities using a floating point number which
-    // will influence the schedule of buffer execution (This is required even
-    // for a small queue)
-    float queuePriority = 1.0f;
-    for (int queueFamily : uniqueQueueFamilies)
+    VkPhysicalDeviceFeatures deviceFeatures = {};
+    deviceFeatures.textureCompressionBC = supportedFeatures.textureCompressionBC;
+    deviceFeatures.textureCompressionETC2 = supportedFeatures.textureCompressionETC2;
+    deviceFeatures.textureCompressionASTC_LDR = supportedFeatures.textureCompressionASTC_LDR;
+    // Only asked for by --overdraw, missing support just turns it off
+    if (options.overdraw)
+      deviceFeatures.pipelineStatisticsQuery = supportedFeatures.pipelineStatisticsQuery;
+    if (options.gpuCulling)
     {
-      VkDeviceQueueCreateInfo queueCreateInfo = {};
-      queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-      queueCreateInfo.queueFamilyIndex = queueFamily;
-      queueCreateInfo.queueCount = 1;
-      queueCreateInfo.pQueuePriorities = &queuePriority;
-      queueCreateInfos.push_back(queueCreateInfo);
+      // Without it every indirect draw would read object 0
+      if (!supportedFeatures.drawIndirectFirstInstance)
+        throw std::runtime_error("--gpu-culling needs the drawIndirectFirstInstance feature!");
+      deviceFeatures.drawIndirectFirstInstance = VK_TRUE;
+      deviceFeatures.multiDrawIndirect = supportedFeatures.multiDrawIndirect;
     }
+    enabledFeatures = deviceFeatures;
 
-    VkPhysicalDeviceFeatures deviceFeatures = {};
     VkDeviceCreateInfo createInfo = {};
     createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
 
@@ -910,8 +2552,44 @@ private:
 
     createInfo.pEnabledFeatures = &deviceFeatures;
 
-    createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-    createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+    std::vector<const char*> extensions = getRequiredDeviceExtensions();
+#ifdef VK_KHR_draw_indirect_count
+    // Lets the GPU read the number of draws the culling pass produced
+    bool drawIndirectCount = options.gpuCulling && deviceFeatures.multiDrawIndirect &&
+      deviceSupportsExtension(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+    if (drawIndirectCount)
+      extensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+#endif
+
+#ifdef VK_VERSION_1_2
+    // Timeline semaphores are core in Vulkan 1.2, older devices may have the
+    // extension. Either way the feature has to be turned on.
+    VkPhysicalDeviceProperties deviceProperties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+    bool coreTimelines = instanceApiVersion >= VK_API_VERSION_1_2 && deviceProperties.apiVersion >= VK_API_VERSION_1_2;
+    bool timelineExtension = !coreTimelines && deviceSupportsExtension(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+
+    VkPhysicalDeviceTimelineSemaphoreFeatures timelineFeatures = {};
+    timelineFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+    PFN_vkGetPhysicalDeviceFeatures2 getFeatures2 = getFeatures2Function();
+    if ((coreTimelines || timelineExtension) && getFeatures2)
+    {
+      VkPhysicalDeviceFeatures2 features2 = {};
+      features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+      features2.pNext = &timelineFeatures;
+      getFeatures2(physicalDevice, &features2);
+      timelineFeatures.pNext = nullptr;
+    }
+    bool timelines = timelineFeatures.timelineSemaphore == VK_TRUE;
+    if (timelines)
+    {
+      createInfo.pNext = &timelineFeatures;
+      if (timelineExtension)
+        extensions.push_back(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+    }
+#endif
+    createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+    createInfo.ppEnabledExtensionNames = extensions.data();
 
     if (enableValidationLayers)
     {
@@ -926,10 +2604,58 @@ private:
     if (vkCreateDevice(physicalDevice, &createInfo, nullptr, &device) != VK_SUCCESS)
       throw std::runtime_error("failed to create logical device!");
 
-    // Retrieve queue handles for each queue family, since we are only creating
-    // a single queue from this family we simply use index 0
-    vkGetDeviceQueue(device, indices.graphicsFamily, 0, &graphicsQueue);
-    vkGetDeviceQueue(device, indices.presentFamily, 0, &presentQueue);
+    // The extension's commands are the core ones with a KHR suffix
+    TimelineFunctions timelineFunctions;
+#ifdef VK_VERSION_1_2
+    if (timelines)
+    {
+      timelineFunctions.getCounterValue = (PFN_vkGetSemaphoreCounterValue)vkGetDeviceProcAddr(device,
+        coreTimelines ? "vkGetSemaphoreCounterValue" : "vkGetSemaphoreCounterValueKHR");
+      timelineFunctions.waitSemaphores = (PFN_vkWaitSemaphores)vkGetDeviceProcAddr(device,
+        coreTimelines ? "vkWaitSemaphores" : "vkWaitSemaphoresKHR");
+    }
+#endif
+
+    // Retrieve the queue handles of every role
+    deviceQueues.create(device, static_cast<uint32_t>(options.framesInFlight), timelineFunctions);
+    if (options.deviceReport)
+      deviceQueues.writeReport(std::cout);
+
+#ifdef VK_KHR_draw_indirect_count
+    // Extension commands aren't exported by the loader
+    if (drawIndirectCount)
+      drawIndexedIndirectCount = (PFN_vkCmdDrawIndexedIndirectCountKHR)vkGetDeviceProcAddr(device,
+        "vkCmdDrawIndexedIndirectCountKHR");
+#endif
+  }
+
+#ifdef VK_VERSION_1_2
+  // vkGetPhysicalDeviceFeatures2 of Vulkan 1.1 or of
+  // VK_KHR_get_physical_device_properties2, null without either
+  PFN_vkGetPhysicalDeviceFeatures2 getFeatures2Function()
+  {
+    if (instanceApiVersion >= VK_API_VERSION_1_1)
+      return (PFN_vkGetPhysicalDeviceFeatures2)vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceFeatures2");
+    if (features2Queries)
+      return (PFN_vkGetPhysicalDeviceFeatures2)vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceFeatures2KHR");
+    return nullptr;
+  }
+#endif
+
+  bool deviceSupportsExtension(const char* name)
+  {
+    uint32_t extensionCount;
+    vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, nullptr);
+
+    std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+    vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, availableExtensions.data());
+
+    for (const auto& extension : availableExtensions)
+    {
+      if (strcmp(extension.extensionName, name) == 0)
+        return true;
+    }
+    return false;
   }
 
   void DestroyDebugReportCallbackEXT(VkInstance instance,
@@ -941,87 +2667,472 @@ private:
       func(instance, callback, pAllocator);
   }
 
+  bool keepRendering(int framesRendered, std::chrono::steady_clock::time_point start)
+  {
+    if (!options.headless && glfwWindowShouldClose(window))
+      return false;
+    if (options.frameCount > 0 && framesRendered >= options.frameCount)
+      return false;
+    if (options.seconds > 0.0 && millisecondsSince(start) >= options.seconds * 1000.0)
+      return false;
+    return true;
+  }
+
+  // Frames the benchmark reserves room for. A --seconds run can only be
+  // estimated, at a frame rate generous enough that it rarely grows midrun
+  size_t expectedBenchmarkFrames() const
+  {
+    const double estimatedFps = 1000.0;
+
+    if (!options.benchmark)
+      return 0;
+    size_t frames = static_cast<size_t>(options.seconds * estimatedFps);
+    if (options.frameCount > 0 && (frames == 0 || static_cast<size_t>(options.frameCount) < frames))
+      frames = options.frameCount;
+    return frames;
+  }
+
   // Run while checking for events like pressing xuntil the window itself has
   // been closed
   void mainLoop()
   {
-    while (!glfwWindowShouldClose(window))
+    auto start = std::chrono::steady_clock::now();
+    auto lastReport = start;
+    int framesSinceReport = 0;
+    int framesRendered = 0;
+
+    FrameBenchmark benchmark(expectedBenchmarkFrames());
+    benchmark.recordEvent("startup", startupMs);
+    benchmark.recordEvent(pipelineCache.isWarm() ? "pipeline_creation_warm" : "pipeline_creation_cold", pipelineCreationMs);
+    if (!drawOrder.empty())
+      benchmark.recordEvent("draw_sort", drawSortMs);
+
+    while (keepRendering(framesRendered, start))
     {
-      glfwPollEvents();
-      drawFrame();
+      auto frameStart = std::chrono::steady_clock::now();
+
+      if (!options.headless)
+        glfwPollEvents();
+      if (options.hotReload)
+        reloadChangedShaders();
+      if (!drawFrame())
+        continue;
+      ++framesRendered;
+
+      if (options.benchmark)
+      {
+        frameTiming.total = millisecondsSince(frameStart);
+        benchmark.record(frameTiming);
+      }
+
+      if (options.headless)
+        continue;
+
+      // Frames per second in the title bar, so runs with a different
+      // --frames-in-flight can be compared side by side
+      ++framesSinceReport;
+      auto now = std::chrono::steady_clock::now();
+      std::chrono::duration<double> elapsed = now - lastReport;
+      if (elapsed.count() >= 1.0)
+      {
+        std::ostringstream title;
+        title << "Vulkan - " << options.framesInFlight << " frame(s) in flight - "
+          << static_cast<int>(framesSinceReport / elapsed.count()) << " fps";
+        glfwSetWindowTitle(window, title.str().c_str());
+
+        lastReport = now;
+        framesSinceReport = 0;
+      }
     }
 
     vkDeviceWaitIdle(device);
+    double elapsedSeconds = millisecondsSince(start) / 1000.0;
+
+    if (options.headless && !options.outputPath.empty())
+      saveOffscreenImage(lastImageIndex, options.outputPath);
+
+    if (options.benchmark)
+      writeBenchmarkReport(benchmark, elapsedSeconds);
+
+    // Pick up the frames that were still in flight when the loop ended
+    if (gpuProfiler.isEnabled() || overdrawCounter.isEnabled())
+      collectPendingGpuTimings();
+    if (gpuProfiler.isEnabled())
+      gpuProfiler.writeReport(std::cout);
+    if (overdrawCounter.isEnabled())
+      overdrawCounter.writeReport(std::cout, static_cast<uint64_t>(swapChainExtent.width) * swapChainExtent.height);
+
+    if (options.memoryStats)
+      gpuAllocator.writeReport(std::cout);
+
+    if (options.shaderStats)
+      shaderCompiler.writeReport(std::cout);
+
+    if (options.assetStats)
+      assets.writeReport(std::cout);
+
+    if (options.textureStats)
+      textureStreamer.writeReport(std::cout);
+  }
+
+  /*
+    Packs every shader in the shader directory, sources and prebuilt SPIR-V
+    alike, and the built in triangle as meshes/triangle.mesh. Names are the
+    paths the app opens them by, so mounting the pack with --asset-pack
+    replaces the loose files.
+  */
+  void writeAssetPack(const std::string& path)
+  {
+    static const char* SHADER_FILES[] =
+    {
+      "shader.vert", "shader.frag", "instanced.vert", "cull.comp", "post.vert", "post.frag",
+      "vert.spv", "frag.spv", "instanced.spv", "cull.spv", "postvert.spv", "postfrag.spv"
+    };
+
+    std::vector<std::pair<std::string, Asset>> entries;
+    for (const char* file : SHADER_FILES)
+    {
+      std::string name = options.shaderDirectory + '/' + file;
+      Asset asset = assets.tryOpen(name);
+      if (!asset.empty())
+        entries.push_back(std::make_pair(name, asset));
+    }
+    entries.push_back(std::make_pair(std::string("meshes/triangle.mesh"), makeMeshAsset(makeTriangleMesh())));
+
+    AssetPack::write(path, entries);
+    std::cout << "wrote " << entries.size() << " assets to " << path << std::endl;
+  }
+
+  // Reads the timestamps and fragment counts of every submitted slot, the
+  // device must be idle
+  void collectPendingGpuTimings()
+  {
+    if (recordsEveryFrame())
+    {
+      for (size_t i = 0; i < frameCommands.size(); ++i)
+        collectQueries(static_cast<uint32_t>(i));
+    }
+    else
+    {
+      for (size_t i = 0; i < imageSubmissions.size(); ++i)
+        if (imageSubmissions[i] != 0)
+          collectQueries(static_cast<uint32_t>(i));
+    }
+  }
+
+  // The slot's command buffer has finished executing
+  void collectQueries(uint32_t slot)
+  {
+    gpuProfiler.collect(slot);
+    overdrawCounter.collect(slot);
+  }
+
+  void writeBenchmarkReport(const FrameBenchmark& benchmark, double elapsedSeconds)
+  {
+    std::ofstream file;
+    if (!options.benchmarkOutput.empty())
+    {
+      file.open(options.benchmarkOutput);
+      if (!file.is_open())
+        throw std::runtime_error("failed to open benchmark output file!");
+    }
+    std::ostream& out = file.is_open() ? file : std::cout;
+
+    if (options.benchmarkFormat == "json")
+      benchmark.writeJson(out, elapsedSeconds);
+    else
+      benchmark.writeCsv(out, elapsedSeconds);
   }
 
-  void drawFrame()
+  // Returns false when no frame was rendered because the swap chain had to
+  // be recreated first
+  bool drawFrame()
   {
-    uint32_t imageIndex;
-    vkAcquireNextImageKHR(device, swapChain, std::numeric_limits<uint64_t>::max(),
-      imageAvailableSemaphore, VK_NULL_HANDLE, &imageIndex);
+    // Wait for the GPU to finish the last submission that used this frame's
+    // semaphores. With more than one frame in flight the CPU can record
+    // ahead while the GPU is still busy with earlier frames.
+    auto phaseStart = std::chrono::steady_clock::now();
+    deviceQueues.wait(QueueRole::Graphics, frameSubmissions[currentFrame]);
+    frameTiming.wait = millisecondsSince(phaseStart);
+
+    // Whatever was replaced while earlier frames were in flight
+    deletionQueue.collect();
+
+    // Headless frames each own an offscreen image, so there is nothing to
+    // acquire and no semaphore to wait on
+    phaseStart = std::chrono::steady_clock::now();
+    uint32_t imageIndex = static_cast<uint32_t>(currentFrame);
+    if (!options.headless)
+    {
+      VkResult result = vkAcquireNextImageKHR(device, swapChain, std::numeric_limits<uint64_t>::max(),
+        imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
+
+      // Out of date can't be presented to at all. The frame hasn't begun
+      // yet, nothing was staged or submitted for it, so it can simply be
+      // tried again. Suboptimal still works, it is recreated after this
+      // frame was presented.
+      if (result == VK_ERROR_OUT_OF_DATE_KHR)
+      {
+        recreateSwapChain();
+        return false;
+      }
+      if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR)
+        throw std::runtime_error("failed to acquire swap chain image!");
+    }
+
+    // A previous frame may still be rendering into this image. Once it is
+    // done, the timestamps its command buffer wrote can be read for free.
+    if (imageSubmissions[imageIndex] != 0)
+    {
+      deviceQueues.wait(QueueRole::Graphics, imageSubmissions[imageIndex]);
+      if (!recordsEveryFrame())
+        collectQueries(imageIndex);
+    }
+    frameTiming.acquire = millisecondsSince(phaseStart);
+
+    // Only once the image was acquired: beginning the frame releases its
+    // staging space, which would free this frame's own uploads if the
+    // frame were begun a second time after a failed acquire. The frame's
+    // previous uploads and culling finished before its rendering did.
+    deviceQueues.beginFrame(static_cast<uint32_t>(currentFrame));
+    uploader.beginFrame(static_cast<uint32_t>(currentFrame));
+    // Stages whatever finished decoding, never waits for a decode
+    textureStreamer.beginFrame(static_cast<uint32_t>(currentFrame));
+
+    // Prerecorded command buffers still bind what was resident back then
+    if (!recordsEveryFrame() && textureStreamer.residentCount() != recordedResidentCount)
+      recordCommandBuffersAgain();
+
+    // Per frame command buffers finished along with the frame's submission
+    if (recordsEveryFrame())
+      collectQueries(static_cast<uint32_t>(currentFrame));
+
+    // The slot's command buffer was waited on above, by the frame's
+    // submission when recording every frame and by the image's otherwise
+    phaseStart = std::chrono::steady_clock::now();
+    uint32_t slot = recordsEveryFrame() ? static_cast<uint32_t>(currentFrame) : imageIndex;
+    if (instanceStreams.isEnabled())
+      updateInstanceStreams(slot);
+    updateDrawUniforms(slot);
+    frameTiming.update = millisecondsSince(phaseStart);
+
+    phaseStart = std::chrono::steady_clock::now();
+    if (recordsEveryFrame())
+      recordFrameCommands(currentFrame, imageIndex);
+
+    // Textures that became resident this frame are acquired and get their
+    // mips ahead of the frame's commands, which may already sample them
+    QueueSubmission graphics;
+    VkCommandBuffer textureCommands = textureStreamer.recordTransitions();
+    if (textureCommands != VK_NULL_HANDLE)
+      graphics.execute(textureCommands);
+    graphics.execute(recordsEveryFrame() ? frameCommands[currentFrame].primary : commandBuffers[imageIndex]);
+    frameTiming.record = millisecondsSince(phaseStart);
+
+    if (!options.headless)
+      graphics.wait(imageAvailableSemaphores[currentFrame], VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+
+    // Everything uploaded this frame goes out in one submit. Vertex input is
+    // the first stage that draws read the uploaded buffers at, cull.comp
+    // reads the object buffer before any of them and the texture
+    // transitions pick up the uploaded images with transfer commands.
+    VkSemaphore uploaded = uploader.submit();
+    VkPipelineStageFlags uploadStages = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT |
+      VK_PIPELINE_STAGE_TRANSFER_BIT;
+
+    phaseStart = std::chrono::steady_clock::now();
+    if (options.asyncCompute)
+    {
+      // Culling only waits for the uploads, so it runs while the previous
+      // frame is still rendering. The draws wait for the culling, and
+      // through it for the uploads: the semaphore can only be waited on
+      // once, and the culling started after the uploads were done.
+      QueueSubmission compute;
+      if (uploaded != VK_NULL_HANDLE)
+        compute.wait(uploaded, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+      compute.execute(frameCommands[currentFrame].compute);
+      VkSemaphore culled = deviceQueues.dependency();
+      compute.signal(culled);
+      deviceQueues.submit(QueueRole::Compute, compute);
+
+      graphics.wait(culled, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | uploadStages);
+    }
+    else if (uploaded != VK_NULL_HANDLE)
+      graphics.wait(uploaded, uploadStages);
+
+    // Nobody would wait on the semaphore without a present
+    if (!options.headless)
+      graphics.signal(renderFinishedSemaphores[currentFrame]);
+
+    frameSubmissions[currentFrame] = deviceQueues.submit(QueueRole::Graphics, graphics);
+    imageSubmissions[imageIndex] = frameSubmissions[currentFrame];
+    frameTiming.submit = millisecondsSince(phaseStart);
+
+    lastImageIndex = imageIndex;
+
+    phaseStart = std::chrono::steady_clock::now();
+
+    if (!options.headless)
+    {
+      VkPresentInfoKHR presentInfo = {};
+      presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+      presentInfo.waitSemaphoreCount = 1;
+      presentInfo.pWaitSemaphores = &renderFinishedSemaphores[currentFrame];
+
+      VkSwapchainKHR swapChains[] = { swapChain };
+      presentInfo.swapchainCount = 1;
+      presentInfo.pSwapchains = swapChains;
+      presentInfo.pImageIndices = &imageIndex;
+
+      VkResult result = vkQueuePresentKHR(deviceQueues.queue(QueueRole::Present), &presentInfo);
+      if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || framebufferResized)
+      {
+        framebufferResized = false;
+        recreateSwapChain();
+      }
+      else if (result != VK_SUCCESS)
+        throw std::runtime_error("failed to present swap chain image!");
+    }
+    frameTiming.present = millisecondsSince(phaseStart);
+
+    currentFrame = (currentFrame + 1) % options.framesInFlight;
+    return true;
+  }
 
-    VkSubmitInfo submitInfo = {};
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  /*
+    Rebuilds only what depends on the swap chain images or their size: image
+    views, framebuffers, the render graph's own images and the prerecorded
+    command buffers. Render passes and pipelines stay, the pipelines take
+    viewport and scissor as dynamic state. The surface format doesn't change
+    on a resize so the render passes remain compatible with the new images.
+  */
+  void recreateSwapChain()
+  {
+    // A minimized window has a zero sized framebuffer, which can't be a swap
+    // chain. Sleep until it is visible again.
+    int width = 0, height = 0;
+    glfwGetFramebufferSize(window, &width, &height);
+    while (width == 0 || height == 0)
+    {
+      glfwWaitEvents();
+      glfwGetFramebufferSize(window, &width, &height);
+    }
 
-    VkSemaphore waitSemaphores[] = { imageAvailableSemaphore };
-    VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
-    submitInfo.waitSemaphoreCount = 1;
-    submitInfo.pWaitSemaphores = waitSemaphores;
-    submitInfo.pWaitDstStageMask = waitStages;
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &commandBuffers[imageIndex];
+    // Views and framebuffers may still be used by frames in flight
+    deviceQueues.wait(deviceQueues.submitted());
 
-    VkSemaphore signalSemaphores[] = { renderFinishedSemaphore };
-    submitInfo.signalSemaphoreCount = 1;
-    submitInfo.pSignalSemaphores = signalSemaphores;
+    // Prerecorded buffers get recorded again, grab their timings first
+    if (!recordsEveryFrame())
+      collectPendingGpuTimings();
 
-    if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
-      throw std::runtime_error("failed to submit draw command buffer!");
+    cleanupSwapChainResources();
 
-    VkPresentInfoKHR presentInfo = {};
-    presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
-    presentInfo.waitSemaphoreCount = 1;
-    presentInfo.pWaitSemaphores = signalSemaphores;
+    VkSwapchainKHR oldSwapChain = swapChain;
+    createSwapChain(oldSwapChain);
+    vkDestroySwapchainKHR(device, oldSwapChain, nullptr);
 
-    VkSwapchainKHR swapChains[] = { swapChain };
-    presentInfo.swapchainCount = 1;
-    presentInfo.pSwapchains = swapChains;
-    presentInfo.pImageIndices = &imageIndex;
+    createImageViews();
+    createFrameBuffers();
+    if (!recordsEveryFrame())
+    {
+      gpuProfiler.reserveSlots(static_cast<uint32_t>(swapChainImageViews.size()));
+      overdrawCounter.reserveSlots(static_cast<uint32_t>(swapChainImageViews.size()));
+      instanceStreams.reserveFrames(static_cast<uint32_t>(swapChainImageViews.size()));
+      drawUniforms.reserveFrames(static_cast<uint32_t>(swapChainImageViews.size()));
+      reserveFrameDescriptors(static_cast<uint32_t>(swapChainImageViews.size()));
+      createCommandBuffers();
+    }
 
-    vkQueuePresentKHR(presentQueue, &presentInfo);
+    // The image count can change and no image is in use anymore
+    imageSubmissions.assign(swapChainImages.size(), 0);
+  }
 
-    vkQueueWaitIdle(presentQueue);
+  // Everything tied to the current swap chain images, except the swap chain
+  void cleanupSwapChainResources()
+  {
+    if (!commandBuffers.empty())
+    {
+      vkFreeCommandBuffers(device, commandPool, static_cast<uint32_t>(commandBuffers.size()), commandBuffers.data());
+      commandBuffers.clear();
+    }
+    renderGraph.destroyResources();
+    for (auto imageView : swapChainImageViews)
+      vkDestroyImageView(device, imageView, nullptr);
+    swapChainImageViews.clear();
   }
 
   void cleanup()
   {
-    vkDestroySemaphore(device, renderFinishedSemaphore, nullptr);
-    vkDestroySemaphore(device, imageAvailableSemaphore, nullptr);
+    for (int i = 0; i < options.framesInFlight; ++i)
+    {
+      vkDestroySemaphore(device, renderFinishedSemaphores[i], nullptr);
+      vkDestroySemaphore(device, imageAvailableSemaphores[i], nullptr);
+    }
+    gpuProfiler.destroy();
+    overdrawCounter.destroy();
+    recordWorkers.reset();
+    for (auto& frame : frameCommands)
+    {
+      vkDestroyCommandPool(device, frame.primaryPool, nullptr);
+      if (frame.computePool != VK_NULL_HANDLE)
+        vkDestroyCommandPool(device, frame.computePool, nullptr);
+      for (auto pool : frame.workerPools)
+        vkDestroyCommandPool(device, pool, nullptr);
+    }
+    cleanupSwapChainResources();
     vkDestroyCommandPool(device, commandPool, nullptr);
-    for (auto framebuffer : swapChainFramebuffers)
-      vkDestroyFramebuffer(device, framebuffer, nullptr);
+    gpuCuller.destroy();
+    instanceStreams.destroy();
+    for (auto& descriptors : frameDescriptors)
+      descriptors.destroy();
+    drawUniforms.destroy();
+    gpuAllocator.destroyBuffer(objectBuffer, objectMemory);
+    destroyMesh(gpuAllocator, sceneMesh);
+    textureStreamer.destroy();
+    uploader.destroy();
     vkDestroyPipeline(device, graphicsPipeline, nullptr);
+    if (prepassPipeline != VK_NULL_HANDLE)
+      vkDestroyPipeline(device, prepassPipeline, nullptr);
+    if (postPipeline != VK_NULL_HANDLE)
+      vkDestroyPipeline(device, postPipeline, nullptr);
+    pipelineBuilder.reset();
+    shaderCompiler.destroy();
+    pipelineCache.save();
+    pipelineCache.destroy();
     vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
-    vkDestroyRenderPass(device, renderPass, nullptr);
-    for (auto imageView : swapChainImageViews)
-      vkDestroyImageView(device, imageView, nullptr);
-    vkDestroySwapchainKHR(device, swapChain, nullptr);
+    if (postPipelineLayout != VK_NULL_HANDLE)
+      vkDestroyPipelineLayout(device, postPipelineLayout, nullptr);
+    descriptorLayouts.destroy();
+    renderGraph.destroy();
+    if (options.headless)
+    {
+      for (size_t i = 0; i < swapChainImages.size(); ++i)
+        gpuAllocator.destroyImage(swapChainImages[i], offscreenImageMemory[i]);
+    }
+    else
+      vkDestroySwapchainKHR(device, swapChain, nullptr);
+    deletionQueue.destroy();
+    gpuAllocator.destroy();
+    deviceQueues.destroy();
     vkDestroyDevice(device, nullptr);
     DestroyDebugReportCallbackEXT(instance, callback, nullptr);
-    vkDestroySurfaceKHR(instance, surface, nullptr);
+    if (!options.headless)
+      vkDestroySurfaceKHR(instance, surface, nullptr);
     // Instance should be destroyed right before program exits.
     vkDestroyInstance(instance, nullptr);
-    glfwDestroyWindow(window);
-    glfwTerminate();
+    if (!options.headless)
+    {
+      glfwDestroyWindow(window);
+      glfwTerminate();
+    }
   }
 };
 
-int main()
+int main(int argc, char* argv[])
 {
-  HelloTriangleApplication app;
-
   try
   {
+    HelloTriangleApplication app(parseCommandLine(argc, argv));
     app.run();
   }
   catch (const std::runtime_error& e)
@@ -1030,8 +3141,5 @@ int main()
     return EXIT_FAILURE;
   }
 
-  int n;
-  std::cin >> n;
-
   return EXIT_SUCCESS;
 }
\ No newline at end of file
@@ -0,0 +1,15 @@
+@echo off
+rem Headless benchmark of the scene at 1, 2, 4 and 8 samples per pixel, with
+rem and without the post pass. Frame times go to msaa_*.csv, GPU pass times
+rem and the render graph with its attachment traffic to msaa_*.txt. Counts
+rem the device doesn't support run at the highest one it does, the .txt
+rem says so. Run from this directory so the shaders are found, pass the
+rem executable if it isn't the x64 Release build.
+set EXE=%1
+if "%EXE%"=="" set EXE=..\x64\Release\LearningVulkanEnvironment.exe
+
+for %%s in (1 2 4 8) do (
+  %EXE% --headless --benchmark --gpu-timings --render-graph-dump --frames 300 --objects 10000 --msaa %%s --benchmark-output msaa_%%s.csv > msaa_%%s.txt
+  %EXE% --headless --benchmark --gpu-timings --render-graph-dump --frames 300 --objects 10000 --msaa %%s --post-process --benchmark-output msaa_post_%%s.csv > msaa_post_%%s.txt
+)
+pause
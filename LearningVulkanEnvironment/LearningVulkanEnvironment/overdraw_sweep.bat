@@ -0,0 +1,16 @@
+@echo off
+rem Headless benchmark of a scene of overlapping objects drawn in creation
+rem order, sorted front to back, and after a depth prepass, at growing
+rem overlap. Frame times go to overdraw_*.csv, GPU pass times and the
+rem fragment shader invocations per pixel of every pass to overdraw_*.txt.
+rem Run from this directory so the shaders are found, pass the executable if
+rem it isn't the x64 Release build.
+set EXE=%1
+if "%EXE%"=="" set EXE=..\x64\Release\LearningVulkanEnvironment.exe
+
+for %%o in (1 4 16) do (
+  %EXE% --headless --benchmark --gpu-timings --overdraw --frames 300 --objects 10000 --overlap %%o --unsorted --benchmark-output overdraw_unsorted_%%o.csv > overdraw_unsorted_%%o.txt
+  %EXE% --headless --benchmark --gpu-timings --overdraw --frames 300 --objects 10000 --overlap %%o --benchmark-output overdraw_sorted_%%o.csv > overdraw_sorted_%%o.txt
+  %EXE% --headless --benchmark --gpu-timings --overdraw --frames 300 --objects 10000 --overlap %%o --depth-prepass --benchmark-output overdraw_prepass_%%o.csv > overdraw_prepass_%%o.txt
+)
+pause
@@ -0,0 +1,26 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+out gl_PerVertex
+{
+	vec4 gl_Position;
+};
+
+layout(location = 0) in vec2 inPosition;
+layout(location = 1) in vec3 inColor;
+// Per instance, each from its own stream: offset in xy, uniform scale in z,
+// depth in w
+layout(location = 2) in vec4 inTransform;
+// Per instance tint, stored as R8G8B8A8_UNORM
+layout(location = 3) in vec4 inInstanceColor;
+
+layout(location = 0) out vec3 fragColor;
+// The mesh spans -0.5 to 0.5, that maps the texture once across it
+layout(location = 1) out vec2 fragTexCoord;
+
+void main() 
+{
+	gl_Position = vec4(inPosition * inTransform.z + inTransform.xy, inTransform.w, 1.0);
+	fragTexCoord = inPosition + 0.5;
+	fragColor = inColor * inInstanceColor.rgb;
+}
@@ -0,0 +1,14 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+// Written by the scene subpass, read at this fragment's pixel only
+layout(input_attachment_index = 0, set = 0, binding = 0) uniform subpassInput sceneColor;
+
+layout(location = 0) out vec4 outColor;
+
+void main()
+{
+	vec3 color = subpassLoad(sceneColor).rgb;
+	// Smoothstep contrast curve, just so the pass visibly does something
+	outColor = vec4(color * color * (3.0 - 2.0 * color), 1.0);
+}
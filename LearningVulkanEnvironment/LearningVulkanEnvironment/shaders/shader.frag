@@ -2,9 +2,39 @@
 #extension GL_ARB_separate_shader_objects : enable
 
 layout(location = 0) in vec3 fragColor;
+layout(location = 1) in vec2 fragTexCoord;
 layout(location = 0) out vec4 outColor;
 
+// Where the per draw tint comes from, fixed when the pipeline is built:
+// 0 no tint, 1 the dynamic uniform buffer, 2 push constants. The branches
+// on it are folded away by the driver, each value is its own variant.
+layout(constant_id = 0) const int TINT_SOURCE = 1;
+// Whether the color is multiplied with the streamed texture
+layout(constant_id = 1) const bool TEXTURED = false;
+
+// Per draw data, selected with a dynamic offset when the set is bound
+layout(set = 0, binding = 0) uniform DrawData
+{
+	vec4 tint;
+} draw;
+
+// Per draw data written straight into the command buffer
+layout(push_constant) uniform DrawConstants
+{
+	vec4 tint;
+} constants;
+
+// Streamed in by TextureStreamer, a placeholder until it is resident
+layout(set = 1, binding = 0) uniform sampler2D albedo;
+
 void main()
 {
-	outColor = vec4(fragColor, 1.0);
-}
\ No newline at end of file
+	vec3 color = fragColor;
+	if (TINT_SOURCE == 1)
+		color *= draw.tint.rgb;
+	else if (TINT_SOURCE == 2)
+		color *= constants.tint.rgb;
+	if (TEXTURED)
+		color *= texture(albedo, fragTexCoord).rgb;
+	outColor = vec4(color, 1.0);
+}
@@ -6,22 +6,18 @@ out gl_PerVertex
 	vec4 gl_Position;
 };
 
-layout(location = 0) out vec3 fragColor;
-
-vec2 positions[3] = vec2[](
-	vec2(0.0, -0.5),
-	vec2(0.5, 0.5),
-	vec2(-0.5, 0.5)
-);
+layout(location = 0) in vec2 inPosition;
+layout(location = 1) in vec3 inColor;
+// Per instance: offset in xy, uniform scale in z, depth in w
+layout(location = 2) in vec4 inTransform;
 
-vec3 colors[3] = vec3[](
-	vec3(1.0, 0.0, 0.0),
-	vec3(0.0, 1.0, 0.0),
-	vec3(0.0, 0.0, 1.0)
-);
+layout(location = 0) out vec3 fragColor;
+// The mesh spans -0.5 to 0.5, that maps the texture once across it
+layout(location = 1) out vec2 fragTexCoord;
 
 void main() 
 {
-	gl_Position = vec4(positions[gl_VertexIndex], 0.0, 1.0);
-	fragColor = colors[gl_VertexIndex];
+	gl_Position = vec4(inPosition * inTransform.z + inTransform.xy, inTransform.w, 1.0);
+	fragTexCoord = inPosition + 0.5;
+	fragColor = inColor;
 }
\ No newline at end of file
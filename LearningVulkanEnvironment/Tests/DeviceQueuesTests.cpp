@@ -0,0 +1,267 @@
+#include "Test.h"
+#include "FakeVulkan.h"
+
+#include "DeviceQueues.h"
+
+namespace
+{
+  const VkQueueFlags GRAPHICS = VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT | VK_QUEUE_TRANSFER_BIT;
+  const VkQueueFlags COMPUTE = VK_QUEUE_COMPUTE_BIT | VK_QUEUE_TRANSFER_BIT;
+  const VkQueueFlags TRANSFER = VK_QUEUE_TRANSFER_BIT;
+
+  VkQueueFamilyProperties family(VkQueueFlags flags, uint32_t queueCount, uint32_t granularity = 1)
+  {
+    VkQueueFamilyProperties properties = {};
+    properties.queueFlags = flags;
+    properties.queueCount = queueCount;
+    properties.minImageTransferGranularity = { granularity, granularity, granularity };
+    return properties;
+  }
+
+  uint32_t queueCount(const DeviceQueues& queues, uint32_t family)
+  {
+    for (const auto& info : queues.queueCreateInfos())
+    {
+      if (info.queueFamilyIndex == family)
+        return info.queueCount;
+    }
+    return 0;
+  }
+
+  // Planned and created with fences standing in for timelines
+  void createQueues(DeviceQueues& queues, const std::vector<VkQueueFamilyProperties>& families,
+    const TimelineFunctions& timeline = TimelineFunctions())
+  {
+    resetFakeDevice();
+    queues.plan(families, 0, 0);
+    queues.create(VK_NULL_HANDLE, 2, timeline);
+  }
+
+  QueueSubmission signaling(VkSemaphore semaphore)
+  {
+    QueueSubmission submission;
+    submission.signal(semaphore);
+    return submission;
+  }
+}
+
+TEST(planSharesTheOnlyQueue)
+{
+  DeviceQueues queues;
+  queues.plan({ family(GRAPHICS, 1) }, 0, 0);
+
+  CHECK(queues.queueCreateInfos().size() == 1);
+  CHECK(queueCount(queues, 0) == 1);
+  for (QueueRole role : { QueueRole::Compute, QueueRole::Transfer, QueueRole::Present })
+  {
+    CHECK(queues.family(role) == 0);
+    CHECK(!queues.isDedicated(role));
+    CHECK(!queues.isSeparateFamily(role));
+  }
+  // The graphics queue keeps the priority it was created with
+  CHECK(queues.priority(QueueRole::Transfer) == 1.0f);
+}
+
+TEST(planUsesSpareQueuesOfTheGraphicsFamily)
+{
+  DeviceQueues queues;
+  queues.plan({ family(GRAPHICS, 4) }, 0, 0);
+
+  // Present stays on the graphics queue, the others get one each
+  CHECK(queueCount(queues, 0) == 3);
+  CHECK(!queues.isDedicated(QueueRole::Present));
+  CHECK(queues.isDedicated(QueueRole::Compute));
+  CHECK(queues.isDedicated(QueueRole::Transfer));
+  CHECK(!queues.isSeparateFamily(QueueRole::Compute));
+  CHECK(queues.priority(QueueRole::Graphics) > queues.priority(QueueRole::Compute));
+  CHECK(queues.priority(QueueRole::Compute) > queues.priority(QueueRole::Transfer));
+}
+
+TEST(planPrefersDedicatedFamilies)
+{
+  DeviceQueues queues;
+  queues.plan({ family(GRAPHICS, 1), family(COMPUTE, 2), family(TRANSFER, 2, 8) }, 0, 0);
+
+  CHECK(queues.family(QueueRole::Graphics) == 0);
+  CHECK(queues.family(QueueRole::Compute) == 1);
+  CHECK(queues.family(QueueRole::Transfer) == 2);
+  CHECK(queues.isSeparateFamily(QueueRole::Compute));
+  CHECK(queues.isSeparateFamily(QueueRole::Transfer));
+  CHECK(queues.queueCreateInfos().size() == 3);
+  CHECK(queues.imageTransferGranularity(QueueRole::Transfer).height == 8);
+  CHECK(queues.imageTransferGranularity(QueueRole::Graphics).height == 1);
+}
+
+TEST(planPutsTransfersOnTheComputeFamilyWithoutDmaQueues)
+{
+  DeviceQueues queues;
+  // The empty transfer family doesn't count
+  queues.plan({ family(GRAPHICS, 1), family(COMPUTE, 2), family(TRANSFER, 0) }, 0, 0);
+
+  CHECK(queues.family(QueueRole::Transfer) == 1);
+  CHECK(queueCount(queues, 1) == 2);
+  CHECK(queueCount(queues, 2) == 0);
+  CHECK(queues.isDedicated(QueueRole::Transfer));
+}
+
+TEST(planGivesASeparatePresentFamilyItsOwnQueue)
+{
+  DeviceQueues queues;
+  queues.plan({ family(GRAPHICS, 1), family(TRANSFER, 1) }, 0, 1);
+
+  CHECK(queues.family(QueueRole::Present) == 1);
+  CHECK(queues.isDedicated(QueueRole::Present));
+  // Transfer shares the present queue, which was claimed first
+  CHECK(queues.family(QueueRole::Transfer) == 1);
+  CHECK(queueCount(queues, 1) == 1);
+}
+
+TEST(rolesOnOneQueueShareItsTimeline)
+{
+  DeviceQueues queues;
+  createQueues(queues, { family(GRAPHICS, 1) });
+
+  CHECK(queues.queue(QueueRole::Compute) == fakeQueue(0, 0));
+  CHECK(queues.submit(QueueRole::Graphics, QueueSubmission()) == 1);
+  CHECK(queues.submit(QueueRole::Compute, QueueSubmission()) == 2);
+  CHECK(queues.submit(QueueRole::Transfer, QueueSubmission()) == 3);
+
+  // Finishing the queue's last value finishes every role's
+  CHECK(!queues.hasFinished(QueueRole::Graphics, 1));
+  queues.wait(QueueRole::Transfer, 3);
+  CHECK(queues.hasFinished(QueueRole::Graphics, 1));
+  CHECK(queues.hasFinished(QueueRole::Compute, 2));
+  queues.destroy();
+}
+
+TEST(fencesStandInForTimelines)
+{
+  DeviceQueues queues;
+  createQueues(queues, { family(GRAPHICS, 1), family(COMPUTE, 1) });
+  CHECK(!queues.usesTimelineSemaphores());
+
+  VkQueue graphics = fakeQueue(0, 0);
+  CHECK(queues.submit(QueueRole::Graphics, QueueSubmission()) == 1);
+  CHECK(queues.submit(QueueRole::Graphics, QueueSubmission()) == 2);
+  // Each value is an empty submit with a fence right after the work
+  CHECK(fakeDevice().submits.size() == 4);
+  CHECK(fakeDevice().submits[1].commandBufferCount == 0);
+  CHECK(fakeDevice().submits[1].fence != VK_NULL_HANDLE);
+
+  CHECK(queues.hasFinished(QueueRole::Graphics, 0));
+  CHECK(!queues.hasFinished(QueueRole::Graphics, 1));
+  finishFakeSubmits(graphics, 2);
+  CHECK(queues.hasFinished(QueueRole::Graphics, 1));
+  CHECK(!queues.hasFinished(QueueRole::Graphics, 2));
+
+  // Waiting on a value waits on its own fence, not the queue
+  CHECK(queues.submit(QueueRole::Graphics, QueueSubmission()) == 3);
+  queues.wait(QueueRole::Graphics, 2);
+  CHECK(queues.hasFinished(QueueRole::Graphics, 2));
+  CHECK(!queues.hasFinished(QueueRole::Graphics, 3));
+
+  // Finished fences are recycled, the steady state creates none
+  queues.wait(QueueRole::Graphics, 3);
+  uint32_t fencesCreated = fakeDevice().fencesCreated;
+  for (int i = 0; i < 4; ++i)
+  {
+    uint64_t value = queues.submit(QueueRole::Graphics, QueueSubmission());
+    queues.wait(QueueRole::Graphics, value);
+  }
+  CHECK(fakeDevice().fencesCreated == fencesCreated);
+
+  queues.destroy();
+  CHECK(fakeDevice().fences.empty());
+  CHECK(fakeDevice().semaphores.empty());
+}
+
+TEST(submitPointsCoverEveryQueue)
+{
+  DeviceQueues queues;
+  createQueues(queues, { family(GRAPHICS, 1), family(COMPUTE, 1) });
+
+  queues.submit(QueueRole::Graphics, QueueSubmission());
+  queues.submit(QueueRole::Compute, QueueSubmission());
+  queues.submit(QueueRole::Compute, QueueSubmission());
+  SubmitPoint point = queues.submitted();
+
+  // Later work doesn't hold the point up
+  queues.submit(QueueRole::Graphics, QueueSubmission());
+  finishFakeSubmits(fakeQueue(0, 0), 2);
+  CHECK(!queues.hasFinished(point));
+  finishFakeSubmits(fakeQueue(1, 0), 4);
+  CHECK(queues.hasFinished(point));
+  CHECK(!queues.hasFinished(queues.submitted()));
+
+  queues.wait(queues.submitted());
+  CHECK(queues.hasFinished(QueueRole::Graphics, 2));
+  queues.destroy();
+}
+
+TEST(dependenciesAreRecycledWithTheFrame)
+{
+  DeviceQueues queues;
+  createQueues(queues, { family(GRAPHICS, 1), family(COMPUTE, 1) });
+
+  // The compute queue signals, graphics waits
+  queues.beginFrame(0);
+  VkSemaphore culled = queues.dependency();
+  queues.submit(QueueRole::Compute, signaling(culled));
+  QueueSubmission draws;
+  draws.wait(culled, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT);
+  queues.submit(QueueRole::Graphics, draws);
+
+  const std::vector<FakeSubmit>& submits = fakeDevice().submits;
+  CHECK(submits[0].queue == fakeQueue(1, 0));
+  CHECK(submits[0].signalSemaphores.size() == 1 && submits[0].signalSemaphores[0] == culled);
+  CHECK(submits[2].queue == fakeQueue(0, 0));
+  CHECK(submits[2].waitSemaphores.size() == 1 && submits[2].waitSemaphores[0] == culled);
+
+  // Frames have semaphores of their own, and get the same ones back
+  queues.beginFrame(1);
+  CHECK(queues.dependency() != culled);
+  queues.beginFrame(0);
+  CHECK(queues.dependency() == culled);
+
+  // A frame only has so many
+  CHECK_THROWS(for (int i = 0; i < 100; ++i) queues.dependency());
+  queues.destroy();
+}
+
+#ifdef VK_VERSION_1_2
+TEST(timelineSemaphoresReplaceFences)
+{
+  TimelineFunctions timeline;
+  timeline.getCounterValue = fakeGetSemaphoreCounterValue;
+  timeline.waitSemaphores = fakeWaitSemaphores;
+
+  DeviceQueues queues;
+  createQueues(queues, { family(GRAPHICS, 1), family(COMPUTE, 1) }, timeline);
+  CHECK(queues.usesTimelineSemaphores());
+
+  VkSemaphore other;
+  vkCreateSemaphore(VK_NULL_HANDLE, nullptr, nullptr, &other);
+  CHECK(queues.submit(QueueRole::Compute, signaling(other)) == 1);
+  CHECK(queues.submit(QueueRole::Compute, QueueSubmission()) == 2);
+
+  // The queue's semaphore signals the value next to the submission's own
+  const std::vector<FakeSubmit>& submits = fakeDevice().submits;
+  CHECK(submits.size() == 2);
+  CHECK(submits[0].signalSemaphores.size() == 2 && submits[0].signalSemaphores[0] == other);
+  CHECK(submits[0].signalValues.size() == 2 && submits[0].signalValues[1] == 1);
+  CHECK(submits[1].signalValues.size() == 1 && submits[1].signalValues[0] == 2);
+  CHECK(fakeDevice().fencesCreated == 0);
+
+  CHECK(!queues.hasFinished(QueueRole::Compute, 1));
+  finishFakeSubmits(fakeQueue(1, 0), 1);
+  CHECK(queues.hasFinished(QueueRole::Compute, 1));
+  queues.wait(QueueRole::Compute, 2);
+  CHECK(queues.hasFinished(QueueRole::Compute, 2));
+  // Graphics has a timeline of its own
+  CHECK(!queues.hasFinished(QueueRole::Graphics, 1));
+
+  vkDestroySemaphore(VK_NULL_HANDLE, other, nullptr);
+  queues.destroy();
+  CHECK(fakeDevice().semaphores.empty());
+}
+#endif
@@ -0,0 +1,303 @@
+#include "FakeVulkan.h"
+
+#include <algorithm>
+
+FakeDevice& fakeDevice()
+{
+  static FakeDevice device;
+  return device;
+}
+
+void resetFakeDevice()
+{
+  FakeDevice& device = fakeDevice();
+  device = FakeDevice();
+  device.properties.apiVersion = VK_API_VERSION_1_0;
+  device.properties.limits.bufferImageGranularity = 1;
+  device.properties.limits.nonCoherentAtomSize = 1;
+  device.requirements.alignment = 256;
+  device.requirements.memoryTypeBits = ~0u;
+  addFakeMemoryType(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 1024ull * 1024 * 1024);
+}
+
+uint32_t addFakeMemoryType(VkMemoryPropertyFlags flags, VkDeviceSize heapSize)
+{
+  VkPhysicalDeviceMemoryProperties& memory = fakeDevice().memoryProperties;
+  uint32_t heap = memory.memoryHeapCount++;
+  memory.memoryHeaps[heap].size = heapSize;
+  uint32_t type = memory.memoryTypeCount++;
+  memory.memoryTypes[type].propertyFlags = flags;
+  memory.memoryTypes[type].heapIndex = heap;
+  return type;
+}
+
+VkQueue fakeQueue(uint32_t family, uint32_t queueIndex)
+{
+  // Far away from the other handles
+  return (VkQueue)(uintptr_t)(0x10000 + family * 0x100 + queueIndex);
+}
+
+void finishFakeSubmits(VkQueue queue, size_t count)
+{
+  FakeDevice& device = fakeDevice();
+  for (auto& submit : device.submits)
+  {
+    if (count == 0)
+      break;
+    if (submit.queue != queue || submit.finished)
+      continue;
+
+    submit.finished = true;
+    --count;
+    if (submit.fence != VK_NULL_HANDLE)
+      device.signaledFences.insert(fakeHandleId(submit.fence));
+    for (size_t i = 0; i < submit.signalValues.size(); ++i)
+      device.timelineValues[fakeHandleId(submit.signalSemaphores[i])] = submit.signalValues[i];
+  }
+}
+
+namespace
+{
+  template<typename Handle>
+  Handle newHandle()
+  {
+    return (Handle)(uintptr_t)fakeDevice().nextHandle++;
+  }
+
+  // The submit signaling the fence, or null
+  const FakeSubmit* submitOf(VkFence fence)
+  {
+    for (const auto& submit : fakeDevice().submits)
+    {
+      if (submit.fence == fence && !submit.finished)
+        return &submit;
+    }
+    return nullptr;
+  }
+}
+
+#ifdef VK_VERSION_1_2
+VKAPI_ATTR VkResult VKAPI_CALL fakeGetSemaphoreCounterValue(VkDevice, VkSemaphore semaphore, uint64_t* pValue)
+{
+  *pValue = fakeDevice().timelineValues[fakeHandleId(semaphore)];
+  return VK_SUCCESS;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL fakeWaitSemaphores(VkDevice device, const VkSemaphoreWaitInfo* pWaitInfo, uint64_t)
+{
+  // Finishes submits one by one until every value is reached
+  for (uint32_t i = 0; i < pWaitInfo->semaphoreCount; ++i)
+  {
+    uint64_t value = 0;
+    fakeGetSemaphoreCounterValue(device, pWaitInfo->pSemaphores[i], &value);
+    for (const auto& submit : fakeDevice().submits)
+    {
+      if (value >= pWaitInfo->pValues[i])
+        break;
+      if (submit.finished)
+        continue;
+      finishFakeSubmits(submit.queue, 1);
+      fakeGetSemaphoreCounterValue(device, pWaitInfo->pSemaphores[i], &value);
+    }
+    if (value < pWaitInfo->pValues[i])
+      return VK_TIMEOUT;
+  }
+  return VK_SUCCESS;
+}
+#endif
+
+VKAPI_ATTR void VKAPI_CALL vkGetPhysicalDeviceProperties(VkPhysicalDevice, VkPhysicalDeviceProperties* pProperties)
+{
+  *pProperties = fakeDevice().properties;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkGetPhysicalDeviceMemoryProperties(VkPhysicalDevice,
+  VkPhysicalDeviceMemoryProperties* pMemoryProperties)
+{
+  *pMemoryProperties = fakeDevice().memoryProperties;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkAllocateMemory(VkDevice, const VkMemoryAllocateInfo* pAllocateInfo,
+  const VkAllocationCallbacks*, VkDeviceMemory* pMemory)
+{
+  *pMemory = newHandle<VkDeviceMemory>();
+  fakeDevice().memories[fakeHandleId(*pMemory)].resize(static_cast<size_t>(pAllocateInfo->allocationSize));
+  return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkFreeMemory(VkDevice, VkDeviceMemory memory, const VkAllocationCallbacks*)
+{
+  fakeDevice().memories.erase(fakeHandleId(memory));
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkMapMemory(VkDevice, VkDeviceMemory memory, VkDeviceSize offset, VkDeviceSize,
+  VkMemoryMapFlags, void** ppData)
+{
+  if (fakeDevice().failMapping)
+    return VK_ERROR_MEMORY_MAP_FAILED;
+  *ppData = fakeDevice().memories[fakeHandleId(memory)].data() + offset;
+  return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkUnmapMemory(VkDevice, VkDeviceMemory)
+{
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkFlushMappedMemoryRanges(VkDevice, uint32_t, const VkMappedMemoryRange*)
+{
+  return VK_SUCCESS;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkCreateBuffer(VkDevice, const VkBufferCreateInfo*, const VkAllocationCallbacks*,
+  VkBuffer* pBuffer)
+{
+  *pBuffer = newHandle<VkBuffer>();
+  return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkDestroyBuffer(VkDevice, VkBuffer, const VkAllocationCallbacks*)
+{
+}
+
+VKAPI_ATTR void VKAPI_CALL vkGetBufferMemoryRequirements(VkDevice, VkBuffer, VkMemoryRequirements* pMemoryRequirements)
+{
+  *pMemoryRequirements = fakeDevice().requirements;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkBindBufferMemory(VkDevice, VkBuffer, VkDeviceMemory, VkDeviceSize)
+{
+  return VK_SUCCESS;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkCreateImage(VkDevice, const VkImageCreateInfo*, const VkAllocationCallbacks*,
+  VkImage* pImage)
+{
+  *pImage = newHandle<VkImage>();
+  return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkDestroyImage(VkDevice, VkImage, const VkAllocationCallbacks*)
+{
+}
+
+VKAPI_ATTR void VKAPI_CALL vkGetImageMemoryRequirements(VkDevice, VkImage, VkMemoryRequirements* pMemoryRequirements)
+{
+  *pMemoryRequirements = fakeDevice().requirements;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkBindImageMemory(VkDevice, VkImage, VkDeviceMemory, VkDeviceSize)
+{
+  return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkGetDeviceQueue(VkDevice, uint32_t queueFamilyIndex, uint32_t queueIndex, VkQueue* pQueue)
+{
+  *pQueue = fakeQueue(queueFamilyIndex, queueIndex);
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkCreateSemaphore(VkDevice, const VkSemaphoreCreateInfo*, const VkAllocationCallbacks*,
+  VkSemaphore* pSemaphore)
+{
+  *pSemaphore = newHandle<VkSemaphore>();
+  fakeDevice().semaphores.insert(fakeHandleId(*pSemaphore));
+  return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkDestroySemaphore(VkDevice, VkSemaphore semaphore, const VkAllocationCallbacks*)
+{
+  fakeDevice().semaphores.erase(fakeHandleId(semaphore));
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkCreateFence(VkDevice, const VkFenceCreateInfo* pCreateInfo, const VkAllocationCallbacks*,
+  VkFence* pFence)
+{
+  FakeDevice& device = fakeDevice();
+  *pFence = newHandle<VkFence>();
+  device.fences.insert(fakeHandleId(*pFence));
+  if (pCreateInfo->flags & VK_FENCE_CREATE_SIGNALED_BIT)
+    device.signaledFences.insert(fakeHandleId(*pFence));
+  ++device.fencesCreated;
+  return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkDestroyFence(VkDevice, VkFence fence, const VkAllocationCallbacks*)
+{
+  fakeDevice().fences.erase(fakeHandleId(fence));
+  fakeDevice().signaledFences.erase(fakeHandleId(fence));
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkResetFences(VkDevice, uint32_t fenceCount, const VkFence* pFences)
+{
+  for (uint32_t i = 0; i < fenceCount; ++i)
+    fakeDevice().signaledFences.erase(fakeHandleId(pFences[i]));
+  return VK_SUCCESS;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkGetFenceStatus(VkDevice, VkFence fence)
+{
+  return fakeDevice().signaledFences.count(fakeHandleId(fence)) ? VK_SUCCESS : VK_NOT_READY;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkWaitForFences(VkDevice device, uint32_t fenceCount, const VkFence* pFences, VkBool32,
+  uint64_t)
+{
+  // Queues finish in order, up to the submit of each fence
+  for (uint32_t i = 0; i < fenceCount; ++i)
+  {
+    const FakeSubmit* submit = submitOf(pFences[i]);
+    if (submit)
+    {
+      const auto& submits = fakeDevice().submits;
+      VkQueue queue = submit->queue;
+      size_t count = std::count_if(submits.begin(), submits.begin() + (submit - submits.data()) + 1,
+        [queue](const FakeSubmit& earlier) { return earlier.queue == queue && !earlier.finished; });
+      finishFakeSubmits(queue, count);
+    }
+    if (vkGetFenceStatus(device, pFences[i]) != VK_SUCCESS)
+      return VK_TIMEOUT;
+  }
+  return VK_SUCCESS;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkQueueSubmit(VkQueue queue, uint32_t submitCount, const VkSubmitInfo* pSubmits,
+  VkFence fence)
+{
+  FakeDevice& device = fakeDevice();
+  if (submitCount == 0)
+  {
+    FakeSubmit submit;
+    submit.queue = queue;
+    submit.fence = fence;
+    device.submits.push_back(submit);
+    return VK_SUCCESS;
+  }
+
+  // The fence goes with the last batch
+  for (uint32_t i = 0; i < submitCount; ++i)
+  {
+    const VkSubmitInfo& info = pSubmits[i];
+    FakeSubmit submit;
+    submit.queue = queue;
+    submit.waitSemaphores.assign(info.pWaitSemaphores, info.pWaitSemaphores + info.waitSemaphoreCount);
+    submit.signalSemaphores.assign(info.pSignalSemaphores, info.pSignalSemaphores + info.signalSemaphoreCount);
+    submit.commandBufferCount = info.commandBufferCount;
+    submit.fence = i + 1 == submitCount ? fence : VK_NULL_HANDLE;
+
+#ifdef VK_VERSION_1_2
+    const VkTimelineSemaphoreSubmitInfo* timelineInfo = static_cast<const VkTimelineSemaphoreSubmitInfo*>(info.pNext);
+    if (timelineInfo)
+    {
+      submit.signalValues.assign(timelineInfo->pSignalSemaphoreValues,
+        timelineInfo->pSignalSemaphoreValues + timelineInfo->signalSemaphoreValueCount);
+    }
+#endif
+    device.submits.push_back(submit);
+  }
+  return VK_SUCCESS;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkQueueWaitIdle(VkQueue queue)
+{
+  finishFakeSubmits(queue);
+  return VK_SUCCESS;
+}
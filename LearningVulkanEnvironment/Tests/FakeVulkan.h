@@ -0,0 +1,76 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <map>
+#include <set>
+#include <vector>
+
+// A vkQueueSubmit batch, or just a fence for a submit without batches
+struct FakeSubmit
+{
+  VkQueue queue = VK_NULL_HANDLE;
+  std::vector<VkSemaphore> waitSemaphores;
+  std::vector<VkSemaphore> signalSemaphores;
+  // From a chained VkTimelineSemaphoreSubmitInfo, empty without one
+  std::vector<uint64_t> signalValues;
+  uint32_t commandBufferCount = 0;
+  VkFence fence = VK_NULL_HANDLE;
+  bool finished = false;
+};
+
+/*
+  Stands in for the Vulkan loader so the code under test links and runs
+  without a device. The tests set up the properties the fake physical
+  device reports and look at what was allocated and submitted. Submits
+  only finish when a test says so, or when something waits for them.
+*/
+struct FakeDevice
+{
+  VkPhysicalDeviceProperties properties = {};
+  VkPhysicalDeviceMemoryProperties memoryProperties = {};
+  // Reported by vkGet*MemoryRequirements for every buffer and image
+  VkMemoryRequirements requirements = {};
+  // vkMapMemory fails while set
+  bool failMapping = false;
+
+  // Live VkDeviceMemory allocations with their host storage
+  std::map<uint64_t, std::vector<char>> memories;
+  // Live semaphores and fences, and how many fences were ever created
+  std::set<uint64_t> semaphores;
+  std::set<uint64_t> fences;
+  uint32_t fencesCreated = 0;
+  std::set<uint64_t> signaledFences;
+  // Counter of every timeline semaphore that was signaled
+  std::map<uint64_t, uint64_t> timelineValues;
+  // Every submit so far, in order
+  std::vector<FakeSubmit> submits;
+  uint64_t nextHandle = 1;
+};
+
+FakeDevice& fakeDevice();
+// Back to one 1GB device local memory type and no allocations
+void resetFakeDevice();
+
+// Adds a memory type on a heap of its own, returns its index
+uint32_t addFakeMemoryType(VkMemoryPropertyFlags flags, VkDeviceSize heapSize);
+
+// What vkGetDeviceQueue returns for the queue
+VkQueue fakeQueue(uint32_t family, uint32_t queueIndex);
+// Finishes the oldest count unfinished submits of the queue, or all of them
+void finishFakeSubmits(VkQueue queue, size_t count = SIZE_MAX);
+
+#ifdef VK_VERSION_1_2
+// Stand-ins for the device functions of timeline semaphores
+VKAPI_ATTR VkResult VKAPI_CALL fakeGetSemaphoreCounterValue(VkDevice device, VkSemaphore semaphore, uint64_t* pValue);
+VKAPI_ATTR VkResult VKAPI_CALL fakeWaitSemaphores(VkDevice device, const VkSemaphoreWaitInfo* pWaitInfo,
+  uint64_t timeout);
+#endif
+
+// Fake handles are just increasing numbers
+template<typename Handle>
+uint64_t fakeHandleId(Handle handle)
+{
+  return (uint64_t)(uintptr_t)handle;
+}
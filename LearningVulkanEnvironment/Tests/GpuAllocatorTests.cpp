@@ -0,0 +1,315 @@
+#include "Test.h"
+#include "FakeVulkan.h"
+
+#include "GpuAllocator.h"
+
+namespace
+{
+  const VkDeviceSize KB = 1024;
+  const VkDeviceSize MB = 1024 * 1024;
+
+  VkMemoryRequirements requirements(VkDeviceSize size, VkDeviceSize alignment = 256)
+  {
+    VkMemoryRequirements result = {};
+    result.size = size;
+    result.alignment = alignment;
+    result.memoryTypeBits = ~0u;
+    return result;
+  }
+}
+
+TEST(buddySplitsTheSmallestFreeBlock)
+{
+  BuddyAllocator buddy(1024, 256);
+  VkDeviceSize offset = 1;
+
+  CHECK(buddy.allocate(256, 1, offset));
+  CHECK(offset == 0);
+  // 1024 split into 512 + 256 + 256, one 256 handed out
+  CHECK(buddy.largestFreeBlock() == 512);
+  CHECK(buddy.allocate(256, 1, offset));
+  CHECK(offset == 256);
+  CHECK(buddy.allocate(512, 1, offset));
+  CHECK(offset == 512);
+
+  CHECK(buddy.usedBytes() == 1024);
+  CHECK(buddy.allocationCount() == 3);
+  CHECK(buddy.largestFreeBlock() == 0);
+  CHECK(!buddy.allocate(1, 1, offset));
+}
+
+TEST(buddyMergesFreedBuddies)
+{
+  BuddyAllocator buddy(1024, 256);
+  VkDeviceSize offsets[4];
+  for (auto& offset : offsets)
+    CHECK(buddy.allocate(256, 1, offset));
+
+  // 0 and 512 have no free buddy, nothing merges
+  buddy.free(offsets[0]);
+  buddy.free(offsets[2]);
+  CHECK(buddy.largestFreeBlock() == 256);
+  CHECK(buddy.usedBytes() == 512);
+
+  // 256 merges with 0 into 512, 768 with 512 and then with the first half
+  buddy.free(offsets[1]);
+  CHECK(buddy.largestFreeBlock() == 512);
+  buddy.free(offsets[3]);
+  CHECK(buddy.largestFreeBlock() == 1024);
+  CHECK(buddy.usedBytes() == 0);
+  CHECK(buddy.allocationCount() == 0);
+
+  VkDeviceSize whole;
+  CHECK(buddy.allocate(1024, 1, whole));
+  CHECK(whole == 0);
+}
+
+TEST(buddyRoundsSizes)
+{
+  // Size down, minimum block up to a power of two
+  BuddyAllocator buddy(1000, 100);
+  CHECK(buddy.size() == 512);
+
+  VkDeviceSize offset;
+  CHECK(buddy.allocate(1, 1, offset));
+  CHECK(buddy.usedBytes() == 128);
+  CHECK(!buddy.allocate(513, 1, offset));
+}
+
+TEST(buddyAlignsToTheRequestedAlignment)
+{
+  BuddyAllocator buddy(4096, 256);
+  VkDeviceSize first;
+  VkDeviceSize second;
+  CHECK(buddy.allocate(16, 1, first));
+  // A 1024 aligned block is 1024 large, so it can't sit at 256
+  CHECK(buddy.allocate(16, 1024, second));
+  CHECK(second % 1024 == 0);
+  CHECK(second != first);
+  CHECK(buddy.usedBytes() == 256 + 1024);
+}
+
+TEST(buddyRejectsUnknownOffsets)
+{
+  BuddyAllocator buddy(1024, 256);
+  VkDeviceSize offset;
+  CHECK(buddy.allocate(256, 1, offset));
+  CHECK_THROWS(buddy.free(512));
+  buddy.free(offset);
+  CHECK_THROWS(buddy.free(offset));
+}
+
+TEST(ringWrapsAroundAndReleasesRetiredFrames)
+{
+  RingAllocator ring;
+  ring.reset(1024, 2);
+  VkDeviceSize offset;
+
+  ring.beginFrame(0);
+  CHECK(ring.allocate(600, 1, offset));
+  CHECK(offset == 0);
+
+  ring.beginFrame(1);
+  CHECK(ring.allocate(300, 1, offset));
+  CHECK(offset == 600);
+  // Only fits at the start, which frame 0 still uses
+  CHECK(!ring.allocate(200, 1, offset));
+
+  // Frame 0 retired, its 600 bytes are free again
+  ring.beginFrame(0);
+  CHECK(ring.usedBytes() == 300);
+  CHECK(ring.allocate(200, 1, offset));
+  CHECK(offset == 0);
+  // The skipped 124 bytes at the end belong to the wrapping allocation
+  CHECK(ring.usedBytes() == 300 + 124 + 200);
+
+  ring.beginFrame(1);
+  CHECK(ring.usedBytes() == 124 + 200);
+  ring.beginFrame(0);
+  CHECK(ring.usedBytes() == 0);
+}
+
+TEST(ringReleasesWhatWasAllocatedBeforeTheFirstFrame)
+{
+  RingAllocator ring;
+  ring.reset(1024, 2);
+  VkDeviceSize offset;
+
+  CHECK(ring.allocate(512, 1, offset));
+  ring.beginFrame(0);
+  CHECK(ring.usedBytes() == 512);
+  ring.beginFrame(1);
+  // Frame 0's slot was never used before, the setup data stays until then
+  CHECK(ring.usedBytes() == 512);
+  ring.beginFrame(0);
+  CHECK(ring.usedBytes() == 0);
+}
+
+TEST(ringAlignsOffsets)
+{
+  RingAllocator ring;
+  ring.reset(4096, 1);
+  ring.beginFrame(0);
+  VkDeviceSize offset;
+
+  CHECK(ring.allocate(10, 1, offset));
+  CHECK(ring.allocate(16, 256, offset));
+  CHECK(offset == 256);
+  CHECK(ring.usedBytes() == 256 + 16);
+  CHECK(!ring.allocate(4097, 1, offset));
+}
+
+TEST(allocatorSeparatesLinearAndOptimalResources)
+{
+  resetFakeDevice();
+  fakeDevice().properties.limits.bufferImageGranularity = 1024;
+
+  GpuAllocator allocator;
+  allocator.create(VK_NULL_HANDLE, VK_NULL_HANDLE, MB);
+  GpuAllocation buffer = allocator.allocate(requirements(4 * KB), 0, 0, GpuResourceKind::Linear);
+  GpuAllocation image = allocator.allocate(requirements(4 * KB), 0, 0, GpuResourceKind::Optimal);
+  GpuAllocation otherBuffer = allocator.allocate(requirements(4 * KB), 0, 0, GpuResourceKind::Linear);
+
+  // Different memory blocks, so they can never share a granularity page
+  CHECK(buffer.memory != image.memory);
+  CHECK(buffer.memory == otherBuffer.memory);
+  CHECK(allocator.stats().blockCount == 2);
+
+  allocator.free(buffer);
+  allocator.free(image);
+  allocator.free(otherBuffer);
+  allocator.destroy();
+  CHECK(fakeDevice().memories.empty());
+}
+
+TEST(allocatorSharesBlocksWithoutGranularity)
+{
+  resetFakeDevice();
+
+  GpuAllocator allocator;
+  allocator.create(VK_NULL_HANDLE, VK_NULL_HANDLE, MB);
+  GpuAllocation buffer = allocator.allocate(requirements(4 * KB), 0, 0, GpuResourceKind::Linear);
+  GpuAllocation image = allocator.allocate(requirements(4 * KB), 0, 0, GpuResourceKind::Optimal);
+
+  CHECK(buffer.memory == image.memory);
+  CHECK(buffer.offset != image.offset);
+
+  allocator.free(buffer);
+  allocator.free(image);
+  allocator.destroy();
+}
+
+TEST(allocatorReportsFragmentation)
+{
+  resetFakeDevice();
+
+  GpuAllocator allocator;
+  allocator.create(VK_NULL_HANDLE, VK_NULL_HANDLE, MB);
+  GpuAllocation quarters[4];
+  for (auto& quarter : quarters)
+    quarter = allocator.allocate(requirements(256 * KB), 0, 0, GpuResourceKind::Linear);
+
+  GpuMemoryStats stats = allocator.stats();
+  CHECK(stats.blockCount == 1);
+  CHECK(stats.allocationCount == 4);
+  CHECK(stats.usedBytes == MB);
+  CHECK(stats.fragmentation == 0.0);
+
+  // Two free quarters that aren't buddies: half the free memory is unusable
+  // for a 512KB request
+  allocator.free(quarters[0]);
+  allocator.free(quarters[2]);
+  stats = allocator.stats();
+  CHECK(stats.allocationCount == 2);
+  CHECK(stats.usedBytes == 512 * KB);
+  CHECK(stats.largestFreeBlock == 256 * KB);
+  CHECK(stats.fragmentation == 0.5);
+
+  allocator.free(quarters[1]);
+  allocator.free(quarters[3]);
+  stats = allocator.stats();
+  CHECK(stats.largestFreeBlock == MB);
+  CHECK(stats.fragmentation == 0.0);
+  allocator.destroy();
+}
+
+TEST(allocatorGivesLargeResourcesTheirOwnMemory)
+{
+  resetFakeDevice();
+
+  GpuAllocator allocator;
+  allocator.create(VK_NULL_HANDLE, VK_NULL_HANDLE, MB);
+  GpuAllocation small = allocator.allocate(requirements(4 * KB), 0, 0, GpuResourceKind::Linear);
+  GpuAllocation large = allocator.allocate(requirements(MB / 2 + 1), 0, 0, GpuResourceKind::Linear);
+
+  CHECK(large.memory != small.memory);
+  CHECK(large.offset == 0);
+  CHECK(fakeDevice().memories.size() == 2);
+
+  // Dedicated memory goes straight back to the driver
+  allocator.free(large);
+  CHECK(fakeDevice().memories.size() == 1);
+  allocator.free(small);
+  allocator.destroy();
+}
+
+TEST(allocatorReleasesEmptyBlocksButTheLast)
+{
+  resetFakeDevice();
+
+  GpuAllocator allocator;
+  allocator.create(VK_NULL_HANDLE, VK_NULL_HANDLE, MB);
+  GpuAllocation halves[3];
+  for (auto& half : halves)
+    half = allocator.allocate(requirements(MB / 2), 0, 0, GpuResourceKind::Linear);
+  CHECK(halves[0].memory == halves[1].memory);
+  CHECK(halves[2].memory != halves[0].memory);
+  CHECK(fakeDevice().memories.size() == 2);
+
+  allocator.free(halves[2]);
+  CHECK(fakeDevice().memories.size() == 1);
+  allocator.free(halves[0]);
+  allocator.free(halves[1]);
+  CHECK(fakeDevice().memories.size() == 1);
+  allocator.destroy();
+  CHECK(fakeDevice().memories.empty());
+}
+
+TEST(allocatorAlignsNonCoherentMemoryToAtoms)
+{
+  resetFakeDevice();
+  fakeDevice().properties.limits.nonCoherentAtomSize = 1024;
+  fakeDevice().memoryProperties = VkPhysicalDeviceMemoryProperties();
+  addFakeMemoryType(VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, 256 * MB);
+
+  GpuAllocator allocator;
+  allocator.create(VK_NULL_HANDLE, VK_NULL_HANDLE, MB);
+  GpuAllocation first = allocator.allocate(requirements(16, 16), VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, 0,
+    GpuResourceKind::Linear);
+  GpuAllocation second = allocator.allocate(requirements(16, 16), VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, 0,
+    GpuResourceKind::Linear);
+
+  CHECK(first.offset % 1024 == 0);
+  CHECK(second.offset % 1024 == 0);
+  CHECK(first.mapped != nullptr);
+  CHECK(static_cast<char*>(second.mapped) - static_cast<char*>(first.mapped) ==
+    static_cast<ptrdiff_t>(second.offset - first.offset));
+
+  allocator.free(first);
+  allocator.free(second);
+  allocator.destroy();
+}
+
+TEST(allocatorFreesBlocksItCannotMap)
+{
+  resetFakeDevice();
+  fakeDevice().memoryProperties = VkPhysicalDeviceMemoryProperties();
+  addFakeMemoryType(VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, 256 * MB);
+  fakeDevice().failMapping = true;
+
+  GpuAllocator allocator;
+  allocator.create(VK_NULL_HANDLE, VK_NULL_HANDLE, MB);
+  CHECK_THROWS(allocator.allocate(requirements(16), VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, 0, GpuResourceKind::Linear));
+  CHECK(fakeDevice().memories.empty());
+  allocator.destroy();
+}
@@ -0,0 +1,43 @@
+#include "Test.h"
+
+#include <cmath>
+
+#include "Scene.h"
+
+namespace
+{
+  bool planeIs(const float plane[4], float x, float y, float z, float w)
+  {
+    const float epsilon = 1e-5f;
+    return std::fabs(plane[0] - x) < epsilon && std::fabs(plane[1] - y) < epsilon &&
+      std::fabs(plane[2] - z) < epsilon && std::fabs(plane[3] - w) < epsilon;
+  }
+}
+
+TEST(identityFrustumIsTheClipVolume)
+{
+  const float identity[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+  float planes[6][4];
+  frustumPlanes(identity, planes);
+
+  CHECK(planeIs(planes[0], 1, 0, 0, 1));
+  CHECK(planeIs(planes[1], -1, 0, 0, 1));
+  CHECK(planeIs(planes[2], 0, 1, 0, 1));
+  CHECK(planeIs(planes[3], 0, -1, 0, 1));
+  CHECK(planeIs(planes[4], 0, 0, 1, 0));
+  CHECK(planeIs(planes[5], 0, 0, -1, 1));
+}
+
+TEST(frustumPlanesAreNormalized)
+{
+  // Halves x and moves everything 0.5 along z, column major: the view gets
+  // twice as wide and the depth range moves to -0.5 to 0.5
+  const float viewProjection[16] = { 0.5f, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0.5f, 1 };
+  float planes[6][4];
+  frustumPlanes(viewProjection, planes);
+
+  CHECK(planeIs(planes[0], 1, 0, 0, 2));
+  CHECK(planeIs(planes[1], -1, 0, 0, 2));
+  CHECK(planeIs(planes[4], 0, 0, 1, 0.5f));
+  CHECK(planeIs(planes[5], 0, 0, -1, 0.5f));
+}
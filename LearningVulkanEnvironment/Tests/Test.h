@@ -0,0 +1,33 @@
+#pragma once
+
+/*
+  Just enough of a test runner for the host side logic that doesn't need a
+  device. TEST defines a test function that registers itself, CHECK records
+  a failure and carries on so one run shows every broken expectation.
+*/
+
+typedef void (*TestFunction)();
+
+void registerTest(const char* name, TestFunction function);
+void reportFailure(const char* file, int line, const char* expression);
+
+struct TestRegistration
+{
+  TestRegistration(const char* name, TestFunction function) { registerTest(name, function); }
+};
+
+#define TEST(name) \
+  static void name(); \
+  static TestRegistration name##Registration(#name, name); \
+  static void name()
+
+#define CHECK(expression) \
+  do { if (!(expression)) reportFailure(__FILE__, __LINE__, #expression); } while (0)
+
+#define CHECK_THROWS(expression) \
+  do \
+  { \
+    bool thrown = false; \
+    try { expression; } catch (...) { thrown = true; } \
+    if (!thrown) reportFailure(__FILE__, __LINE__, #expression " throws"); \
+  } while (0)
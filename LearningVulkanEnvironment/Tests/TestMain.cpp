@@ -0,0 +1,62 @@
+#include "Test.h"
+
+#include <exception>
+#include <iostream>
+#include <vector>
+
+namespace
+{
+  struct RegisteredTest
+  {
+    const char* name;
+    TestFunction function;
+  };
+
+  // Function local so registrations from other files' static initializers
+  // never see it unconstructed
+  std::vector<RegisteredTest>& registeredTests()
+  {
+    static std::vector<RegisteredTest> tests;
+    return tests;
+  }
+
+  int failures = 0;
+}
+
+void registerTest(const char* name, TestFunction function)
+{
+  RegisteredTest test = { name, function };
+  registeredTests().push_back(test);
+}
+
+void reportFailure(const char* file, int line, const char* expression)
+{
+  std::cerr << file << '(' << line << "): check failed: " << expression << std::endl;
+  ++failures;
+}
+
+int main()
+{
+  int failedTests = 0;
+  for (const auto& test : registeredTests())
+  {
+    int failuresBefore = failures;
+    try
+    {
+      test.function();
+    }
+    catch (const std::exception& e)
+    {
+      std::cerr << test.name << ": unexpected exception: " << e.what() << std::endl;
+      ++failures;
+    }
+
+    bool passed = failures == failuresBefore;
+    if (!passed)
+      ++failedTests;
+    std::cout << (passed ? "ok     " : "FAILED ") << test.name << std::endl;
+  }
+
+  std::cout << registeredTests().size() - failedTests << " of " << registeredTests().size() << " tests passed" << std::endl;
+  return failedTests == 0 ? 0 : 1;
+}
@@ -0,0 +1,79 @@
+#include "Test.h"
+
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+
+#include "ThreadPool.h"
+
+/*
+  Many small batches back to back are where a worker still finishing the
+  previous batch would run into the next one. Each index only touches its
+  own slot, so any overlap also shows up as a data race when the tests are
+  built with ThreadSanitizer.
+*/
+TEST(parallelForRunsEveryIndexOnce)
+{
+  ThreadPool pool(4);
+  std::vector<int> calls(64);
+  bool everyIndexOnce = true;
+
+  for (uint32_t batch = 0; batch < 2000; ++batch)
+  {
+    uint32_t count = batch % 65;
+    // Written before the batch, read by the workers during it
+    for (uint32_t i = 0; i < count; ++i)
+      calls[i] = static_cast<int>(batch);
+
+    auto body = [&](uint32_t index) { calls[index] -= static_cast<int>(batch) - 1; };
+    pool.parallelFor(count, body);
+
+    for (uint32_t i = 0; i < count; ++i)
+      everyIndexOnce = everyIndexOnce && calls[i] == 1;
+  }
+  CHECK(everyIndexOnce);
+}
+
+TEST(parallelForRethrowsAndStaysUsable)
+{
+  ThreadPool pool(4);
+  std::atomic<uint32_t> finished(0);
+
+  auto failing = [&](uint32_t index)
+  {
+    if (index % 7 == 3)
+      throw std::runtime_error("failed");
+    ++finished;
+  };
+  CHECK_THROWS(pool.parallelFor(100, failing));
+  // Every call still ran, the batch only ended once all of them had
+  CHECK(finished == 100 - 14);
+
+  finished = 0;
+  auto counting = [&](uint32_t) { ++finished; };
+  pool.parallelFor(100, counting);
+  CHECK(finished == 100);
+}
+
+TEST(parallelForAlongsideSubmittedTasks)
+{
+  ThreadPool pool(3);
+  std::vector<std::future<int>> results;
+  for (int i = 0; i < 200; ++i)
+    results.push_back(pool.submit([i]() { return i * 2; }));
+
+  std::vector<uint32_t> values(256);
+  auto body = [&](uint32_t index) { values[index] = index + 1; };
+  for (int batch = 0; batch < 50; ++batch)
+    pool.parallelFor(static_cast<uint32_t>(values.size()), body);
+
+  bool tasksFinished = true;
+  for (int i = 0; i < 200; ++i)
+    tasksFinished = tasksFinished && results[i].get() == i * 2;
+  CHECK(tasksFinished);
+
+  bool valuesWritten = true;
+  for (uint32_t i = 0; i < values.size(); ++i)
+    valuesWritten = valuesWritten && values[i] == i + 1;
+  CHECK(valuesWritten);
+}